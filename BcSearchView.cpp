@@ -0,0 +1,108 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "BcSearchView.h"
+#include "BcViewer2.h"
+#include "LuaJitComposer.h"
+#include <QLineEdit>
+#include <QLabel>
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QVBoxLayout>
+#include <QElapsedTimer>
+using namespace Lua;
+
+BcSearchView::BcSearchView(BcViewer2* bcv, QWidget* parent):QWidget(parent),d_bcv(bcv)
+{
+    Q_ASSERT( bcv != 0 );
+    QVBoxLayout* vbox = new QVBoxLayout(this);
+    vbox->setMargin(0);
+    vbox->setSpacing(2);
+    d_query = new QLineEdit(this);
+    d_query->setPlaceholderText(tr("e.g. op:GGET global:print, str:x, num:42, upval:x, args:2"));
+    vbox->addWidget(d_query);
+    d_status = new QLabel(this);
+    vbox->addWidget(d_status);
+    d_hits = new QTreeWidget(this);
+    d_hits->setRootIsDecorated(false);
+    d_hits->setUniformRowHeights(true);
+    d_hits->setAlternatingRowColors(true);
+    d_hits->setColumnCount(4);
+    d_hits->setHeaderLabels( QStringList() << "function" << "idx" << "lnr" << "op" );
+    d_hits->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    vbox->addWidget(d_hits);
+
+    connect( d_query, SIGNAL(returnPressed()), this, SLOT(onSearch()) );
+    connect( d_bcv, SIGNAL(sigLoaded()), this, SLOT(onSearch()) );
+    connect( d_hits, SIGNAL(itemDoubleClicked(QTreeWidgetItem*,int)), this, SLOT(onDblClicked(QTreeWidgetItem*,int)) );
+}
+
+void BcSearchView::onSearch()
+{
+    d_hits->clear();
+    d_status->clear();
+    if( d_query->text().trimmed().isEmpty() || d_bcv->isEmpty() )
+        return;
+
+    QElapsedTimer t;
+    t.start();
+    QString error;
+    const JitIndex::Postings hits = d_bcv->getIndex().query( d_query->text(), &error );
+    if( !error.isEmpty() )
+    {
+        d_status->setText(error);
+        return;
+    }
+
+    const QList<JitBytecode::FuncRef>& funcs = d_bcv->getBc().getFuncs();
+    QList<QTreeWidgetItem*> items;
+    for( int i = 0; i < hits.size() && i < MaxHits; i++ )
+    {
+        const JitBytecode::Function* f = funcs[hits[i].d_func].constData();
+        const quint32 pc = hits[i].d_pc;
+        QTreeWidgetItem* item = new QTreeWidgetItem();
+        item->setText(0, tr("Function %1").arg(f->d_id) );
+        item->setText(1, QString::number(pc) );
+        if( !f->d_lines.isEmpty() )
+        {
+            const quint32 line = f->d_lines[pc];
+            if( JitComposer::isRowCol() )
+                item->setText(2, QString("%1:%2").arg(JitComposer::unpackRow(line)).arg(JitComposer::unpackCol(line)) );
+            else
+                item->setText(2, QString::number(line) );
+        }
+        item->setText(3, JitBytecode::nameOfOp( f->d_byteCodes[pc] & 0xff ) );
+        item->setData(0, Qt::UserRole, hits[i].d_func );
+        item->setData(1, Qt::UserRole, pc );
+        items << item;
+    }
+    d_hits->addTopLevelItems(items);
+    d_hits->resizeColumnToContents(1);
+    d_hits->resizeColumnToContents(2);
+    if( hits.size() > MaxHits )
+        d_status->setText( tr("%1 hits, first %2 listed, %3 ms").arg(hits.size()).arg(int(MaxHits)).arg(t.elapsed()) );
+    else
+        d_status->setText( tr("%1 hits, %2 ms").arg(hits.size()).arg(t.elapsed()) );
+}
+
+void BcSearchView::onDblClicked(QTreeWidgetItem* item, int)
+{
+    // by index, since stripped dumps have no firstline and functions can share one
+    d_bcv->gotoIndexPc( item->data(0,Qt::UserRole).toInt(), item->data(1,Qt::UserRole).toUInt() + 1, true, false );
+}
@@ -0,0 +1,53 @@
+#ifndef LUA_BCSEARCHVIEW_H
+#define LUA_BCSEARCHVIEW_H
+
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QWidget>
+
+class QLineEdit;
+class QLabel;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+namespace Lua
+{
+    class BcViewer2;
+
+    // Queries the JitIndex of a BcViewer2 (see JitIndex::query for the syntax) and lists the hits;
+    // double click goes to the instruction in the viewer. The query is repeated when the viewer loads.
+    class BcSearchView : public QWidget
+    {
+        Q_OBJECT
+    public:
+        enum { MaxHits = 5000 }; // listed, the total is still reported
+        explicit BcSearchView(BcViewer2*, QWidget* parent = 0);
+    protected slots:
+        void onSearch();
+        void onDblClicked(QTreeWidgetItem*,int);
+    private:
+        BcViewer2* d_bcv;
+        QLineEdit* d_query;
+        QLabel* d_status;
+        QTreeWidget* d_hits;
+    };
+}
+
+#endif // LUA_BCSEARCHVIEW_H
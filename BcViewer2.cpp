@@ -21,16 +21,18 @@
 #include "LjDisasm.h"
 #include "LuaJitComposer.h"
 #include "Engine2.h"
+#include "LuaJitDiff.h"
 #include <QHeaderView>
+#include <QAbstractTableModel>
 #include <QFile>
 #include <QTextStream>
 #include <QtDebug>
 #include <QDir>
+#include <QtMath>
+#include <algorithm>
 using namespace Lua;
 
-#define LINEAR
-
-enum { FuncType = 10, VarsType, CodeType, LineType };
+enum { ColCount = 6 };
 
 static QString printRowCol( quint32 rowCol )
 {
@@ -40,25 +42,227 @@ static QString printRowCol( quint32 rowCol )
         return QString::number(rowCol);
 }
 
-BcViewer2::BcViewer2(QWidget *parent) : QTreeWidget(parent),d_lock(false),d_lastWidth(90),d_lastMarker(0)
+static inline QString indent( int level )
+{
+    // the rows are flat, the nesting of the former tree is only shown by indentation
+    return QString( level * 4, QChar(' ') );
+}
+
+class BcViewer2::Model : public QAbstractTableModel
+{
+public:
+    Model(BcViewer2* v):QAbstractTableModel(v),d_view(v)
+    {
+        d_bold = v->font();
+        d_bold.setBold(true);
+        d_ul = v->font();
+        d_ul.setUnderline(true);
+    }
+    BcViewer2* d_view;
+    QFont d_bold, d_ul;
+
+    void beginReset() { beginResetModel(); }
+    void endReset() { endResetModel(); }
+    void changed( int row )
+    {
+        if( row >= 0 )
+            emit dataChanged( index(row,0), index(row,ColCount-1) );
+    }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : d_view->d_rowCount;
+    }
+    int columnCount(const QModelIndex& parent = QModelIndex()) const
+    {
+        return parent.isValid() ? 0 : ColCount;
+    }
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const
+    {
+        static const char* labels[ColCount] = { "what", "idx", "lnr/pc", "lnr/pc/A", "pars/B", "frms/C/D" };
+        if( orientation == Qt::Horizontal && role == Qt::DisplayRole && section >= 0 && section < ColCount )
+            return labels[section];
+        return QVariant();
+    }
+    QString text( int kind, const JitBytecode::Function& f, int j, int col ) const
+    {
+        switch( kind )
+        {
+        case FuncRow:
+            switch( col )
+            {
+            case 0:
+                return tr("Function %1%2").arg(f.d_id).arg( f.d_isRoot ? " top" : "" );
+            case 1:
+                return QString::number(f.d_id);
+            case 2:
+                return d_view->d_bc.isStripped() ? QString() : printRowCol(f.d_firstline);
+            case 3:
+                return d_view->d_bc.isStripped() ? QString() : printRowCol(f.lastLine());
+            case 4:
+                if( f.d_flags & 0x02 )
+                    return QString("%1+varg").arg(f.d_numparams);
+                else
+                    return QString::number(f.d_numparams);
+            case 5:
+                return QString::number(f.d_framesize);
+            }
+            break;
+        case UpvalsRow:
+            return col == 0 ? indent(1) + tr("Upvals") : QString();
+        case VarsRow:
+            return col == 0 ? indent(1) + tr("Vars") : QString();
+        case CodeRow:
+            return col == 0 ? indent(1) + tr("Code") : QString();
+        case UpvalRow:
+            if( col == 0 )
+            {
+                const quint16 up = f.getUpval(j);
+                // an upvalue points into the upvalue or the var list of the function where FNEW is executed
+                QString options;
+                const bool isLocal = f.isLocalUpval(j) ;
+                if( isLocal )
+                    options += "loc ";
+                if( f.isImmutableUpval(j) )
+                    options += "ro";
+                QString name;
+                if( !f.d_upNames.isEmpty() && j < f.d_upNames.size() && !f.d_upNames[j].isEmpty() )
+                    name = f.d_upNames[j] + " ";
+                if( isLocal )
+                    return indent(2) + QString("%1[%2] %3").arg(name).arg(up).arg(options);
+                else
+                    return indent(2) + QString("%1(%2) %3").arg(name).arg(up).arg(options);
+            }else if( col == 1 )
+                return QString::number(j);
+            break;
+        case VarRow:
+            switch( col )
+            {
+            case 0:
+                return indent(2) + f.d_vars[j].d_name.constData();
+            case 1:
+                return QString::number(j);
+            case 2:
+                return QString::number(f.d_vars[j].d_startpc);
+            case 3:
+                return QString::number(f.d_vars[j].d_endpc);
+            }
+            break;
+        case LineRow:
+            {
+                JitBytecode::Instruction bc = JitBytecode::dissectInstruction(f.d_byteCodes[j]);
+                switch( col )
+                {
+                case 0:
+                    {
+                        QByteArray warning;
+                        Ljas::Disasm::OP op;
+                        Ljas::Disasm::adaptToLjasm(bc, op, warning );
+                        return indent(2) + Ljas::Disasm::s_opName[op];
+                    }
+                case 1:
+                    return QString::number(j);
+                case 2:
+                    return f.d_lines.isEmpty() ? QString() : printRowCol(f.d_lines[j]);
+                case 3:
+                    return Ljas::Disasm::renderArg(&f,bc.d_ta, bc.d_a, j, false, true );
+                case 4:
+                    return Ljas::Disasm::renderArg(&f,bc.d_tb, bc.d_b, j, false, true );
+                case 5:
+                    return Ljas::Disasm::renderArg(&f,bc.d_tcd, bc.getCd(), j, false, true );
+                }
+            }
+            break;
+        }
+        return QString();
+    }
+    QVariant data(const QModelIndex& index, int role) const
+    {
+        if( !index.isValid() || index.row() >= rowCount() )
+            return QVariant();
+        const Func* fr;
+        int j;
+        const int kind = d_view->rowKind( index.row(), &fr, &j );
+        const JitBytecode::Function& f = *fr->d_func;
+        const int col = index.column();
+        switch( role )
+        {
+        case Qt::DisplayRole:
+            return text( kind, f, j, col );
+        case Qt::ToolTipRole:
+            if( col == 1 && d_view->d_heat.contains(index.row()) )
+                return d_view->d_heat.value(index.row()).d_notes.join("\n");
+            if( kind == FuncRow && col == 0 && !d_view->d_bc.isStripped() )
+                return f.d_sourceFile;
+            if( kind == LineRow && col == 0 )
+            {
+                JitBytecode::Instruction bc = JitBytecode::dissectInstruction(f.d_byteCodes[j]);
+                QByteArray warning;
+                Ljas::Disasm::OP op;
+                Ljas::Disasm::adaptToLjasm(bc, op, warning );
+                return Ljas::Disasm::s_opHelp[op];
+            }
+            if( kind == LineRow && col >= 3 )
+                return text( kind, f, j, col );
+            break;
+        case Qt::FontRole:
+            if( col == 0 && kind == FuncRow )
+                return d_bold;
+            if( col == 0 && ( kind == UpvalsRow || kind == VarsRow || kind == CodeRow ) )
+                return d_ul;
+            break;
+        case Qt::DecorationRole:
+            if( col == 0 && kind == LineRow )
+            {
+                const bool brk = d_view->d_breakRows.contains(index.row());
+                if( index.row() == d_view->d_lastMarker )
+                    return QPixmap( brk ? ":/images/break-marker.png" : ":/images/marker.png" );
+                else if( brk )
+                    return QPixmap(":/images/breakpoint.png");
+            }else if( col == 1 && d_view->d_heat.contains(index.row()) )
+            {
+                const QString icon = d_view->d_heat.value(index.row()).d_icon;
+                if( !icon.isEmpty() )
+                    return QPixmap(icon);
+            }
+            break;
+        case Qt::BackgroundRole:
+            if( d_view->d_heat.contains(index.row()) )
+            {
+                const QColor c = d_view->d_heat.value(index.row()).d_back;
+                if( c.isValid() )
+                    return c;
+            }
+            break;
+        case Qt::ForegroundRole:
+            if( col == 1 && d_view->d_heat.contains(index.row()) )
+            {
+                const QColor c = d_view->d_heat.value(index.row()).d_fore;
+                if( c.isValid() )
+                    return c;
+            }
+            break;
+        }
+        return QVariant();
+    }
+};
+
+BcViewer2::BcViewer2(QWidget *parent) : QTreeView(parent),d_lock(false),d_lastWidth(90),d_lastMarker(-1),
+    d_rowCount(0),d_indexed(false)
 {
+    d_model = new Model(this);
+    setModel(d_model);
+    setUniformRowHeights(true);
+    setRootIsDecorated(false);
+    setItemsExpandable(false);
     setHeaderHidden(false);
     setAlternatingRowColors(true);
-    setColumnCount(6);
     setExpandsOnDoubleClick(false);
-    setHeaderLabels( QStringList() << "what" << "idx" << "lnr/pc" << "lnr/pc/A" << "pars/B" << "frms/C/D");
     header()->setStretchLastSection(false);
     header()->setSectionResizeMode(0,QHeaderView::Stretch);
-    /*
-    header()->setSectionResizeMode(1,QHeaderView::Interactive);
-    header()->setSectionResizeMode(2,QHeaderView::Interactive);
-    header()->setSectionResizeMode(3,QHeaderView::Interactive);
-    header()->setSectionResizeMode(4,QHeaderView::Interactive);
-    header()->setSectionResizeMode(5,QHeaderView::Interactive);
-    */
 
-    connect(this,SIGNAL(itemDoubleClicked(QTreeWidgetItem*,int)),this,SLOT(onDoubleClicked(QTreeWidgetItem*,int)));
-    //connect(this,SIGNAL(itemSelectionChanged()),this,SLOT(onSelectionChanged()));
+    connect(this,SIGNAL(doubleClicked(QModelIndex)),this,SLOT(onDoubleClicked(QModelIndex)));
+    connect(selectionModel(),SIGNAL(currentChanged(QModelIndex,QModelIndex)),this,SLOT(onSelectionChanged()));
 }
 
 bool BcViewer2::loadFrom(const QString& path, const QString& source)
@@ -71,12 +275,6 @@ bool BcViewer2::loadFrom(const QString& path, const QString& source)
         d_path = path;
     else
         d_path = source;
-    // TEST
-//    QFile orig(path);
-//    QDir d;
-//    d.remove("orig.bin");
-//    orig.copy("orig.bin");
-//    d_bc.write("generated.bin");
 
     d_bc.calcVarNames();
     fillTree();
@@ -97,82 +295,94 @@ bool BcViewer2::loadFrom(QIODevice* in, const QString& path)
     return true;
 }
 
+bool BcViewer2::lessLine( const Line& lhs, quint32 row )
+{
+    return lhs.d_row < row;
+}
+
+bool BcViewer2::lessLineRow( const Line& lhs, const Line& rhs )
+{
+    return lhs.d_row < rhs.d_row;
+}
+
 void BcViewer2::gotoLine(quint32 lnr)
 {
     Q_ASSERT( !d_lock );
     d_lock = true;
-    Items::const_iterator i = d_items.find(JitComposer::unpackRow(lnr));
-    if( i != d_items.end() )
+    const quint32 row = JitComposer::unpackRow(lnr);
+    QVector<Line>::const_iterator i = std::lower_bound( d_lines.begin(), d_lines.end(), row, lessLine );
+    if( i != d_lines.end() && i->d_row == row )
     {
-        QTreeWidgetItem * hit = 0;
-        foreach( QTreeWidgetItem * item, i.value() )
+        QVector<Line>::const_iterator hit = d_lines.end();
+        for( QVector<Line>::const_iterator j = i; j != d_lines.end() && j->d_row == row; ++j )
         {
-            const quint32 cur = item->data(2,Qt::UserRole).toUInt();
-            if( lnr == cur )
+            if( lnr == j->d_line )
             {
-                hit = item;
+                hit = j;
                 break;
             }
-            if( lnr < cur )
+            if( lnr < j->d_line )
             {
                 break;
             }
-            hit = item;
+            hit = j;
         }
-        if( hit == 0 )
+        if( hit == d_lines.end() )
         {
-            hit = i.value().first();
+            hit = i;
         }
-        scrollToItem(hit,QAbstractItemView::PositionAtCenter);
-        setCurrentItem(hit);
-        hit->setSelected(true);
+        setCurrentRow(hit->d_item,true);
         d_lock = false;
         return;
     }
 
-    if( currentItem() )
-    {
-        currentItem()->setSelected(false);
-        setCurrentItem(0);
-    }
+    clearSelection();
+    setCurrentIndex(QModelIndex());
     d_lock = false;
 }
 
 quint32 BcViewer2::gotoFuncPc(quint32 func, quint32 pc, bool center, bool setMarker)
 {
-    QTreeWidgetItem* found = findItem(func,pc);
-    if( found )
+    return gotoIndexPc( d_funcs.value(func,-1), pc, center, setMarker );
+}
+
+quint32 BcViewer2::gotoIndexPc(int index, quint32 pc, bool center, bool setMarker)
+{
+    const int found = findIndexItem(index,pc);
+    if( found >= 0 )
     {
-        setCurrentItem(found);
-        scrollToItem(found, center ? QTreeWidget::PositionAtCenter : QTreeWidget::EnsureVisible );
+        setCurrentRow(found,center);
+        const Func* f;
+        int j;
+        rowKind(found,&f,&j);
         if( setMarker )
         {
             clearMarker();
-            const quint32 l = Engine2::packDeflinePc( found->data(1,Qt::UserRole).toUInt(),
-                                                      found->data(0,Qt::UserRole).toUInt()+1 );
-            if( d_breakPoints.contains(l) )
-                found->setIcon(0, QPixmap(":/images/break-marker.png"));
-            else
-                found->setIcon(0, QPixmap(":/images/marker.png"));
             d_lastMarker = found;
+            d_model->changed(found);
         }
-        return found->data(2,Qt::UserRole).toUInt();
+        if( f->d_func->d_lines.isEmpty() )
+            return 0;
+        return f->d_func->d_lines[j];
     }
     return 0;
 }
 
 void BcViewer2::clearMarker()
 {
-    if( d_lastMarker )
+    const int row = d_lastMarker;
+    d_lastMarker = -1;
+    d_model->changed(row);
+}
+
+const JitIndex& BcViewer2::getIndex() const
+{
+    if( !d_indexed )
     {
-        const quint32 l = Engine2::packDeflinePc( d_lastMarker->data(1,Qt::UserRole).toUInt(),
-                                                  d_lastMarker->data(0,Qt::UserRole).toUInt()+1 );
-        if( d_breakPoints.contains(l) )
-            d_lastMarker->setIcon(0, QPixmap(":/images/breakpoint.png"));
-        else
-            d_lastMarker->setIcon(0,QIcon() );
+        d_index.build(d_bc);
+        d_indexed = true;
     }
-    d_lastMarker = 0;
+    return d_index;
 }
 
 bool BcViewer2::saveTo(const QString& path, bool stripped)
@@ -189,10 +399,17 @@ bool BcViewer2::saveTo(const QString& path, bool stripped)
 void BcViewer2::clear()
 {
     Q_ASSERT( !d_lock );
-    d_items.clear();
+    d_model->beginReset();
+    d_funcList.clear();
+    d_lines.clear();
     d_funcs.clear();
-    d_lastMarker = 0;
-    QTreeWidget::clear();
+    d_heat.clear();
+    d_breakRows.clear();
+    d_index.clear();
+    d_indexed = false;
+    d_rowCount = 0;
+    d_lastMarker = -1;
+    d_model->endReset();
 }
 
 bool BcViewer2::addBreakPoint(quint32 l)
@@ -201,11 +418,12 @@ bool BcViewer2::addBreakPoint(quint32 l)
         return false;
     QPair<quint32, quint16> rc = Engine2::unpackDeflinePc(l);
 
-    QTreeWidgetItem* f = findItem(rc.first,rc.second);
-    if( f == 0 )
+    const int row = findItem(rc.first,rc.second);
+    if( row < 0 )
         return false;
     d_breakPoints.insert(l);
-    f->setIcon(0,QPixmap(":/images/breakpoint.png") );
+    d_breakRows.insert(row);
+    d_model->changed(row);
     return true;
 }
 
@@ -217,25 +435,25 @@ bool BcViewer2::removeBreakPoint(quint32 l)
 
     QPair<quint32, quint16> rc = Engine2::unpackDeflinePc(l);
 
-    QTreeWidgetItem* i = findItem(rc.first,rc.second);
-    if( i == 0 )
+    const int row = findItem(rc.first,rc.second);
+    if( row < 0 )
         return false;
     d_breakPoints.erase(it);
-    i->setIcon(0,QIcon() );
+    d_breakRows.remove(row);
+    d_model->changed(row);
     return true;
 }
 
 bool BcViewer2::toggleBreakPoint(Breakpoint* out)
 {
-    QTreeWidgetItem* cur = currentItem();
-    if( cur == 0 || cur->type() != LineType )
+    const QModelIndex cur = currentIndex();
+    if( !cur.isValid() )
+        return false;
+    const Func* f;
+    int pc;
+    if( rowKind(cur.row(),&f,&pc) != LineRow )
         return false;
-    const quint16 pc = cur->data(0,Qt::UserRole).toUInt();
-    QTreeWidgetItem* p = cur->parent();
-    Q_ASSERT(p);
-    p = p->parent();
-    Q_ASSERT(p && p->type() == FuncType );
-    const quint32 def = p->data(0,Qt::UserRole).toUInt();
+    const quint32 def = d_bc.isStripped() ? 0 : JitComposer::unpackRow(f->d_func->d_firstline);
     const quint32 l = Engine2::packDeflinePc(def,pc+1);
     if( d_breakPoints.contains(l) )
     {
@@ -263,189 +481,311 @@ void BcViewer2::clearBreakPoints()
         removeBreakPoint(l);
 }
 
-void BcViewer2::onDoubleClicked(QTreeWidgetItem* i, int)
+static QString formatReasons( const QMap<QByteArray,quint32>& reasons )
 {
-    if( i && ( i->type() == FuncType || i->type() == LineType ) )
-        emit sigGotoLine(i->data(2,Qt::UserRole).toUInt());
+    QStringList res;
+    QMap<QByteArray,quint32>::const_iterator i;
+    for( i = reasons.begin(); i != reasons.end(); ++i )
+        res << QString("%1 (%2)").arg(QString::fromUtf8(i.key())).arg(i.value());
+    return res.join(", ");
 }
 
-void BcViewer2::onSelectionChanged()
+void BcViewer2::setHeat(const Engine2* e, const QByteArray& source)
 {
-    onDoubleClicked(currentItem(),0);
-}
-
-QTreeWidgetItem* BcViewer2::addFunc(const JitBytecode::Function* fp, QTreeWidgetItem* p)
-{
-    QFont bold = font();
-    bold.setBold(true);
-    QFont ul = font();
-    ul.setUnderline(true);
-
-    const JitBytecode::Function& f = *fp;
-    QTreeWidgetItem* fi = p != 0 ? new QTreeWidgetItem(p,FuncType) : new QTreeWidgetItem(this,FuncType);
-#ifdef LINEAR
-    QString top;
-    if( f.d_isRoot )
-        top = " top";
-    fi->setText(0,tr("Function %1%2").arg(f.d_id).arg(top));
-#else
-    fi->setText(0,tr("Function"));
-#endif
-    fi->setText(1,QString::number(f.d_id));
-    fi->setFont(0,bold);
-    if( !d_bc.isStripped() )
+    clearHeat();
+    const QList<Engine2::TraceProto>& protos = e->getTraceProtos();
+    QSet<quint32> mine;
+    for( int i = 0; i < protos.size(); i++ )
     {
-        const quint32 line = JitComposer::unpackRow(f.d_firstline);
-        fi->setText(2,printRowCol(f.d_firstline));
-        fi->setText(3,printRowCol(f.lastLine()));
-        fi->setData(2,Qt::UserRole,f.d_firstline);
-        fi->setData(0,Qt::UserRole,line);
-        fi->setToolTip(0, f.d_sourceFile );
-        d_items[line].append(fi);
-        d_funcs[f.d_firstline] = fi;
+        if( protos[i].d_source == source )
+            mine.insert(i);
     }
-    if( f.d_flags & 0x02 )
-        fi->setText(4,QString("%1+varg").arg(f.d_numparams));
-    else
-        fi->setText(4,QString::number(f.d_numparams));
-    fi->setText(5,QString::number(f.d_framesize));
+    if( mine.isEmpty() )
+        return;
 
-    QTreeWidgetItem* t;
+    // an instruction can be start, abort and blacklisted loop at the same time
 
-    if( ! f.d_upvals.isEmpty() )
+    const QList<Engine2::ExecSite> exec = e->getExecProfile();
+    quint32 total = 0, max = 0;
+    foreach( const Engine2::ExecSite& s, exec )
     {
-        t = new QTreeWidgetItem(fi, VarsType );
-        t->setText(0,tr("Upvals"));
-        t->setFont(0,ul);
-        for( int j = 0; j < f.d_upvals.size(); j++ )
-        {
-            QTreeWidgetItem* ci = new QTreeWidgetItem(t);
-            const quint16 up = f.getUpval(j);
-            // an upvalue points into the upvalue or the var list of the function where FNEW is executed
-            QString options;
-            const bool isLocal = f.isLocalUpval(j) ;
-            if( isLocal )
-                options += "loc ";
-            if( f.isImmutableUpval(j) )
-                options += "ro";
-            QString name;
-            if( !f.d_upNames.isEmpty() && j < f.d_upNames.size() && !f.d_upNames[j].isEmpty() )
-                name = f.d_upNames[j] + " ";
-            if( isLocal )
-                ci->setText(0,QString("%1[%2] %3").arg(name).arg(up).arg(options));
-            else
-                ci->setText(0,QString("%1(%2) %3").arg(name).arg(up).arg(options));
-            ci->setText(1,QString::number(j));
-        }
+        if( !mine.contains(s.d_proto) )
+            continue;
+        total += s.d_count;
+        max = qMax( max, s.d_count );
+    }
+    foreach( const Engine2::ExecSite& s, exec )
+    {
+        if( !mine.contains(s.d_proto) )
+            continue;
+        const int row = findItem( protos[s.d_proto].d_lineDefined, s.d_pc );
+        if( row < 0 )
+            continue;
+        Heat& h = d_heat[row];
+        h.d_back = heatColor( s.d_count, max );
+        h.d_notes << tr("%1 samples (%2%)").arg(s.d_count).arg( s.d_count * 100.0 / total, 0, 'f', 1 );
     }
 
-    if( ! f.d_vars.isEmpty() )
+    foreach( const Engine2::TraceSite& s, e->getTraceStarts() )
     {
-        t = new QTreeWidgetItem(fi, VarsType);
-        t->setText(0,tr("Vars"));
-        t->setFont(0,ul);
-        for( int j = 0; j < f.d_vars.size(); j++ )
-        {
-            QTreeWidgetItem* ci = new QTreeWidgetItem(t);
-            ci->setText(0,f.d_vars[j].d_name.constData());
-            ci->setText(1,QString::number(j));
-            ci->setText(2,QString::number(f.d_vars[j].d_startpc));
-            ci->setText(3,QString::number(f.d_vars[j].d_endpc));
-        }
+        if( !mine.contains(s.d_proto) )
+            continue;
+        const int row = findItem( protos[s.d_proto].d_lineDefined, s.d_pc );
+        if( row < 0 )
+            continue;
+        Heat& h = d_heat[row];
+        if( s.d_reasons.size() > 1 || !s.d_reasons.contains("completed") )
+            h.d_icon = ":/images/exclamation-circle.png";
+        else
+            h.d_fore = Qt::darkGreen;
+        h.d_notes << tr("%1 traces started: %2").arg(s.d_count).arg( formatReasons(s.d_reasons) );
+    }
+    foreach( const Engine2::TraceSite& s, e->getTraceAborts() )
+    {
+        if( !mine.contains(s.d_proto) )
+            continue;
+        const int row = findItem( protos[s.d_proto].d_lineDefined, s.d_pc );
+        if( row < 0 )
+            continue;
+        Heat& h = d_heat[row];
+        h.d_fore = Qt::red;
+        h.d_notes << tr("%1 traces aborted here: %2").arg(s.d_count).arg( formatReasons(s.d_reasons) );
+    }
+    foreach( const Engine2::TraceSite& s, e->getBlacklisted() )
+    {
+        if( !mine.contains(s.d_proto) )
+            continue;
+        const int row = findItem( protos[s.d_proto].d_lineDefined, s.d_pc );
+        if( row < 0 )
+            continue;
+        Heat& h = d_heat[row];
+        h.d_icon = ":/images/exclamation-red.png";
+        h.d_notes << tr("blacklisted: %1").arg( formatReasons(s.d_reasons) );
     }
 
-    if( ! f.d_byteCodes.isEmpty() )
+    foreach( quint32 row, d_heat.keys() )
+        d_model->changed(row);
+}
+
+void BcViewer2::clearHeat()
+{
+    const QList<quint32> rows = d_heat.keys();
+    d_heat.clear();
+    foreach( quint32 row, rows )
+        d_model->changed(row);
+}
+
+void BcViewer2::setDiff(const JitDiff& diff, bool sideA)
+{
+    clearHeat();
+    const QColor changed(255,255,200);
+    const QColor removed(255,220,220);
+    const QColor added(220,255,220);
+    foreach( const JitDiff::FuncDiff& d, diff.getFuncs() )
     {
-        t = new QTreeWidgetItem(fi, CodeType );
-        t->setText(0,tr("Code"));
-        t->setFont(0,ul);
-        for( int j = 0; j < f.d_byteCodes.size(); j++ )
+        if( !d.isChanged() )
+            continue;
+        const int func = sideA ? d.d_a : d.d_b;
+        if( func < 0 || func >= d_funcList.size() )
+            continue;
+        const Func& f = d_funcList[func];
+        Heat& h = d_heat[f.d_row];
+        const int other = sideA ? d.d_b : d.d_a;
+        if( other < 0 )
         {
-            QTreeWidgetItem* ci = new QTreeWidgetItem(t, LineType);
-            JitBytecode::Instruction bc = JitBytecode::dissectInstruction(f.d_byteCodes[j]);
-
-            QByteArray warning, mnemonic;
-            Ljas::Disasm::OP op;
-            Ljas::Disasm::adaptToLjasm(bc, op, warning );
-            mnemonic = Ljas::Disasm::s_opName[op];
-            ci->setText(0,mnemonic);
-            ci->setData(0,Qt::UserRole, j );
-            ci->setData(1,Qt::UserRole,JitComposer::unpackRow(f.d_firstline));
-            ci->setToolTip(0, Ljas::Disasm::s_opHelp[op]);
-            ci->setText(1,QString::number(j));
-            if( !f.d_lines.isEmpty() )
-            {
-                Q_ASSERT( f.d_byteCodes.size() == f.d_lines.size() );
-                ci->setText(2,printRowCol(f.d_lines[j]));
-                ci->setData(2,Qt::UserRole,f.d_lines[j] );
-                d_items[JitComposer::unpackRow(f.d_lines[j])].append(ci);
-            }
-            ci->setText(3, Ljas::Disasm::renderArg(&f,bc.d_ta, bc.d_a, j, false, true ) );
-            ci->setToolTip(3, ci->text(3) );
-            ci->setText(4, Ljas::Disasm::renderArg(&f,bc.d_tb, bc.d_b, j, false, true ) );
-            ci->setToolTip(4, ci->text(4) );
-            ci->setText(5, Ljas::Disasm::renderArg(&f,bc.d_tcd, bc.getCd(), j, false, true ) );
-            ci->setToolTip(5, ci->text(5) );
+            h.d_back = sideA ? removed : added;
+            h.d_notes << tr("only in this dump");
+            continue;
+        }
+        h.d_back = changed;
+        h.d_notes << tr("compared with function %1").arg(other);
+        if( d.d_instrDelta )
+            h.d_notes << tr("instructions %1%2").arg( d.d_instrDelta > 0 ? "+" : "" ).arg(d.d_instrDelta);
+        if( d.d_deleted || d.d_inserted )
+            h.d_notes << tr("%1 deleted, %2 inserted").arg(d.d_deleted).arg(d.d_inserted);
+        if( d.d_frameDelta )
+            h.d_notes << tr("framesize %1%2").arg( d.d_frameDelta > 0 ? "+" : "" ).arg(d.d_frameDelta);
+        if( !d.d_constRemoved.isEmpty() )
+            h.d_notes << tr("constants removed: %1").arg( d.d_constRemoved.join(" ") );
+        if( !d.d_constAdded.isEmpty() )
+            h.d_notes << tr("constants added: %1").arg( d.d_constAdded.join(" ") );
+        if( f.d_code < 0 )
+            continue;
+        foreach( const JitDiff::Edit& e, d.d_edits )
+        {
+            if( sideA && e.d_kind == JitDiff::Deleted )
+                d_heat[f.d_code + 1 + e.d_pcA].d_back = removed;
+            else if( !sideA && e.d_kind == JitDiff::Inserted )
+                d_heat[f.d_code + 1 + e.d_pcB].d_back = added;
         }
     }
-    return fi;
+    foreach( quint32 row, d_heat.keys() )
+        d_model->changed(row);
 }
 
-QTreeWidgetItem*BcViewer2::findItem(quint32 func, quint16 pc) const
+int BcViewer2::currentFunc() const
 {
-    QTreeWidgetItem* item = 0;
+    const QModelIndex i = currentIndex();
+    if( !i.isValid() || d_funcList.isEmpty() )
+        return -1;
+    const Func* f;
+    int j;
+    rowKind(i.row(),&f,&j);
+    return f - d_funcList.constData();
+}
 
-    if( JitComposer::isRowCol() )
-        item = d_funcs.value(func);
-    else
+void BcViewer2::gotoFunc(int index)
+{
+    if( index < 0 || index >= d_funcList.size() || index == currentFunc() )
+        return;
+    setCurrentRow( d_funcList[index].d_row, false );
+}
+
+QColor BcViewer2::heatColor(quint32 count, quint32 max)
+{
+    if( max == 0 )
+        return QColor();
+    // square root, so that lukewarm code is still distinguishable from code which didn't run at all
+    const qreal f = qSqrt( qreal(count) / max );
+    return QColor( 255, 255 - f * 160, 255 - f * 200 );
+}
+
+void BcViewer2::onDoubleClicked(const QModelIndex& index)
+{
+    if( !index.isValid() )
+        return;
+    const Func* f;
+    int j;
+    switch( rowKind(index.row(),&f,&j) )
     {
-        QList<QTreeWidgetItem*> res = d_items.value(func);
-        for( int i = 0; i < res.size(); i++ )
-        {
-            if( res[i]->type() == FuncType )
-            {
-                item = res[i];
-                break;
-            }
-        }
+    case FuncRow:
+        emit sigGotoLine( d_bc.isStripped() ? 0 : f->d_func->d_firstline );
+        break;
+    case LineRow:
+        emit sigGotoLine( f->d_func->d_lines.isEmpty() ? 0 : f->d_func->d_lines[j] );
+        break;
+    }
+}
+
+void BcViewer2::onSelectionChanged()
+{
+    // only double click moves the editor, as before
+    emit sigFuncSelected(currentFunc());
+}
+
+bool BcViewer2::lessRow( quint32 row, const Func& f )
+{
+    return row < f.d_row;
+}
+
+int BcViewer2::rowKind(quint32 row, const Func** f, int* index) const
+{
+    QVector<Func>::const_iterator i = std::upper_bound( d_funcList.begin(), d_funcList.end(), row, lessRow );
+    Q_ASSERT( i != d_funcList.begin() );
+    --i;
+    *f = &(*i);
+    const qint32 r = row;
+    if( row == i->d_row )
+    {
+        *index = 0;
+        return FuncRow;
     }
-    if( item == 0 )
-        return 0;
-    QTreeWidgetItem* found = 0;
-    for(int i = 0; i < item->childCount(); i++ )
+    if( i->d_code >= 0 && r >= i->d_code )
     {
-        if( item->child(i)->type() == CodeType )
-        {
-            pc--;
-            if( pc < item->child(i)->childCount() )
-                found = item->child(i)->child(pc);
-            break;
-        }
+        *index = r - i->d_code - 1;
+        return r == i->d_code ? CodeRow : LineRow;
     }
-    return found;
+    if( i->d_vars >= 0 && r >= i->d_vars )
+    {
+        *index = r - i->d_vars - 1;
+        return r == i->d_vars ? VarsRow : VarRow;
+    }
+    *index = r - i->d_upvals - 1;
+    return r == i->d_upvals ? UpvalsRow : UpvalRow;
+}
+
+int BcViewer2::findItem(quint32 func, quint16 pc) const
+{
+    return findIndexItem( d_funcs.value(func,-1), pc );
+}
+
+int BcViewer2::findIndexItem(int index, quint16 pc) const
+{
+    if( index < 0 || index >= d_funcList.size() )
+        return -1;
+    const Func& f = d_funcList[index];
+    if( f.d_code < 0 )
+        return -1;
+    pc--;
+    if( pc < f.d_func->d_byteCodes.size() )
+        return f.d_code + 1 + pc;
+    return -1;
+}
+
+void BcViewer2::setCurrentRow(int row, bool center)
+{
+    const QModelIndex i = d_model->index(row,0);
+    scrollTo(i, center ? QAbstractItemView::PositionAtCenter : QAbstractItemView::EnsureVisible );
+    setCurrentIndex(i);
 }
 
 void BcViewer2::fillTree()
 {
     clear();
 
-#ifdef LINEAR
+    d_model->beginReset();
+    const bool stripped = d_bc.isStripped();
+    quint32 row = 0;
+    d_funcList.reserve( d_bc.getFuncs().size() );
     for( int i = 0; i < d_bc.getFuncs().size(); i++ )
-        addFunc( d_bc.getFuncs()[i].data() );
-#else
-    const JitBytecode::Function* root = bc.getRoot();
-    if( root )
-        addFunc( root );
-#endif
-
-    expandAll();
+    {
+        const JitBytecode::Function* f = d_bc.getFuncs()[i].data();
+        Func fr;
+        fr.d_func = f;
+        fr.d_row = row++;
+        fr.d_upvals = fr.d_vars = fr.d_code = -1;
+        if( !stripped )
+        {
+            const Line l = { JitComposer::unpackRow(f->d_firstline), f->d_firstline, fr.d_row };
+            d_lines.append(l);
+            // same lookup as the former tree: by packed firstline the last, by row the first function
+            if( JitComposer::isRowCol() || !d_funcs.contains(f->d_firstline) )
+                d_funcs[f->d_firstline] = i;
+        }
+        if( !f->d_upvals.isEmpty() )
+        {
+            fr.d_upvals = row;
+            row += 1 + f->d_upvals.size();
+        }
+        if( !f->d_vars.isEmpty() )
+        {
+            fr.d_vars = row;
+            row += 1 + f->d_vars.size();
+        }
+        if( !f->d_byteCodes.isEmpty() )
+        {
+            fr.d_code = row++;
+            if( !f->d_lines.isEmpty() )
+            {
+                Q_ASSERT( f->d_byteCodes.size() == f->d_lines.size() );
+                for( int j = 0; j < f->d_lines.size(); j++ )
+                {
+                    const Line l = { JitComposer::unpackRow(f->d_lines[j]), f->d_lines[j], row + j };
+                    d_lines.append(l);
+                }
+            }
+            row += f->d_byteCodes.size();
+        }
+        d_funcList.append(fr);
+    }
+    std::stable_sort( d_lines.begin(), d_lines.end(), lessLineRow );
+    d_rowCount = row;
+    d_model->endReset();
+
     resizeColumnToContents(1);
     resizeColumnToContents(2);
     setColumnWidth(3,70);
     setColumnWidth(4,60);
     setColumnWidth(5,d_lastWidth);
-    //resizeColumnToContents(3);
-    //resizeColumnToContents(4);
-    //resizeColumnToContents(5);
+    emit sigLoaded();
 }
-
@@ -20,14 +20,20 @@
 * http://www.gnu.org/copyleft/gpl.html.
 */
 
-#include <QTreeWidget>
+#include <QTreeView>
 #include "LuaJitBytecode.h"
+#include "LuaJitIndex.h"
 
 class QTextStream;
 
 namespace Lua
 {
-    class BcViewer2 : public QTreeWidget
+    class Engine2;
+    class JitDiff;
+
+    // Shows the functions of a JitBytecode as a flat list of rows which are rendered on demand by a
+    // model reading the bytecode directly; only the row layout and a line index are precomputed.
+    class BcViewer2 : public QTreeView
     {
         Q_OBJECT
     public:
@@ -36,11 +42,15 @@ namespace Lua
         bool loadFrom( QIODevice*, const QString& path = QString() );
         void gotoLine(quint32);
         quint32 gotoFuncPc(quint32 func, quint32 pc, bool center, bool setMarker); // pc is one-based, returns row/col or 0
+        quint32 gotoIndexPc(int index, quint32 pc, bool center, bool setMarker); // index in getBc().getFuncs()
         void clearMarker();
         bool saveTo( const QString&, bool stripped = false );
         void clear();
+        bool isEmpty() const { return d_funcList.isEmpty(); }
         void setLastWidth(int w) { d_lastWidth = w; }
         const QString& getPath() const { return d_path; }
+        const JitBytecode& getBc() const { return d_bc; }
+        const JitIndex& getIndex() const; // built on first use after each load
 
         bool addBreakPoint( quint32 );
         bool removeBreakPoint( quint32 );
@@ -52,23 +62,67 @@ namespace Lua
         bool toggleBreakPoint(Breakpoint* out = 0); // current line
         void clearBreakPoints();
         const QSet<quint32>& getBreakPoints() const { return d_breakPoints; }
+
+        // overlays the execution profile and the JIT trace sites of source ("@" + path) recorded by the engine
+        void setHeat( const Engine2*, const QByteArray& source );
+        void clearHeat();
+        static QColor heatColor( quint32 count, quint32 max );
+
+        // marks the changes of a comparison in the same overlay; this viewer shows side a or b of the diff
+        void setDiff( const JitDiff&, bool sideA );
+        int currentFunc() const; // index in getBc().getFuncs() or -1
+        void gotoFunc( int index );
     signals:
         void sigGotoLine(quint32 lnr);
+        void sigLoaded();
+        void sigFuncSelected(int index);
     protected slots:
-        void onDoubleClicked(QTreeWidgetItem*,int);
+        void onDoubleClicked(const QModelIndex&);
         void onSelectionChanged();
     protected:
-        QTreeWidgetItem* addFunc( const JitBytecode::Function*, QTreeWidgetItem* p = 0 );
-        QTreeWidgetItem* findItem( quint32 func, quint16 pc ) const;
+        class Model;
+        struct Func
+        {
+            const JitBytecode::Function* d_func;
+            quint32 d_row; // of the function header
+            qint32 d_upvals, d_vars, d_code; // row of the section header, -1 if the section is empty
+        };
+        struct Line
+        {
+            quint32 d_row; // unpacked source row, the sort key
+            quint32 d_line; // as in Function::d_lines or d_firstline
+            quint32 d_item; // row in the view
+        };
+        struct Heat
+        {
+            QColor d_back;
+            QColor d_fore;
+            QString d_icon;
+            QStringList d_notes;
+        };
+        enum Kind { FuncRow, UpvalsRow, UpvalRow, VarsRow, VarRow, CodeRow, LineRow };
+        int rowKind( quint32 row, const Func** f, int* index ) const;
+        int findItem( quint32 func, quint16 pc ) const; // row or -1
+        int findIndexItem( int index, quint16 pc ) const;
         void fillTree();
+        void setCurrentRow( int row, bool center );
+        static bool lessLine( const Line&, quint32 row );
+        static bool lessLineRow( const Line&, const Line& );
+        static bool lessRow( quint32 row, const Func& );
     private:
         QString d_path;
         JitBytecode d_bc;
-        typedef QMap<quint32,QList<QTreeWidgetItem*> > Items;
-        Items d_items;
-        QHash<quint32,QTreeWidgetItem*> d_funcs;
-        QTreeWidgetItem* d_lastMarker;
+        Model* d_model;
+        mutable JitIndex d_index;
+        mutable bool d_indexed;
+        QVector<Func> d_funcList; // ascending d_row
+        QVector<Line> d_lines; // ascending d_row, rows of equal d_row in view order
+        QHash<quint32,int> d_funcs; // d_firstline -> index in d_funcList
+        quint32 d_rowCount;
+        int d_lastMarker;
         QSet<quint32> d_breakPoints;
+        QSet<int> d_breakRows;
+        QHash<quint32,Heat> d_heat; // view row -> overlay
         int d_lastWidth;
         bool d_lock;
     };
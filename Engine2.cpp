@@ -27,15 +27,29 @@
 #include <QTime>
 #include <QFileInfo>
 #include <QDir>
+#include <QIODevice>
+#include <stdlib.h>
+#include <string.h>
+extern "C" {
+#include <lj_obj.h>
+}
 
 using namespace Lua;
 
+#define TREDEF(name, msg) msg,
+static const char* s_traceErrs[] = {
+#include <lj_traceerr.h>
+};
+#undef TREDEF
+
 static Engine2* s_this = 0;
 
 static const char* s_path = "path";
 static const char* s_cpath = "cpath";
 static Engine2::Breaks s_dummy;
 static const int s_aliveCount = 10000;
+static const int s_memSampleCount = 1000;
+static const int s_execSampleCount = 97; // prime, so the samples don't lock step with short loops
 static QMap<QByteArray,QByteArray> preloads; // name -> buffer
 
 int Engine2::_print (lua_State *L)
@@ -227,11 +241,121 @@ int Engine2::_prettyTraceLoc(lua_State* L)
     return 1;
 }
 
+// Size class pool for small Lua objects. Each Engine2 owns its own pool and a lua_State only runs
+// on one thread at a time, so the free lists need no locking. Blocks are carved from big chunks which
+// are released all at once when the state is closed; while lua_close runs, freeing a small block is
+// a no-op.
+class Engine2::MemPool
+{
+public:
+    enum { Granularity = 16, MaxSmall = 512, ClassCount = MaxSmall / Granularity,
+           ChunkSize = 64 * 1024, KeepChunks = 16 };
+    MemPool():d_cur(0),d_end(0),d_next(0),d_closing(false)
+    {
+        ::memset( d_free, 0, sizeof(d_free) );
+    }
+    ~MemPool()
+    {
+        for( int i = 0; i < d_chunks.size(); i++ )
+            ::free( d_chunks[i] );
+    }
+    static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+    {
+        MemPool* p = static_cast<MemPool*>(ud);
+        if( nsize == 0 )
+        {
+            if( ptr )
+                p->release( ptr, osize );
+            return 0;
+        }
+        if( ptr == 0 )
+            return p->allocate( nsize );
+        if( osize > MaxSmall && nsize > MaxSmall )
+            return ::realloc( ptr, nsize );
+        if( osize <= MaxSmall && nsize <= MaxSmall && toClass(osize) == toClass(nsize) )
+            return ptr;
+        void* res = p->allocate( nsize );
+        if( res == 0 )
+            return 0;
+        ::memcpy( res, ptr, osize < nsize ? osize : nsize );
+        p->release( ptr, osize );
+        return res;
+    }
+    void setClosing() { d_closing = true; }
+    void reset()
+    {
+        // only called after lua_close, i.e. all large blocks are already freed
+        d_closing = false;
+        ::memset( d_free, 0, sizeof(d_free) );
+        while( d_chunks.size() > KeepChunks )
+            ::free( d_chunks.takeLast() );
+        d_next = 0;
+        d_cur = d_end = 0;
+    }
+private:
+    struct Free
+    {
+        Free* d_next;
+    };
+    static int toClass( size_t s ) { return ( s + Granularity - 1 ) / Granularity - 1; }
+    void* allocate( size_t n )
+    {
+        if( n > MaxSmall )
+            return ::malloc( n );
+        const int cls = toClass(n);
+        if( Free* f = d_free[cls] )
+        {
+            d_free[cls] = f->d_next;
+            return f;
+        }
+        const size_t len = ( cls + 1 ) * Granularity;
+        if( d_cur + len > d_end )
+        {
+            if( d_next < d_chunks.size() )
+                d_cur = d_chunks[d_next];
+            else
+            {
+                char* c = static_cast<char*>( ::malloc( ChunkSize ) );
+                if( c == 0 )
+                    return 0;
+                d_chunks.append(c);
+                d_cur = c;
+            }
+            d_next++;
+            d_end = d_cur + ChunkSize;
+        }
+        void* res = d_cur;
+        d_cur += len;
+        return res;
+    }
+    void release( void* ptr, size_t n )
+    {
+        if( n > MaxSmall )
+            ::free( ptr );
+        else if( !d_closing )
+        {
+            Free* f = static_cast<Free*>(ptr);
+            const int cls = toClass(n);
+            f->d_next = d_free[cls];
+            d_free[cls] = f;
+        }
+    }
+    Free* d_free[ClassCount];
+    QList<char*> d_chunks;
+    int d_next; // index of the chunk following d_cur
+    char* d_cur;
+    char* d_end;
+    bool d_closing; // the chunks are dropped as a whole afterwards
+};
+
 Engine2::Engine2(QObject *p):QObject(p),
     d_ctx( 0 ), d_debugging( false ), d_running(false), d_waitForCommand(false),
     d_dbgCmd(RunToBreakPoint), d_defaultDbgCmd(RunToBreakPoint), d_activeLevel(0), d_dbgShell(0),
-    d_printToStdout(false), d_aliveSignal(false), d_mode(LineMode), d_aliveCount(0), d_stepCallDepth(0),
-    d_stepOverSync(false)
+    d_printToStdout(false), d_aliveSignal(false), d_mode(LineMode), d_aliveCount(0), d_stepDepth(0),
+    d_allocf(0), d_allocUd(0), d_memSampleRate(64*1024), d_memPending(0),
+    d_memProf(false), d_memSampleDue(false), d_pool(0), d_usePool(false),
+    d_traceNext(0), d_traceWrapped(false), d_traceRef(LUA_NOREF), d_traceStartFunc(LUA_NOREF), d_traceOn(false),
+    d_execProf(false), d_envRef(LUA_NOREF), d_envLevel(0), d_envDepth(0), d_lastHandle(0)
 {
     if( !restart() )
         throw Exception( "failed to create engine" );
@@ -239,8 +363,12 @@ Engine2::Engine2(QObject *p):QObject(p),
 
 Engine2::~Engine2()
 {
+    if( d_pool )
+        d_pool->setClosing();
 	if( d_ctx )
 		lua_close( d_ctx );
+    if( d_pool )
+        delete d_pool;
 }
 
 void Engine2::addStdLibs()
@@ -258,11 +386,50 @@ bool Engine2::restart()
 
     if( d_ctx )
     {
+        releaseConditions();
+        if( d_pool )
+            d_pool->setClosing();
         lua_close( d_ctx );
         d_ctx = 0;
     }
+    d_handles.clear();
+    d_handleRefs.clear();
+    d_usedHandles.clear();
+    d_traceRef = LUA_NOREF;
+    d_traceStartFunc = LUA_NOREF;
+    d_envRef = LUA_NOREF;
+    d_traceProtoIndex.clear(); // the prototypes of the closed state are gone, not their records
+
+    if( d_pool )
+    {
+        if( d_usePool )
+            d_pool->reset();
+        else
+        {
+            delete d_pool;
+            d_pool = 0;
+        }
+    }
 
-    lua_State* ctx = lua_open();
+    lua_State* ctx = 0;
+    if( d_usePool )
+    {
+        if( d_pool == 0 )
+            d_pool = new MemPool();
+        ctx = lua_newstate( MemPool::alloc, d_pool );
+        if( ctx == 0 )
+        {
+            // 64 bit LuaJIT without GC64 insists on its own allocator
+            delete d_pool;
+            d_pool = 0;
+            d_usePool = false;
+            d_lastError = "this LuaJIT build doesn't support the pool allocator; using the default allocator";
+            error( d_lastError );
+        }else
+            lua_atpanic( ctx, atPanic );
+    }
+    if( ctx == 0 )
+        ctx = lua_open();
     if( ctx == 0 )
     {
         qCritical() << "Not enough memory to create Lua context";
@@ -272,6 +439,8 @@ bool Engine2::restart()
     LUAJIT_VERSION_SYM();
 
     d_ctx = ctx;
+    if( d_memProf )
+        installMemProfiler();
 
     addLibrary( BASE );	// Das muss hier stehen, sonst wird ev. print wieder überschrieben
 
@@ -294,9 +463,19 @@ bool Engine2::restart()
         d_aliveSignal = false;
         setAliveSignal(true);
     }
+    installHook();
+    if( d_traceOn )
+        installTraceCollector();
     return true;
 }
 
+int Engine2::atPanic(lua_State* L)
+{
+    // same as the one set by luaL_newstate
+    qCritical() << "PANIC: unprotected error in call to Lua API" << lua_tostring(L, -1);
+    return 0;
+}
+
 void Engine2::addLibrary(Lib what)
 {
     if( d_running )
@@ -730,55 +909,126 @@ int Engine2::ErrHandler( lua_State* L )
     return 1;
 }
 
-void Engine2::debugHook(lua_State *L, lua_Debug *ar)
+int Engine2::stackDepth(lua_State* L)
 {
-    Engine2* e = Engine2::getInst();
-    Q_ASSERT( e != 0 );
+    // lua_getstack walks the frames from the top, so don't probe each level
+    lua_Debug ar;
+    if( !lua_getstack( L, 0, &ar ) )
+        return 0;
+    int lo = 0, hi = 1;
+    while( lua_getstack( L, hi, &ar ) )
+    {
+        lo = hi;
+        hi *= 2;
+    }
+    while( hi - lo > 1 )
+    {
+        const int mid = ( lo + hi ) / 2;
+        if( lua_getstack( L, mid, &ar ) )
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return hi;
+}
 
-    const StackLevel l = e->getStackLevel(0,false,ar);
+int Engine2::compareDepth(lua_State* L, int depth)
+{
+    lua_Debug ar;
+    if( depth > 0 && !lua_getstack( L, depth - 1, &ar ) )
+        return -1;
+    if( lua_getstack( L, depth, &ar ) )
+        return 1;
+    return 0;
+}
 
-    const quint32 wasRow = JitComposer::unpackRow(e->d_curRowCol);
-    const quint32 isRow = JitComposer::unpackRow(l.d_line);
+bool Engine2::isStepFrame(lua_State* L, const Break& b)
+{
+    lua_Debug ar;
+    if( !lua_getstack( L, 0, &ar ) || !lua_getinfo( L, "S", &ar ) )
+        return false;
+    const char* source = *ar.source == '@' ? ar.source + 1 : ar.source; // see getStackLevel
+    return quint32(ar.linedefined) == b.second && b.first == source;
+}
 
-    // NOTE: LUA_HOOKTAILRET is defined in lua.h, but never used!
-    if( ar->event == LUA_HOOKCALL )
+bool Engine2::breakWhileStepping(lua_State* L, lua_Debug* ar)
+{
+    const StackLevel l = getStackLevel(0,false,ar);
+    const QByteArray script = d_curScript;
+    const quint32 rowCol = d_curRowCol;
+    d_curScript = l.d_source;
+    if( d_mode == PcMode )
+        d_curRowCol = packDeflinePc( JitComposer::unpackRow(l.d_lineDefined),l.d_line);
+    else
+        d_curRowCol = l.d_line;
+    const quint32 line = lineForBreak();
+    const bool lineChanged = d_mode == PcMode || d_stepPos.first != d_curScript || d_stepPos.second != line;
+    d_stepPos = Break( d_curScript, line );
+    d_activeLevel = 0;
+    if( lineChanged && d_breaks.value( d_curScript ).contains( line ) && checkBreakCondition( line ) )
     {
-        // HOOKRET comes when already in the function to be called
-        if( e->d_dbgCmd == StepOut || e->d_dbgCmd == StepOver )
+        d_breakHit = true;
+        d_waitForCommand = true;
+        notify( BreakHit, d_curScript, lineForNotify() );
+        if( d_dbgShell )
+            d_dbgShell->handleBreak( this, d_curScript, line );
+        d_waitForCommand = false;
+        if( d_dbgCmd == Abort || d_dbgCmd == AbortSilently )
         {
-            if( !l.d_inC )
-                e->d_stepCallDepth++;
+            lua_pushnil(L);
+            lua_error(L);
         }
-        return;
+        notify( Continued );
+        return true;
     }
-    if( ar->event == LUA_HOOKRET )
-        // LUA_HOOKRET isn't fired in case of CALLT!!! Use _LJTOOLS_DONT_CREATE_TAIL_CALLS to avoid.
+    d_curScript = script;
+    d_curRowCol = rowCol;
+    return false;
+}
+
+void Engine2::debugHook(lua_State *L, lua_Debug *ar)
+{
+    Engine2* e = Engine2::getInst();
+    Q_ASSERT( e != 0 );
+
+    if( e->d_memSampleDue )
+        e->sampleMem(L);
+
+    Q_ASSERT( ar->event == LUA_HOOKLINE || ar->event == LUA_HOOKCOUNT );
+
+    // StepOver and StepOut are tracked by stack depth instead of call and return events, because
+    // LuaJIT doesn't fire LUA_HOOKRET for CALLT. A tail call replaces the frame of the caller, so the
+    // stack doesn't grow but the function at the original depth changes.
+    bool left = false;
+    if( e->d_dbgCmd == StepOver || e->d_dbgCmd == StepOut )
     {
-        // HOOKRET comes when still in the returning function; even the pc is still the same as the previous HOOKLINE
-        if( e->d_dbgCmd == StepOut || e->d_dbgCmd == StepOver )
+        const int cmp = compareDepth( L, e->d_stepDepth );
+        if( cmp < 0 )
+            left = true; // returned from the function where StepOver or StepOut was called
+        else if( cmp > 0 || e->d_dbgCmd == StepOut || !isStepFrame( L, e->d_stepBreak ) )
         {
-            Q_ASSERT( !l.d_inC && !e->d_stepBreak.first.isEmpty() ); // see runToNextLine
-
-            e->d_stepCallDepth--;
-            if(  e->d_stepCallDepth < 0 &&
-                    e->d_stepBreak.first == l.d_source &&
-                    e->d_stepBreak.second == l.d_lineDefined )
-                e->d_dbgCmd = Engine2::StepNext;
-                // Change StepOut to StepNext if we leave the function in which StepOut was called (i.e. callDepth<0)
-                // Change StepOver to StepNext if we're about to leave the function where StepOver was called (i.e. callDepth<0)
-            else if( e->d_dbgCmd == StepOver && e->d_stepCallDepth == 0 )
+            // still in a callee; only breakpoints stop here, otherwise d_curRowCol stays on the line
+            // where the step started
+            if( !e->d_breaks.isEmpty() && e->breakWhileStepping( L, ar ) )
+                return;
+            if( ++e->d_aliveCount > s_aliveCount / 2 && e->d_dbgShell )
             {
-                // if we step over a procedure call reset curLine/Script to the original value to avoid that
-                // we break twice on the line of the function call (by avoiding lineChanged to become true)
-                e->d_curScript = e->d_stepBreak.first;
-                e->d_curRowCol = e->d_stepCurRowCol;
-                e->d_dbgCmd = Engine2::StepNext;
-                e->d_stepOverSync = true;
+                e->d_dbgShell->handleAliveSignal( e );
+                e->d_aliveCount = 0;
+                if( e->d_dbgCmd == Abort || e->d_dbgCmd == AbortSilently )
+                {
+                    lua_pushnil(L);
+                    lua_error(L);
+                }
             }
+            return;
         }
-        return;
     }
-    Q_ASSERT( ar->event == LUA_HOOKLINE || ar->event == LUA_HOOKCOUNT );
+
+    const StackLevel l = e->getStackLevel(0,false,ar);
+
+    const quint32 wasRow = JitComposer::unpackRow(e->d_curRowCol);
+    const quint32 isRow = JitComposer::unpackRow(l.d_line);
 
     e->d_aliveCount++;
 
@@ -786,16 +1036,19 @@ void Engine2::debugHook(lua_State *L, lua_Debug *ar)
     switch( e->d_mode )
     {
     case LineMode:
-        if( e->d_stepOverSync && e->d_stepCallDepth == 0 && JitComposer::isRowCol() )
-            e->d_dbgCmd = StepOver; // happens if arg or a call is yet another call on the same line
-        else
-            lineChanged = ( wasRow != isRow || e->d_curScript != l.d_source );
+        lineChanged = ( wasRow != isRow || e->d_curScript != l.d_source );
         break;
     case RowColMode:
     case PcMode:
         lineChanged = ( unpackDeflinePc(e->d_curRowCol).second != l.d_line || e->d_curScript != l.d_source );
         break;
     }
+    if( left )
+    {
+        // stop at the first event in the caller, even if it is on the same line as the step started
+        e->d_dbgCmd = StepNext;
+        lineChanged = true;
+    }
 
     e->d_curScript = l.d_source;
     if( e->d_mode == PcMode )
@@ -809,11 +1062,8 @@ void Engine2::debugHook(lua_State *L, lua_Debug *ar)
         e->d_activeLevel = 0;
 
         const quint32 line = e->lineForBreak();
-        if( e->d_dbgCmd == Engine2::StepNext ||
-                ( e->d_dbgCmd == Engine2::StepOver && e->d_stepCallDepth == 0 &&
-                                e->d_stepBreak.first == l.d_source &&
-                                e->d_stepBreak.second == l.d_lineDefined ) )
-                // the Engine2::StepOver case is still relevant here because we can step over non-calls too.
+        if( e->d_dbgCmd == Engine2::StepNext || e->d_dbgCmd == Engine2::StepOver )
+                // StepOver only gets here in the frame where it was called, see above
         {
             e->d_waitForCommand = true;
             e->d_breakHit = true;
@@ -821,7 +1071,7 @@ void Engine2::debugHook(lua_State *L, lua_Debug *ar)
             if( e->d_dbgShell )
                 e->d_dbgShell->handleBreak( e, e->d_curScript, line );
             e->d_waitForCommand = false;
-        }else if( e->d_breaks.value( e->d_curScript ).contains( line ) )
+        }else if( e->d_breaks.value( e->d_curScript ).contains( line ) && e->checkBreakCondition( line ) )
         {
             e->d_waitForCommand = true;
             e->d_breakHit = true;
@@ -855,7 +1105,6 @@ void Engine2::debugHook(lua_State *L, lua_Debug *ar)
         }
 #endif
     }
-    e->d_stepOverSync = false;
     //else // this doesn't seem to be necessary, even counterproductive
     //    lua_pop(L, 1); // function
 }
@@ -864,6 +1113,8 @@ void Engine2::aliveSignal(lua_State* L, lua_Debug* ar)
 {
     Engine2* e = Engine2::getInst();
     Q_ASSERT( e != 0 );
+    if( e->d_memSampleDue )
+        e->sampleMem(L);
     if( e->d_dbgShell )
     {
         e->d_dbgShell->handleAliveSignal(e);
@@ -900,12 +1151,20 @@ QByteArray Engine2::getBinaryFromFunc(lua_State *L)
 void Engine2::notifyStart()
 {
     d_running = true;
+    QHash<QByteArray,BreakConds>::iterator i;
+    for( i = d_conds.begin(); i != d_conds.end(); ++i )
+    {
+        BreakConds::iterator j;
+        for( j = i.value().begin(); j != i.value().end(); ++j )
+            j.value().d_hits = 0;
+    }
     notify( Started );
 }
 
 void Engine2::notifyEnd()
 {
     d_running = false;
+    releaseHandles();
 	notify( (d_dbgCmd == Abort || d_dbgCmd == AbortSilently)? Aborted : Finished );
 }
 
@@ -913,18 +1172,47 @@ void Engine2::setDebug(bool on)
 {
     if( d_debugging == on )
         return;
-    if( on )
+    d_debugging = on;
+    installHook();
+}
+
+void Engine2::installHook()
+{
+    if( d_debugging )
     {
         if( d_mode == PcMode )
-            lua_sethook( d_ctx, debugHook, LUA_MASKCOUNT | LUA_MASKRET | LUA_MASKCALL, 1);
+            lua_sethook( d_ctx, debugHook, LUA_MASKCOUNT, 1);
         else
-            lua_sethook( d_ctx, debugHook, LUA_MASKLINE | LUA_MASKRET | LUA_MASKCALL, 1);
+            lua_sethook( d_ctx, debugHook, LUA_MASKLINE, 1);
     }else if( d_aliveSignal )
         lua_sethook( d_ctx, aliveSignal, LUA_MASKCOUNT, s_aliveCount); // get's a hook call with each bytecode op when 1
+    else if( d_execProf )
+        lua_sethook( d_ctx, profileHook, LUA_MASKCOUNT, s_execSampleCount );
+    else if( d_memProf && d_memSampleRate )
+        lua_sethook( d_ctx, profileHook, LUA_MASKCOUNT, s_memSampleCount );
     else
         lua_sethook( d_ctx, 0, 0, 0);
-    d_debugging = on;
+}
 
+void Engine2::interrupt()
+{
+    // same approach as in luajit.c; lua_sethook is safe to be called asynchronously
+    if( d_ctx )
+        lua_sethook( d_ctx, interruptHook, LUA_MASKCOUNT, 1 );
+}
+
+void Engine2::interruptHook(lua_State* L, lua_Debug* ar)
+{
+    Engine2* e = Engine2::getInst();
+    Q_ASSERT( e != 0 );
+    e->installHook();
+    if( e->d_dbgShell )
+        e->d_dbgShell->handleAliveSignal(e);
+    if( e->d_dbgCmd == Abort || e->d_dbgCmd == AbortSilently )
+    {
+        lua_pushnil(L);
+        lua_error(L);
+    }
 }
 
 void Engine2::setJit(bool on)
@@ -945,10 +1233,622 @@ void Engine2::setAliveSignal(bool on)
     if( d_debugging )
         return;
     d_aliveCount = 0;
+    installHook();
+}
+
+void Engine2::setMemProfiling(bool on)
+{
+    if( d_memProf == on )
+        return;
+    d_memProf = on;
+    if( on )
+        installMemProfiler();
+    else if( d_allocf )
+    {
+        lua_setallocf( d_ctx, d_allocf, d_allocUd );
+        d_allocf = 0;
+        d_allocUd = 0;
+    }
+    if( !d_debugging && !d_aliveSignal )
+        installHook();
+}
+
+void Engine2::setMemSampling(quint32 bytes)
+{
+    if( d_memSampleRate == bytes )
+        return;
+    const bool wasOn = d_memSampleRate != 0;
+    d_memSampleRate = bytes;
+    d_memPending = 0;
+    d_memSampleDue = false;
+    if( d_memProf && !d_debugging && !d_aliveSignal && wasOn != ( bytes != 0 ) )
+        installHook();
+}
+
+void Engine2::setExecProfiling(bool on)
+{
+    if( d_execProf == on )
+        return;
+    d_execProf = on;
+    if( !d_debugging && !d_aliveSignal )
+        installHook();
+}
+
+void Engine2::resetExecProfile()
+{
+    d_execSites.clear();
+}
+
+void Engine2::sampleExec(lua_State* L)
+{
+    lua_Debug ar;
+    if( !lua_getstack( L, 0, &ar ) || !lua_getinfo( L, "lf", &ar ) )
+        return;
+    if( ar.currentline < 0 )
+    {
+        lua_pop( L, 1 ); // not in a Lua function
+        return;
+    }
+    const quint32 proto = traceProto( L, lua_gettop(L) );
+    lua_pop( L, 1 );
+    const quint32 line = ar.currentline;
+    lua_getinfo( L, "p", &ar ); // currentline is the pc now
+    ExecSite& s = d_execSites[ traceKey(proto,ar.currentline) ];
+    if( s.d_count == 0 )
+    {
+        s.d_proto = proto;
+        s.d_pc = ar.currentline;
+        s.d_line = line;
+    }
+    s.d_count++;
+}
+
+Engine2::MemSnapshot Engine2::getMemSnapshot() const
+{
+    MemSnapshot res = d_mem;
+    res.d_time = d_memStart.elapsed();
+    return res;
+}
+
+void Engine2::resetMemProfile()
+{
+    const qint64 cur = d_mem.d_current;
+    d_mem = MemSnapshot();
+    d_mem.d_current = cur;
+    d_mem.d_peak = cur;
+    d_memPending = 0;
+    d_memSampleDue = false;
+    d_memStart.start();
+}
+
+void Engine2::installMemProfiler()
+{
+    // We wrap whatever allocator the state was created with instead of using lua_newstate, because
+    // 64 bit LuaJIT only works with its built-in allocator (lua_newstate returns null there).
+    void* ud;
+    lua_Alloc f = lua_getallocf( d_ctx, &ud );
+    if( f == memAlloc )
+        return;
+    d_allocf = f;
+    d_allocUd = ud;
+    d_mem.d_current = lua_gc( d_ctx, LUA_GCCOUNT, 0 ) * 1024 + lua_gc( d_ctx, LUA_GCCOUNTB, 0 );
+    resetMemProfile();
+    lua_setallocf( d_ctx, memAlloc, this );
+}
+
+void* Engine2::memAlloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    Engine2* e = static_cast<Engine2*>(ud);
+    void* res = e->d_allocf( e->d_allocUd, ptr, osize, nsize );
+    if( nsize != 0 && res == 0 )
+        return 0; // allocation failed, nothing changed
+    MemSnapshot& m = e->d_mem;
+    if( ptr != 0 )
+        m.d_current -= osize;
+    if( nsize == 0 )
+    {
+        if( ptr != 0 )
+            m.d_frees++;
+        return res;
+    }
+    m.d_current += nsize;
+    if( m.d_current > m.d_peak )
+        m.d_peak = m.d_current;
+    const int cls = MemSnapshot::sizeClass(nsize);
+    m.d_allocs++;
+    m.d_bytes[cls] += nsize;
+    m.d_counts[cls]++;
+    if( e->d_memSampleRate )
+    {
+        // Attribution needs a consistent Lua stack which we don't have inside the allocator;
+        // so we only mark the sample here and let the next count hook assign it to the current line.
+        e->d_memPending += nsize;
+        if( e->d_memPending >= e->d_memSampleRate )
+            e->d_memSampleDue = true;
+    }
+    return res;
+}
+
+void Engine2::sampleMem(lua_State* L)
+{
+    d_memSampleDue = false;
+    lua_Debug ar;
+    QByteArray site;
+    if( lua_getstack( L, 0, &ar ) && lua_getinfo( L, "Sl", &ar ) )
+    {
+        site = ar.short_src;
+        site += ':';
+        if( ar.currentline > 0 && JitComposer::isRowCol() )
+            site += QByteArray::number( JitComposer::unpackRow(ar.currentline) );
+        else
+            site += QByteArray::number( ar.currentline );
+    }else
+        site = "?";
+    d_mem.d_sites[site] += d_memPending;
+    d_memPending = 0;
+}
+
+void Engine2::profileHook(lua_State* L, lua_Debug* ar)
+{
+    Engine2* e = Engine2::getInst();
+    Q_ASSERT( e != 0 );
+    if( e->d_memSampleDue )
+        e->sampleMem(L);
+    if( e->d_execProf )
+        e->sampleExec(L);
+}
+
+Engine2::MemSnapshot::MemSnapshot():d_current(0),d_peak(0),d_allocs(0),d_frees(0),d_time(0)
+{
+    for( int i = 0; i < MemSizeClasses; i++ )
+    {
+        d_bytes[i] = 0;
+        d_counts[i] = 0;
+    }
+}
+
+Engine2::MemSnapshot Engine2::MemSnapshot::operator-(const Engine2::MemSnapshot& older) const
+{
+    MemSnapshot res;
+    res.d_current = d_current - older.d_current;
+    res.d_peak = d_peak;
+    res.d_allocs = d_allocs - older.d_allocs;
+    res.d_frees = d_frees - older.d_frees;
+    res.d_time = d_time - older.d_time;
+    for( int i = 0; i < MemSizeClasses; i++ )
+    {
+        res.d_bytes[i] = d_bytes[i] - older.d_bytes[i];
+        res.d_counts[i] = d_counts[i] - older.d_counts[i];
+    }
+    QHash<QByteArray,qint64>::const_iterator i;
+    for( i = d_sites.begin(); i != d_sites.end(); ++i )
+    {
+        const qint64 delta = i.value() - older.d_sites.value(i.key());
+        if( delta != 0 )
+            res.d_sites[i.key()] = delta;
+    }
+    return res;
+}
+
+int Engine2::MemSnapshot::sizeClass(quint64 bytes)
+{
+    int cls = 0;
+    quint64 limit = 16;
+    while( bytes > limit && cls < MemSizeClasses - 1 )
+    {
+        limit <<= 1;
+        cls++;
+    }
+    return cls;
+}
+
+quint32 Engine2::MemSnapshot::classLimit(int cls)
+{
+    if( cls >= MemSizeClasses - 1 )
+        return 0;
+    return 16 << cls;
+}
+
+static const char* s_traceTypes[] = { "start", "stop", "abort", "flush" };
+enum { TraceCapacity = 64 * 1024 };
+
+static inline quint64 traceKey( quint32 proto, quint16 pc )
+{
+    return ( quint64(proto) << 16 ) | pc;
+}
+
+void Engine2::setTraceCollecting(bool on)
+{
+    if( d_traceOn == on )
+        return;
+    d_traceOn = on;
     if( on )
-        lua_sethook( d_ctx, aliveSignal, LUA_MASKCOUNT, s_aliveCount);
+    {
+        if( d_traceRing.isEmpty() )
+            d_traceRing.resize(TraceCapacity);
+        installTraceCollector();
+    }else
+        removeTraceCollector();
+}
+
+void Engine2::setTraceCapacity(int events)
+{
+    d_traceRing = QVector<TraceEvent>( qMax(1,events) );
+    d_traceNext = 0;
+    d_traceWrapped = false;
+}
+
+void Engine2::resetTraces()
+{
+    // the prototypes stay interned, they are shared with the execution profile
+    d_traceNext = 0;
+    d_traceWrapped = false;
+    d_traceAborts.clear();
+    d_traceBlack.clear();
+    d_traceStarts.clear();
+    d_traceStats.clear();
+    d_traceStart = TraceEvent();
+}
+
+void Engine2::installTraceCollector()
+{
+    if( d_traceRef != LUA_NOREF )
+        return;
+    lua_State* L = d_ctx;
+    lua_getfield( L, LUA_REGISTRYINDEX, "_LOADED" );
+    lua_getfield( L, -1, "jit.util" );
+    if( !lua_istable( L, -1 ) )
+    {
+        lua_pop( L, 1 );
+        addLibrary( JIT );
+        lua_getfield( L, -1, "jit.util" );
+    }
+    lua_getfield( L, -2, LUA_JITLIBNAME );
+    lua_getfield( L, -1, "attach" );
+    lua_pushlightuserdata( L, this );
+    lua_getfield( L, -4, "funcinfo" );
+    lua_getfield( L, -5, "funcbc" );
+    lua_pushcclosure( L, traceEvent, 3 );
+    lua_pushvalue( L, -1 );
+    d_traceRef = luaL_ref( L, LUA_REGISTRYINDEX );
+    lua_pushstring( L, "trace" );
+    lua_call( L, 2, 0 ); // jit.attach(handler, "trace")
+    lua_pop( L, 3 );
+}
+
+void Engine2::removeTraceCollector()
+{
+    if( d_traceRef == LUA_NOREF )
+        return;
+    lua_State* L = d_ctx;
+    lua_getfield( L, LUA_REGISTRYINDEX, "_LOADED" );
+    lua_getfield( L, -1, LUA_JITLIBNAME );
+    lua_getfield( L, -1, "attach" );
+    lua_rawgeti( L, LUA_REGISTRYINDEX, d_traceRef );
+    lua_call( L, 1, 0 ); // without event the handler is detached
+    lua_pop( L, 2 );
+    luaL_unref( L, LUA_REGISTRYINDEX, d_traceRef );
+    luaL_unref( L, LUA_REGISTRYINDEX, d_traceStartFunc );
+    d_traceRef = LUA_NOREF;
+    d_traceStartFunc = LUA_NOREF;
+}
+
+quint32 Engine2::traceProto(lua_State* L, int func)
+{
+    // Interned by GCproto (all C functions share one entry); the source is only fetched and copied the first
+    // time, the names are formatted when the results are collected.
+    const GCfunc* fn = static_cast<const GCfunc*>( lua_topointer( L, func ) );
+    const GCproto* pt = isluafunc(fn) ? funcproto(fn) : 0;
+    const void* chunk = pt ? strref(pt->chunkname) : 0;
+    const qint32 line = pt ? qint32(pt->firstline) : -1;
+    QHash<const void*,ProtoRef>::const_iterator i = d_traceProtoIndex.find(pt);
+    if( i != d_traceProtoIndex.end() && i.value().d_chunk == chunk && i.value().d_line == line )
+        return i.value().d_index;
+    // new or the address was reused by another prototype after a collection
+    lua_Debug ar;
+    lua_pushvalue( L, func );
+    lua_getinfo( L, ">S", &ar );
+    ProtoRef r;
+    r.d_index = d_traceProtos.size();
+    r.d_chunk = chunk;
+    r.d_line = line;
+    d_traceProtos.append( TraceProto(ar.source,ar.linedefined) );
+    d_traceProtoIndex.insert(pt,r);
+    return r.d_index;
+}
+
+int Engine2::traceEvent(lua_State* L)
+{
+    // what, tr, func, pc, otr, oex as in jit/v.lua; upvalues: engine, jit.util.funcinfo, jit.util.funcbc
+    Engine2* e = static_cast<Engine2*>( lua_touserdata( L, lua_upvalueindex(1) ) );
+    const QByteArray what = lua_tostring( L, 1 );
+    TraceEvent ev;
+    ev.d_trace = lua_tointeger( L, 2 );
+    if( what == "flush" )
+    {
+        e->addTraceEvent(ev);
+        return 0;
+    }
+    if( lua_isfunction( L, 3 ) )
+    {
+        ev.d_proto = e->traceProto( L, 3 );
+        ev.d_pc = lua_tointeger( L, 4 );
+        lua_pushvalue( L, lua_upvalueindex(2) );
+        lua_pushvalue( L, 3 );
+        lua_pushvalue( L, 4 );
+        lua_call( L, 2, 1 );
+        lua_getfield( L, -1, "currentline" );
+        ev.d_line = lua_tointeger( L, -1 );
+        lua_pop( L, 2 );
+    }
+    if( what == "start" )
+    {
+        ev.d_type = TraceEvent::Start;
+        ev.d_parent = lua_tointeger( L, 5 ); // nil for root traces
+        ev.d_exit = lua_tointeger( L, 6 );
+        e->addTraceEvent(ev);
+        luaL_unref( L, LUA_REGISTRYINDEX, e->d_traceStartFunc );
+        lua_pushvalue( L, 3 );
+        e->d_traceStartFunc = luaL_ref( L, LUA_REGISTRYINDEX );
+    }else if( what == "stop" )
+    {
+        ev.d_type = TraceEvent::Stop;
+        e->addTraceEvent(ev);
+    }else if( what == "abort" )
+    {
+        ev.d_type = TraceEvent::Abort;
+        if( lua_isnumber( L, 5 ) )
+            ev.d_reason = lua_tointeger( L, 5 ); // otherwise a Lua error during recording, i.e. 0
+        if( lua_isnumber( L, 6 ) )
+            ev.d_info = lua_tointeger( L, 6 );
+        else if( lua_isfunction( L, 6 ) )
+        {
+            // fast function not yet implemented
+            lua_pushvalue( L, lua_upvalueindex(2) );
+            lua_pushvalue( L, 6 );
+            lua_call( L, 1, 1 );
+            lua_getfield( L, -1, "ffid" );
+            ev.d_info = lua_tointeger( L, -1 );
+            lua_pop( L, 2 );
+        }
+        e->addTraceEvent(ev);
+
+        // LuaJIT penalizes the start of a failed root trace and eventually blacklists it by
+        // replacing the loop instruction with its I-variant before the abort event is sent
+        const TraceEvent& start = e->d_traceStart;
+        if( start.d_parent == 0 && e->d_traceStartFunc != LUA_NOREF )
+        {
+            lua_pushvalue( L, lua_upvalueindex(3) );
+            lua_rawgeti( L, LUA_REGISTRYINDEX, e->d_traceStartFunc );
+            lua_pushinteger( L, start.d_pc );
+            lua_call( L, 2, 1 );
+            const quint8 op = quint32( lua_tonumber( L, -1 ) ) & 0xff;
+            lua_pop( L, 1 );
+            if( op == JitBytecode::OP_ILOOP || op == JitBytecode::OP_IFORL || op == JitBytecode::OP_IITERL )
+            {
+                TraceSite& site = e->d_traceBlack[ traceKey(start.d_proto,start.d_pc) ];
+                site.d_proto = start.d_proto;
+                site.d_pc = start.d_pc;
+                site.d_line = start.d_line;
+                site.d_count++;
+                site.d_reasons[traceReason(ev.d_reason,ev.d_info)]++;
+            }
+        }
+    }
+    return 0;
+}
+
+void Engine2::addTraceEvent(const Engine2::TraceEvent& ev)
+{
+    if( !d_traceRing.isEmpty() )
+    {
+        d_traceRing[d_traceNext++] = ev;
+        if( d_traceNext == d_traceRing.size() )
+        {
+            d_traceNext = 0;
+            d_traceWrapped = true;
+        }
+    }
+    switch( ev.d_type )
+    {
+    case TraceEvent::Start:
+        {
+            d_traceStart = ev;
+            TraceProtoStat& s = d_traceStats[ev.d_proto];
+            s.d_proto = ev.d_proto;
+            s.d_started++;
+            TraceSite& site = d_traceStarts[ traceKey(ev.d_proto,ev.d_pc) ];
+            site.d_proto = ev.d_proto;
+            site.d_pc = ev.d_pc;
+            site.d_line = ev.d_line;
+            site.d_count++;
+        }
+        break;
+    case TraceEvent::Stop:
+        d_traceStats[d_traceStart.d_proto].d_stopped++;
+        d_traceStarts[ traceKey(d_traceStart.d_proto,d_traceStart.d_pc) ].d_reasons["completed"]++;
+        break;
+    case TraceEvent::Abort:
+        {
+            d_traceStats[d_traceStart.d_proto].d_aborted++;
+            d_traceStarts[ traceKey(d_traceStart.d_proto,d_traceStart.d_pc) ]
+                    .d_reasons[traceReason(ev.d_reason,ev.d_info)]++;
+            TraceSite& site = d_traceAborts[ traceKey(ev.d_proto,ev.d_pc) ];
+            site.d_proto = ev.d_proto;
+            site.d_pc = ev.d_pc;
+            site.d_line = ev.d_line;
+            site.d_count++;
+            site.d_reasons[traceReason(ev.d_reason,ev.d_info)]++;
+        }
+        break;
+    }
+}
+
+QList<Engine2::TraceEvent> Engine2::getTraceEvents() const
+{
+    QList<TraceEvent> res;
+    if( d_traceWrapped )
+    {
+        for( int i = d_traceNext; i < d_traceRing.size(); i++ )
+            res.append( d_traceRing[i] );
+    }
+    for( int i = 0; i < d_traceNext; i++ )
+        res.append( d_traceRing[i] );
+    return res;
+}
+
+static bool moreCount( const Engine2::TraceSite& lhs, const Engine2::TraceSite& rhs )
+{
+    return lhs.d_count > rhs.d_count;
+}
+
+static bool moreStarted( const Engine2::TraceProtoStat& lhs, const Engine2::TraceProtoStat& rhs )
+{
+    return lhs.d_started > rhs.d_started;
+}
+
+static bool lessSite( const Engine2::TraceSite& lhs, const Engine2::TraceSite& rhs )
+{
+    return traceKey(lhs.d_proto,lhs.d_pc) < traceKey(rhs.d_proto,rhs.d_pc);
+}
+
+QList<Engine2::TraceSite> Engine2::getTraceAborts() const
+{
+    QList<TraceSite> res = d_traceAborts.values();
+    std::stable_sort( res.begin(), res.end(), moreCount );
+    return res;
+}
+
+QList<Engine2::TraceProtoStat> Engine2::getTracesPerProto() const
+{
+    QList<TraceProtoStat> res = d_traceStats.values();
+    std::stable_sort( res.begin(), res.end(), moreStarted );
+    return res;
+}
+
+QList<Engine2::TraceSite> Engine2::getBlacklisted() const
+{
+    QList<TraceSite> res = d_traceBlack.values();
+    std::sort( res.begin(), res.end(), lessSite );
+    return res;
+}
+
+QList<Engine2::TraceSite> Engine2::getTraceStarts() const
+{
+    QList<TraceSite> res = d_traceStarts.values();
+    std::stable_sort( res.begin(), res.end(), moreCount );
+    return res;
+}
+
+static bool moreExec( const Engine2::ExecSite& lhs, const Engine2::ExecSite& rhs )
+{
+    return lhs.d_count > rhs.d_count;
+}
+
+QList<Engine2::ExecSite> Engine2::getExecProfile() const
+{
+    QList<ExecSite> res = d_execSites.values();
+    std::stable_sort( res.begin(), res.end(), moreExec );
+    return res;
+}
+
+QByteArray Engine2::formatTraceSite(quint32 proto, quint32 line) const
+{
+    if( proto >= quint32(d_traceProtos.size()) )
+        return "(?)";
+    const TraceProto& p = d_traceProtos[proto];
+    if( p.d_lineDefined < 0 )
+        return "[C]";
+    QByteArray res = p.d_source;
+    if( res.startsWith('@') || res.startsWith('=') )
+        res = QFileInfo( QString::fromUtf8(res.mid(1)) ).fileName().toUtf8();
+    if( line == 0 )
+        line = p.d_lineDefined;
+    if( JitComposer::isRowCol() )
+        return res + ":" + QByteArray::number( JitComposer::unpackRow(line) ) + ":"
+                + QByteArray::number( JitComposer::unpackCol(line) );
     else
-        lua_sethook( d_ctx, aliveSignal, 0, 0);
+        return res + ":" + QByteArray::number(line);
+}
+
+QByteArray Engine2::traceReason(quint16 reason, qint32 info)
+{
+    const int count = sizeof(s_traceErrs) / sizeof(const char*);
+    QByteArray res = reason < count ? s_traceErrs[reason] : "trace error %d";
+    res.replace("%d", QByteArray::number(info) );
+    res.replace("%s", QByteArray::number(info) ); // the id of the fast function
+    return res;
+}
+
+QByteArray Engine2::getTraceReport(int maxRows) const
+{
+    QByteArray res;
+    QList<TraceProtoStat> protos = getTracesPerProto();
+    quint32 started = 0, stopped = 0, aborted = 0;
+    foreach( const TraceProtoStat& s, protos )
+    {
+        started += s.d_started;
+        stopped += s.d_stopped;
+        aborted += s.d_aborted;
+    }
+    res += "JIT traces: " + QByteArray::number(started) + " started, " + QByteArray::number(stopped) +
+            " completed, " + QByteArray::number(aborted) + " aborted\n";
+
+    res += "\nAborts per location:\n";
+    const QList<TraceSite> aborts = getTraceAborts();
+    for( int i = 0; i < aborts.size() && i < maxRows; i++ )
+    {
+        const TraceSite& s = aborts[i];
+        res += "  " + QByteArray::number(s.d_count).rightJustified(6) + "  " + formatTraceSite(s.d_proto,s.d_line);
+        QMap<QByteArray,quint32>::const_iterator j;
+        for( j = s.d_reasons.begin(); j != s.d_reasons.end(); ++j )
+            res += "  " + j.key() + " (" + QByteArray::number(j.value()) + ")";
+        res += "\n";
+    }
+
+    res += "\nTraces per prototype (started, completed, aborted):\n";
+    for( int i = 0; i < protos.size() && i < maxRows; i++ )
+    {
+        const TraceProtoStat& s = protos[i];
+        res += "  " + QByteArray::number(s.d_started).rightJustified(6) +
+                QByteArray::number(s.d_stopped).rightJustified(7) +
+                QByteArray::number(s.d_aborted).rightJustified(7) + "  " + formatTraceSite(s.d_proto,0) + "\n";
+    }
+
+    res += "\nBlacklisted loops:\n";
+    foreach( const TraceSite& s, getBlacklisted() )
+    {
+        res += "  " + formatTraceSite(s.d_proto,s.d_line);
+        if( !s.d_reasons.isEmpty() )
+            res += "  " + s.d_reasons.begin().key();
+        res += "\n";
+    }
+    return res;
+}
+
+bool Engine2::exportTraceEvents(QIODevice* out) const
+{
+    if( out == 0 || !out->isWritable() )
+        return false;
+    out->write("event,trace,parent,exit,source,linedefined,pc,line,reason\n");
+    foreach( const TraceEvent& e, getTraceEvents() )
+    {
+        TraceProto p;
+        if( e.d_type != TraceEvent::Flush && e.d_proto < quint32(d_traceProtos.size()) )
+            p = d_traceProtos[e.d_proto];
+        QByteArray source = p.d_source;
+        source.replace('"', "\"\"");
+        QByteArray line = QByteArray(s_traceTypes[e.d_type]) + "," + QByteArray::number(e.d_trace) + "," +
+                QByteArray::number(e.d_parent) + "," + QByteArray::number(e.d_exit) + ",\"" + source + "\"," +
+                QByteArray::number(p.d_lineDefined) + "," + QByteArray::number(e.d_pc) + "," +
+                QByteArray::number(e.d_line) + ",";
+        if( e.d_type == TraceEvent::Abort )
+            line += "\"" + traceReason(e.d_reason,e.d_info).replace('"', "\"\"") + "\"";
+        line += "\n";
+        if( out->write(line) != line.size() )
+            return false;
+    }
+    return true;
 }
 
 void Engine2::setDebugMode(Engine2::Mode m)
@@ -975,24 +1875,25 @@ void Engine2::runToNextLine(DebugCommand where)
 {
     Q_ASSERT( where == StepNext || where == StepOver || where == StepOut );
     d_stepBreak = Break();
+    d_stepDepth = 0;
     if( where == StepOver || where == StepOut )
     {
         StackLevel l = getStackLevel(0,false);
         if( l.d_inC )
         {
-            // an FFI C call apparently never issues a LUA_HOOKLINE or LUA_HOOKRET (but a LUA_HOOKCALL)
+            // an FFI C call apparently never issues a LUA_HOOKLINE
             where = StepNext;
         }else
         {
-            // remember in which function StepOver or StepOut were called
+            // remember in which function and at which depth StepOver or StepOut were called
             d_stepBreak.first = l.d_source;
             d_stepBreak.second = l.d_lineDefined;
-            d_stepCurRowCol = d_curRowCol;
+            d_stepDepth = stackDepth( d_ctx );
+            d_stepPos = Break( d_curScript, lineForBreak() );
         }
     }
     d_dbgCmd = where;
     d_waitForCommand = false;
-    d_stepCallDepth = 0;
 }
 
 void Engine2::runToBreakPoint()
@@ -1091,6 +1992,8 @@ void Engine2::addBreak(const QByteArray &s, quint32 l)
 void Engine2::removeBreak(const QByteArray & s, quint32 l)
 {
 	d_breaks[s].remove( l );
+    if( d_conds.value( s ).contains( l ) )
+        setBreakCondition( s, l, QByteArray() );
     notify( BreakPoints, s );
 }
 
@@ -1118,6 +2021,181 @@ const Engine2::Breaks& Engine2::getBreaks(const QByteArray & s) const
         return (*i);
 }
 
+void Engine2::setBreakCondition(const QByteArray& s, quint32 l, const QByteArray& expr, quint32 hitCount)
+{
+    const QByteArray e = expr.trimmed();
+    QHash<QByteArray,BreakConds>::iterator i = d_conds.find( s );
+    if( i == d_conds.end() )
+    {
+        if( e.isEmpty() && hitCount <= 1 )
+            return;
+        i = d_conds.insert( s, BreakConds() );
+    }
+    BreakCond& c = i.value()[l];
+    if( c.d_expr != e )
+    {
+        if( c.d_ref > 0 && d_ctx )
+            luaL_unref( d_ctx, LUA_REGISTRYINDEX, c.d_ref );
+        c.d_ref = 0;
+        c.d_expr = e;
+    }
+    c.d_hitCount = hitCount;
+    c.d_hits = 0;
+    if( e.isEmpty() && hitCount <= 1 )
+    {
+        i.value().remove( l );
+        if( i.value().isEmpty() )
+            d_conds.erase( i );
+    }
+    notify( BreakPoints, s );
+}
+
+Engine2::BreakCond Engine2::getBreakCondition(const QByteArray& s, quint32 l) const
+{
+    return d_conds.value( s ).value( l );
+}
+
+bool Engine2::checkBreakCondition(quint32 line)
+{
+    QHash<QByteArray,BreakConds>::iterator i = d_conds.find( d_curScript );
+    if( i == d_conds.end() )
+        return true;
+    BreakConds::iterator j = i.value().find( line );
+    if( j == i.value().end() )
+        return true;
+    BreakCond& c = j.value();
+    if( !c.d_expr.isEmpty() )
+    {
+        if( c.d_ref == 0 )
+        {
+            QByteArray err;
+            c.d_ref = compileExpr( c.d_expr, "=condition", &err );
+            if( c.d_ref < 0 )
+                error( "invalid break condition " + c.d_expr + ": " + err ); // stop each time then
+        }
+        if( c.d_ref > 0 && pushFrameEnv( 0 ) )
+        {
+            // Stack: env
+            lua_rawgeti( d_ctx, LUA_REGISTRYINDEX, c.d_ref );
+            lua_pushvalue( d_ctx, -2 );
+            lua_setfenv( d_ctx, -2 );
+            // Stack: env, expr
+            if( lua_pcall( d_ctx, 0, 1, 0 ) != 0 )
+            {
+                error( "break condition " + c.d_expr + ": " + QByteArray(lua_tostring( d_ctx, -1 )) );
+                lua_pop( d_ctx, 2 ); // env, message
+                return true;
+            }
+            const bool res = lua_toboolean( d_ctx, -1 );
+            lua_pop( d_ctx, 2 ); // env, result
+            if( !res )
+                return false;
+        }
+    }
+    c.d_hits++;
+    return c.d_hits >= c.d_hitCount;
+}
+
+int Engine2::compileExpr(const QByteArray& expr, const char* name, QByteArray* error)
+{
+    const QByteArray source = "return " + expr;
+    if( luaL_loadbuffer( d_ctx, source, source.size(), name ) != 0 )
+    {
+        if( error )
+            *error = lua_tostring( d_ctx, -1 );
+        lua_pop( d_ctx, 1 );
+        return -1;
+    }
+    return luaL_ref( d_ctx, LUA_REGISTRYINDEX );
+}
+
+bool Engine2::pushFrameEnv(int level)
+{
+    // Pushes the env table shared by all conditions and watches; it stays empty and resolves each name
+    // on demand in frameIndex, so a break hit doesn't copy the locals and upvalues of the frame.
+    lua_Debug ar;
+    if( !lua_getstack( d_ctx, level, &ar ) )
+        return false;
+    d_envLevel = level;
+    d_envDepth = stackDepth( d_ctx );
+    if( d_envRef == LUA_NOREF )
+    {
+        lua_newtable( d_ctx );
+        lua_createtable( d_ctx, 0, 1 );
+        lua_pushlightuserdata( d_ctx, this );
+        lua_pushcclosure( d_ctx, frameIndex, 1 );
+        lua_setfield( d_ctx, -2, "__index" );
+        lua_setmetatable( d_ctx, -2 );
+        d_envRef = luaL_ref( d_ctx, LUA_REGISTRYINDEX );
+    }
+    lua_rawgeti( d_ctx, LUA_REGISTRYINDEX, d_envRef );
+    return true;
+}
+
+int Engine2::frameIndex(lua_State* L)
+{
+    // Stack: env, key; locals shadow upvalues which shadow the environment of the function
+    Engine2* e = static_cast<Engine2*>( lua_touserdata( L, lua_upvalueindex(1) ) );
+    lua_Debug ar;
+    // the frame of pushFrameEnv is now deeper by the expression and this function
+    if( !lua_getstack( L, stackDepth( L ) - e->d_envDepth + e->d_envLevel, &ar ) )
+        return 0;
+    const char* key = lua_type( L, 2 ) == LUA_TSTRING ? lua_tostring( L, 2 ) : 0;
+    if( key )
+    {
+        int found = 0;
+        int n = 1;
+        while( const char* name = lua_getlocal( L, &ar, n ) )
+        {
+            lua_pop( L, 1 );
+            if( ::strcmp( name, key ) == 0 )
+                found = n; // the last one is the innermost
+            n++;
+        }
+        if( found )
+        {
+            lua_getlocal( L, &ar, found );
+            return 1;
+        }
+    }
+    if( lua_getinfo( L, "f", &ar ) == 0 )
+        return 0;
+    const int f = lua_gettop(L);
+    if( key )
+    {
+        int n = 1;
+        while( const char* name = lua_getupvalue( L, f, n++ ) )
+        {
+            if( ::strcmp( name, key ) == 0 )
+                return 1;
+            lua_pop( L, 1 );
+        }
+    }
+    lua_getfenv( L, f );
+    lua_pushvalue( L, 2 );
+    lua_gettable( L, -2 );
+    return 1;
+}
+
+void Engine2::releaseConditions()
+{
+    QHash<QByteArray,BreakConds>::iterator i;
+    for( i = d_conds.begin(); i != d_conds.end(); ++i )
+    {
+        BreakConds::iterator j;
+        for( j = i.value().begin(); j != i.value().end(); ++j )
+        {
+            if( j.value().d_ref > 0 )
+                luaL_unref( d_ctx, LUA_REGISTRYINDEX, j.value().d_ref );
+            j.value().d_ref = 0;
+        }
+    }
+    QHash<QByteArray,int>::const_iterator k;
+    for( k = d_watches.begin(); k != d_watches.end(); ++k )
+        luaL_unref( d_ctx, LUA_REGISTRYINDEX, k.value() );
+    d_watches.clear();
+}
+
 Engine2::StackLevels Engine2::getStackTrace() const
 {
     StackLevels ls;
@@ -1221,6 +2299,11 @@ Engine2::StackLevel Engine2::getStackLevel(lua_State *L, quint16 level, bool wit
     return l;
 }
 
+static QByteArray _toHex(const void *p)
+{
+    return "0x" + QByteArray::number((quintptr)p, 16 ); // table, thread, function, userdata
+}
+
 static bool sortLocals( const Lua::Engine2::LocalVar& lhs, const Lua::Engine2::LocalVar& rhs )
 {
     return lhs.d_name.toLower() < rhs.d_name.toLower();
@@ -1317,20 +2400,249 @@ Engine2::LocalVars Engine2::getLocalVars(bool includeUpvals, quint8 resolveTable
     return ls;
 }
 
+static bool sortLazy( const Lua::Engine2::LazyVar& lhs, const Lua::Engine2::LazyVar& rhs )
+{
+    return lhs.d_name.toLower() < rhs.d_name.toLower();
+}
+
+Engine2::LazyVars Engine2::getLazyLocals(bool includeUpvals, bool includeTemps)
+{
+    LazyVars ls;
+    releaseUnusedHandles();
+
+    lua_Debug ar;
+    if( !lua_getstack( d_ctx, d_activeLevel, &ar ) )
+        return LazyVars();
+    int n = 1;
+    while( const char* name = lua_getlocal( d_ctx, &ar, n) )
+    {
+        const QByteArray str = name;
+        if( !str.startsWith('(') && !str.isEmpty() )
+        {
+            LazyVar v = getLazyVar( lua_gettop(d_ctx) );
+            v.d_name = str;
+            ls << v;
+        }else if( includeTemps || str.isEmpty() )
+        {
+            LazyVar v = getLazyVar( lua_gettop(d_ctx) );
+            v.d_name = "[" + QByteArray::number(n-1) + "]";
+            ls << v;
+        }
+        lua_pop( d_ctx, 1 );
+        n++;
+    }
+
+    if( includeUpvals && lua_getinfo( d_ctx, "f", &ar ) != 0 )
+    {
+        const int f = lua_gettop(d_ctx);
+
+        int n = 1;
+        while( const char* name = lua_getupvalue( d_ctx, f, n) )
+        {
+            const QByteArray str = name;
+            if( !str.startsWith('(') && !str.isEmpty() )
+            {
+                LazyVar v = getLazyVar( lua_gettop(d_ctx) );
+                v.d_name = str;
+                v.d_isUv = true;
+                ls << v;
+            }else if( includeTemps || str.isEmpty() )
+            {
+                LazyVar v = getLazyVar( lua_gettop(d_ctx) );
+                v.d_name = "(" + QByteArray::number(n-1) + ")";
+                v.d_isUv = true;
+                ls << v;
+            }
+            lua_pop( d_ctx, 1 );
+            n++;
+        }
+        lua_pop( d_ctx, 1 ); // fuction
+    }
+
+    std::sort( ls.begin(), ls.end(), sortLazy );
+
+    return ls;
+}
+
+Engine2::LazyVars Engine2::getChildren(quint32 handle, int from, int count, bool* more)
+{
+    // lua_next has no random access, so a page costs from + count steps; still much cheaper than
+    // converting the whole table with getValue.
+    LazyVars res;
+    if( more )
+        *more = false;
+    const int ref = d_handleRefs.value( handle, LUA_NOREF );
+    if( ref == LUA_NOREF )
+        return res; // released meanwhile
+    lua_rawgeti( d_ctx, LUA_REGISTRYINDEX, ref );
+    if( !lua_istable( d_ctx, -1 ) )
+    {
+        lua_pop( d_ctx, 1 );
+        return res;
+    }
+    const int t = lua_gettop(d_ctx);
+    int i = 0;
+    lua_pushnil(d_ctx);  /* first key */
+    while( lua_next(d_ctx, t) != 0 )
+    {
+        if( i >= from + count )
+        {
+            if( more )
+                *more = true;
+            lua_pop( d_ctx, 2 ); // key and value
+            break;
+        }
+        if( i >= from )
+        {
+            const int top = lua_gettop(d_ctx);
+            LazyVar v = getLazyVar( top );
+            // don't call lua_tolstring on a key which is not a string; see getValue
+            switch( lua_type( d_ctx, top - 1 ) )
+            {
+            case LUA_TNUMBER:
+                v.d_name = QByteArray::number( lua_tonumber( d_ctx, top - 1 ), 'g', 17 );
+                break;
+            case LUA_TSTRING:
+                v.d_name = lua_tostring( d_ctx, top - 1 );
+                break;
+            default:
+                v.d_name = "<" + getTypeName( top - 1 ) + " " + _toHex( lua_topointer( d_ctx, top - 1 ) ) + ">";
+                break;
+            }
+            res << v;
+        }
+        lua_pop(d_ctx, 1);
+        i++;
+    }
+    lua_pop( d_ctx, 1 ); // table
+    return res;
+}
+
+void Engine2::releaseHandles()
+{
+    QHash<const void*,Handle>::const_iterator i;
+    for( i = d_handles.begin(); i != d_handles.end(); ++i )
+        luaL_unref( d_ctx, LUA_REGISTRYINDEX, i.value().d_ref );
+    d_handles.clear();
+    d_handleRefs.clear();
+    d_usedHandles.clear();
+}
+
+void Engine2::releaseUnusedHandles()
+{
+    QHash<const void*,Handle>::iterator i = d_handles.begin();
+    while( i != d_handles.end() )
+    {
+        if( d_usedHandles.contains(i.key()) )
+            ++i;
+        else
+        {
+            luaL_unref( d_ctx, LUA_REGISTRYINDEX, i.value().d_ref );
+            d_handleRefs.remove( i.value().d_id );
+            i = d_handles.erase(i);
+        }
+    }
+    d_usedHandles.clear();
+}
+
+Engine2::LazyVar Engine2::getLazyVar(int arg)
+{
+    LazyVar v;
+    const int t = lua_type( d_ctx, arg );
+    v.d_type = luaToValType( t );
+    v.d_value = getValue( arg, 0, 0 );
+    if( t == LUA_TTABLE )
+    {
+        v.d_handle = getHandle( arg );
+        v.d_len = lua_objlen( d_ctx, arg );
+    }
+    return v;
+}
+
+quint32 Engine2::getHandle(int arg)
+{
+    // the id is never reused, unlike the registry ref and the address of a collected table, so the same
+    // handle means the same table
+    const void* p = lua_topointer( d_ctx, arg );
+    d_usedHandles.insert(p);
+    QHash<const void*,Handle>::const_iterator i = d_handles.find(p);
+    if( i != d_handles.end() )
+        return i.value().d_id;
+    lua_pushvalue( d_ctx, arg );
+    Handle h;
+    h.d_ref = luaL_ref( d_ctx, LUA_REGISTRYINDEX );
+    h.d_id = ++d_lastHandle;
+    d_handles[p] = h;
+    d_handleRefs[h.d_id] = h.d_ref;
+    return h.d_id;
+}
+
+Engine2::LazyVars Engine2::evalWatches(const QByteArrayList& exprs)
+{
+    LazyVars res;
+    if( exprs.isEmpty() )
+        return res;
+    const bool inFrame = pushFrameEnv( d_activeLevel );
+    foreach( const QByteArray& expr, exprs )
+    {
+        LazyVar v;
+        QByteArray err;
+        int ref = d_watches.value( expr );
+        if( ref == 0 )
+        {
+            ref = compileExpr( expr, "=watch", &err );
+            if( ref > 0 )
+                d_watches[expr] = ref;
+        }
+        if( ref > 0 && inFrame )
+        {
+            lua_rawgeti( d_ctx, LUA_REGISTRYINDEX, ref );
+            lua_pushvalue( d_ctx, -2 );
+            lua_setfenv( d_ctx, -2 );
+            if( lua_pcall( d_ctx, 0, 1, 0 ) == 0 )
+                v = getLazyVar( lua_gettop(d_ctx) );
+            else
+                err = lua_tostring( d_ctx, -1 );
+            lua_pop( d_ctx, 1 ); // result or message
+        }else if( ref > 0 )
+            err = "not available";
+        if( !err.isEmpty() )
+        {
+            v.d_value = err;
+            v.d_type = LocalVar::UNKNOWN;
+        }
+        v.d_name = expr;
+        res << v;
+    }
+    if( inFrame )
+        lua_pop( d_ctx, 1 ); // env
+    return res;
+}
+
 void Engine2::removeAllBreaks(const QByteArray &s)
 {
+    // the conditions are released even if there are no breaks left, otherwise they reappear on new ones
 	if( s.isNull() )
 	{
-		if( d_breaks.empty() )
-			return;
+        const bool hadBreaks = !d_breaks.empty();
 		d_breaks.clear();
-		notify( BreakPoints );
+        releaseConditions();
+        d_conds.clear();
+        if( hadBreaks )
+            notify( BreakPoints );
 	}else
 	{
-		if( d_breaks[s].empty() )
-			return;
-		d_breaks[s].clear();
-		notify( BreakPoints, s );
+        const bool hadBreaks = !d_breaks.value( s ).empty();
+        d_breaks.remove( s );
+        const BreakConds conds = d_conds.take( s );
+        BreakConds::const_iterator i;
+        for( i = conds.begin(); i != conds.end(); ++i )
+        {
+            if( i.value().d_ref > 0 )
+                luaL_unref( d_ctx, LUA_REGISTRYINDEX, i.value().d_ref );
+        }
+        if( hadBreaks )
+            notify( BreakPoints, s );
 	}
 }
 
@@ -1403,11 +2715,6 @@ QByteArray Engine2::getTypeName(int arg) const
     return "<unknown>";
 }
 
-static QByteArray _toHex(const void *p)
-{
-    return "0x" + QByteArray::number((quintptr)p, 16 ); // table, thread, function, userdata
-}
-
 QByteArray Engine2::getValueString(int arg, bool showAddress ) const
 {
     switch( lua_type( d_ctx, arg ) )
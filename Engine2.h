@@ -26,6 +26,11 @@
 #include <QSet>
 #include <QMap>
 #include <QVariant>
+#include <QHash>
+#include <QTime>
+#include <QVector>
+
+class QIODevice;
 
 typedef struct lua_State lua_State;
 typedef struct lua_Debug lua_Debug;
@@ -59,6 +64,12 @@ namespace Lua
 		void addLibrary( Lib );
 		void addStdLibs();
         void setPrintToStdout(bool on) { d_printToStdout = on; }
+        // Runs the state on a size class pool owned by this engine (not by the thread, so that restart()
+        // can drop the blocks of its own state in bulk); takes effect with the next restart(). LuaJIT on
+        // 64 bit without GC64 rejects custom allocators; restart() then reports an Error message and
+        // continues with the default allocator, see usesPoolAllocator().
+        void setPoolAllocator(bool on) { d_usePool = on; }
+        bool usesPoolAllocator() const { return d_pool != 0; }
         bool restart();
 
         typedef QSet<quint32> Breaks;
@@ -85,6 +96,7 @@ namespace Lua
         void setDefaultCmd( DebugCommand c ) { d_defaultDbgCmd = c; }
         DebugCommand getDefaultCmd() const { return d_defaultDbgCmd; }
         void terminate(bool silent = false);
+        void interrupt(); // calls DbgShell::handleAliveSignal asap; can be called from any thread
         DebugCommand getCmd() const { return d_dbgCmd; }
         quint32 getCurRowCol() const { return d_curRowCol; }
         bool isStepping() const { return d_dbgCmd == StepNext || d_dbgCmd == StepOver || d_dbgCmd == StepOut; }
@@ -98,6 +110,20 @@ namespace Lua
         static QPair<quint32,quint16> unpackDeflinePc(quint32);
         void addBreak( const QByteArray&, quint32 l); // l is plain line numer, packed row/col, or packed defline/pc
         const Breaks& getBreaks( const QByteArray & ) const;
+        const BreaksPerScript& getAllBreaks() const { return d_breaks; }
+        // A break with a condition only stops if the Lua expression evaluates to true in the scope of
+        // the stopped function (locals, upvalues, then globals), and only from the hitCount-th time on.
+        // The expression is compiled on first use and cached with the break.
+        struct BreakCond
+        {
+            QByteArray d_expr; // empty: no condition
+            quint32 d_hitCount; // 0 or 1: stop each time
+            quint32 d_hits; // since the script was started
+            int d_ref; // registry ref of the compiled d_expr; 0 not yet compiled, -1 syntax error
+            BreakCond():d_hitCount(0),d_hits(0),d_ref(0){}
+        };
+        void setBreakCondition( const QByteArray&, quint32 l, const QByteArray& expr, quint32 hitCount = 0 );
+        BreakCond getBreakCondition( const QByteArray&, quint32 l ) const;
 		const QByteArray& getCurBinary() const { return d_curBinary; }
         struct StackLevel
         {
@@ -136,10 +162,125 @@ namespace Lua
         LocalVars getLocalVars(bool includeUpvals = true, quint8 resolveTableToLevel = 0,
                                int maxArrayIndex = 10, bool includeTemps = false) const;
 
+        // Lazy inspection: tables are not resolved but referenced by a handle which can be expanded page
+        // by page with getChildren. The same table always gets the same handle while it is reached on
+        // each refresh, and a handle is never given to another table; getLazyLocals releases the handles
+        // which were not used since the previous call, so tables of left frames are no longer kept alive.
+        struct LazyVar
+        {
+            QByteArray d_name; // local or upvalue name, or the key in case of a table child
+            QVariant d_value; // like LocalVar::d_value with resolveTableToLevel 0
+            quint32 d_handle; // != 0 for tables
+            quint32 d_len; // length of the array part of tables
+            quint8 d_type; // LocalVar::Type
+            bool d_isUv;
+            LazyVar():d_handle(0),d_len(0),d_type(LocalVar::NIL),d_isUv(false){}
+        };
+        typedef QList<LazyVar> LazyVars;
+        LazyVars getLazyLocals(bool includeUpvals = true, bool includeTemps = false);
+        LazyVars getChildren(quint32 handle, int from, int count, bool* more = 0);
+        void releaseHandles();
+        // Evaluates all expressions in the scope of the active level at once; the result has one entry
+        // per expression with d_name set to the expression; a failing expression has its error message
+        // as value and type UNKNOWN.
+        LazyVars evalWatches( const QByteArrayList& );
+
 		static Engine2* getInst();
 		static void setInst( Engine2* );
 		void collect();
 
+        // Memory profiling
+        enum { MemSizeClasses = 16 }; // class 0: <= 16 bytes, class n: <= 16 << n, last class: everything above
+        struct MemSnapshot
+        {
+            qint64 d_current; // bytes currently allocated by the Lua state
+            qint64 d_peak; // highest d_current seen so far
+            qint64 d_allocs; // number of allocations, each (re)allocation to a new size counts as one
+            qint64 d_frees;
+            qint64 d_bytes[MemSizeClasses]; // allocated bytes per size class
+            qint64 d_counts[MemSizeClasses]; // allocations per size class
+            QHash<QByteArray,qint64> d_sites; // "source:line" -> allocated bytes, sampled estimate
+            quint32 d_time; // ms since profiling started; in a diff the ms between the two snapshots
+            MemSnapshot();
+            MemSnapshot operator-( const MemSnapshot& older ) const; // d_peak of result is from this
+            static int sizeClass( quint64 bytes );
+            static quint32 classLimit( int cls ); // 0 for the last, unbounded class
+        };
+        void setMemProfiling( bool on ); // wraps the allocator of the current and all restarted states
+        bool isMemProfiling() const { return d_memProf; }
+        void setMemSampling( quint32 bytes ); // attribute allocations every n bytes; 0 switches attribution off
+        quint32 getMemSampling() const { return d_memSampleRate; }
+        MemSnapshot getMemSnapshot() const;
+        void resetMemProfile();
+
+        // JIT trace collection; the events of jit.attach("trace") are recorded in a ring buffer and
+        // aggregated per site. Only query while the engine is not executing.
+        struct TraceEvent
+        {
+            enum Type { Start, Stop, Abort, Flush };
+            quint32 d_proto; // index in getTraceProtos; position of the event
+            quint32 d_line; // at d_pc as reported by jit.util.funcinfo; 0 if unknown
+            quint16 d_pc;
+            quint16 d_trace;
+            quint16 d_parent; // Start: parent trace of a side trace, 0 for a root trace
+            quint16 d_exit; // Start: exit of the parent trace
+            quint16 d_reason; // Abort: LJ_TRERR_* code, see traceReason
+            qint32 d_info; // Abort: number argument of the reason
+            quint8 d_type;
+            TraceEvent():d_proto(0),d_line(0),d_pc(0),d_trace(0),d_parent(0),d_exit(0),d_reason(0),d_info(0),d_type(Flush){}
+        };
+        struct TraceProto
+        {
+            QByteArray d_source;
+            qint32 d_lineDefined; // -1 for C functions
+            TraceProto(const QByteArray& s = QByteArray(), qint32 l = 0):d_source(s),d_lineDefined(l){}
+        };
+        struct TraceSite
+        {
+            quint32 d_proto;
+            quint16 d_pc;
+            quint32 d_line;
+            quint32 d_count;
+            QMap<QByteArray,quint32> d_reasons; // traceReason -> count
+            TraceSite():d_proto(0),d_pc(0),d_line(0),d_count(0){}
+        };
+        struct TraceProtoStat
+        {
+            quint32 d_proto;
+            quint32 d_started, d_stopped, d_aborted; // by start position
+            TraceProtoStat():d_proto(0),d_started(0),d_stopped(0),d_aborted(0){}
+        };
+        void setTraceCollecting( bool on ); // loads the jit library if necessary; survives restart()
+        bool isTraceCollecting() const { return d_traceOn; }
+        void setTraceCapacity( int events ); // default 64k
+        void resetTraces();
+        QList<TraceEvent> getTraceEvents() const; // oldest first
+        const QList<TraceProto>& getTraceProtos() const { return d_traceProtos; }
+        QList<TraceSite> getTraceAborts() const; // per abort position, most frequent first
+        QList<TraceProtoStat> getTracesPerProto() const; // most started first
+        QList<TraceSite> getBlacklisted() const; // loops LuaJIT no longer tries to trace
+        QList<TraceSite> getTraceStarts() const; // per start position; d_reasons counts "completed" or the abort reason
+        QByteArray formatTraceSite( quint32 proto, quint32 line ) const;
+        static QByteArray traceReason( quint16 reason, qint32 info = 0 );
+        QByteArray getTraceReport( int maxRows = 50 ) const;
+        bool exportTraceEvents( QIODevice* ) const; // CSV
+
+        // Execution profile; a count hook samples the current pc every few instructions. Compiled traces
+        // don't call hooks, so the counts show where the interpreter spends its time, i.e. hot code which
+        // didn't get compiled. Not sampled while debugging or with the alive signal on.
+        struct ExecSite
+        {
+            quint32 d_proto; // index in getTraceProtos
+            quint16 d_pc; // one-based as in TraceSite
+            quint32 d_line;
+            quint32 d_count;
+            ExecSite():d_proto(0),d_pc(0),d_line(0),d_count(0){}
+        };
+        void setExecProfiling( bool on ); // survives restart()
+        bool isExecProfiling() const { return d_execProf; }
+        void resetExecProfile();
+        QList<ExecSite> getExecProfile() const; // most frequent first
+
         lua_State* getCtx() const { return d_ctx; }
         int getActiveLevel() const { return d_activeLevel; }
         void setActiveLevel(int level );
@@ -213,7 +354,28 @@ namespace Lua
     private:
         static StackLevel getStackLevel(lua_State *L, quint16 level, bool withValidLines, bool bytecodeMode, lua_Debug* ar);
         static void debugHook(lua_State *L, lua_Debug *ar);
+        static int stackDepth(lua_State *L);
+        static int compareDepth(lua_State *L, int depth); // <0 shallower, 0 same, >0 deeper
+        static bool isStepFrame(lua_State *L, const Break&);
+        bool breakWhileStepping(lua_State *L, lua_Debug *ar);
         static void aliveSignal(lua_State *L, lua_Debug *ar);
+        static void profileHook(lua_State *L, lua_Debug *ar);
+        static void interruptHook(lua_State *L, lua_Debug *ar);
+        void installHook();
+        static void* memAlloc(void *ud, void *ptr, size_t osize, size_t nsize);
+        void sampleMem(lua_State *L);
+        void sampleExec(lua_State *L);
+        void installMemProfiler();
+        static int atPanic(lua_State *L);
+        LazyVar getLazyVar(int arg);
+        quint32 getHandle(int arg);
+        void releaseUnusedHandles();
+        bool checkBreakCondition( quint32 line );
+        int compileExpr( const QByteArray& expr, const char* name, QByteArray* error );
+        bool pushFrameEnv( int level );
+        static int frameIndex(lua_State *L);
+        void releaseConditions();
+        class MemPool;
         static int ErrHandler( lua_State* L );
         void notifyStart();
         void notifyEnd();
@@ -222,13 +384,28 @@ namespace Lua
         static int _writeStderr(lua_State *L);
         static int _writeImp(lua_State *L, bool err);
         static int _prettyTraceLoc(lua_State *L);
+        static int traceEvent(lua_State *L);
+        void installTraceCollector();
+        void removeTraceCollector();
+        quint32 traceProto(lua_State *L, int func);
+        struct ProtoRef
+        {
+            quint32 d_index; // in d_traceProtos
+            const void* d_chunk; // chunkname and firstline of the prototype when interned
+            qint32 d_line;
+        };
+        void addTraceEvent( const TraceEvent& );
 
 		BreaksPerScript d_breaks;
+        typedef QHash<quint32,BreakCond> BreakConds;
+        QHash<QByteArray,BreakConds> d_conds; // filename -> line -> condition
+        QHash<QByteArray,int> d_watches; // expression -> registry ref
         Break d_stepBreak;
-        int d_stepCallDepth;
+        int d_stepDepth; // number of stack levels when StepOver or StepOut was called
+        Break d_stepPos; // script and lineForBreak of the last event skipped by StepOver or StepOut
         QByteArray d_curScript;
 		QByteArray d_curBinary;
-        quint32 d_curRowCol, d_stepCurRowCol; // packDeflinePc in case of PcMode, RowCol otherwise
+        quint32 d_curRowCol; // packDeflinePc in case of PcMode, RowCol otherwise
 		lua_State* d_ctx;
         int d_activeLevel;
 		QByteArray d_lastError;
@@ -244,7 +421,44 @@ namespace Lua
         bool d_waitForCommand;
         bool d_printToStdout;
         quint8 d_mode; // default source line mode
-        bool d_stepOverSync;
+        MemSnapshot d_mem;
+        typedef void* (*AllocFunc)(void *ud, void *ptr, size_t osize, size_t nsize); // same as lua_Alloc
+        AllocFunc d_allocf; // allocator of the state before installMemProfiler
+        void* d_allocUd;
+        quint32 d_memSampleRate;
+        qint64 d_memPending; // bytes allocated since last attribution
+        QTime d_memStart;
+        bool d_memProf;
+        bool d_memSampleDue;
+        MemPool* d_pool;
+        struct Handle
+        {
+            quint32 d_id; // what getLazyVar returns
+            int d_ref; // registry ref which keeps the table alive
+        };
+        QHash<const void*,Handle> d_handles; // table -> handle
+        QHash<quint32,int> d_handleRefs; // handle id -> registry ref
+        quint32 d_lastHandle;
+        QSet<const void*> d_usedHandles; // since the last getLazyLocals
+        bool d_usePool;
+        QVector<TraceEvent> d_traceRing;
+        int d_traceNext; // ring position of the next event
+        bool d_traceWrapped;
+        QList<TraceProto> d_traceProtos;
+        QHash<const void*,ProtoRef> d_traceProtoIndex; // GCproto, or 0 for C functions
+        QHash<quint64,TraceSite> d_traceAborts; // proto << 16 | pc
+        QHash<quint64,TraceSite> d_traceBlack;
+        QHash<quint64,TraceSite> d_traceStarts;
+        QHash<quint32,TraceProtoStat> d_traceStats;
+        TraceEvent d_traceStart; // of the trace currently recorded
+        int d_traceRef; // registry ref of the attached handler
+        int d_traceStartFunc; // registry ref of the function of d_traceStart
+        bool d_traceOn;
+        QHash<quint64,ExecSite> d_execSites; // proto << 16 | pc
+        bool d_execProf;
+        int d_envRef; // registry ref of the table pushed by pushFrameEnv
+        int d_envLevel;
+        int d_envDepth; // stackDepth when pushFrameEnv was called
 	};
 }
 
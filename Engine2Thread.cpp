@@ -0,0 +1,368 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "Engine2Thread.h"
+#include <QMutexLocker>
+using namespace Lua;
+
+Engine2Thread::Engine2Thread(Engine2* lua, QObject* parent):QThread(parent),d_lua(lua),
+    d_curLine(0),d_busy(false),d_waiting(false),d_failed(false),d_withTemps(false)
+{
+    Q_ASSERT( lua != 0 );
+    qRegisterMetaType<Lua::Engine2Thread::Snapshot>();
+    syncState();
+    start();
+}
+
+Engine2Thread::~Engine2Thread()
+{
+    d_lock.lock();
+    d_jobs.clear();
+    d_jobs.append( Job(Quit) );
+    d_cmds.append( Command(Run,Engine2::AbortSilently) );
+    d_wake.wakeAll();
+    const bool running = d_busy && !d_waiting;
+    d_lock.unlock();
+    if( running )
+        d_lua->interrupt();
+    wait();
+}
+
+void Engine2Thread::executeCmd(const QByteArray& source, const QByteArray& name, bool skipAfterError)
+{
+    QMutexLocker l(&d_lock);
+    d_jobs.append( Job(RunCmd,source,name,skipAfterError) );
+    d_busy = true;
+    d_wake.wakeAll();
+}
+
+void Engine2Thread::executeFile(const QByteArray& path)
+{
+    QMutexLocker l(&d_lock);
+    d_jobs.append( Job(RunFile,path) );
+    d_busy = true;
+    d_wake.wakeAll();
+}
+
+bool Engine2Thread::isBusy() const
+{
+    QMutexLocker l(&d_lock);
+    return d_busy;
+}
+
+bool Engine2Thread::isWaiting() const
+{
+    QMutexLocker l(&d_lock);
+    return d_waiting;
+}
+
+Engine2::Breaks Engine2Thread::getBreaks(const QByteArray& source) const
+{
+    QMutexLocker l(&d_lock);
+    return d_breaks.value(source);
+}
+
+Engine2::BreakCond Engine2Thread::getBreakCondition(const QByteArray& source, quint32 line) const
+{
+    QMutexLocker l(&d_lock);
+    return d_conds.value( Engine2::Break(source,line) );
+}
+
+void Engine2Thread::syncState()
+{
+    QMutexLocker l(&d_lock);
+    Q_ASSERT( !d_busy );
+    d_debug.store( d_lua->isDebug() );
+    d_breaks = d_lua->getAllBreaks();
+    d_conds.clear();
+    Engine2::BreaksPerScript::const_iterator i;
+    for( i = d_breaks.begin(); i != d_breaks.end(); ++i )
+    {
+        foreach( quint32 line, i.value() )
+        {
+            const Engine2::BreakCond c = d_lua->getBreakCondition( i.key(), line );
+            if( !c.d_expr.isEmpty() || c.d_hitCount > 1 )
+                d_conds[ Engine2::Break(i.key(),line) ] = c;
+        }
+    }
+}
+
+void Engine2Thread::runToNextLine(Engine2::DebugCommand where)
+{
+    if( where == Engine2::StepNext || where == Engine2::StepOver || where == Engine2::StepOut )
+        d_debug.store(true); // applyCommands switches it on if necessary
+    post( Command(Run,where) );
+}
+
+void Engine2Thread::runToBreakPoint()
+{
+    post( Command(Run,Engine2::RunToBreakPoint) );
+}
+
+void Engine2Thread::terminate(bool silent)
+{
+    d_lock.lock();
+    d_jobs.clear();
+    d_lock.unlock();
+    post( Command(Run, silent ? Engine2::AbortSilently : Engine2::Abort ) );
+}
+
+void Engine2Thread::setActiveLevel(int level)
+{
+    post( Command(SelectLevel,level) );
+}
+
+void Engine2Thread::setDebug(bool on)
+{
+    d_debug.store(on);
+    post( Command(Debug,on) );
+}
+
+void Engine2Thread::addBreak(const QByteArray& source, quint32 line)
+{
+    d_lock.lock();
+    d_breaks[source].insert(line);
+    d_lock.unlock();
+    post( Command(AddBreak,line,source) );
+}
+
+void Engine2Thread::removeBreak(const QByteArray& source, quint32 line)
+{
+    d_lock.lock();
+    d_breaks[source].remove(line);
+    d_conds.remove( Engine2::Break(source,line) );
+    d_lock.unlock();
+    post( Command(RemoveBreak,line,source) );
+}
+
+void Engine2Thread::setBreakCondition(const QByteArray& source, quint32 line, const QByteArray& expr, quint32 hitCount)
+{
+    d_lock.lock();
+    Engine2::BreakCond& mirror = d_conds[ Engine2::Break(source,line) ];
+    mirror.d_expr = expr;
+    mirror.d_hitCount = hitCount;
+    d_lock.unlock();
+    Command c(SetCondition,line,source);
+    c.d_expr = expr;
+    c.d_count = hitCount;
+    post( c );
+}
+
+void Engine2Thread::setWatches(const QByteArrayList& watches)
+{
+    QMutexLocker l(&d_lock);
+    d_watches = watches;
+}
+
+void Engine2Thread::setDefaultCmd(Engine2::DebugCommand cmd)
+{
+    post( Command(DefaultCmd,cmd) );
+}
+
+void Engine2Thread::run()
+{
+    forever
+    {
+        d_lock.lock();
+        while( d_jobs.isEmpty() && d_cmds.isEmpty() )
+            d_wake.wait(&d_lock);
+        Job job(RunCmd);
+        const bool hasJob = !d_jobs.isEmpty();
+        if( hasJob )
+            job = d_jobs.takeFirst();
+        d_lock.unlock();
+
+        applyCommands(); // the ones received while idle
+        if( !hasJob )
+            continue;
+        if( job.d_kind == Quit )
+            return;
+
+        bool ok = true;
+        if( !job.d_skipAfterError || !d_failed )
+        {
+            if( job.d_kind == RunFile )
+                ok = d_lua->executeFile( job.d_source );
+            else
+                ok = d_lua->executeCmd( job.d_source, job.d_name );
+            if( !ok )
+                d_failed = true;
+            emit sigJobDone( ok, d_lua->getLastError() );
+        }
+
+        d_lock.lock();
+        if( d_lua->isAborted() )
+            d_jobs.clear();
+        const bool idle = d_jobs.isEmpty();
+        if( idle )
+            d_busy = false;
+        d_lock.unlock();
+        if( idle )
+        {
+            d_failed = false;
+            emit sigIdle();
+        }
+    }
+}
+
+void Engine2Thread::handleBreak(Engine2* lua, const QByteArray& source, quint32 line)
+{
+    Snapshot s;
+    s.d_source = source;
+    s.d_line = line;
+    s.d_breakHit = lua->isBreakHit();
+    s.d_value = lua->getValueString(1).simplified();
+    s.d_value = s.d_value.mid(1,s.d_value.size()-2); // remove ""
+    s.d_stack = lua->getStackTrace();
+    for( int level = 0; level < s.d_stack.size(); level++ )
+    {
+        // the same level the IDE selects when it fills the stack view
+        if( !s.d_stack[level].d_inC )
+        {
+            lua->setActiveLevel(level);
+            break;
+        }
+    }
+    snapshotLocals(s);
+
+    d_lock.lock();
+    d_curSource = source;
+    d_curLine = line;
+    d_waiting = true;
+    d_lock.unlock();
+
+    emit sigBreak(s);
+
+    forever
+    {
+        d_lock.lock();
+        while( d_cmds.isEmpty() )
+            d_wake.wait(&d_lock);
+        d_lock.unlock();
+        if( applyCommands() )
+            break;
+    }
+
+    d_lock.lock();
+    d_waiting = false;
+    d_lock.unlock();
+
+    emit sigContinued();
+}
+
+void Engine2Thread::handleAliveSignal(Engine2*)
+{
+    // no event pumping necessary here; just take the commands which arrived meanwhile
+    applyCommands();
+}
+
+void Engine2Thread::post(const Engine2Thread::Command& cmd)
+{
+    QMutexLocker l(&d_lock);
+    d_cmds.append(cmd);
+    if( cmd.d_kind == Run )
+        d_waiting = false; // from now on the caller must no longer inspect the engine
+    d_wake.wakeAll();
+    if( d_busy && !d_waiting && !d_debug.load() )
+        d_lua->interrupt(); // in debug mode the hook regularly calls handleAliveSignal anyway
+}
+
+bool Engine2Thread::applyCommands()
+{
+    d_lock.lock();
+    const QList<Command> cmds = d_cmds;
+    d_cmds.clear();
+    const bool waiting = d_waiting;
+    d_lock.unlock();
+
+    bool resume = false;
+    foreach( const Command& c, cmds )
+    {
+        switch( c.d_kind )
+        {
+        case Run:
+            switch( c.d_arg )
+            {
+            case Engine2::StepNext:
+            case Engine2::StepOver:
+            case Engine2::StepOut:
+                if( !d_lua->isExecuting() )
+                    break;
+                if( !d_lua->isDebug() )
+                {
+                    d_lua->setDebug(true);
+                    d_debug.store(true);
+                }
+                d_lua->runToNextLine( Engine2::DebugCommand(c.d_arg) );
+                resume = true;
+                break;
+            case Engine2::RunToBreakPoint:
+                d_lua->runToBreakPoint();
+                resume = true;
+                break;
+            case Engine2::Abort:
+            case Engine2::AbortSilently:
+                if( d_lua->isExecuting() )
+                    d_lua->terminate( c.d_arg == Engine2::AbortSilently );
+                resume = true;
+                break;
+            }
+            break;
+        case SelectLevel:
+            d_lua->setActiveLevel(c.d_arg);
+            if( waiting )
+            {
+                Snapshot s;
+                d_lock.lock();
+                s.d_source = d_curSource;
+                s.d_line = d_curLine;
+                d_lock.unlock();
+                snapshotLocals(s);
+                emit sigLevel(s);
+            }
+            break;
+        case Debug:
+            d_lua->setDebug(c.d_arg);
+            break;
+        case AddBreak:
+            d_lua->addBreak(c.d_source,c.d_arg);
+            break;
+        case RemoveBreak:
+            d_lua->removeBreak(c.d_source,c.d_arg);
+            break;
+        case SetCondition:
+            d_lua->setBreakCondition(c.d_source,c.d_arg,c.d_expr,c.d_count);
+            break;
+        case DefaultCmd:
+            d_lua->setDefaultCmd( Engine2::DebugCommand(c.d_arg) );
+            break;
+        }
+    }
+    return resume;
+}
+
+void Engine2Thread::snapshotLocals(Engine2Thread::Snapshot& s) const
+{
+    s.d_activeLevel = d_lua->getActiveLevel();
+    s.d_locals = d_lua->getLazyLocals( true, d_withTemps );
+    d_lock.lock();
+    const QByteArrayList watches = d_watches;
+    d_lock.unlock();
+    s.d_watches = d_lua->evalWatches( watches );
+}
@@ -0,0 +1,138 @@
+#ifndef LUA_ENGINE2THREAD_H
+#define LUA_ENGINE2THREAD_H
+
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <LjTools/Engine2.h>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+namespace Lua
+{
+    // Runs the scripts of an Engine2 on a worker thread. The GUI only enqueues jobs and commands
+    // and gets a Snapshot when the script stops, so there is no nested event loop in handleBreak.
+    // Install it with Engine2::setDbgShell. Don't call the engine directly while isBusy(), except
+    // for inspection while isWaiting() (the worker is blocked then).
+    class Engine2Thread : public QThread, public DbgShell
+    {
+        Q_OBJECT
+    public:
+        struct Snapshot
+        {
+            QByteArray d_source;
+            quint32 d_line; // as passed to DbgShell::handleBreak
+            int d_activeLevel;
+            bool d_breakHit;
+            QByteArray d_value; // value at stack position 1, i.e. the error message or TRAP argument
+            Engine2::StackLevels d_stack; // empty if only the level changed
+            Engine2::LazyVars d_locals; // of d_activeLevel; expand with Engine2::getChildren while waiting
+            Engine2::LazyVars d_watches; // see setWatches
+            Snapshot():d_line(0),d_activeLevel(0),d_breakHit(false){}
+        };
+
+        explicit Engine2Thread(Engine2*, QObject* parent = 0);
+        ~Engine2Thread();
+        Engine2* getEngine() const { return d_lua; }
+
+        // Jobs are executed in order on the worker thread
+        void executeCmd( const QByteArray& source, const QByteArray& name = QByteArray(),
+                         bool skipAfterError = false ); // skip if a job of the current batch failed
+        void executeFile( const QByteArray& path );
+        bool isBusy() const; // a job is running or pending
+        bool isWaiting() const; // the running job stopped and waits for a command
+
+        // State as set through this class; use these instead of the engine while the runner is in use
+        bool isDebug() const { return d_debug.load(); }
+        Engine2::Breaks getBreaks( const QByteArray& ) const;
+        Engine2::BreakCond getBreakCondition( const QByteArray&, quint32 ) const;
+        void syncState(); // takes the state from the engine; call while idle, e.g. after using the engine directly
+
+        // Commands; can be called from any thread
+        void runToNextLine( Engine2::DebugCommand = Engine2::StepNext ); // also pauses a running script
+        void runToBreakPoint();
+        void terminate( bool silent = false ); // also drops all pending jobs
+        void setActiveLevel( int );
+        void setDebug( bool );
+        void addBreak( const QByteArray&, quint32 );
+        void removeBreak( const QByteArray&, quint32 );
+        void setBreakCondition( const QByteArray&, quint32, const QByteArray& expr, quint32 hitCount = 0 );
+        void setWatches( const QByteArrayList& ); // evaluated in d_activeLevel with each Snapshot
+        void setDefaultCmd( Engine2::DebugCommand );
+        void setLocalsWithTemps( bool on ) { d_withTemps = on; } // see Engine2::getLazyLocals; set before running
+    signals:
+        void sigBreak( const Lua::Engine2Thread::Snapshot& );
+        void sigLevel( const Lua::Engine2Thread::Snapshot& );
+        void sigContinued();
+        void sigJobDone( bool ok, const QByteArray& error );
+        void sigIdle();
+    protected:
+        void run();
+        // DbgShell, called on the worker thread
+        void handleBreak( Engine2*, const QByteArray& source, quint32 line );
+        void handleAliveSignal(Engine2*);
+    private:
+        enum JobKind { RunCmd, RunFile, Quit };
+        struct Job
+        {
+            QByteArray d_source;
+            QByteArray d_name;
+            quint8 d_kind;
+            bool d_skipAfterError;
+            Job(quint8 k = Quit, const QByteArray& s = QByteArray(), const QByteArray& n = QByteArray(), bool skip = false):
+                d_kind(k),d_source(s),d_name(n),d_skipAfterError(skip){}
+        };
+        enum CmdKind { Run, SelectLevel, Debug, AddBreak, RemoveBreak, SetCondition, DefaultCmd };
+        struct Command
+        {
+            QByteArray d_source;
+            QByteArray d_expr; // SetCondition only
+            quint32 d_arg; // DebugCommand, level, bool or line
+            quint32 d_count; // SetCondition only
+            quint8 d_kind;
+            Command(quint8 k = Run, quint32 a = 0, const QByteArray& s = QByteArray()):
+                d_kind(k),d_arg(a),d_source(s),d_count(0){}
+        };
+        void post( const Command& );
+        bool applyCommands(); // returns true if the stopped script has to resume
+        void snapshotLocals( Snapshot& ) const;
+
+        Engine2* d_lua;
+        mutable QMutex d_lock;
+        QWaitCondition d_wake;
+        QList<Job> d_jobs;
+        QList<Command> d_cmds;
+        QByteArrayList d_watches;
+        Engine2::BreaksPerScript d_breaks; // mirror of the engine
+        QMap<Engine2::Break,Engine2::BreakCond> d_conds; // only d_expr and d_hitCount
+        QAtomicInt d_debug;
+        QByteArray d_curSource;
+        quint32 d_curLine;
+        bool d_busy;
+        bool d_waiting;
+        bool d_failed;
+        bool d_withTemps;
+    };
+}
+
+Q_DECLARE_METATYPE(Lua::Engine2Thread::Snapshot)
+
+#endif // LUA_ENGINE2THREAD_H
@@ -0,0 +1,151 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LuaJitComposer.h"
+#include "LjasLexer.h"
+#include "LjasParser.h"
+#include "LjasErrors.h"
+#include "LjAssembler.h"
+#include <QCoreApplication>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QTextStream>
+using namespace Lua;
+
+// Usage: LjAllocBench [-w window] [sizes...]
+// Measures the register allocation for functions with many short lived temporaries, by default with 1k, 10k and
+// 100k intervals per function: first JitComposer::allocateWithLinearScan alone on random intervals, then the
+// assembler on a generated function where each temporary is read by the next one and by the one window
+// statements later, so that about window temporaries are live at any time. With O(n log n) allocation the time
+// per interval stays about constant from one size to the next.
+
+static qint64 benchLinearScan( int n, int window )
+{
+    JitComposer::Intervals vars(n);
+    qsrand(n);
+    for( int i = 0; i < n; i++ )
+    {
+        const quint32 from = i;
+        vars[i] = JitComposer::Interval( from, from + 1 + qrand() % window );
+    }
+    JitComposer::SlotPool pool;
+    QElapsedTimer t;
+    t.start();
+    if( !JitComposer::allocateWithLinearScan(pool,vars) )
+        return -1;
+    return t.nsecsElapsed();
+}
+
+static QByteArray generateFunction( int n, int window )
+{
+    QByteArray src;
+    src.reserve( n * 40 );
+    src += "function bench()\nvar";
+    for( int i = 0; i < n; i++ )
+        src += " t" + QByteArray::number(i);
+    src += "\nbegin\n\tKSET t0 1\n";
+    for( int i = 1; i < n; i++ )
+    {
+        if( i < window )
+            src += "\tADD t" + QByteArray::number(i) + " t" + QByteArray::number(i-1) + " 1\n";
+        else
+            src += "\tADD t" + QByteArray::number(i) + " t" + QByteArray::number(i-1) +
+                    " t" + QByteArray::number(i-window) + "\n";
+    }
+    src += "\tRET t" + QByteArray::number(n-1) + "\nend bench\n";
+    return src;
+}
+
+static qint64 benchAssembler( int n, int window, QTextStream& err )
+{
+    QByteArray src = generateFunction(n,window);
+    QBuffer buf(&src);
+    buf.open(QIODevice::ReadOnly);
+    Ljas::Errors errs;
+    Ljas::Lexer lex;
+    lex.setErrors(&errs);
+    lex.setStream(&buf,"bench.ljasm");
+    Ljas::Parser p(&lex,&errs);
+    p.Parse();
+    if( errs.getErrCount() != 0 )
+    {
+        err << "cannot parse the generated function" << endl;
+        return -1;
+    }
+    // parsing isn't part of the measurement; the assembler time is dominated by the allocation
+    Ljas::Assembler ass(&errs);
+    QElapsedTimer t;
+    t.start();
+    if( !ass.process( p.d_root.d_children.first(), "bench.ljasm" ) )
+    {
+        err << "cannot assemble the generated function" << endl;
+        return -1;
+    }
+    return t.nsecsElapsed();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("me@rochus-keller.ch");
+    a.setOrganizationDomain("github.com/rochus-keller/LjTools");
+    a.setApplicationName("LjAllocBench");
+    a.setApplicationVersion("0.1");
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    QList<int> sizes;
+    int window = 16;
+    const QStringList args = a.arguments();
+    bool ok = true;
+    for( int i = 1; i < args.size(); i++ )
+    {
+        if( args[i] == "-w" && i + 1 < args.size() )
+            window = qBound( 2, args[++i].toInt(), JitComposer::MAX_SLOTS / 2 );
+        else if( args[i].toInt() > 0 )
+            sizes << args[i].toInt();
+        else
+            ok = false;
+    }
+    // validated after all options, since -w can come after the sizes
+    foreach( int n, sizes )
+    {
+        if( n <= window )
+            ok = false;
+    }
+    if( !ok )
+    {
+        err << "usage: LjAllocBench [-w window] [sizes...], each size greater than the window" << endl;
+        return 2;
+    }
+    if( sizes.isEmpty() )
+        sizes << 1000 << 10000 << 100000;
+
+    out << "intervals,linear_scan_ms,linear_scan_ns_per_interval,assembler_ms,assembler_ns_per_interval" << endl;
+    foreach( int n, sizes )
+    {
+        const qint64 scan = benchLinearScan(n,window);
+        const qint64 ass = benchAssembler(n,window,err);
+        if( scan < 0 || ass < 0 )
+            return 1;
+        out << n << "," << scan / 1000000.0 << "," << scan / n << "," <<
+               ass / 1000000.0 << "," << ass / n << endl;
+    }
+    return 0;
+}
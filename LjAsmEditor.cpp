@@ -90,6 +90,37 @@ public:
     Ljas::Highlighter* d_hl;
 
     typedef QList<const Ljas::Assembler::Xref*> SymList;
+    typedef QVector<const Ljas::Assembler::Xref*> Index;
+    Index d_index; // all xrefs of d_xref ordered by position
+
+    static quint64 toPos( const Ljas::Assembler::Xref* x ) { return ( quint64(x->d_line) << 16 ) | x->d_col; }
+    struct PosLess
+    {
+        bool operator()( quint64 pos, const Ljas::Assembler::Xref* x ) const { return pos < toPos(x); }
+        bool operator()( const Ljas::Assembler::Xref* lhs, const Ljas::Assembler::Xref* rhs ) const
+        {
+            return toPos(lhs) < toPos(rhs);
+        }
+    };
+
+    void setXref( Ljas::Assembler::Xref* x )
+    {
+        if( d_xref )
+            delete d_xref;
+        d_xref = x;
+        d_index.clear();
+        if( d_xref )
+        {
+            indexXref(d_xref);
+            std::stable_sort( d_index.begin(), d_index.end(), PosLess() );
+        }
+    }
+    void indexXref( const Ljas::Assembler::Xref* node )
+    {
+        d_index.append(node);
+        foreach( const Ljas::Assembler::Xref* n, node->d_subs )
+            indexXref(n);
+    }
 
     void markNonTerms(const SymList& syms)
     {
@@ -152,21 +183,19 @@ public:
 
         setExtraSelections(sum);
     }
-    const Ljas::Assembler::Xref* findSymbolBySourcePos(const Ljas::Assembler::Xref* node, quint32 line, quint16 col ) const
+    const Ljas::Assembler::Xref* findSymbolBySourcePos(quint32 line, quint16 col ) const
     {
-        if( node == 0 )
-            return 0;
-        if( node->d_line > line )
+        // the xref starting last before line:col; of those starting there the first in tree order
+        const quint64 pos = ( quint64(line) << 16 ) | col;
+        Index::const_iterator i = std::upper_bound( d_index.begin(), d_index.end(), pos, PosLess() );
+        if( i == d_index.begin() )
             return 0;
+        --i;
+        while( i != d_index.begin() && toPos(*(i-1)) == toPos(*i) )
+            --i;
+        const Ljas::Assembler::Xref* node = *i;
         if( line == node->d_line && col >= node->d_col && col <= node->d_col + node->d_name.size() )
             return node;
-        // else
-        foreach( const Ljas::Assembler::Xref* n, node->d_subs )
-        {
-            const Ljas::Assembler::Xref* res = findSymbolBySourcePos( n, line, col );
-            if( res )
-                return res;
-        }
         return 0;
     }
     void mousePressEvent(QMouseEvent* e)
@@ -181,7 +210,7 @@ public:
         }else if( QApplication::keyboardModifiers() == Qt::ControlModifier )
         {
             QTextCursor cur = cursorForPosition(e->pos());
-            const Ljas::Assembler::Xref* sym = findSymbolBySourcePos(d_xref,cur.blockNumber() + 1,cur.positionInBlock() + 1);
+            const Ljas::Assembler::Xref* sym = findSymbolBySourcePos(cur.blockNumber() + 1,cur.positionInBlock() + 1);
             if( sym )
             {
                 const Ljas::Assembler::Xref* d = sym->d_decl;
@@ -201,7 +230,7 @@ public:
         if( QApplication::keyboardModifiers() == Qt::ControlModifier && d_xref )
         {
             QTextCursor cur = cursorForPosition(e->pos());
-            const Ljas::Assembler::Xref* sym = findSymbolBySourcePos(d_xref,cur.blockNumber() + 1, cur.positionInBlock() + 1);
+            const Ljas::Assembler::Xref* sym = findSymbolBySourcePos(cur.blockNumber() + 1, cur.positionInBlock() + 1);
             const bool alreadyArrow = !d_link.isEmpty();
             d_link.clear();
             if( sym )
@@ -587,7 +616,7 @@ void AsmEditor::onCursor()
     d_edit->getCursorPosition( &line, &col );
     line += 1;
     col += 1;
-    const Ljas::Assembler::Xref* sym = d_edit->findSymbolBySourcePos(d_edit->d_xref, line, col);
+    const Ljas::Assembler::Xref* sym = d_edit->findSymbolBySourcePos(line, col);
     if( sym && sym->d_decl )
         sym = sym->d_decl;
     if( sym )
@@ -725,9 +754,7 @@ bool AsmEditor::checkSaved(const QString& title)
 bool AsmEditor::compile()
 {
     d_edit->d_err.clear();
-    if( d_edit->d_xref )
-        delete d_edit->d_xref;
-    d_edit->d_xref = 0;
+    d_edit->setXref(0);
 
     Ljas::Lexer lex;
     lex.setErrors(&d_edit->d_err);
@@ -741,8 +768,10 @@ bool AsmEditor::compile()
         return false;
 
     Ljas::Assembler ass(&d_edit->d_err);
+    ass.setParallel(true);
+    ass.setCache(&d_asmCache);
     const bool res = ass.process( p.d_root.d_children.first(), d_edit->getPath().toUtf8(), true );
-    d_edit->d_xref = ass.getXref(true);
+    d_edit->setXref( ass.getXref(true) );
     d_edit->updateExtraSelections();
     d_edit->d_hl->rehighlight();
     if( res )
@@ -21,6 +21,7 @@
 */
 
 #include <QMainWindow>
+#include <LjTools/LjAssembler.h>
 
 class QTreeWidget;
 
@@ -79,6 +80,7 @@ namespace Lua
         QTreeWidget* d_usedBy;
         JitEngine* d_eng;
         QByteArray d_bc;
+        Ljas::Assembler::Cache d_asmCache; // functions of the last compile
         bool d_lock;
         bool d_importStrip;
         bool d_importAlloc;
@@ -17,7 +17,7 @@
 #* http://www.gnu.org/copyleft/gpl.html.
 #*/
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets printsupport
 
@@ -33,10 +33,13 @@ SOURCES += LjAsmEditor.cpp \
     LuaHighlighter.cpp \
     LuaJitBytecode.cpp \
     Engine2.cpp \
+    Engine2Thread.cpp \
     Terminal2.cpp \
     ExpressionParser.cpp \
     LuaJitEngine.cpp \
     LuaJitComposer.cpp \
+    LuaJitFlowGraph.cpp \
+    LuaJitVerifier.cpp \
     LjasErrors.cpp \
     LjasFileCache.cpp \
     LjasLexer.cpp \
@@ -55,10 +58,13 @@ HEADERS  += LjAsmEditor.h \
     LuaHighlighter.h \
     LuaJitBytecode.h \
     Engine2.h \
+    Engine2Thread.h \
     Terminal2.h \
     ExpressionParser.h \
     LuaJitEngine.h \
     LuaJitComposer.h \
+    LuaJitFlowGraph.h \
+    LuaJitVerifier.h \
     LjasErrors.h \
     LjasFileCache.h \
     LjasLexer.h \
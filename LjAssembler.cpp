@@ -23,6 +23,8 @@
 #include <QtDebug>
 #include <QElapsedTimer>
 #include <QBuffer>
+#include <QtConcurrent>
+#include <QCryptographicHash>
 using namespace Ljas;
 using namespace Lua;
 
@@ -31,7 +33,7 @@ Q_DECLARE_METATYPE( SynTree* )
 
 // TODO: array vars
 
-Assembler::Assembler(Errors* errs):d_errs(errs),d_xref(0)
+Assembler::Assembler(Errors* errs):d_errs(errs),d_xref(0),d_parallel(false),d_cache(0),d_lock(0)
 {
     Q_ASSERT( errs != 0 );
 }
@@ -62,7 +64,12 @@ bool Assembler::process(SynTree* st, const QByteArray& sourceRef, bool createXre
     {
         QBuffer buf;
         buf.open(QIODevice::WriteOnly);
-        d_comp.write(&buf);
+        if( !d_comp.write(&buf) )
+        {
+            foreach( const JitVerifier::Issue& i, d_comp.getIssues() )
+                d_errs->error( Errors::Generator, QString::fromUtf8(d_ref), i.d_line, 1, i.toString() );
+            return false;
+        }
         buf.close();
         d_bc = buf.data();
         return true;
@@ -111,7 +118,7 @@ Assembler::Var*Assembler::toVar(Assembler::Named* n)
         return n->toVar();
 }
 
-void Assembler::findOverlaps(Assembler::VarList& out, Assembler::Var* header)
+void Assembler::findOverlaps(Assembler::VarList& out, QSet<Var*>& seen, Assembler::Var* header)
 {
     // v0 v1 v2 v3
     //       u0 u1 u2
@@ -122,14 +129,18 @@ void Assembler::findOverlaps(Assembler::VarList& out, Assembler::Var* header)
     {
         if( v->d_n > 1 )
         {
-            if( !headerRegistered && !out.contains(header) )
+            if( !headerRegistered && !seen.contains(header) )
             {
                 headerRegistered = true;
+                seen << header;
                 out << header;
             }
-            if( !out.contains(v) )
+            if( !seen.contains(v) )
+            {
+                seen << v;
                 out << v;
-            findOverlaps(out, v );
+            }
+            findOverlaps(out, seen, v );
         }
         v = v->d_next;
     }
@@ -168,22 +179,41 @@ static bool xrefSort( const Assembler::Xref* lhs, const Assembler::Xref* rhs )
 }
 
 bool Assembler::processFunc(SynTree* st, Func* outer)
+{
+    Func* me = declareFunc(st, outer);
+    if( me == 0 )
+        return false;
+    return processFuncBody(st, me);
+}
+
+Assembler::Func*Assembler::declareFunc(SynTree* st, Assembler::Func* outer)
 {
     Q_ASSERT( st != 0 && st->d_tok.d_type == SynTree::R_function_decl );
 
     SynTree* fname = flatten(findFirstChild(st, SynTree::R_fname ));
     if( fname == 0 && outer != 0 )
-        return error( st, tr("only top-level function can be unnamed") );
-    SynTree* lastName = 0;
+    {
+        error( st, tr("only top-level function can be unnamed") );
+        return 0;
+    }
     if( fname != 0 )
     {
         if( outer && outer->d_names.contains(fname->d_tok.d_val) )
-            return error( fname, tr("function name not unique") );
-        lastName = flatten(st->d_children.last());
+        {
+            error( fname, tr("function name not unique") );
+            return 0;
+        }
+        SynTree* lastName = flatten(st->d_children.last());
         if( lastName == 0 || lastName->d_tok.d_type != Tok_ident )
-            return error( lastName, tr("expected function name after 'end'") );
+        {
+            error( lastName, tr("expected function name after 'end'") );
+            return 0;
+        }
         if( lastName->d_tok.d_val != fname->d_tok.d_val )
-            return error( lastName, tr("name after 'end' not equal to function name") );
+        {
+            error( lastName, tr("name after 'end' not equal to function name") );
+            return 0;
+        }
     }
 
     Func* me = new Func();
@@ -214,6 +244,15 @@ bool Assembler::processFunc(SynTree* st, Func* outer)
         }else
             d_xref = x;
     }
+    return me;
+}
+
+bool Assembler::processFuncBody(SynTree* st, Assembler::Func* me)
+{
+    Func* outer = me->d_outer;
+    SynTree* lastName = 0;
+    if( findFirstChild(st, SynTree::R_fname ) )
+        lastName = flatten(st->d_children.last());
 
     SynTree* hdr = findFirstChild(st, SynTree::R_function_header );
     Q_ASSERT( hdr != 0 );
@@ -227,19 +266,29 @@ bool Assembler::processFunc(SynTree* st, Func* outer)
     if( !processVars(hdr,me) )
         return false;
 
-    int id = d_comp.openFunction(me->d_params.size(),d_ref,st->d_tok.d_lineNr, st->d_children.last()->d_tok.d_lineNr );
-    if( outer )
-    {
-        Q_ASSERT( id != -1 );
+    int id = d_comp.openFunction(me->d_params.size(),d_ref,st->d_tok.d_lineNr, st->d_children.last()->d_tok.d_lineNr,
+                                 me->d_varargs );
+    if( d_lock )
+        d_opened.append(me); // the upvalues are set when the job is added to the outer composer
+    if( outer && id != -1 )
         me->d_id = id;
-    }
+    else
+        Q_ASSERT( outer == 0 || d_lock ); // the job root gets its id in processFuncsInParallel
 
-    for( int i = 3; i < hdr->d_children.size(); i++ )
+    QList<QByteArray> enclosing;
+    if( outer == 0 && d_parallel && !refersToOtherFuncs(st, enclosing) )
     {
-        if( hdr->d_children[i]->d_tok.d_type == SynTree::R_function_decl )
+        if( !processFuncsInParallel(hdr, me) )
+            return false;
+    }else
+    {
+        for( int i = 3; i < hdr->d_children.size(); i++ )
         {
-            if( !processFunc(hdr->d_children[i], me ) )
-                return false;
+            if( hdr->d_children[i]->d_tok.d_type == SynTree::R_function_decl )
+            {
+                if( !processFunc(hdr->d_children[i], me ) )
+                    return false;
+            }
         }
     }
 
@@ -288,6 +337,11 @@ bool Assembler::processFunc(SynTree* st, Func* outer)
         if( !checkJumpsAndMore( stmts, labels, me ) )
             return false;
 
+        if( !checkLoops( stmts ) )
+            return false;
+
+        extendLoopRanges( me, stmts );
+
     }else
     {
         // add at least RET
@@ -310,6 +364,9 @@ bool Assembler::processFunc(SynTree* st, Func* outer)
         return false;
 //#endif
 
+    if( !checkMultRes(me,stmts) )
+        return false;
+
     if( !generateCode(me,stmts) )
         return false;
 
@@ -330,19 +387,310 @@ bool Assembler::processFunc(SynTree* st, Func* outer)
             me->d_xref->d_subs.append(x);
         }
 
-        Xref* func = outer ? outer->d_xref->d_subs.last() : d_xref;
-        std::sort( func->d_subs.begin(), func->d_subs.end(), xrefSort );
+        std::sort( me->d_xref->d_subs.begin(), me->d_xref->d_subs.end(), xrefSort );
     }
 
     return true;
 }
 
+bool Assembler::refersToOtherFuncs(SynTree* st, QList<QByteArray>& enclosing)
+{
+    // true if a desig in st is qualified with the name of a function which doesn't enclose it
+    if( st->d_tok.d_type == SynTree::R_desig && !st->d_children.isEmpty() &&
+            st->d_children.first()->d_tok.d_type == SynTree::R_fname )
+    {
+        SynTree* name = flatten( st->d_children.first() );
+        return !enclosing.contains( name->d_tok.d_val );
+    }
+    const bool isFunc = st->d_tok.d_type == SynTree::R_function_decl;
+    if( isFunc )
+    {
+        SynTree* name = flatten(findFirstChild(st, SynTree::R_fname ));
+        enclosing.append( name ? name->d_tok.d_val : QByteArray() );
+    }
+    bool res = false;
+    for( int i = 0; i < st->d_children.size() && !res; i++ )
+        res = refersToOtherFuncs( st->d_children[i], enclosing );
+    if( isFunc )
+        enclosing.removeLast();
+    return res;
+}
+
+void Assembler::runJob(Assembler::Job& j)
+{
+    if( j.d_cached )
+        return; // taken from the cache, no assembler allocated
+    j.d_ok = j.d_ass->processFuncBody(j.d_st,j.d_func);
+}
+
+bool Assembler::processFuncsInParallel(SynTree* hdr, Assembler::Func* me)
+{
+    // The nested functions of the top-level function only share the variables of the latter, which
+    // are not yet allocated; each is assembled by its own Assembler with its own JitComposer.
+    // Names are declared upfront so the lookups in the jobs see a complete and stable outer scope.
+    QMutex lock;
+    QList<Job> jobs;
+    for( int i = 3; i < hdr->d_children.size(); i++ )
+    {
+        if( hdr->d_children[i]->d_tok.d_type != SynTree::R_function_decl )
+            continue;
+        Job j;
+        j.d_st = hdr->d_children[i];
+        j.d_func = declareFunc(j.d_st, me);
+        if( j.d_func == 0 )
+            return false;
+        jobs << j;
+    }
+
+    if( d_cache )
+    {
+        // the jobs depend on the declarations of the top-level function, not on its statements
+        QCryptographicHash h(QCryptographicHash::Sha1);
+        h.addData(d_ref);
+        h.addData(d_createXref ? "x" : "-");
+        for( int i = 0; i < hdr->d_children.size(); i++ )
+        {
+            if( hdr->d_children[i]->d_tok.d_type != SynTree::R_function_decl )
+                h.addData( cacheKey(QByteArray(), hdr->d_children[i]) );
+        }
+        for( int i = 0; i < jobs.size(); i++ )
+            h.addData( jobs[i].d_func->d_name->d_tok.d_val + ' ' );
+        const QByteArray scope = h.result();
+        for( int i = 0; i < jobs.size(); i++ )
+        {
+            Job& j = jobs[i];
+            j.d_key = cacheKey(scope,j.d_st);
+            j.d_cached = d_cache->d_entries.value(j.d_key);
+        }
+    }
+    for( int i = 0; i < jobs.size(); i++ )
+    {
+        Job& j = jobs[i];
+        if( j.d_cached )
+        {
+            j.d_ok = true;
+            continue;
+        }
+        j.d_ass = new Assembler(d_errs);
+        j.d_ass->d_ref = d_ref;
+        j.d_ass->d_createXref = d_createXref;
+        j.d_ass->d_lock = &lock;
+    }
+    QtConcurrent::blockingMap( jobs, runJob );
+
+    // the variable use of all jobs has to be known before the upvalues are calculated
+    typedef QPair<QByteArray,bool> Use;
+    for( int i = 0; i < jobs.size(); i++ )
+    {
+        const QList<Use>& uses = jobs[i].d_cached ? jobs[i].d_cached->d_outerUses :
+                                                     jobs[i].d_ass->d_outerUses;
+        foreach( const Use& u, uses )
+        {
+            Var* v = toVar(me->findLocal(u.first));
+            Q_ASSERT( v != 0 );
+            v->d_uv = true;
+            if( u.second )
+                v->d_uvRo = false;
+        }
+    }
+
+    // stitch the prototypes in source order, so the constant slots are the same as in serial mode
+    bool ok = true;
+    Cache::Entries next;
+    for( int i = 0; i < jobs.size(); i++ )
+    {
+        Job& j = jobs[i];
+        if( j.d_cached )
+        {
+            d_cache->d_entries.remove(j.d_key);
+            next.insert(j.d_key, j.d_cached);
+            if( ok )
+                j.d_func->d_id = reuseCacheEntry(j,me);
+        }else if( j.d_ok )
+        {
+            QList<JitComposer::UpvalList> upvals;
+            foreach( Func* f, j.d_ass->d_opened )
+                upvals << f->getUpvals();
+            if( d_cache )
+                next.insert(j.d_key, createCacheEntry(j,me,upvals));
+            if( ok )
+            {
+                const int id = d_comp.addFunction(j.d_ass->d_comp,upvals);
+                Q_ASSERT( id != -1 );
+                j.d_func->d_id = id;
+            }
+        }else
+            ok = false;
+        delete j.d_ass;
+    }
+    if( d_cache )
+    {
+        d_cache->clear();
+        d_cache->d_entries = next;
+    }
+    return ok;
+}
+
+struct Assembler::Cache::Entry
+{
+    struct OuterUv
+    {
+        quint16 d_func; // index in d_funcs
+        quint16 d_uv;
+        QByteArray d_name; // of the variable of the top-level function
+    };
+    quint32 d_line; // of the function when it was assembled
+    QList<JitBytecode::FuncRef> d_funcs; // without upvalues
+    QList<JitComposer::UpvalList> d_upvals; // OuterUv depend on the current top-level function
+    QList<OuterUv> d_outerUvs;
+    QList<QPair<QByteArray,bool> > d_outerUses;
+    Xref* d_xref; // copies of the subs of the function, if any; uses of outer names have no d_decl
+    Entry():d_line(0),d_xref(0){}
+    ~Entry() { if( d_xref ) delete d_xref; }
+};
+
+void Assembler::Cache::clear()
+{
+    foreach( Entry* e, d_entries )
+        delete e;
+    d_entries.clear();
+}
+
+static void addTreeToHash( QCryptographicHash& h, const SynTree* st, quint32 line, bool withPos )
+{
+    const quint32 tok[5] = { quint32(st->d_tok.d_type), withPos ? st->d_tok.d_lineNr - line : 0,
+                             withPos ? st->d_tok.d_colNr : 0u, quint32(st->d_tok.d_val.size()),
+                             quint32(st->d_children.size()) };
+    h.addData( reinterpret_cast<const char*>(tok), sizeof(tok) );
+    h.addData( st->d_tok.d_val );
+    foreach( SynTree* sub, st->d_children )
+        addTreeToHash( h, sub, line, withPos );
+}
+
+QByteArray Assembler::cacheKey(const QByteArray& scope, SynTree* st) const
+{
+    // without scope only the tokens count, otherwise also their position relative to the first line
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    h.addData(scope);
+    addTreeToHash( h, st, st->d_tok.d_lineNr, !scope.isEmpty() );
+    return h.result();
+}
+
+typedef QHash<const Assembler::Xref*,Assembler::Xref*> XrefMap;
+
+static void copyXrefSubs( const Assembler::Xref* from, Assembler::Xref* to, int lineDelta, XrefMap& map )
+{
+    map[from] = to;
+    foreach( const Assembler::Xref* sub, from->d_subs )
+    {
+        Assembler::Xref* x = new Assembler::Xref();
+        x->d_name = sub->d_name;
+        x->d_line = sub->d_line + lineDelta;
+        x->d_col = sub->d_col;
+        x->d_kind = sub->d_kind;
+        x->d_role = sub->d_role;
+        x->d_decl = sub->d_decl;
+        to->d_subs.append(x);
+        copyXrefSubs( sub, x, lineDelta, map );
+    }
+}
+
+static void relinkXrefs( const XrefMap& map )
+{
+    XrefMap::const_iterator i;
+    for( i = map.begin(); i != map.end(); ++i )
+    {
+        Assembler::Xref* x = i.value();
+        x->d_decl = map.value(x->d_decl); // null if outside of the copied function
+        foreach( const Assembler::Xref* use, i.key()->d_usedBy )
+        {
+            if( map.contains(use) )
+                x->d_usedBy.append( map.value(use) );
+        }
+    }
+}
+
+Assembler::Cache::Entry*Assembler::createCacheEntry(const Job& j, Func* me, const QList<JitComposer::UpvalList>& upvals)
+{
+    Cache::Entry* e = new Cache::Entry();
+    e->d_line = j.d_st->d_tok.d_lineNr;
+    e->d_funcs = JitComposer::copyFunctions(j.d_ass->d_comp.getFuncs()); // before the upvalues are added
+    e->d_upvals = upvals;
+    e->d_outerUses = j.d_ass->d_outerUses;
+    for( int i = 0; i < j.d_ass->d_opened.size(); i++ )
+    {
+        Func::Upvals::const_iterator u;
+        for( u = j.d_ass->d_opened[i]->d_upvals.begin(); u != j.d_ass->d_opened[i]->d_upvals.end(); ++u )
+        {
+            if( u.key()->d_func != me )
+                continue;
+            Cache::Entry::OuterUv ouv;
+            ouv.d_func = i;
+            ouv.d_uv = u.value();
+            ouv.d_name = u.key()->d_name->d_tok.d_val;
+            e->d_outerUvs.append(ouv);
+        }
+    }
+    if( j.d_func->d_xref )
+    {
+        e->d_xref = new Xref();
+        XrefMap map;
+        copyXrefSubs( j.d_func->d_xref, e->d_xref, 0, map );
+        relinkXrefs( map );
+    }
+    return e;
+}
+
+int Assembler::reuseCacheEntry(const Job& j, Func* me)
+{
+    Cache::Entry* e = j.d_cached;
+    const int lineDelta = int(j.d_st->d_tok.d_lineNr) - int(e->d_line);
+
+    QList<JitComposer::UpvalList> upvals = e->d_upvals;
+    foreach( const Cache::Entry::OuterUv& ouv, e->d_outerUvs )
+    {
+        // as in Func::getUpvals, but with the current variables of the top-level function
+        Var* v = toVar(me->findLocal(ouv.d_name));
+        Q_ASSERT( v != 0 );
+        JitComposer::Upval& u = upvals[ouv.d_func][ouv.d_uv];
+        u.d_isRo = v->d_uvRo;
+        if( ouv.d_func == 0 )
+            u.d_uv = v->d_slot;
+    }
+    const int id = d_comp.addFunction( JitComposer::copyFunctions(e->d_funcs, lineDelta), upvals );
+    Q_ASSERT( id != -1 );
+
+    if( e->d_xref && j.d_func->d_xref )
+    {
+        XrefMap map;
+        copyXrefSubs( e->d_xref, j.d_func->d_xref, lineDelta, map );
+        relinkXrefs( map );
+        foreach( Xref* x, map )
+        {
+            if( x->d_role == Xref::Decl || x->d_decl != 0 )
+                continue;
+            Named* n = me->findLocal(x->d_name);
+            if( n && n->d_xref )
+            {
+                x->d_decl = n->d_xref;
+                n->d_xref->d_usedBy.append(x);
+            }
+        }
+    }
+    return id;
+}
+
 bool Assembler::processParams(SynTree* hdr, Assembler::Func* me )
 {
     SynTree* fp = findFirstChild(hdr, SynTree::R_formal_params );
     Q_ASSERT( fp != 0 );
     for( int i = 0; i < fp->d_children.size(); i++ )
     {
+        if( fp->d_children[i]->d_tok.d_type == Tok_3Dot )
+        {
+            me->d_varargs = true;
+            continue;
+        }
         SynTree* p = flatten(fp->d_children[i]);
         if( me->d_names.contains(p->d_tok.d_val) )
             return error( p, tr("parameter name not unique") );
@@ -969,9 +1317,14 @@ bool Assembler::processStat(SynTree* st, Assembler::Stmts& l, Func* me)
             int rets = 0, args = 0;
             if( st->d_children.size() > 2 )
             {
-                if( !fetchN( st->d_children[2], s ) )
+                if( st->d_children[2]->d_tok.d_type == Tok_3Dot )
+                {
+                    rets = -1; // MULTRES
+                    s.d_vals << rets;
+                }else if( !fetchN( st->d_children[2], s ) )
                     return false;
-                rets = s.d_vals.back().toInt();
+                else
+                    rets = s.d_vals.back().toInt();
                 if( st->d_children.size() > 3 )
                 {
                     if( !fetchN( st->d_children[3], s ) )
@@ -1044,6 +1397,130 @@ bool Assembler::processStat(SynTree* st, Assembler::Stmts& l, Func* me)
             return false;
         s.d_vals << QVariant::fromValue( flatten(st->d_children[2]) );
         break;
+    case SynTree::R_ITERC_:
+    case SynTree::R_ITERN_:
+        {
+            Q_ASSERT( st->d_children.size() == 3 );
+            s.d_op = st->d_tok.d_type == SynTree::R_ITERC_ ? JitBytecode::OP_ITERC : JitBytecode::OP_ITERN;
+            if( !fetchN( st->d_children[2], s ) )
+                return false;
+            const int n = s.d_vals.back().toInt();
+            if( n == 0 )
+                return error( st->d_children[2], tr("expecting integer greater than zero "));
+            if( n + 3 > JitComposer::MAX_SLOTS )
+                return error( st->d_children[2], tr("invalid number of loop variables") );
+            // generator, state and control followed by the loop variables; the call copies
+            // the first three to the loop variable slots, so at least three of them are required
+            if( !fetchV( st->d_children[1], s, me, 3 + qMax(n,3), true, true ) )
+                return false;
+            qSwap(s.d_vals[0],s.d_vals[1]);
+            s.d_vals << 3; // Operand C is one plus the two args state and control
+        }
+        break;
+    case SynTree::R_ITERL_:
+    case SynTree::R_ISNEXT_:
+        s.d_op = st->d_tok.d_type == SynTree::R_ITERL_ ? JitBytecode::OP_ITERL : JitBytecode::OP_ISNEXT;
+        Q_ASSERT( st->d_children.size() == 3 );
+        if( !fetchV( st->d_children[1], s, me, 3, true, true ) )
+            return false;
+        s.d_vals << QVariant::fromValue( flatten(st->d_children[2]) );
+        break;
+    case SynTree::R_VARG_:
+        {
+            Q_ASSERT( st->d_children.size() == 2 || st->d_children.size() == 3 );
+            if( !me->d_varargs )
+                return error( st, tr("VARG requires '...' at the end of the parameter list") );
+            s.d_op = JitBytecode::OP_VARG;
+            int n = -1; // MULTRES
+            if( st->d_children.size() == 3 )
+            {
+                if( !fetchN( st->d_children[2], s ) )
+                    return false;
+                n = s.d_vals.back().toInt();
+                if( n == 0 )
+                    return error( st->d_children[2], tr("expecting integer greater than zero "));
+                if( n > JitComposer::MAX_SLOTS )
+                    return error( st->d_children[2], tr("invalid number of values") );
+            }else
+                s.d_vals << n;
+            if( !fetchV( st->d_children[1], s, me, qMax(n,1) ) )
+                return false;
+            qSwap(s.d_vals[0],s.d_vals[1]);
+            s.d_vals << me->d_params.size(); // Operand C is the number of fixed params
+        }
+        break;
+    case SynTree::R_CALLM_:
+        {
+            Q_ASSERT( st->d_children.size() >= 2 && st->d_children.size() <= 4 );
+            s.d_op = JitBytecode::OP_CALLM;
+            int rets = 0, args = 0;
+            if( st->d_children.size() > 2 )
+            {
+                if( st->d_children[2]->d_tok.d_type == Tok_3Dot )
+                {
+                    rets = -1; // MULTRES
+                    s.d_vals << rets;
+                }else if( !fetchN( st->d_children[2], s ) )
+                    return false;
+                else
+                    rets = s.d_vals.back().toInt();
+                if( st->d_children.size() > 3 )
+                {
+                    if( !fetchN( st->d_children[3], s ) )
+                        return false;
+                    args = s.d_vals.back().toInt();
+                }else
+                    s.d_vals << args;
+                if( rets > JitComposer::MAX_SLOTS )
+                    return error( st->d_children[2], tr("invalid number of return values") );
+                if( args + 2 > JitComposer::MAX_SLOTS )
+                    return error( st->d_children[2], tr("invalid number of argument") );
+            }else
+                s.d_vals << rets << args;
+            // the function, the fixed args and the slot where VARG puts the MULTRES args
+            const int n = qMax( rets, args + 2 );
+            if( !fetchV( st->d_children[1], s, me, n, true, true ) )
+                return false;
+            Q_ASSERT( s.d_vals.size() == 3 );
+            s.d_vals.push_front(s.d_vals.back());
+            s.d_vals.pop_back();
+        }
+        break;
+    case SynTree::R_CALLMT_:
+    case SynTree::R_RETM_:
+        {
+            Q_ASSERT( st->d_children.size() == 2 || st->d_children.size() == 3 );
+            const bool call = st->d_tok.d_type == SynTree::R_CALLMT_;
+            s.d_op = call ? JitBytecode::OP_CALLMT : JitBytecode::OP_RETM;
+            int n = 0;
+            if( st->d_children.size() == 3 )
+            {
+                if( !fetchN( st->d_children[2], s ) )
+                    return false;
+                n = s.d_vals.back().toInt();
+            }else
+                s.d_vals << n;
+            // CALLMT: the function, the fixed args and the first MULTRES slot; RETM: the fixed values
+            // and the first MULTRES slot
+            const int count = n + ( call ? 2 : 1 );
+            if( count > JitComposer::MAX_SLOTS )
+                return error( st, tr("invalid number of fixed values") );
+            if( !fetchV( st->d_children[1], s, me, count, true, call ) )
+                return false;
+            Q_ASSERT( s.d_vals.size() == 2 );
+            qSwap(s.d_vals[0],s.d_vals[1]);
+        }
+        break;
+    case SynTree::R_TSETM_:
+        s.d_op = JitBytecode::OP_TSETM;
+        Q_ASSERT( st->d_children.size() == 3 );
+        if( !fetchN( st->d_children[2], s ) )
+            return false;
+        // the table followed by the slot where VARG puts the values
+        if( !fetchV( st->d_children[1], s, me, 2, false ) )
+            return false;
+        qSwap(s.d_vals[0],s.d_vals[1]);
+        break;
     case SynTree::R_JMP_:
         {
             Named* n = &me->d_firstUnused;
@@ -1102,9 +1579,15 @@ bool Assembler::fetchU(SynTree* st, Assembler::Stmt& s, Assembler::Func* me, boo
         return error(st,tr("argument doesn't designate a variable"));
     createUseXref(ns.first,ns.second,me,1,lhs);
     me->resolveUpval(v);
+    if( d_lock && v->d_func->d_outer == 0 )
+        d_outerUses.append( qMakePair( v->d_name->d_tok.d_val, lhs ) ); // a reused job repeats these
+    if( d_lock )
+        d_lock->lock(); // v might belong to the top-level function shared by all jobs
     v->d_uv = true;
     if( lhs )
         v->d_uvRo = false;
+    if( d_lock )
+        d_lock->unlock();
     s.d_vals << QVariant::fromValue(ns.first);
     return true;
 }
@@ -1290,6 +1773,8 @@ bool Assembler::checkJumpsAndMore(Assembler::Stmts& stmts, const Assembler::Labe
         case JitBytecode::OP_UCLO:
         case JitBytecode::OP_FORI:
         case JitBytecode::OP_FORL:
+        case JitBytecode::OP_ITERL:
+        case JitBytecode::OP_ISNEXT:
         case JitBytecode::OP_JMP:
             {
                 Q_ASSERT( !s.d_vals.isEmpty() );
@@ -1328,6 +1813,7 @@ bool Assembler::checkJumpsAndMore(Assembler::Stmts& stmts, const Assembler::Labe
     case JitBytecode::OP_RET1:
     case JitBytecode::OP_RETM:
     case JitBytecode::OP_CALLT:
+    case JitBytecode::OP_CALLMT:
         return true;
     default:
         return error( stmts.last().d_st, tr("last statement must be return or tail call") );
@@ -1335,6 +1821,188 @@ bool Assembler::checkJumpsAndMore(Assembler::Stmts& stmts, const Assembler::Labe
     return true;
 }
 
+int Assembler::jumpTarget(const Assembler::Stmt& s, int pc)
+{
+    // only valid after checkJumpsAndMore
+    if( JitBytecode::typeCdFromOp(s.d_op) != JitBytecode::Instruction::_jump || s.d_vals.isEmpty() ||
+            !JitBytecode::isNumber(s.d_vals.last()) )
+        return -1;
+    return pc + 1 + s.d_vals.last().toInt() - JitBytecode::Instruction::JumpBias;
+}
+
+bool Assembler::checkLoops(const Assembler::Stmts& stmts)
+{
+    // numeric for: FORI jumps past FORL, FORL jumps back to the statement after FORI
+    // generic for: ( ISNEXT | JMP ) to ITERN/ITERC which is followed by ITERL jumping back to the
+    // statement after ISNEXT/JMP; ISNEXT requires ITERN and vice versa.
+    for( int pc = 0; pc < stmts.size(); pc++ )
+    {
+        const Stmt& s = stmts[pc];
+        switch( s.d_op )
+        {
+        case JitBytecode::OP_FORI:
+            {
+                const int t = jumpTarget(s,pc);
+                if( t < 1 || t > stmts.size() || stmts[t-1].d_op != JitBytecode::OP_FORL ||
+                        toVar(stmts[t-1].d_vals.first()) != toVar(s.d_vals.first()) )
+                    return error(s.d_st,tr("FORI must jump to the statement after the FORL of the same loop") );
+            }
+            break;
+        case JitBytecode::OP_FORL:
+            {
+                const int t = jumpTarget(s,pc);
+                if( t < 1 || t > pc || stmts[t-1].d_op != JitBytecode::OP_FORI ||
+                        toVar(stmts[t-1].d_vals.first()) != toVar(s.d_vals.first()) )
+                    return error(s.d_st,tr("FORL must jump back to the statement after the FORI of the same loop") );
+            }
+            break;
+        case JitBytecode::OP_ITERC:
+        case JitBytecode::OP_ITERN:
+            if( pc + 1 >= stmts.size() || stmts[pc+1].d_op != JitBytecode::OP_ITERL ||
+                    toVar(stmts[pc+1].d_vals.first()) != toVar(s.d_vals.first()) )
+                return error(s.d_st,tr("%1 must be followed by the ITERL of the same loop")
+                             .arg(JitBytecode::nameOfOp(s.d_op)) );
+            break;
+        case JitBytecode::OP_ITERL:
+            {
+                if( pc == 0 || ( stmts[pc-1].d_op != JitBytecode::OP_ITERC &&
+                                 stmts[pc-1].d_op != JitBytecode::OP_ITERN ) )
+                    return error(s.d_st,tr("ITERL must follow ITERC or ITERN") );
+                const int t = jumpTarget(s,pc);
+                if( t < 1 || t > pc )
+                    return error(s.d_st,tr("ITERL must jump back into the loop body") );
+                const Stmt& entry = stmts[t-1];
+                const bool isNext = stmts[pc-1].d_op == JitBytecode::OP_ITERN;
+                if( entry.d_op != JitBytecode::OP_ISNEXT && entry.d_op != JitBytecode::OP_JMP )
+                    return error(s.d_st,tr("ITERL must jump to the statement after the ISNEXT or JMP entering the loop") );
+                if( jumpTarget(entry,t-1) != pc - 1 )
+                    return error(entry.d_st,tr("the loop must be entered at its %1")
+                                 .arg(JitBytecode::nameOfOp(stmts[pc-1].d_op)) );
+                if( isNext && entry.d_op != JitBytecode::OP_ISNEXT )
+                    return error(entry.d_st,tr("ITERN loops must be entered by ISNEXT") );
+                if( !isNext && entry.d_op == JitBytecode::OP_ISNEXT )
+                    return error(entry.d_st,tr("ISNEXT must jump to an ITERN") );
+            }
+            break;
+        case JitBytecode::OP_ISNEXT:
+            {
+                const int t = jumpTarget(s,pc);
+                if( t < 0 || t >= stmts.size() || stmts[t].d_op != JitBytecode::OP_ITERN ||
+                        toVar(stmts[t].d_vals.first()) != toVar(s.d_vals.first()) )
+                    return error(s.d_st,tr("ISNEXT must jump to the ITERN of the same loop") );
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+void Assembler::extendLoopRanges(Assembler::Func* me, const Assembler::Stmts& stmts)
+{
+    // A variable used before and within a loop must survive the back jump, otherwise the allocator
+    // could hand its slot to a variable used later in the loop body. Ranges are pc + 1 based.
+    bool changed = true;
+    while( changed )
+    {
+        changed = false;
+        for( int pc = 0; pc < stmts.size(); pc++ )
+        {
+            const int t = jumpTarget(stmts[pc],pc);
+            if( t < 0 || t > pc )
+                continue;
+            Func::Names::const_iterator i;
+            for( i = me->d_names.begin(); i != me->d_names.end(); ++i )
+            {
+                Var* v = i.value()->toVar();
+                if( v == 0 || v->isUnused() || v->isFixed() )
+                    continue;
+                if( v->d_from < t + 1 && v->d_to >= t + 1 && v->d_to < pc + 1 )
+                {
+                    v->d_to = pc + 1;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+static inline bool isMultResConsumer( quint8 op )
+{
+    return op == JitBytecode::OP_CALLM || op == JitBytecode::OP_CALLMT ||
+            op == JitBytecode::OP_RETM || op == JitBytecode::OP_TSETM;
+}
+
+static inline bool isMultResProducer( quint8 op, int count )
+{
+    // count is the number of values or return values, negative for MULTRES
+    return count < 0 && ( op == JitBytecode::OP_VARG || op == JitBytecode::OP_CALL || op == JitBytecode::OP_CALLM );
+}
+
+bool Assembler::checkMultRes(Assembler::Func* me, const Assembler::Stmts& stmts)
+{
+    // A VARG without count or a CALL or CALLM with '...' returns sets MULTRES which is consumed by the
+    // immediately following statement; the values occupy the slots from the VARG slot or the call base
+    // upwards, so this slot has to be where the consumer expects them and no variable still in use may be above.
+    QSet<int> targets;
+    for( int pc = 0; pc < stmts.size(); pc++ )
+        targets << jumpTarget(stmts[pc],pc);
+
+    for( int pc = 0; pc < stmts.size(); pc++ )
+    {
+        const Stmt& s = stmts[pc];
+        if( s.d_vals.size() > 1 && isMultResProducer( s.d_op, s.d_vals[1].toInt() ) &&
+                ( pc + 1 >= stmts.size() || !isMultResConsumer(stmts[pc+1].d_op) ) )
+            return error(s.d_st,tr("%1 with MULTRES values must be followed by CALLM, CALLMT, RETM or TSETM")
+                         .arg(JitBytecode::nameOfOp(s.d_op)) );
+        if( !isMultResConsumer(s.d_op) )
+            continue;
+        const Var* base = toVar(s.d_vals.first());
+        Q_ASSERT( base != 0 );
+        int first = 0;
+        switch( s.d_op )
+        {
+        case JitBytecode::OP_CALLM:
+            first = base->d_slot + 1 + s.d_vals[2].toInt();
+            break;
+        case JitBytecode::OP_CALLMT:
+            first = base->d_slot + 1 + s.d_vals[1].toInt();
+            break;
+        case JitBytecode::OP_RETM:
+            first = base->d_slot + s.d_vals[1].toInt();
+            break;
+        case JitBytecode::OP_TSETM:
+            first = base->d_slot + 1;
+            break;
+        }
+        const char* name = JitBytecode::nameOfOp(s.d_op);
+        if( pc == 0 || stmts[pc-1].d_vals.size() < 2 ||
+                !isMultResProducer( stmts[pc-1].d_op, stmts[pc-1].d_vals[1].toInt() ) )
+            return error(s.d_st,tr("%1 must directly follow a VARG without count or a CALL or CALLM with '...' returns")
+                         .arg(name) );
+        const Stmt& prod = stmts[pc-1];
+        const char* prodName = JitBytecode::nameOfOp(prod.d_op);
+        if( targets.contains(pc) )
+            return error(s.d_st,tr("jumping to %1 would skip the %2 setting its values").arg(name).arg(prodName) );
+        const Var* v = toVar(prod.d_vals.first());
+        Q_ASSERT( v != 0 );
+        if( v->d_slot != first )
+            return error(prod.d_st,tr("%1 must use the slot after the fixed values of %2; use a record")
+                         .arg(prodName).arg(name) );
+        Func::Names::const_iterator i;
+        for( i = me->d_names.begin(); i != me->d_names.end(); ++i )
+        {
+            const Var* o = i.value()->toVar();
+            if( o == 0 || o == v || o->isUnused() || o->d_slot <= v->d_slot )
+                continue;
+            // the producer is at pc - 1, i.e. range position pc
+            if( o->d_uv || ( o->d_from < pc && o->d_to > pc + 1 ) )
+                return error(prod.d_st,tr("%1 would overwrite variable '%2' still in use")
+                             .arg(prodName).arg(o->d_name->d_tok.d_val.constData()) );
+        }
+    }
+    return true;
+}
+
 bool Assembler::sortVars1( Assembler::Var* lhs, Assembler::Var* rhs )
 {
     return lhs->d_from < rhs->d_from;
@@ -1453,7 +2121,8 @@ bool Assembler::allocateRegisters3(Assembler::Func* me)
             continue;
         // go rightward to find the end of a successing header without overlap
         VarList overlap;
-        findOverlaps( overlap, h );
+        QSet<Var*> seen;
+        findOverlaps( overlap, seen, h );
 #ifdef _DEBUG_
         if( !overlap.isEmpty() )
         {
@@ -1590,6 +2259,57 @@ bool Assembler::checkSlotOrder(const Assembler::Stmts& stmts)
                     return error(s.d_st,tr(msg) );
             }
             break;
+        case JitBytecode::OP_CALLM:
+            {
+                Q_ASSERT( s.d_vals.size() == 3 );
+                const int rets = s.d_vals[1].toInt();
+                const int args = s.d_vals[2].toInt();
+                const Var* v = toVar(s.d_vals[0]);
+                const int n = qMax( rets, args + 2 );
+                if( !checkSlotOrder( v, n ) )
+                    return error(s.d_st,tr(msg) );
+            }
+            break;
+        case JitBytecode::OP_CALLMT:
+        case JitBytecode::OP_RETM:
+            {
+                Q_ASSERT( s.d_vals.size() == 2 );
+                const int n = s.d_vals[1].toInt() + ( s.d_op == JitBytecode::OP_CALLMT ? 2 : 1 );
+                const Var* v = toVar(s.d_vals[0]);
+                if( !checkSlotOrder( v, n ) )
+                    return error(s.d_st,tr(msg) );
+            }
+            break;
+        case JitBytecode::OP_TSETM:
+            {
+                const Var* v = toVar(s.d_vals.first());
+                if( !checkSlotOrder( v, 2 ) )
+                    return error(s.d_st,tr(msg) );
+            }
+            break;
+        case JitBytecode::OP_VARG:
+            {
+                const Var* v = toVar(s.d_vals.first());
+                if( !checkSlotOrder( v, qMax( s.d_vals[1].toInt(), 1 ) ) )
+                    return error(s.d_st,tr(msg) );
+            }
+            break;
+        case JitBytecode::OP_ITERC:
+        case JitBytecode::OP_ITERN:
+            {
+                const Var* v = toVar(s.d_vals.first());
+                if( !checkSlotOrder( v, 3 + qMax( s.d_vals[1].toInt(), 3 ) ) )
+                    return error(s.d_st,tr(msg) );
+            }
+            break;
+        case JitBytecode::OP_ITERL:
+        case JitBytecode::OP_ISNEXT:
+            {
+                const Var* v = toVar(s.d_vals.first());
+                if( !checkSlotOrder( v, 3 ) )
+                    return error(s.d_st,tr(msg) );
+            }
+            break;
         }
     }
     return true;
@@ -1626,7 +2346,8 @@ bool Assembler::checkTestOp(const Assembler::Stmts& stmts, int pc)
 bool Assembler::generateCode(Func* f, const Stmts& stmts)
 {
     // TODO: check for read-only upvals
-    d_comp.setUpvals(f->getUpvals());
+    if( d_lock == 0 )
+        d_comp.setUpvals(f->getUpvals());
     d_comp.setVarNames(f->getVarNames());
 
     for( int pc = 0; pc < stmts.size(); pc++ )
@@ -1662,13 +2383,36 @@ bool Assembler::generateCode(Func* f, const Stmts& stmts)
         case JitBytecode::OP_CALL:
             // Operand C is one plus the number of fixed arguments.
             s.d_vals[2] = s.d_vals[2].toUInt() + 1;
-            // Operand B is one plus the number of return values (MULTRES is not supported)
-            s.d_vals[1] = s.d_vals[1].toUInt() + 1;
+            // Operand B is one plus the number of return values or zero for MULTRES
+            s.d_vals[1] = s.d_vals[1].toInt() < 0 ? 0 : s.d_vals[1].toInt() + 1;
             break;
         case JitBytecode::OP_CALLT:
             // Operand C is one plus the number of fixed arguments.
             s.d_vals[1] = s.d_vals[1].toUInt() + 1;
             break;
+        case JitBytecode::OP_CALLM:
+            // Operand C is the number of fixed arguments, B as with CALL.
+            s.d_vals[1] = s.d_vals[1].toInt() < 0 ? 0 : s.d_vals[1].toInt() + 1;
+            break;
+        case JitBytecode::OP_VARG:
+            // Operand B is one plus the number of values or zero for MULTRES
+            s.d_vals[1] = s.d_vals[1].toInt() < 0 ? 0 : s.d_vals[1].toInt() + 1;
+            break;
+        case JitBytecode::OP_TSETM:
+            // Operand A is the first value, the table is at A - 1
+            s.d_vals[0] = toValue(f, JitBytecode::typeAFromOp(s.d_op), s.d_vals[0] ) + 1;
+            s.d_vals[1] = JitComposer::toTsetmConst( s.d_vals[1].toUInt() );
+            break;
+        case JitBytecode::OP_ITERC:
+        case JitBytecode::OP_ITERN:
+            // Operand B is one plus the number of loop variables
+            s.d_vals[1] = s.d_vals[1].toUInt() + 1;
+            // fall through
+        case JitBytecode::OP_ITERL:
+        case JitBytecode::OP_ISNEXT:
+            // Operand A is the first loop variable, generator, state and control are at A - 3 to A - 1
+            s.d_vals[0] = toValue(f, JitBytecode::typeAFromOp(s.d_op), s.d_vals[0] ) + 3;
+            break;
         default:
             break;
         }
@@ -1728,7 +2472,11 @@ void Assembler::createUseXref(Assembler::Named* n, SynTree* st, Assembler::Func*
             x->d_col = st->d_tok.d_colNr;
             Q_ASSERT( n->d_xref != 0 );
             x->d_decl = n->d_xref;
+            if( d_lock )
+                d_lock->lock();
             n->d_xref->d_usedBy.append(x);
+            if( d_lock )
+                d_lock->unlock();
             Q_ASSERT( f->d_xref != 0 );
             f->d_xref->d_subs.append(x);
             Var* v = n->toVar();
@@ -1855,6 +2603,19 @@ Assembler::NameSym Assembler::derefDesig(SynTree* st, Assembler::Func* me, bool
             error(name,tr("name doesn't designate a function"));
             return NameSym();
         }
+        if( d_lock )
+        {
+            // jobs run in parallel or are reused; only the enclosing functions are stable, see
+            // refersToOtherFuncs
+            Func* f = me;
+            while( f && f != func )
+                f = f->d_outer;
+            if( f == 0 )
+            {
+                error(name,tr("only enclosing functions can be referenced when assembling in parallel"));
+                return NameSym();
+            }
+        }
         vnameIdx = 2;
     }
 
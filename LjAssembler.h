@@ -21,6 +21,8 @@
 */
 
 #include <QObject>
+#include <QSet>
+#include <QMutex>
 #include <LjTools/LjasSynTree.h>
 #include <LjTools/LuaJitComposer.h>
 
@@ -53,6 +55,28 @@ namespace Ljas
         ~Assembler();
         bool process( SynTree*, const QByteArray& sourceRef = QByteArray(), bool createXref = false );
         const QByteArray& getBc() const { return d_bc; }
+        // assemble the functions nested in the top-level function in parallel on the global thread pool;
+        // falls back to serial assembly if a nested function qualifies a name with a non-enclosing function
+        void setParallel( bool on ) { d_parallel = on; }
+
+        // Keeps the nested functions assembled in parallel mode. A subsequent run with the same cache
+        // only reassembles the functions the source or outer declarations of which changed; the others
+        // are reused and moved to their new lines. Entries not used by the last run are dropped.
+        class Cache
+        {
+        public:
+            Cache() {}
+            ~Cache() { clear(); }
+            void clear();
+            int size() const { return d_entries.size(); }
+            struct Entry;
+        private:
+            friend class Assembler;
+            typedef QHash<QByteArray,Entry*> Entries;
+            Entries d_entries;
+            Q_DISABLE_COPY(Cache)
+        };
+        void setCache( Cache* c ) { d_cache = c; }
         Xref* getXref( bool transferOwnership = false );
 
     protected:
@@ -123,7 +147,8 @@ namespace Ljas
             Func* d_outer;
             quint16 d_id;
             Var d_firstUnused;
-            Func():d_outer(0),d_id(0) {}
+            bool d_varargs;
+            Func():d_outer(0),d_id(0),d_varargs(false) {}
             ~Func();
             virtual bool isFunc() const { return true; }
             Named* findAll(const QByteArray& name , bool* isLocal = 0) const;
@@ -143,8 +168,25 @@ namespace Ljas
             void registerRange( Var* );
         };
         typedef QList<Stmt> Stmts;
+        struct Job
+        {
+            SynTree* d_st;
+            Func* d_func;
+            Assembler* d_ass; // owned by processFuncsInParallel, null if reused from cache
+            Cache::Entry* d_cached;
+            QByteArray d_key;
+            bool d_ok;
+            Job():d_st(0),d_func(0),d_ass(0),d_cached(0),d_ok(false){}
+        };
 
         bool processFunc( SynTree*, Func* outer = 0 );
+        Func* declareFunc( SynTree*, Func* outer );
+        bool processFuncBody( SynTree*, Func* me );
+        bool processFuncsInParallel( SynTree* hdr, Func* me );
+        static void runJob( Job& );
+        QByteArray cacheKey( const QByteArray& scope, SynTree* ) const;
+        Cache::Entry* createCacheEntry( const Job&, Func* me, const QList<Lua::JitComposer::UpvalList>& );
+        int reuseCacheEntry( const Job&, Func* me );
         bool processParams(SynTree*, Func* me );
         bool processConsts( SynTree*, Func* me );
         bool processConst( SynTree*, Const* c, bool allowTable );
@@ -163,6 +205,9 @@ namespace Ljas
         bool fetchCsnp( SynTree*, Stmt&, Func* );
         bool fetchVcn( SynTree*, Stmt&, Func* );
         bool checkJumpsAndMore( Stmts&, const Labels&, Func*);
+        bool checkLoops( const Stmts& );
+        void extendLoopRanges( Func*, const Stmts& );
+        bool checkMultRes( Func*, const Stmts& );
         bool allocateRegisters3(Func* me );
         bool checkSlotOrder(const Stmts& stmts);
         bool checkTestOp( const Stmts& stmts, int pc );
@@ -175,12 +220,14 @@ namespace Ljas
         NameSym derefDesig( SynTree*, Func*, bool onlyLocalVars = true );
         static SynTree* findFirstChild(const SynTree*, int type , int startWith = 0);
         static SynTree* flatten( SynTree*, int stopAt = 0 );
+        static bool refersToOtherFuncs( SynTree*, QList<QByteArray>& enclosing );
         bool error( SynTree*, const QString& );
         static bool sortVars1( Var* lhs, Var* rhs );
         static bool checkSlotOrder( const Var*, int n );
         static Var* toVar( const QVariant& );
         static Var* toVar( Named* );
-        static void findOverlaps( VarList&, Var* header );
+        static int jumpTarget( const Stmt&, int pc );
+        static void findOverlaps( VarList&, QSet<Var*>& seen, Var* header );
         static void resolveOverlaps( const VarList& );
     private:
         friend struct QMetaTypeId<Named*>;
@@ -192,6 +239,11 @@ namespace Ljas
         Func d_top;
         bool d_createXref;
         Xref* d_xref;
+        bool d_parallel;
+        Cache* d_cache;
+        QMutex* d_lock; // only set in the Assemblers of the jobs
+        QList<Func*> d_opened; // functions of a job in openFunction order
+        QList<QPair<QByteArray,bool> > d_outerUses; // variables of the top-level function used by a job, lhs
     };
 }
 
@@ -28,6 +28,7 @@
 #include <LjTools/BcViewer.h>
 #include <LjTools/LuaJitEngine.h>
 #include <LjTools/LuaJitComposer.h>
+#include <LjTools/LocalsView.h>
 #include <lua.hpp>
 #include <QtDebug>
 #include <QDockWidget>
@@ -101,42 +102,6 @@ QString BcDebugger::relativeToAbsolutePath( QString path )
     return path;
 }
 
-class BcDebugger::Debugger : public DbgShell
-{
-public:
-    BcDebugger* d_ide;
-    Debugger(BcDebugger* ide):d_ide(ide){}
-    void handleBreak( Engine2* lua, const QByteArray& source, quint32 line )
-    {
-        d_ide->enableDbgMenu();
-        d_ide->fillStack();
-        d_ide->fillLocals();
-
-        QByteArray msg = lua->getValueString(1).simplified();
-        msg = msg.mid(1,msg.size()-2); // remove ""
-        if( !lua->isBreakHit() )
-        {
-            if( d_ide->luaRuntimeMessage(msg,source) )
-                d_ide->onErrors();
-        }
-
-        while( lua->isWaiting() )
-        {
-            QApplication::processEvents(QEventLoop::AllEvents | QEventLoop::WaitForMoreEvents );
-            QApplication::flush();
-        }
-        d_ide->removePosMarkers();
-        d_ide->enableDbgMenu();
-        d_ide->d_stack->clear();
-        d_ide->d_locals->clear();
-    }
-    void handleAliveSignal(Engine2* e)
-    {
-        QApplication::processEvents(QEventLoop::AllEvents | QEventLoop::WaitForMoreEvents );
-        QApplication::flush();
-    }
-};
-
 static BcDebugger* s_this = 0;
 static void report(QtMsgType type, const QString& message )
 {
@@ -166,7 +131,7 @@ static void messageHander(QtMsgType type, const QMessageLogContext& ctx, const Q
 }
 
 BcDebugger::BcDebugger(Engine2* lua, QWidget *parent)
-    : QMainWindow(parent),d_lock(false),d_pushBackLock(false)
+    : QMainWindow(parent),d_lock(false),d_pushBackLock(false),d_threadErrors(false)
 {
     s_this = this;
 
@@ -194,9 +159,16 @@ BcDebugger::BcDebugger(Engine2* lua, QWidget *parent)
     lua_pushcfunction( d_lua->getCtx(), Engine2::ABORT );
     lua_setglobal( d_lua->getCtx(), "ABORT" );
 
-    d_dbg = new Debugger(this);
-    d_lua->setDbgShell(d_dbg);
-    // d_lua->setAliveSignal(true); // reduces performance by factor 2 to 5
+    d_runner = new Engine2Thread(d_lua);
+    d_runner->setLocalsWithTemps(true);
+    d_lua->setDbgShell(d_runner);
+    connect( d_runner, SIGNAL(sigBreak(Lua::Engine2Thread::Snapshot)),
+             this, SLOT(onThreadBreak(Lua::Engine2Thread::Snapshot)) );
+    connect( d_runner, SIGNAL(sigLevel(Lua::Engine2Thread::Snapshot)),
+             this, SLOT(onThreadLevel(Lua::Engine2Thread::Snapshot)) );
+    connect( d_runner, SIGNAL(sigContinued()), this, SLOT(onThreadContinued()) );
+    connect( d_runner, SIGNAL(sigJobDone(bool,QByteArray)), this, SLOT(onThreadJobDone(bool,QByteArray)) );
+    connect( d_runner, SIGNAL(sigIdle()), this, SLOT(onThreadIdle()) );
     connect( d_lua, SIGNAL(onNotify(int,QByteArray,int)),this,SLOT(onLuaNotify(int,QByteArray,int)) );
 
     d_tab = new DocTabWidget(this,false);
@@ -288,8 +260,8 @@ BcDebugger::BcDebugger(Engine2* lua, QWidget *parent)
 
 BcDebugger::~BcDebugger()
 {
+    delete d_runner; // aborts the running script and waits for the worker
     d_lua->setDbgShell(0);
-    delete d_dbg;
 }
 
 void BcDebugger::loadFile(const QString& path)
@@ -330,7 +302,7 @@ bool BcDebugger::initializeFromFiles(const Files& files, const QString& workingD
 
 void BcDebugger::closeEvent(QCloseEvent* event)
 {
-    if( d_lua->isExecuting() )
+    if( d_runner->isBusy() )
     {
         QMessageBox::warning(this,tr("Closing Main Window"), tr("Cannot quit IDE when Lua is running") );
         event->setAccepted(false);
@@ -351,6 +323,7 @@ void BcDebugger::createTerminal()
     dock->setAllowedAreas( Qt::AllDockWidgetAreas );
     dock->setFeatures( QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable );
     d_term = new Terminal2(dock, d_lua);
+    d_term->setRunner(d_runner);
     dock->setWidget(d_term);
     addDockWidget( Qt::BottomDockWidgetArea, dock );
     new Gui::AutoShortcut( tr("CTRL+SHIFT+C"), this, d_term, SLOT(onClear()) );
@@ -419,12 +392,8 @@ void BcDebugger::createLocals()
     dock->setObjectName("BcLocals");
     dock->setAllowedAreas( Qt::AllDockWidgetAreas );
     dock->setFeatures( QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable );
-    d_locals = new QTreeWidget(dock);
-    d_locals->setHeaderHidden(true);
-    d_locals->setAlternatingRowColors(true);
-    d_locals->setColumnCount(2); // Name, Value
-    d_locals->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
-    d_locals->header()->setSectionResizeMode(1, QHeaderView::Stretch);
+    d_locals = new LocalsView(d_lua,dock);
+    d_locals->setRunner(d_runner);
     dock->setWidget(d_locals);
     addDockWidget( Qt::LeftDockWidgetArea, dock );
 }
@@ -542,33 +511,18 @@ void BcDebugger::createMenuBar()
 
 void BcDebugger::onRun()
 {
-    ENABLED_IF( !d_files.isEmpty() && !d_lua->isExecuting() );
+    ENABLED_IF( !d_files.isEmpty() && !d_runner->isBusy() );
 
 
     QDir::setCurrent(d_workingDir);
 
-    bool hasErrors = false;
+    // only queued; the results arrive in onThreadJobDone and onThreadIdle
+    d_threadErrors = false;
     foreach( const SourceBinaryPair& path, d_files )
     {
         const QString module = QFileInfo(path.second).baseName();
-        d_lua->executeCmd( QString("package.loaded[\"%1\"]=nil").arg(module).toUtf8(), "terminal" );
-        if( !d_lua->executeFile(path.second.toUtf8()) )
-        {
-            hasErrors = true;
-        }
-
-        if( d_lua->isAborted() )
-        {
-            removePosMarkers();
-            return;
-        }
-    }
-
-    if( hasErrors )
-    {
-        removePosMarkers();
-        onErrors();
-        return;
+        d_runner->executeCmd( QString("package.loaded[\"%1\"]=nil").arg(module).toUtf8(), "terminal" );
+        d_runner->executeFile(path.second.toUtf8());
     }
 
     //out << "jit.off()" << endl;
@@ -578,15 +532,13 @@ void BcDebugger::onRun()
     //out << "jit.opt.start(\"hotloop=10\", \"hotexit=2\")" << endl;
 
     if( !d_runCmd.isEmpty() )
-        d_lua->executeCmd(d_runCmd);
-    removePosMarkers();
-
+        d_runner->executeCmd(d_runCmd, QByteArray(), true);
+    enableDbgMenu();
 }
 
 void BcDebugger::onAbort()
 {
-    // ENABLED_IF( d_lua->isWaiting() );
-    d_lua->terminate();
+    d_runner->terminate();
 }
 
 void BcDebugger::onNewPro()
@@ -742,8 +694,7 @@ void BcDebugger::onStackDblClicked(QTreeWidgetItem* item, int)
             showEditor( source, func, line );
         }
         const int level = item->data(0,Qt::UserRole).toInt();
-        d_lua->setActiveLevel(level);
-        fillLocals();
+        d_runner->setActiveLevel(level); // locals arrive with onThreadLevel
     }
 }
 
@@ -830,19 +781,15 @@ void BcDebugger::onRemoveFile()
 
 void BcDebugger::onEnableDebug()
 {
-    CHECKED_IF( true, d_lua->isDebug() );
+    CHECKED_IF( true, d_runner->isDebug() );
 
-    d_lua->setDebug( !d_lua->isDebug() );
+    d_runner->setDebug( !d_runner->isDebug() );
     enableDbgMenu();
 }
 
 void BcDebugger::onBreak()
 {
-    if( !d_lua->isDebug() )
-        d_lua->setDebug(true);
-    // normal call because called during processEvent which doesn't seem to enable
-    // the functions: ENABLED_IF( d_lua->isExecuting() );
-    d_lua->runToNextLine();
+    d_runner->runToNextLine(); // switches on debugging if necessary
 }
 
 bool BcDebugger::checkSaved(const QString& title)
@@ -952,7 +899,7 @@ void BcDebugger::showEditor(const QString& path, quint32 func, quint32 pc, bool
         edit->setLastWidth(200);
         edit->loadFrom(d_files[found].second,d_files[found].first);
 
-        const Engine2::Breaks& br = d_lua->getBreaks( path.toUtf8() );
+        const Engine2::Breaks br = d_runner->getBreaks( path.toUtf8() );
         Engine2::Breaks::const_iterator j;
         for( j = br.begin(); j != br.end(); ++j )
             edit->addBreakPoint((*j));
@@ -1032,10 +979,9 @@ bool BcDebugger::luaRuntimeMessage(const QByteArray& msg, const QString& file )
     // qWarning() << "Unknown Lua error message format:" << msg;
 }
 
-void BcDebugger::fillStack()
+void BcDebugger::fillStack(const Engine2::StackLevels& ls)
 {
     d_stack->clear();
-    Engine2::StackLevels ls = d_lua->getStackTrace();
 
     bool opened = false;
     for( int level = 0; level < ls.size(); level++ )
@@ -1060,8 +1006,7 @@ void BcDebugger::fillStack()
             item->setToolTip(3, path );
             if( !opened )
             {
-                showEditor(path, l.d_lineDefined, l.d_line, true );
-                d_lua->setActiveLevel(level);
+                showEditor(path, l.d_lineDefined, l.d_line, true ); // the runner made it the active level
                 opened = true;
             }
         }
@@ -1070,166 +1015,6 @@ void BcDebugger::fillStack()
     d_stack->parentWidget()->show();
 }
 
-static void typeAddr( QTreeWidgetItem* item, const QVariant& val )
-{
-    if( val.canConvert<Lua::Engine2::VarAddress>() )
-    {
-        Lua::Engine2::VarAddress addr = val.value<Lua::Engine2::VarAddress>();
-        if( addr.d_addr )
-        {
-            QString str = QString("address 0x%1").arg(quintptr(addr.d_addr),8,16,QChar('0'));
-            if( addr.d_meta )
-                str += QString(" metatable 0x%1").arg(quintptr(addr.d_meta),8,16,QChar('0'));
-            item->setToolTip(1, str);
-        }
-        switch( addr.d_type )
-        {
-        case Engine2::LocalVar::NIL:
-            item->setText(1, "nil");
-            break;
-        case Engine2::LocalVar::FUNC:
-            item->setText(1, "func");
-            break;
-        case Engine2::LocalVar::TABLE:
-            item->setText(1, "table");
-            break;
-        case Engine2::LocalVar::STRUCT:
-            item->setText(1, "struct");
-            break;
-        case Engine2::LocalVar::CDATA:
-            item->setText(1, "cdata");
-            break;
-        case Engine2::LocalVar::UNKNOWN:
-            item->setText(1, "<unknown>");
-            break;
-        }
-    }else if( val.type() == QMetaType::QVariantMap)
-    {
-        QVariantMap map = val.toMap();
-        typeAddr( item, map.value(QString()) );
-    }
-}
-
-static void setLocalText( QTreeWidgetItem* local, const QVariant& val )
-{
-    switch( val.type() )
-    {
-    case QVariant::Double:
-        {
-            const double d = val.toDouble();
-            const int i = d;
-            if( d == NAN )
-            {
-                local->setText(1, "#NaN" );
-            }else if( d - double(i) == 0.0 )
-            {
-                local->setToolTip(1, QString("%1 0x%2").arg(i).arg(i,0,16));
-                local->setText(1, QString::number( qint32(d) ) );
-            }else
-            {
-                local->setText(1, val.toString() );
-                local->setToolTip(1,QString::number(d, 'f', 8 ));
-            }
-        }
-        break;
-    case QVariant::Int:
-    case QVariant::UInt:
-    case QVariant::LongLong:
-    case QVariant::ULongLong:
-        local->setText(1, val.toString() );
-        local->setToolTip(1, QString("%1 0x%2").arg(val.toString()).arg(val.toLongLong(),0,16));
-        break;
-    default:
-        local->setText(1, val.toString() );
-        break;
-    }
-}
-
-static void fillLocalSubs( QTreeWidgetItem* super, const QVariantMap& vals )
-{
-    QVariantMap::const_iterator i;
-    for( i = vals.begin(); i != vals.end(); i++ )
-    {
-        if( i.key().isEmpty() )
-            continue;
-        QTreeWidgetItem* item = new QTreeWidgetItem(super);
-        item->setText(0, i.key() );
-
-        if( i.value().canConvert<Lua::Engine2::VarAddress>() )
-        {
-            typeAddr(item,i.value());
-        }else if( i.value().type() == QMetaType::QVariantMap)
-        {
-            typeAddr(item,i.value());
-            fillLocalSubs(item,i.value().toMap() );
-        }else if( i.value().type() == QMetaType::QByteArray )
-        {
-            item->setText(1, "\"" + i.value().toString().simplified() + "\"");
-            item->setToolTip(1, i.value().toString());
-        }else
-            setLocalText(item,i.value());
-    }
-}
-
-void BcDebugger::fillLocals()
-{
-    d_locals->clear();
-    Engine2::LocalVars vs = d_lua->getLocalVars(true,4,50,true); // TODO: adjustable
-    foreach( const Engine2::LocalVar& v, vs )
-    {
-        QTreeWidgetItem* item = new QTreeWidgetItem(d_locals);
-        QString name = v.d_name;
-        if( v.d_isUv )
-            name = name + "'";
-        item->setText(0,name);
-        if( v.d_value.canConvert<Lua::Engine2::VarAddress>() )
-        {
-            typeAddr(item,v.d_value);
-        }else if( v.d_value.type() == QMetaType::QVariantMap )
-        {
-            typeAddr(item,v.d_value);
-            fillLocalSubs(item,v.d_value.toMap() );
-        }else if( JitBytecode::isString(v.d_value) )
-        {
-            if( v.d_type == Engine2::LocalVar::CDATA || v.d_type == Engine2::LocalVar::UNKNOWN )
-                item->setText(1, v.d_value.toString().simplified());
-            else
-                item->setText(1, "\"" + v.d_value.toString().simplified() + "\"");
-            item->setToolTip(1, v.d_value.toString() );
-        }else if( !v.d_value.isNull() )
-            setLocalText(item,v.d_value);
-        else
-        {
-            switch( v.d_type )
-            {
-            case Engine2::LocalVar::NIL:
-                item->setText(1, "nil");
-                break;
-            case Engine2::LocalVar::FUNC:
-                item->setText(1, "func");
-                break;
-            case Engine2::LocalVar::TABLE:
-                item->setText(1, "table");
-                break;
-            case Engine2::LocalVar::STRUCT:
-                item->setText(1, "struct");
-                break;
-            case Engine2::LocalVar::CDATA:
-                item->setText(1, "cdata");
-                break;
-            case Engine2::LocalVar::UNKNOWN:
-                item->setText(1, "<unknown>");
-                break;
-            case Engine2::LocalVar::STRING:
-                item->setText(1, "\"" + v.d_value.toString().simplified() + "\"");
-                break;
-            default:
-                break;
-           }
-        }
-    }
-}
-
 void BcDebugger::removePosMarkers()
 {
     for( int i = 0; i < d_tab->count(); i++ )
@@ -1241,12 +1026,12 @@ void BcDebugger::removePosMarkers()
 
 void BcDebugger::enableDbgMenu()
 {
-    d_dbgBreak->setEnabled(d_lua->isExecuting());
-    d_dbgAbort->setEnabled(d_lua->isExecuting());
-    d_dbgContinue->setEnabled(d_lua->isWaiting());
+    d_dbgBreak->setEnabled(d_runner->isBusy());
+    d_dbgAbort->setEnabled(d_runner->isBusy());
+    d_dbgContinue->setEnabled(d_runner->isWaiting());
     d_dbgStepIn->setEnabled(true);
-    d_dbgStepOver->setEnabled(d_lua->isWaiting() && d_lua->isDebug() );
-    d_dbgStepOut->setEnabled(d_lua->isWaiting() && d_lua->isDebug() );
+    d_dbgStepOver->setEnabled(d_runner->isWaiting() && d_runner->isDebug() );
+    d_dbgStepOut->setEnabled(d_runner->isWaiting() && d_runner->isDebug() );
 }
 
 void BcDebugger::handleGoBack()
@@ -1287,38 +1072,37 @@ void BcDebugger::onToggleBreakPt()
     if( !edit->toggleBreakPoint(&bp) )
         return;
     if( bp.d_on )
-        d_lua->addBreak( edit->getPath().toUtf8(), bp.d_linePc );
+        d_runner->addBreak( edit->getPath().toUtf8(), bp.d_linePc );
     else
-        d_lua->removeBreak( edit->getPath().toUtf8(), bp.d_linePc );
+        d_runner->removeBreak( edit->getPath().toUtf8(), bp.d_linePc );
 }
 
 void BcDebugger::onStepInto()
 {
-    // ENABLED_IF( d_lua->isWaiting() );
-
-    if( !d_lua->isWaiting() || !d_lua->isDebug() )
+    if( d_runner->isBusy() )
+        d_runner->runToNextLine(); // also stops a running script
+    else
     {
-        d_lua->setDebug(true);
+        d_runner->setDebug(true);
+        d_runner->setDefaultCmd(Engine2::StepNext);
         enableDbgMenu();
-        d_lua->setDefaultCmd(Engine2::StepNext);
         onRun();
-    }else
-        d_lua->runToNextLine();
+    }
 }
 
 void BcDebugger::onStepOver()
 {
-    d_lua->runToNextLine(Engine2::StepOver);
+    d_runner->runToNextLine(Engine2::StepOver);
 }
 
 void BcDebugger::onStepOut()
 {
-    d_lua->runToNextLine(Engine2::StepOut);
+    d_runner->runToNextLine(Engine2::StepOut);
 }
 
 void BcDebugger::onContinue()
 {
-    d_lua->runToBreakPoint();
+    d_runner->runToBreakPoint();
 }
 
 void BcDebugger::onWorkingDir()
@@ -1342,13 +1126,56 @@ void BcDebugger::onLuaNotify(int messageType, QByteArray val1, int val2)
     case Engine2::LineHit:
     case Engine2::BreakHit:
     case Engine2::ErrorHit:
+        enableDbgMenu();
+        break;
     case Engine2::Finished:
     case Engine2::Aborted:
         enableDbgMenu();
+        d_locals->clear();
         break;
     }
 }
 
+void BcDebugger::onThreadBreak(const Engine2Thread::Snapshot& s)
+{
+    enableDbgMenu();
+    fillStack( s.d_stack );
+    d_locals->setLocals( s.d_locals );
+    if( !s.d_breakHit )
+    {
+        if( luaRuntimeMessage(s.d_value,s.d_source) )
+            onErrors();
+    }
+}
+
+void BcDebugger::onThreadLevel(const Engine2Thread::Snapshot& s)
+{
+    d_locals->setLocals( s.d_locals );
+}
+
+void BcDebugger::onThreadContinued()
+{
+    removePosMarkers();
+    enableDbgMenu();
+    d_stack->clear();
+    // d_locals is kept so the next stop can be diffed against it
+}
+
+void BcDebugger::onThreadJobDone(bool ok, const QByteArray& error)
+{
+    if( !ok )
+        d_threadErrors = true;
+}
+
+void BcDebugger::onThreadIdle()
+{
+    removePosMarkers();
+    enableDbgMenu();
+    if( d_threadErrors )
+        onErrors();
+    d_threadErrors = false;
+}
+
 void BcDebugger::pushLocation(const BcDebugger::Location& loc)
 {
     if( d_pushBackLock )
@@ -1395,7 +1222,7 @@ void BcDebugger::onSetMain()
 
 void BcDebugger::onQuit()
 {
-    ENABLED_IF(!d_lua->isExecuting());
+    ENABLED_IF(!d_runner->isBusy());
 
     close();
     // qApp->quit();
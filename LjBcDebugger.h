@@ -22,6 +22,7 @@
 
 #include <QMainWindow>
 #include <LjTools/LuaModule.h>
+#include <LjTools/Engine2Thread.h>
 
 class QTreeWidget;
 class QTreeWidgetItem;
@@ -38,6 +39,7 @@ namespace Lua
     class Engine2;
     class BcViewer2;
     class Terminal2;
+    class LocalsView;
     class JitEngine;
     /*
     namespace Ast
@@ -81,8 +83,7 @@ namespace Lua
         void createMenu( QWidget* );
         void addDebugMenu(Gui::AutoMenu * pop);
         bool luaRuntimeMessage(const QByteArray&, const QString& file);
-        void fillStack();
-        void fillLocals();
+        void fillStack( const Engine2::StackLevels& );
         void removePosMarkers();
         void enableDbgMenu();
         struct Location
@@ -137,15 +138,19 @@ namespace Lua
         void onQt();
         void onSetMain();
         void onQuit();
+        void onThreadBreak( const Lua::Engine2Thread::Snapshot& );
+        void onThreadLevel( const Lua::Engine2Thread::Snapshot& );
+        void onThreadContinued();
+        void onThreadJobDone( bool ok, const QByteArray& error );
+        void onThreadIdle();
     private:
-        class Debugger;
         DocTabWidget* d_tab;
-        Debugger* d_dbg;
         Lua::Engine2* d_lua;
+        Lua::Engine2Thread* d_runner; // all scripts run on it; the engine is only inspected while it waits
         Lua::Terminal2* d_term;
         QTreeWidget* d_mods;
         QTreeWidget* d_stack;
-        QTreeWidget* d_locals;
+        LocalsView* d_locals;
         QTreeWidget* d_errs;
         QList<Location> d_backHisto; // d_backHisto.last() ist aktuell angezeigtes Objekt
         QList<Location> d_forwardHisto;
@@ -160,6 +165,7 @@ namespace Lua
         QByteArray d_runCmd;
         bool d_lock;
         bool d_pushBackLock;
+        bool d_threadErrors;
     };
 }
 
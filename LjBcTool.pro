@@ -0,0 +1,54 @@
+#/*
+#* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+#*
+#* This file is part of the LuaJIT BC Viewer application.
+#*
+#* The following is the license that applies to this copy of the
+#* application. For a license to use the application under conditions
+#* other than those described here, please email to me@rochus-keller.ch.
+#*
+#* GNU General Public License Usage
+#* This file may be used under the terms of the GNU General Public
+#* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+#* Foundation and appearing in the file LICENSE.GPL included in
+#* the packaging of this file. Please review the following information
+#* to ensure GNU General Public Licensing requirements will be met:
+#* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+#* http://www.gnu.org/copyleft/gpl.html.
+#*/
+
+QT       += core concurrent
+QT       -= gui
+
+TARGET = LjBcTool
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += .. ../LuaJIT/src
+
+SOURCES += LjBcToolMain.cpp \
+    LuaJitBytecode.cpp \
+    LuaJitVerifier.cpp \
+    LuaJitComposer.cpp \
+    LuaJitFlowGraph.cpp \
+    LjDisasm.cpp \
+    LuaJitDiff.cpp \
+    LuaJitLinker.cpp
+
+HEADERS  += LuaJitBytecode.h \
+    LuaJitVerifier.h \
+    LuaJitComposer.h \
+    LuaJitFlowGraph.h \
+    LjDisasm.h \
+    LuaJitDiff.h \
+    LuaJitLinker.h \
+    StreamSpy.h
+
+CONFIG(debug, debug|release) {
+        DEFINES += _DEBUG
+}
+
+!win32 {
+    QMAKE_CXXFLAGS += -Wno-reorder -Wno-unused-parameter -Wno-unused-function -Wno-unused-variable
+}
@@ -0,0 +1,530 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LuaJitVerifier.h"
+#include "LjDisasm.h"
+#include "LuaJitDiff.h"
+#include "LuaJitComposer.h"
+#include "LuaJitLinker.h"
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QMutex>
+using namespace Lua;
+
+// Usage: LjBcTool [-j threads] [-v] [-a] [-d dir|-] [-f csv|json] [-o file] [-q] files or directories...
+// Directories are searched recursively for LuaJIT bytecode dumps. Each file is parsed, verified and optionally
+// disassembled to .ljasm (-a next to the input, -d into the given directory, where the files found in a directory
+// argument keep their path relative to it, -d - one after the other to stdout) on all cores. One line of statistics
+// per file is written to stdout or the -o file as soon as the file is done, followed by a line with the totals;
+// -v only verifies and reports the issues, as does -d - without -o. Exits with 1 if any file is invalid.
+// Usage: LjBcTool -c [-f csv|json] [-o file] [-q] old new
+// Compares two dumps (see JitDiff) and writes one line per changed function. Exits with 1 if they differ.
+// Usage: LjBcTool -l out [-s] [-q] [name=]file...
+// Links the dumps into one (see JitLinker) which registers each in package.preload under the given name, by default
+// the file name without suffix; -s strips the debug information.
+
+enum { NumOps = JitBytecode::OP_JMP + 1, NumFrameBuckets = 7 }; // framesize < 4, 8, 16, 32, 64, 128, 256
+
+static const char* s_frameBuckets[NumFrameBuckets] = { "fs<4", "fs<8", "fs<16", "fs<32", "fs<64", "fs<128", "fs<256" };
+
+struct Options
+{
+    bool d_disasm;
+    bool d_json;
+    bool d_stats;
+    QString d_outDir;
+    QHash<QString,QString> d_targets; // input -> .ljasm, if d_disasm
+    QIODevice* d_asmOut; // all disassemblies go there if set
+    QTextStream* d_out;
+    QTextStream* d_err;
+    Options():d_disasm(false),d_json(false),d_stats(true),d_asmOut(0),d_out(0),d_err(0){}
+};
+static Options s_opt;
+static QMutex s_asmLock; // of d_asmOut
+
+struct Stats
+{
+    QString d_path;
+    QStringList d_msgs;
+    bool d_ok;
+    quint32 d_files;
+    quint32 d_invalid;
+    quint64 d_bytes;
+    quint64 d_dbgBytes;
+    quint32 d_funcs;
+    quint32 d_instrs;
+    quint32 d_knum;
+    quint32 d_kobj;
+    quint32 d_upvals;
+    quint32 d_maxFrame;
+    quint32 d_ops[NumOps];
+    quint32 d_frames[NumFrameBuckets];
+    Stats():d_ok(true),d_files(0),d_invalid(0),d_bytes(0),d_dbgBytes(0),d_funcs(0),d_instrs(0),d_knum(0),
+        d_kobj(0),d_upvals(0),d_maxFrame(0)
+    {
+        ::memset(d_ops,0,sizeof(d_ops));
+        ::memset(d_frames,0,sizeof(d_frames));
+    }
+    void add( const Stats& rhs )
+    {
+        d_files += rhs.d_files;
+        d_invalid += rhs.d_ok ? 0 : 1;
+        d_bytes += rhs.d_bytes;
+        d_dbgBytes += rhs.d_dbgBytes;
+        d_funcs += rhs.d_funcs;
+        d_instrs += rhs.d_instrs;
+        d_knum += rhs.d_knum;
+        d_kobj += rhs.d_kobj;
+        d_upvals += rhs.d_upvals;
+        d_maxFrame = qMax( d_maxFrame, rhs.d_maxFrame );
+        for( int i = 0; i < NumOps; i++ )
+            d_ops[i] += rhs.d_ops[i];
+        for( int i = 0; i < NumFrameBuckets; i++ )
+            d_frames[i] += rhs.d_frames[i];
+    }
+};
+
+static int frameBucket( int framesize )
+{
+    int b = 0;
+    while( b < NumFrameBuckets - 1 && framesize >= ( 4 << b ) )
+        b++;
+    return b;
+}
+
+static void count( Stats& s, const JitBytecode& bc )
+{
+    foreach( const JitBytecode::FuncRef& f, bc.getFuncs() )
+    {
+        s.d_funcs++;
+        s.d_instrs += f->d_byteCodes.size();
+        s.d_knum += f->d_constNums.size();
+        s.d_kobj += f->d_constObjs.size();
+        s.d_upvals += f->d_upvals.size();
+        s.d_dbgBytes += f->d_sizedbg;
+        s.d_maxFrame = qMax( s.d_maxFrame, quint32(f->d_framesize) );
+        s.d_frames[frameBucket(f->d_framesize)]++;
+        foreach( quint32 i, f->d_byteCodes )
+        {
+            const quint8 op = i & 0xff;
+            if( op < NumOps )
+                s.d_ops[op]++;
+        }
+    }
+}
+
+static Stats processFile( const QString& path )
+{
+    Stats s;
+    s.d_path = path;
+    s.d_files = 1;
+    QFile in(path);
+    if( !in.open(QIODevice::ReadOnly) )
+    {
+        s.d_ok = false;
+        s.d_msgs << "cannot open file for reading";
+        return s;
+    }
+    s.d_bytes = in.size();
+    JitBytecode bc;
+    if( !bc.parse(&in,path) )
+    {
+        s.d_ok = false;
+        s.d_msgs << "cannot parse bytecode";
+        return s;
+    }
+    count( s, bc );
+
+    JitVerifier v;
+    s.d_ok = v.verify(bc);
+    foreach( const JitVerifier::Issue& i, v.getIssues() )
+        s.d_msgs << i.toString();
+
+    if( s_opt.d_disasm && bc.getRoot() && s_opt.d_asmOut )
+    {
+        // one file at a time, so the output of each stays in one piece; the others go on with parsing
+        QMutexLocker lock(&s_asmLock);
+        if( !Ljas::Disasm::disassemble( bc, s_opt.d_asmOut, path ) )
+            s.d_msgs << "cannot disassemble";
+    }else if( s_opt.d_disasm && bc.getRoot() )
+    {
+        QFile out( s_opt.d_targets.value(path) );
+        if( !out.open(QIODevice::WriteOnly) )
+            s.d_msgs << QString("cannot write %1").arg(out.fileName());
+        else if( !Ljas::Disasm::disassemble( bc, &out, path ) )
+            s.d_msgs << "cannot disassemble";
+    }
+    return s;
+}
+
+static bool assignTargets( const QStringList& files, const QHash<QString,QString>& relPaths, QTextStream& err )
+{
+    // done up front, so that no two jobs write the same .ljasm
+    QHash<QString,QString> inputs; // target -> input
+    foreach( const QString& path, files )
+    {
+        const QFileInfo info(path);
+        QString target;
+        if( s_opt.d_outDir.isEmpty() )
+            target = info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".ljasm" );
+        else
+        {
+            const QString rel = QFileInfo( relPaths.value( path, info.fileName() ) ).path();
+            target = QDir( QDir(s_opt.d_outDir).absoluteFilePath(rel) ).absoluteFilePath(
+                        info.completeBaseName() + ".ljasm" );
+        }
+        target = QDir::cleanPath(target);
+        if( inputs.contains(target) )
+        {
+            err << inputs.value(target) << " and " << path << " would both be disassembled to " << target << endl;
+            return false;
+        }
+        inputs[target] = path;
+        s_opt.d_targets[path] = target;
+        if( !QDir().mkpath( QFileInfo(target).absolutePath() ) )
+        {
+            err << "cannot create directory " << QFileInfo(target).absolutePath() << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isBytecode( const QString& path )
+{
+    QFile in(path);
+    if( !in.open(QIODevice::ReadOnly) )
+        return false;
+    return JitBytecode::isLuaJitBc(in.read(4));
+}
+
+static QString jsonString( const QString& str )
+{
+    QString res;
+    res.reserve( str.size() + 2 );
+    res += '"';
+    foreach( QChar c, str )
+    {
+        if( c == '"' || c == '\\' )
+            res += QString("\\") + c;
+        else if( c.unicode() < 0x20 )
+            res += QString("\\u%1").arg(c.unicode(),4,16,QChar('0'));
+        else
+            res += c;
+    }
+    res += '"';
+    return res;
+}
+
+static void writeHeader( QTextStream& out )
+{
+    if( s_opt.d_json )
+        return;
+    out << "file,ok,files,invalid,bytes,debug_bytes,funcs,instructions,knum,kobj,upvals,framesize_max";
+    for( int i = 0; i < NumFrameBuckets; i++ )
+        out << "," << s_frameBuckets[i];
+    for( int i = 0; i < NumOps; i++ )
+        out << "," << JitBytecode::nameOfOp(i);
+    out << endl;
+}
+
+static void writeStats( QTextStream& out, const QString& name, const Stats& s, bool ok )
+{
+    if( s_opt.d_json )
+    {
+        // one object per line, so the consumer can stream too
+        out << "{\"file\":" << jsonString(name) << ",\"ok\":" << ( ok ? "true" : "false" ) <<
+               ",\"files\":" << s.d_files << ",\"invalid\":" << s.d_invalid <<
+               ",\"bytes\":" << s.d_bytes << ",\"debug_bytes\":" << s.d_dbgBytes <<
+               ",\"funcs\":" << s.d_funcs << ",\"instructions\":" << s.d_instrs <<
+               ",\"knum\":" << s.d_knum << ",\"kobj\":" << s.d_kobj << ",\"upvals\":" << s.d_upvals <<
+               ",\"framesize_max\":" << s.d_maxFrame << ",\"frames\":{";
+        for( int i = 0; i < NumFrameBuckets; i++ )
+            out << ( i ? "," : "" ) << "\"" << s_frameBuckets[i] << "\":" << s.d_frames[i];
+        out << "},\"ops\":{";
+        bool first = true;
+        for( int i = 0; i < NumOps; i++ )
+        {
+            if( s.d_ops[i] == 0 )
+                continue;
+            out << ( first ? "" : "," ) << "\"" << JitBytecode::nameOfOp(i) << "\":" << s.d_ops[i];
+            first = false;
+        }
+        out << "}}" << endl;
+    }else
+    {
+        QString file = name;
+        if( file.contains(',') || file.contains('"') )
+            file = "\"" + file.replace("\"","\"\"") + "\"";
+        out << file << "," << ( ok ? 1 : 0 ) << "," << s.d_files << "," << s.d_invalid << "," <<
+               s.d_bytes << "," << s.d_dbgBytes << "," << s.d_funcs << "," << s.d_instrs << "," <<
+               s.d_knum << "," << s.d_kobj << "," << s.d_upvals << "," << s.d_maxFrame;
+        for( int i = 0; i < NumFrameBuckets; i++ )
+            out << "," << s.d_frames[i];
+        for( int i = 0; i < NumOps; i++ )
+            out << "," << s.d_ops[i];
+        out << endl;
+    }
+}
+
+static void reduce( Stats& total, const Stats& s )
+{
+    // called by one thread at a time; the per file result is written and dropped right away
+    total.add(s);
+    if( s_opt.d_stats )
+    {
+        Stats row = s;
+        row.d_invalid = s.d_ok ? 0 : 1;
+        writeStats( *s_opt.d_out, s.d_path, row, s.d_ok );
+    }
+    foreach( const QString& msg, s.d_msgs )
+        *s_opt.d_err << s.d_path << ": " << msg << endl;
+}
+
+static bool parseFile( const QString& path, JitBytecode& bc, QTextStream& err )
+{
+    QFile in(path);
+    if( !in.open(QIODevice::ReadOnly) )
+    {
+        err << path << ": cannot open file for reading" << endl;
+        return false;
+    }
+    if( !bc.parse(&in,path) )
+    {
+        err << path << ": cannot parse bytecode" << endl;
+        return false;
+    }
+    return true;
+}
+
+static QString funcLine( const JitBytecode& bc, int f )
+{
+    if( f < 0 || bc.isStripped() )
+        return QString();
+    return QString::number( JitComposer::unpackRow( bc.getFuncs()[f]->d_firstline ) );
+}
+
+static int compareFiles( const QString& pathA, const QString& pathB, bool quiet )
+{
+    QTextStream& out = *s_opt.d_out;
+    QTextStream& err = *s_opt.d_err;
+    JitBytecode a, b;
+    if( !parseFile( pathA, a, err ) || !parseFile( pathB, b, err ) )
+        return 2;
+
+    QElapsedTimer t;
+    t.start();
+    JitDiff diff;
+    diff.diff( a, b );
+
+    if( !s_opt.d_json )
+        out << "func_a,func_b,line_a,line_b,instructions_a,instructions_b,instructions_delta,framesize_delta,"
+               "deleted,inserted,const_removed,const_added" << endl;
+    foreach( const JitDiff::FuncDiff& d, diff.getFuncs() )
+    {
+        if( !d.isChanged() )
+            continue;
+        const int na = d.d_a < 0 ? 0 : a.getFuncs()[d.d_a]->d_byteCodes.size();
+        const int nb = d.d_b < 0 ? 0 : b.getFuncs()[d.d_b]->d_byteCodes.size();
+        if( s_opt.d_json )
+        {
+            QStringList removed, added;
+            foreach( const QString& c, d.d_constRemoved )
+                removed << jsonString(c);
+            foreach( const QString& c, d.d_constAdded )
+                added << jsonString(c);
+            out << "{\"func_a\":" << d.d_a << ",\"func_b\":" << d.d_b <<
+                   ",\"line_a\":" << jsonString(funcLine(a,d.d_a)) << ",\"line_b\":" << jsonString(funcLine(b,d.d_b)) <<
+                   ",\"instructions_a\":" << na << ",\"instructions_b\":" << nb <<
+                   ",\"instructions_delta\":" << d.d_instrDelta << ",\"framesize_delta\":" << d.d_frameDelta <<
+                   ",\"deleted\":" << d.d_deleted << ",\"inserted\":" << d.d_inserted <<
+                   ",\"const_removed\":[" << removed.join(",") << "],\"const_added\":[" << added.join(",") <<
+                   "]}" << endl;
+        }else
+        {
+            QString removed = d.d_constRemoved.join(" ");
+            QString added = d.d_constAdded.join(" ");
+            out << d.d_a << "," << d.d_b << "," << funcLine(a,d.d_a) << "," << funcLine(b,d.d_b) << "," <<
+                   na << "," << nb << "," << d.d_instrDelta << "," << d.d_frameDelta << "," <<
+                   d.d_deleted << "," << d.d_inserted << "," <<
+                   "\"" << removed.replace("\"","\"\"") << "\",\"" << added.replace("\"","\"\"") << "\"" << endl;
+        }
+    }
+    const int changed = diff.getChangedCount();
+    if( !quiet )
+        err << a.getFuncs().size() << " and " << b.getFuncs().size() << " functions compared, " << changed <<
+               " changed, " << t.elapsed() << " ms" << endl;
+    return changed ? 1 : 0;
+}
+
+static int linkFiles( const QString& outFile, const QStringList& files, bool stripped, bool quiet )
+{
+    QTextStream& err = *s_opt.d_err;
+    QElapsedTimer t;
+    t.start();
+    JitLinker l;
+    l.setStripped(stripped);
+    bool ok = true;
+    foreach( const QString& arg, files )
+    {
+        QString name = arg.section('=',0,0);
+        QString path = arg.section('=',1);
+        if( !arg.contains('=') )
+        {
+            name = QFileInfo(arg).completeBaseName();
+            path = arg;
+        }
+        ok = l.addModule( name.toUtf8(), path ) && ok;
+    }
+    if( ok )
+        ok = l.write(outFile);
+    foreach( const QString& msg, l.getErrors() )
+        err << msg << endl;
+    foreach( const JitVerifier::Issue& i, l.getIssues() )
+        err << outFile << ": " << i.toString() << endl;
+    if( !ok )
+        return 2;
+    const JitLinker::Stats& s = l.getStats();
+    if( !quiet )
+        err << s.d_modules << " modules linked to " << outFile << ", " << s.d_funcs << " functions, " <<
+               s.d_sharedModules << " modules shared, " << s.d_mergedFuncs << " functions merged, " <<
+               t.elapsed() << " ms" << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    a.setOrganizationName("me@rochus-keller.ch");
+    a.setOrganizationDomain("github.com/rochus-keller/LjTools");
+    a.setApplicationName("LjBcTool");
+    a.setApplicationVersion("0.1");
+
+    QTextStream err(stderr);
+    const char* usage = "usage: LjBcTool [-j threads] [-v] [-a] [-d dir|-] [-f csv|json] [-o file] [-q] files or directories...\n"
+                        "       LjBcTool -c [-f csv|json] [-o file] [-q] old new\n"
+                        "       LjBcTool -l out [-s] [-q] [name=]file...";
+    QStringList files;
+    QHash<QString,QString> relPaths; // files found in a directory argument -> path relative to it
+    QString outFile;
+    bool quiet = false;
+    bool compare = false;
+    bool stripped = false;
+    QString linkFile;
+    const QStringList args = a.arguments();
+    for( int i = 1; i < args.size(); i++ )
+    {
+        if( args[i] == "-q" )
+            quiet = true;
+        else if( args[i] == "-c" )
+            compare = true;
+        else if( args[i] == "-s" )
+            stripped = true;
+        else if( args[i] == "-l" && i + 1 < args.size() )
+            linkFile = args[++i];
+        else if( args[i] == "-v" )
+            s_opt.d_stats = false;
+        else if( args[i] == "-a" )
+            s_opt.d_disasm = true;
+        else if( args[i] == "-d" && i + 1 < args.size() )
+        {
+            s_opt.d_disasm = true;
+            s_opt.d_outDir = args[++i];
+        }else if( args[i] == "-f" && i + 1 < args.size() )
+            s_opt.d_json = args[++i] == "json";
+        else if( args[i] == "-o" && i + 1 < args.size() )
+            outFile = args[++i];
+        else if( args[i] == "-j" && i + 1 < args.size() )
+            QThreadPool::globalInstance()->setMaxThreadCount( qMax( 1, args[++i].toInt() ) );
+        else if( args[i].startsWith('-') )
+        {
+            err << usage << endl;
+            return 2;
+        }else if( !compare && linkFile.isEmpty() && QFileInfo(args[i]).isDir() )
+        {
+            const QDir dir( args[i] );
+            QDirIterator it( args[i], QDir::Files, QDirIterator::Subdirectories );
+            while( it.hasNext() )
+            {
+                const QString path = it.next();
+                if( isBytecode(path) )
+                {
+                    files << path;
+                    relPaths[path] = dir.relativeFilePath(path);
+                }
+            }
+        }else
+            files << args[i];
+    }
+    if( files.isEmpty() || ( compare && files.size() != 2 ) )
+    {
+        err << usage << endl;
+        return 2;
+    }
+    if( !linkFile.isEmpty() )
+    {
+        s_opt.d_err = &err;
+        return linkFiles( linkFile, files, stripped, quiet );
+    }
+    const bool asmToStdout = s_opt.d_outDir == "-";
+    if( s_opt.d_disasm && !compare && !asmToStdout && !assignTargets( files, relPaths, err ) )
+        return 2;
+
+    QFile outDev(outFile);
+    if( outFile.isEmpty() )
+        outDev.open(stdout, QIODevice::WriteOnly);
+    else if( !outDev.open(QIODevice::WriteOnly) )
+    {
+        err << "cannot write " << outFile << endl;
+        return 2;
+    }
+    QTextStream out(&outDev);
+    out.setCodec("UTF-8");
+    s_opt.d_out = &out;
+    s_opt.d_err = &err;
+    QFile asmDev;
+    if( asmToStdout )
+    {
+        asmDev.open(stdout, QIODevice::WriteOnly);
+        s_opt.d_asmOut = &asmDev;
+        if( outFile.isEmpty() )
+            s_opt.d_stats = false; // would be mixed up with the disassembly
+    }
+
+    if( compare )
+        return compareFiles( files[0], files[1], quiet );
+
+    QElapsedTimer t;
+    t.start();
+    if( s_opt.d_stats )
+        writeHeader(out);
+    const Stats total = QtConcurrent::blockingMappedReduced<Stats>( files, processFile, reduce,
+                                                                   QtConcurrent::UnorderedReduce );
+    if( s_opt.d_stats )
+        writeStats( out, "total", total, total.d_invalid == 0 );
+    if( !quiet )
+        err << total.d_files << " files processed, " << total.d_invalid << " invalid, " << t.elapsed() << " ms" << endl;
+    return total.d_invalid ? 1 : 0;
+}
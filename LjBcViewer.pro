@@ -31,11 +31,17 @@ SOURCES += LjBcViewerMain.cpp \
     LuaHighlighter.cpp \
     LuaJitBytecode.cpp \
     Engine2.cpp \
+    Engine2Thread.cpp \
     Terminal2.cpp \
     ExpressionParser.cpp \
     BcViewer2.cpp \
+    BcSearchView.cpp \
+    LuaJitIndex.cpp \
+    LuaJitDiff.cpp \
     LuaJitEngine.cpp \
     LuaJitComposer.cpp \
+    LuaJitFlowGraph.cpp \
+    LuaJitVerifier.cpp \
     LjDisasm.cpp \
     TestFfi.cpp
 
@@ -44,11 +50,17 @@ HEADERS  += LjBcViewerMain.h \
     LuaHighlighter.h \
     LuaJitBytecode.h \
     Engine2.h \
+    Engine2Thread.h \
     Terminal2.h \
     ExpressionParser.h \
     BcViewer2.h \
+    BcSearchView.h \
+    LuaJitIndex.h \
+    LuaJitDiff.h \
     LuaJitEngine.h \
     LuaJitComposer.h \
+    LuaJitFlowGraph.h \
+    LuaJitVerifier.h \
     LjDisasm.h \
     StreamSpy.h
 
@@ -22,7 +22,9 @@
 #include "Engine2.h"
 #include "Terminal2.h"
 #include "BcViewer2.h"
+#include "BcSearchView.h"
 #include "LuaJitEngine.h"
+#include "LuaJitDiff.h"
 
 #include <QtDebug>
 #include <QDockWidget>
@@ -69,7 +71,7 @@ void messageHander(QtMsgType type, const QMessageLogContext& ctx, const QString&
 }
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent),d_lock(false)
+    : QMainWindow(parent),d_lock(false),d_cmp(0)
 {
     s_this = this;
 
@@ -85,6 +87,7 @@ MainWindow::MainWindow(QWidget *parent)
     Engine2::setInst(d_lua);
 
     d_eng = new JitEngine(this);
+    d_diff = new JitDiff();
 
     d_edit = new CodeEditor(this);
     new Highlighter( d_edit->document() );
@@ -125,6 +128,7 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    delete d_diff;
 
 }
 
@@ -176,6 +180,13 @@ void MainWindow::createDumpView()
     d_bcv = new BcViewer2(dock);
     dock->setWidget(d_bcv);
     addDockWidget( Qt::RightDockWidgetArea, dock );
+
+    dock = new QDockWidget( tr("Bytecode Search"), this );
+    dock->setObjectName("BytecodeSearch");
+    dock->setAllowedAreas( Qt::AllDockWidgetAreas );
+    dock->setFeatures( QDockWidget::DockWidgetMovable );
+    dock->setWidget( new BcSearchView(d_bcv, dock) );
+    addDockWidget( Qt::RightDockWidgetArea, dock );
 }
 
 void MainWindow::createMenu()
@@ -191,6 +202,7 @@ void MainWindow::createMenu()
     pop->addCommand( "Dump", this, SLOT(onDump()), tr("CTRL+D"), false );
     pop->addCommand( "Export binary...", this, SLOT(onExportBc()) );
     pop->addCommand( "Export assembler...", this, SLOT(onExportAsm()) );
+    pop->addCommand( "Compare with...", this, SLOT(onCompare()) );
     pop->addSeparator();
     pop->addCommand( "Undo", d_edit, SLOT(handleEditUndo()), tr("CTRL+Z"), true );
     pop->addCommand( "Redo", d_edit, SLOT(handleEditRedo()), tr("CTRL+Y"), true );
@@ -386,9 +398,9 @@ void MainWindow::onExportAsm()
 {
     ENABLED_IF(true);
 
-    if( d_bcv->topLevelItemCount() == 0 )
+    if( d_bcv->isEmpty() )
         onDump();
-    if( d_bcv->topLevelItemCount() == 0 )
+    if( d_bcv->isEmpty() )
         return;
 
     QString fileName = QFileDialog::getSaveFileName(this, tr("Save Assembler"),
@@ -406,6 +418,71 @@ void MainWindow::onExportAsm()
     d_bcv->saveTo(fileName);
 }
 
+void MainWindow::onCompare()
+{
+    ENABLED_IF(true);
+
+    if( d_bcv->isEmpty() )
+        onDump();
+    if( d_bcv->isEmpty() )
+        return;
+
+    const QString fileName = QFileDialog::getOpenFileName(this, tr("Compare with Binary"), QString(),
+                                                          tr("*.bc") );
+    if (fileName.isEmpty())
+        return;
+
+    QDir::setCurrent(QFileInfo(fileName).absolutePath());
+
+    if( d_cmp == 0 )
+    {
+        QDockWidget* dock = new QDockWidget( tr("Compared Bytecode"), this );
+        dock->setObjectName("ComparedBytecode");
+        dock->setAllowedAreas( Qt::AllDockWidgetAreas );
+        dock->setFeatures( QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable );
+        d_cmp = new BcViewer2(dock);
+        dock->setWidget(d_cmp);
+        splitDockWidget( qobject_cast<QDockWidget*>(d_bcv->parentWidget()), dock, Qt::Horizontal );
+        connect(d_bcv,SIGNAL(sigLoaded()),this,SLOT(onDiff()));
+        connect(d_cmp,SIGNAL(sigLoaded()),this,SLOT(onDiff()));
+        connect(d_bcv,SIGNAL(sigFuncSelected(int)),this,SLOT(onFuncSelectedA(int)));
+        connect(d_cmp,SIGNAL(sigFuncSelected(int)),this,SLOT(onFuncSelectedB(int)));
+    }
+    d_cmp->parentWidget()->show();
+    d_cmp->loadFrom(fileName);
+}
+
+void MainWindow::onDiff()
+{
+    // the dump of the editor is side a, so each recompile shows how the bytecode changed
+    if( d_cmp == 0 || d_cmp->isEmpty() || d_bcv->isEmpty() )
+        return;
+    d_diff->diff( d_bcv->getBc(), d_cmp->getBc() );
+    d_bcv->setDiff( *d_diff, true );
+    d_cmp->setDiff( *d_diff, false );
+    int removed = 0, added = 0;
+    foreach( const JitDiff::FuncDiff& d, d_diff->getFuncs() )
+    {
+        if( d.d_b < 0 )
+            removed++;
+        else if( d.d_a < 0 )
+            added++;
+    }
+    logMessage( tr("compared with %1: %2 functions changed, %3 only here, %4 only there")
+                .arg(d_cmp->getPath()).arg(d_diff->getChangedCount()).arg(removed).arg(added) );
+}
+
+void MainWindow::onFuncSelectedA(int f)
+{
+    if( d_cmp )
+        d_cmp->gotoFunc( d_diff->matchOfA(f) );
+}
+
+void MainWindow::onFuncSelectedB(int f)
+{
+    d_bcv->gotoFunc( d_diff->matchOfB(f) );
+}
+
 bool MainWindow::checkSaved(const QString& title)
 {
     if( d_edit->isModified() )
@@ -30,6 +30,7 @@ namespace Lua
     class BcViewer2;
     class Terminal2;
     class JitEngine;
+    class JitDiff;
 
     class MainWindow : public QMainWindow
     {
@@ -64,11 +65,17 @@ namespace Lua
         void onCursor();
         void onExportBc();
         void onExportAsm();
+        void onCompare();
+        void onDiff();
+        void onFuncSelectedA(int);
+        void onFuncSelectedB(int);
 
     private:
         CodeEditor* d_edit;
         Engine2* d_lua;
         BcViewer2* d_bcv;
+        BcViewer2* d_cmp; // side b of the comparison, created on first use
+        JitDiff* d_diff;
         Terminal2* d_term;
         JitEngine* d_eng;
         bool d_lock;
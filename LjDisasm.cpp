@@ -20,10 +20,10 @@
 #include "LjDisasm.h"
 #include "LuaJitBytecode.h"
 #include "LuaJitComposer.h"
+#include "LuaJitFlowGraph.h"
 #include <QtDebug>
 #include <QSet>
-#include <QTextStream>
-#include <QFile>
+#include <QIODevice>
 using namespace Ljas;
 using namespace Lua;
 
@@ -47,7 +47,9 @@ const char* Disasm::s_opName[] = {
     "CALL", "CALLT", "RET",
     "FORI", "FORL",
     "LOOP",
-    "JMP"
+    "JMP",
+    "TSETM", "CALLM", "CALLMT", "RETM", "VARG",
+    "ITERC", "ITERN", "ITERL", "ISNEXT"
 };
 
 const char* Disasm::s_opHelp[] = {
@@ -85,29 +87,37 @@ const char* Disasm::s_opHelp[] = {
     "GSET src:desig index:( string | cname )",
     "TGET dst:desig table:desig index:( desig | string | posint )",
     "TSET src:desig table:desig index:( desig | string | posint )",
-    "CALL slots:desig [ numOfReturns:posint [ numOfArgs:posint ] ]",
+    "CALL slots:desig [ numOfReturns:(posint|'...') [ numOfArgs:posint ] ], '...' returns all values (MULTRES)",
     "CALLT slots:desig [ numOfArgs:posint ]",
     "RET [ slots:desig [ numOfSlots:posint ] ]",
     "FORI slots:desig label, slots=index,stop,step,index copy",
     "FORL desig label",
     "LOOP",
-    "JMP label"
+    "JMP label",
+    "TSETM slots:desig index:posint, slots=table,values; table[index], ... = MULTRES values",
+    "CALLM slots:desig [ numOfReturns:(posint|'...') [ numOfFixedArgs:posint ] ], MULTRES args follow the fixed",
+    "CALLMT slots:desig [ numOfFixedArgs:posint ], MULTRES args follow the fixed",
+    "RETM slots:desig [ numOfFixed:posint ], MULTRES values follow the fixed",
+    "VARG dst:desig [ numOfValues:posint ], all values (MULTRES) if numOfValues is left out",
+    "ITERC slots:desig numOfVars:posint, slots=generator,state,control,vars",
+    "ITERN slots:desig numOfVars:posint, slots=generator,state,control,vars; specialized for next",
+    "ITERL slots:desig label, jump to label if first var is not nil",
+    "ISNEXT slots:desig label, check for next and jump to label which is the ITERN"
 };
 
 
 bool Disasm::disassemble(const JitBytecode& bc, QIODevice* f, const QString& path, bool stripped, bool alloc)
 {
-    QTextStream out(f);
-    out.setCodec("UTF-8");
+    Writer out(f);
     out << "-- disassembled from ";
     if( path.isEmpty() )
         out << "Lua source";
     else
         out << path;
-    out << endl << endl;
+    out << '\n' << '\n';
     if( !writeFunc( out, bc.getRoot(), stripped, alloc, 0 ) )
         return false;
-    return true;
+    return out.flush();
 }
 
 bool Disasm::adaptToLjasm(JitBytecode::Instruction& bc, OP& op, QByteArray& warning )
@@ -284,38 +294,31 @@ bool Disasm::adaptToLjasm(JitBytecode::Instruction& bc, OP& op, QByteArray& warn
         {
             op = CALL;
             bc.d_cd--;
-            if( bc.d_b >= 1 )
-                bc.d_b = bc.d_b - 1;
-            else if( bc.d_b == 0 ) // Operand B is zero for calls which return all results; modify to 1 return here
+            if( bc.d_b == 0 )
+                bc.d_tb = JitBytecode::Instruction::Unused; // MULTRES, writeFunc renders it as '...'
+            else
             {
-                warning = "original second argument is MULTRES (not supported)";
-                bc.d_b = 1;
+                bc.d_b = bc.d_b - 1;
+                if( bc.d_b == 0 && bc.d_cd == 0 )
+                    bc.d_tb = JitBytecode::Instruction::Unused;
             }
-            if( bc.d_b == 0 && bc.d_cd == 0 )
-            {
-                bc.d_tb = JitBytecode::Instruction::Unused;
-                bc.d_tcd = JitBytecode::Instruction::Unused;
-            }else if( bc.d_cd == 0 )
+            if( bc.d_cd == 0 )
                 bc.d_tcd = JitBytecode::Instruction::Unused;
         }
         break;
     case JitBytecode::OP_CALLM:
         {
-            warning = "original is CALLM " + QByteArray::number(bc.d_b) + " "
-                    + QByteArray::number(bc.d_cd) + " (not supported)";
-            op = CALL;
+            op = CALLM;
             // compared to CALL bc.d_cd is already the true number of fixed args
-            if( bc.d_cd == 0 )
-                bc.d_cd = 1; // we return at least one fixed arg
-            if( bc.d_b >= 1 )
-                bc.d_b = bc.d_b - 1;
-            else if( bc.d_b == 0 ) // Operand B is zero for calls which return all results; modify to 1 return here
-                bc.d_b = 1;
-            if( bc.d_b == 0 && bc.d_cd == 0 )
+            if( bc.d_b == 0 )
+                bc.d_tb = JitBytecode::Instruction::Unused; // MULTRES, writeFunc renders it as '...'
+            else
             {
-                bc.d_tb = JitBytecode::Instruction::Unused;
-                bc.d_tcd = JitBytecode::Instruction::Unused;
-            }else if( bc.d_cd == 0 )
+                bc.d_b = bc.d_b - 1;
+                if( bc.d_b == 0 && bc.d_cd == 0 )
+                    bc.d_tb = JitBytecode::Instruction::Unused;
+            }
+            if( bc.d_cd == 0 )
                 bc.d_tcd = JitBytecode::Instruction::Unused;
         }
         break;
@@ -324,10 +327,38 @@ bool Disasm::adaptToLjasm(JitBytecode::Instruction& bc, OP& op, QByteArray& warn
         bc.d_cd--;
         break;
     case JitBytecode::OP_CALLMT:
-        op = INVALID;
-        warning = "original is CALLMT " + QByteArray::number(bc.d_cd) + " (not supported)";
+        op = CALLMT;
+        if( bc.d_cd == 0 )
+            bc.d_tcd = JitBytecode::Instruction::Unused;
+        break;
+    case JitBytecode::OP_RETM:
+        op = RETM;
         if( bc.d_cd == 0 )
-            bc.d_cd = 1; // we return at least one fixed arg
+            bc.d_tcd = JitBytecode::Instruction::Unused;
+        break;
+    case JitBytecode::OP_VARG:
+        op = VARG;
+        bc.d_tcd = JitBytecode::Instruction::Unused; // C is the number of fixed params
+        if( bc.d_b == 0 )
+            bc.d_tb = JitBytecode::Instruction::Unused; // MULTRES
+        else
+            bc.d_b--;
+        break;
+    case JitBytecode::OP_TSETM:
+        op = TSETM;
+        bc.d_a--; // the table
+        break;
+    case JitBytecode::OP_ITERC:
+    case JitBytecode::OP_ITERN:
+        op = bc.d_op == JitBytecode::OP_ITERC ? ITERC : ITERN;
+        bc.d_a -= 3; // generator, state, control
+        bc.d_b--;
+        bc.d_tcd = JitBytecode::Instruction::Unused; // C is always 3
+        break;
+    case JitBytecode::OP_ITERL:
+    case JitBytecode::OP_ISNEXT:
+        op = bc.d_op == JitBytecode::OP_ITERL ? ITERL : ISNEXT;
+        bc.d_a -= 3;
         break;
     case JitBytecode::OP_CAT:
         op = CAT;
@@ -337,13 +368,6 @@ bool Disasm::adaptToLjasm(JitBytecode::Instruction& bc, OP& op, QByteArray& warn
         else
             bc.d_tcd = JitBytecode::Instruction::_lit;
         break;
-        // implement later
-    case JitBytecode::OP_TSETM:
-    case JitBytecode::OP_RETM:
-    case JitBytecode::OP_VARG:
-    case JitBytecode::OP_ITERC:
-    case JitBytecode::OP_ITERN:
-    case JitBytecode::OP_ITERL:
         // internals
     case JitBytecode::OP_JFORI:
     case JitBytecode::OP_IFORL:
@@ -352,7 +376,6 @@ bool Disasm::adaptToLjasm(JitBytecode::Instruction& bc, OP& op, QByteArray& warn
     case JitBytecode::OP_JITERL:
     case JitBytecode::OP_ILOOP:
     case JitBytecode::OP_JLOOP:
-    case JitBytecode::OP_ISNEXT:
         warning = "operator not supported";
         op = INVALID;
         break;
@@ -370,21 +393,90 @@ bool Disasm::adaptToLjasm(JitBytecode::Instruction& bc, QByteArray& mnemonic, QB
     return res;
 }
 
-static inline QByteArray ws(int level)
+Disasm::Writer::Writer(QIODevice* out):d_out(out),d_written(0),d_ok(true)
 {
-    return QByteArray(level,'\t');
+    // reserved capacity survives resize(0)
+    if( d_out )
+        d_buf.reserve( FlushSize + 1024 );
 }
 
-static inline QByteArray varName( const QByteArray& name, int v )
+Disasm::Writer& Disasm::Writer::operator<<(const char* str)
 {
-    if( name.startsWith('(') )
+    d_buf.append(str);
+    return *this;
+}
+
+Disasm::Writer& Disasm::Writer::operator<<(const QByteArray& str)
+{
+    d_buf.append(str);
+    return *this;
+}
+
+Disasm::Writer& Disasm::Writer::operator<<(const QString& str)
+{
+    d_buf.append(str.toUtf8());
+    return *this;
+}
+
+Disasm::Writer& Disasm::Writer::operator<<(char ch)
+{
+    d_buf.append(ch);
+    if( ch == '\n' && d_out != 0 && d_buf.size() >= FlushSize )
+        flush();
+    return *this;
+}
+
+Disasm::Writer& Disasm::Writer::number(qint64 v)
+{
+    char tmp[24];
+    int n = 0;
+    quint64 u = v < 0 ? quint64(-(v + 1)) + 1 : quint64(v);
+    do
     {
-        return "R" + QByteArray::number(v);
-    }else
-        return name;
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    }while( u );
+    if( v < 0 )
+        tmp[n++] = '-';
+    while( n > 0 )
+        d_buf.append(tmp[--n]);
+    return *this;
 }
 
-bool Disasm::writeFunc(QTextStream& out, const JitBytecode::Function* f, bool stripped, bool alloc, int level)
+Disasm::Writer& Disasm::Writer::real(double v)
+{
+    // same format as QByteArray::number, which has no allocation free variant
+    d_buf.append( QByteArray::number(v) );
+    return *this;
+}
+
+Disasm::Writer& Disasm::Writer::indent(int level)
+{
+    for( int i = 0; i < level; i++ )
+        d_buf.append('\t');
+    return *this;
+}
+
+bool Disasm::Writer::flush()
+{
+    if( d_out == 0 || d_buf.isEmpty() )
+        return d_ok;
+    if( d_out->write(d_buf) != d_buf.size() )
+        d_ok = false;
+    d_written += d_buf.size();
+    d_buf.resize(0);
+    return d_ok;
+}
+
+static inline void writeVarName( Disasm::Writer& out, const QByteArray& name, int v )
+{
+    if( name.startsWith('(') )
+        out << 'R' << v;
+    else
+        out << name;
+}
+
+bool Disasm::writeFunc(Writer& out, const JitBytecode::Function* f, bool stripped, bool alloc, int level)
 {
     if( f == 0 )
         return false;
@@ -395,7 +487,7 @@ bool Disasm::writeFunc(QTextStream& out, const JitBytecode::Function* f, bool st
 
     //int nextR = 0;
     const int nextR = f->d_numparams;
-    out << ws(level) << "function F" << f->d_id << "(";
+    out.indent(level) << "function F" << f->d_id << "(";
     for( int i = 0; i < f->d_numparams; i++ )
     {
         if( i < f->d_varNames.size() && !doStrip )
@@ -413,6 +505,8 @@ bool Disasm::writeFunc(QTextStream& out, const JitBytecode::Function* f, bool st
             // nextR = i+1;
         }
     }
+    if( f->d_flags & JitBytecode::Function::FuVarargs )
+        out << ( f->d_numparams ? " ..." : "..." );
     out << ") ";
     if( !f->isStripped() )
     {
@@ -420,84 +514,20 @@ bool Disasm::writeFunc(QTextStream& out, const JitBytecode::Function* f, bool st
         out << JitComposer::unpackRow(f->d_firstline) << " to " <<
                    JitComposer::unpackRow(f->lastLine() );
     }
-    out << endl;
+    out << '\n';
 
-#if 0
-    QHash<QByteArray,int> unique;
-    for( int i = 0; i < f->d_numparams && i < f->d_vars.size(); i++ )
-        unique.insert( f->d_vars[i].d_name,i);
-
-    if( f->d_framesize > f->d_numparams || f->d_framesize != 0 && f->d_vars.isEmpty() )
-    {
-        // print variable declarations
-        QByteArray buf;
-        buf = ws(level+1);
-        buf += "var\t";
-        if( f->d_vars.size() > f->d_numparams )
-        {
-            buf += "{ ";
-            for( int i = f->d_numparams; i < f->d_vars.size(); i++ )
-            {
-                QByteArray name = f->d_vars[i].d_name;
-                if( name.startsWith('(') )
-                    continue; // don't use these as vars; they're used as Rx instead
-
-                if( unique.contains(name) )
-                {
-                    // qDebug() << "duplicate var" << name;
-                    continue;
-                }
-                unique.insert(name,i);
-                buf += name + " ";
-                if( buf.size() > 80 )
-                {
-                    out << buf << endl;
-                    buf = ws(level+2);
-                }
-            }
-            buf += "} ";
-        }
-        out << buf;
-#ifdef _USE_REGISTER_ARRAY_
-        if( f->d_framesize > 0 )
-        {
-            out << "T[" << f->d_framesize << "]" << endl;
-        }
-#else
-        buf.clear();
-        if( f->d_vars.size() > f->d_numparams )
-        {
-            out << endl;
-            buf = ws(level+2);
-        }
-        buf += "{ ";
-        for( int i = 0; i < qMax( int(f->d_framesize), unique.size() ); i++ )
-        {
-            buf += "R" + QByteArray::number( i ) + " ";
-            if( buf.size() > 80 )
-            {
-                out << buf << endl;
-                buf = ws(level+2);
-            }
-        }
-        buf += "} ";
-        out << buf << endl;
-#endif
-    }
-#else
-    // print variable declarations
+    // print variable declarations; lines are wrapped after 80 chars
     if( f->d_framesize > f->d_numparams )
     {
-        QHash<QByteArray,int> unique;
-        QByteArray buf;
-        buf = ws(level+1);
-        buf += "var\t";
+        QSet<QByteArray> unique;
+        qint64 start = out.pos();
+        out.indent(level+1) << "var\t";
         if( !doStrip && f->d_vars.size() > f->d_numparams )
         {
-            buf += "{ ";
+            out << "{ ";
             for( int i = f->d_numparams; i < f->d_varNames.size(); i++ )
             {
-                QByteArray name = f->d_varNames[i];
+                const QByteArray& name = f->d_varNames[i];
                 if( name.isEmpty() )
                     continue;
                 if( name.startsWith('(') )
@@ -505,71 +535,53 @@ bool Disasm::writeFunc(QTextStream& out, const JitBytecode::Function* f, bool st
 
                 if( unique.contains(name) )
                     continue;
-                unique.insert(name,i);
+                unique.insert(name);
 
-                buf += name;
+                out << name;
                 if( alloc )
-                    buf += "(" + QByteArray::number(i) + ") ";
+                    out << "(" << i << ") ";
                 else
-                    buf += " ";
-                if( buf.size() > 80 )
+                    out << " ";
+                if( out.pos() - start > 80 )
                 {
-                    out << buf << endl;
-                    buf = ws(level+2);
+                    out << '\n';
+                    start = out.pos();
+                    out.indent(level+2);
                 }
             }
-            buf += "} ";
+            out << "} ";
         }
 
         // print Rx declarations
-        out << buf;
-        buf.clear();
+        start = out.pos();
         if( !doStrip && f->d_vars.size() > f->d_numparams )
         {
-            out << endl;
-            buf = ws(level+2);
+            out << '\n';
+            start = out.pos();
+            out.indent(level+2);
         }
-        buf += "{ ";
+        out << "{ ";
         for( int i = nextR; i < f->d_framesize; i++ )
         {
-            buf += "R" + QByteArray::number( i );
+            out << "R" << i;
             if( alloc )
-                buf += "(" + QByteArray::number(i) + ") ";
+                out << "(" << i << ") ";
             else
-                buf += " ";
-            if( buf.size() > 80 )
+                out << " ";
+            if( out.pos() - start > 80 )
             {
-                out << buf << endl;
-                buf = ws(level+2);
+                out << '\n';
+                start = out.pos();
+                out.indent(level+2);
             }
         }
-        buf += "} ";
-        out << buf << endl;
+        out << "} " << '\n';
     }
 
-#endif
-
 #ifdef _DEBUG_
         for( int i = 0; i < f->d_vars.size(); i++ )
-            out << ws(level+2) << "-- " << f->d_vars[i].d_name << " pc " <<
-                   f->d_vars[i].d_startpc << " to " << f->d_vars[i].d_endpc << endl;
-#endif
-#ifdef _DEBUG_
-        QFile dbg(QString("F%1_vars.txt").arg(f->d_id));
-        dbg.open(QIODevice::WriteOnly);
-        QTextStream out2(&dbg);
-        for( int pc = 0; pc < f->d_byteCodes.size(); pc++ )
-        {
-            QByteArray str = "pc" + QByteArray::number(pc+2) + "\t";
-            for( int slot = 0; slot < f->d_framesize; slot++ )
-            {
-                const QByteArray name = f->getVarName(pc,slot);
-                if( !name.isEmpty() )
-                    str += "s" + QByteArray::number(slot) + ":" + name + "\t";
-            }
-            out2 << str << endl;
-            //out << ws(level+2) << "-- " << str << endl;
-        }
+            out.indent(level+2) << "-- " << f->d_vars[i].d_name << " pc " <<
+                   f->d_vars[i].d_startpc << " to " << f->d_vars[i].d_endpc << '\n';
 #endif
 
     int funCount = 0;
@@ -579,52 +591,86 @@ bool Disasm::writeFunc(QTextStream& out, const JitBytecode::Function* f, bool st
         if( o.canConvert<JitBytecode::FuncRef>() )
         {
             if( funCount++ == 0 )
-                out << endl;
+                out << '\n';
             writeFunc(out, o.value<JitBytecode::FuncRef>().constData(), stripped, alloc, level+1 );
         }
     }
 
     if( !f->d_byteCodes.isEmpty() )
     {
-        out << ws(level) << "begin" << endl;
+        out.indent(level) << "begin" << '\n';
 
-        QSet<quint32> labels;
-        for( int pc = 0; pc < f->d_byteCodes.size(); pc++ )
+        const int len = f->d_byteCodes.size();
+        QVector<bool> labels(len + 1);
+        for( int pc = 0; pc < len; pc++ )
         {
             const JitBytecode::Instruction bc = JitBytecode::dissectInstruction(f->d_byteCodes[pc]);
-            if( bc.d_tcd == JitBytecode::Instruction::_jump && bc.d_op != JitBytecode::OP_LOOP )
-                labels.insert( pc + 1 + bc.getCd() );
+            const int target = pc + 1 + bc.getCd();
+            if( bc.d_tcd == JitBytecode::Instruction::_jump && bc.d_op != JitBytecode::OP_LOOP &&
+                    target >= 0 && target <= len )
+                labels[target] = true;
         }
 
+        JitFlowGraph cfg;
+        const bool hasCfg = cfg.analyze(f, JitFlowGraph::Loops);
+
         quint32 lastLine = 0;
-        for( int pc = 0; pc < f->d_byteCodes.size(); pc++ )
+        QByteArray warning;
+        for( int pc = 0; pc < len; pc++ )
         {
-            QByteArray warning;
-            if( labels.contains(pc) )
-                out << ws(level) << "__L" << pc << ":" << endl;
+            warning.resize(0);
+            const int block = hasCfg ? cfg.blockOf(pc) : -1;
+            const bool loopHead = block != -1 && cfg.getBlocks()[block].d_first == quint32(pc) &&
+                    cfg.isLoopHeader(block);
+            if( labels[pc] )
+            {
+                out.indent(level) << "__L" << pc << ":";
+                if( loopHead )
+                    out << "\t-- loop depth " << int(cfg.getBlocks()[block].d_depth);
+                out << '\n';
+            }else if( loopHead )
+                out.indent(level) << "-- loop depth " << int(cfg.getBlocks()[block].d_depth) << '\n';
             JitBytecode::Instruction bc = JitBytecode::dissectInstruction(f->d_byteCodes[pc]);
-            out << ws(level+1);
-            QByteArray mnemonic;
-            adaptToLjasm( bc, mnemonic, warning );
-            out << mnemonic << " ";
-
-            const QByteArray a = renderArg(f,bc.d_ta,bc.d_a,pc,stripped);
-            const QByteArray b = renderArg(f,bc.d_tb,bc.d_b,pc,stripped);
-            const QByteArray c = renderArg(f,bc.d_tcd,bc.getCd(),pc,stripped);
+            const bool multRes = ( bc.d_op == JitBytecode::OP_CALL || bc.d_op == JitBytecode::OP_CALLM ) && bc.d_b == 0;
+            out.indent(level+1);
+            OP op;
+            adaptToLjasm( bc, op, warning );
+            if( op == INVALID )
+                out << bc.d_name;
+            else
+                out << s_opName[op];
+            out << " ";
+
             if( bc.d_op == JitBytecode::OP_LOOP )
             {
                 // NOP
             }else if( bc.d_op == JitBytecode::OP_JMP )
             {
-                out << c;
+                writeArg(out,f,bc.d_tcd,bc.getCd(),pc,stripped);
             }else
             {
-                if( !a.isEmpty() )
-                    out << " " << a;
-                if( !b.isEmpty() )
-                    out << " " << b;
-                if( !c.isEmpty() )
-                    out << " " << c;
+                // each operand is preceded by a blank if it renders to something
+                qint64 mark = out.pos() + 1;
+                out << " ";
+                writeArg(out,f,bc.d_ta,bc.d_a,pc,stripped);
+                if( out.pos() == mark )
+                    out.chop(1);
+                mark = out.pos() + 1;
+                out << " ";
+                if( multRes )
+                    out << "...";
+                else
+                    writeArg(out,f,bc.d_tb,bc.d_b,pc,stripped);
+                if( out.pos() == mark )
+                    out.chop(1);
+                mark = out.pos() + 1;
+                out << " ";
+                if( bc.d_op == JitBytecode::OP_TSETM && bc.getCd() < f->d_constNums.size() )
+                    out << JitComposer::fromTsetmConst( f->d_constNums[bc.getCd()] );
+                else
+                    writeArg(out,f,bc.d_tcd,bc.getCd(),pc,stripped);
+                if( out.pos() == mark )
+                    out.chop(1);
             }
             if( !warning.isEmpty() )
                 out << " -- WARNING " << warning;
@@ -645,16 +691,16 @@ bool Disasm::writeFunc(QTextStream& out, const JitBytecode::Function* f, bool st
                 }
             }
 
-            out << endl;
+            out << '\n';
         } // end for each statement
 
     }
 
-    out << ws(level) << "end F" << f->d_id << endl << endl;
-    return true;
+    out.indent(level) << "end F" << f->d_id << '\n' << '\n';
+    return out.isOk();
 }
 
-static inline QByteArray getPriConst(int i)
+static inline const char* getPriConst(int i)
 {
     switch(i)
     {
@@ -667,140 +713,177 @@ static inline QByteArray getPriConst(int i)
     }
 }
 
-static QByteArray escape( QByteArray str )
+static void writeEscaped( Disasm::Writer& out, const QByteArray& str )
 {
     if( !str.isEmpty() && str[0] == char(0) )
-        return QByteArray();
-    str.replace('\\', "\\\\");
-    str.replace('\n', "\\n" );
-    str.replace('\a', "\\a" );
-    str.replace('\b', "\\b" );
-    str.replace('\f', "\\f" );
-    str.replace('\r', "\\r" );
-    str.replace('\t', "\\t" );
-    str.replace('\v', "\\v" );
-    str.replace('"', "\\\"" );
-    str.replace('\'', "\\'" );
-    return str;
+        return;
+    for( int i = 0; i < str.size(); i++ )
+    {
+        const char ch = str[i];
+        switch( ch )
+        {
+        case '\\':
+            out << "\\\\";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        case '\a':
+            out << "\\a";
+            break;
+        case '\b':
+            out << "\\b";
+            break;
+        case '\f':
+            out << "\\f";
+            break;
+        case '\r':
+            out << "\\r";
+            break;
+        case '\t':
+            out << "\\t";
+            break;
+        case '\v':
+            out << "\\v";
+            break;
+        case '"':
+            out << "\\\"";
+            break;
+        case '\'':
+            out << "\\'";
+            break;
+        default:
+            out << ch;
+            break;
+        }
+    }
 }
 
-static QByteArray tostring(const QVariant& v)
+static void writeConst( Disasm::Writer& out, const QVariant& v)
 {
     if( v.type() == QVariant::ByteArray )
     {
-        return "\"" + escape( v.toByteArray() ) + "\"";
+        out << "\"";
+        writeEscaped( out, v.toByteArray() );
+        out << "\"";
     }else if( JitBytecode::isString( v ) )
-        return "\"" + v.toString().toUtf8() + "\"";
+        out << "\"" << v.toString() << "\"";
     else if( JitBytecode::isNumber( v ) )
-        return QByteArray::number( v.toDouble() );
+        out.real( v.toDouble() );
     else
-        return v.toByteArray();
+        out << v.toByteArray();
 }
 
 QByteArray Disasm::renderArg(const JitBytecode::Function* f, int t, int v, int pc, bool stripped, bool alt)
+{
+    Writer out;
+    writeArg( out, f, t, v, pc, stripped, alt );
+    return out.buffer();
+}
+
+void Disasm::writeArg(Writer& out, const JitBytecode::Function* f, int t, int v, int pc, bool stripped, bool alt)
 {
     switch( t )
     {
     case JitBytecode::Instruction::Unused:
-        return QByteArray();
+        return;
     case JitBytecode::Instruction::_var:
     case JitBytecode::Instruction::_dst:
     case JitBytecode::Instruction::_base:
     case JitBytecode::Instruction::_rbase:
         {
-            // int idx;
-            // QByteArray name = varName(f->getVarName(pc, v, &idx ),idx);
-            QByteArray name;
-            if( !stripped )
-                name= varName( v < f->d_varNames.size() ? f->d_varNames[v] : QByteArray(),v);
-            if( !name.isEmpty() )
-                return name;
-//            if( v < f->d_numparams && ( f->isStripped() || stripped ) )
-//                return "__p" + QByteArray::number(v);
+            if( !stripped && v < f->d_varNames.size() && !f->d_varNames[v].isEmpty() )
+            {
+                writeVarName( out, f->d_varNames[v], v );
+                return;
+            }
 #ifdef _USE_REGISTER_ARRAY_
-            return "T[" + QByteArray::number(v) + "]";
+            out << "T[" << v << "]";
 #else
             if( alt )
-                return "[" + QByteArray::number(v) + "]";
+                out << "[" << v << "]";
             else
-                return "R" + QByteArray::number(v);
+                out << "R" << v;
 #endif
         }
-        break;
+        return;
     case JitBytecode::Instruction::_str:
         if( v >= 0 && v < f->d_constObjs.size() )
-            return tostring( f->d_constObjs[ f->d_constObjs.size() - v - 1] );
+            writeConst( out, f->d_constObjs[ f->d_constObjs.size() - v - 1] );
         else
-            return "<invalid string>";
+            out << "<invalid string>";
+        return;
     case JitBytecode::Instruction::_num:
         if( v >= 0 && v < f->d_constNums.size())
-            return QByteArray::number( f->d_constNums[v].toDouble() );
+            out.real( f->d_constNums[v].toDouble() );
         else
-            return "<invalid number>";
+            out << "<invalid number>";
+        return;
     case JitBytecode::Instruction::_pri:
-        return getPriConst(v);
+        out << getPriConst(v);
+        return;
     case JitBytecode::Instruction::_cdata:
-        break; // ??
+        return; // ??
     case JitBytecode::Instruction::_lit:
     case JitBytecode::Instruction::_lits:
-        return QByteArray::number(v);
+        out << v;
+        return;
     case JitBytecode::Instruction::_jump:
         if( alt )
-            return "->" + QByteArray::number(pc+1+v);
+            out << "->" << pc+1+v;
         else
-            return "__L" + QByteArray::number(pc+1+v);
+            out << "__L" << pc+1+v;
+        return;
     case JitBytecode::Instruction::_uv:
         {
             const QPair<quint8, JitBytecode::Function*> up = f->getFuncSlotFromUpval(v);
             if( up.second == 0 )
-                return "???";
+            {
+                out << "???";
+                return;
+            }
 
-            QByteArray quali;
             if( up.second != f )
-                quali = "F" + QByteArray::number(up.second->d_id) + ".";
-//            if( v < f->d_upNames.size() )
-//                return quali + f->d_upNames[v];
+                out << "F" << up.second->d_id << ".";
             if( !stripped && up.first < up.second->d_varNames.size() && !up.second->d_varNames[up.first].isEmpty() )
-                return quali + up.second->d_varNames[up.first];
+                out << up.second->d_varNames[up.first];
             else
             {
 #ifdef _USE_REGISTER_ARRAY_
-                return quali + "T[" + QByteArray::number(up.first) + "]";
+                out << "T[" << int(up.first) << "]";
 #else
                 if( alt )
-                    return quali + "[" + QByteArray::number(up.first) + "]";
+                    out << "[" << int(up.first) << "]";
                 else
-                    return quali + "R" + QByteArray::number(up.first);
+                    out << "R" << int(up.first);
 #endif
             }
         }
-        break;
+        return;
     case JitBytecode::Instruction::_func:
         {
             const int i = f->d_constObjs.size() - v - 1;
             if( i < 0 || i >= f->d_constObjs.size() )
-                return "<invalid const>";
+            {
+                out << "<invalid const>";
+                return;
+            }
             JitBytecode::FuncRef fr = f->d_constObjs[ i ].value<JitBytecode::FuncRef>();
             if( fr.data() != 0 )
-                return QString("F%1").arg(fr->d_id).toUtf8();
+                out << "F" << fr->d_id;
         }
-        break;
+        return;
     case JitBytecode::Instruction::_tab:
         if( v >= 0 && v < f->d_constObjs.size() &&
                 f->d_constObjs[ f->d_constObjs.size() - v - 1 ].canConvert<JitBytecode::ConstTable>() )
         {
-            QByteArray str;
-            QTextStream out(&str);
             out << "{ ";
             JitBytecode::ConstTable t = f->d_constObjs[ f->d_constObjs.size() - v - 1 ].value<JitBytecode::ConstTable>();
-            if( !t.d_array.isEmpty() )
+            for( int i = 0; i < t.d_array.size(); i++ )
             {
-                for( int i = 0; i < t.d_array.size(); i++ )
-                {
-                    if( i != 0 )
-                        out << " ";
-                    out << tostring( t.d_array[i] );
-                }
+                if( i != 0 )
+                    out << " ";
+                writeConst( out, t.d_array[i] );
             }
             if( !t.d_hash.isEmpty() )
             {
@@ -810,15 +893,15 @@ QByteArray Disasm::renderArg(const JitBytecode::Function* f, int t, int v, int p
                 {
                     if( n != 0 )
                         out << " ";
-                    out << tostring( i.key() ) << " = " << tostring( i.value() );
+                    writeConst( out, i.key() );
+                    out << " = ";
+                    writeConst( out, i.value() );
                 }
             }
             out << " }";
-            out.flush();
-            return str;
+            return;
         }
-        return "???";
+        out << "???";
+        return;
     }
-    return QByteArray();
 }
-
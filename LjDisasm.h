@@ -23,7 +23,6 @@
 #include <LjTools/LuaJitBytecode.h>
 
 class QIODevice;
-class QTextStream;
 
 namespace Ljas
 {
@@ -50,20 +49,55 @@ namespace Ljas
             CALL, CALLT, RET,
             FORI, FORL,
             LOOP,
-            JMP
+            JMP,
+            TSETM, CALLM, CALLMT, RETM, VARG,
+            ITERC, ITERN, ITERL, ISNEXT
         };
 
         static const char* s_opName[];
         static const char* s_opHelp[];
 
+        // Formats into one reusable buffer which is handed to the device whenever it exceeds FlushSize;
+        // without a device the buffer just grows and is the result.
+        class Writer
+        {
+        public:
+            enum { FlushSize = 64 * 1024 };
+            explicit Writer( QIODevice* out = 0 );
+            ~Writer() { flush(); }
+            Writer& operator<<( const char* );
+            Writer& operator<<( const QByteArray& );
+            Writer& operator<<( const QString& );
+            Writer& operator<<( char ); // flushes at the end of a line if the buffer is full
+            Writer& operator<<( int v ) { return number(v); }
+            Writer& operator<<( quint32 v ) { return number(v); }
+            Writer& number( qint64 );
+            Writer& real( double );
+            Writer& indent( int level );
+            void chop( int n ) { d_buf.chop(n); } // only within the current line
+            qint64 pos() const { return d_written + d_buf.size(); }
+            bool flush();
+            bool isOk() const { return d_ok; }
+            const QByteArray& buffer() const { return d_buf; }
+        private:
+            QIODevice* d_out;
+            QByteArray d_buf;
+            qint64 d_written;
+            bool d_ok;
+        };
+
+        // The functions are nested in the output, so the root header comes first, but it is the last prototype of
+        // the dump; the dump is therefore parsed as a whole, whereas the output is streamed with constant memory.
         static bool disassemble(const Lua::JitBytecode&, QIODevice*, const QString& path = QString(),
                                 bool stripped = false, bool alloc = false );
         static bool adaptToLjasm(Lua::JitBytecode::Instruction& bc, OP& op, QByteArray& warning);
         static bool adaptToLjasm(Lua::JitBytecode::Instruction& bc, QByteArray& mnemonic, QByteArray& warning);
         static QByteArray renderArg(const Lua::JitBytecode::Function* f, int type, int value, int pc,
                                     bool stripped = false, bool alt = false);
+        static void writeArg(Writer&, const Lua::JitBytecode::Function* f, int type, int value, int pc,
+                                    bool stripped = false, bool alt = false);
     protected:
-        static bool writeFunc( QTextStream& out, const Lua::JitBytecode::Function*, bool stripped, bool alloc, int indent = 0 );
+        static bool writeFunc( Writer& out, const Lua::JitBytecode::Function*, bool stripped, bool alloc, int indent = 0 );
     private:
         Disasm();
 
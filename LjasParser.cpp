@@ -168,6 +168,10 @@ void Parser::formal_params() {
 		while (la->kind == _T_ident) {
 			vname();
 		}
+		if (la->kind == _T_3Dot) {
+			Get();
+			addTerminal(); 
+		}
 		d_stack.pop(); 
 }
 
@@ -373,7 +377,43 @@ void Parser::statement() {
 			JMP_();
 			break;
 		}
-		default: SynErr(71,__FUNCTION__); break;
+		case _T_TSETM: {
+			TSETM_();
+			break;
+		}
+		case _T_CALLM: {
+			CALLM_();
+			break;
+		}
+		case _T_CALLMT: {
+			CALLMT_();
+			break;
+		}
+		case _T_RETM: {
+			RETM_();
+			break;
+		}
+		case _T_VARG: {
+			VARG_();
+			break;
+		}
+		case _T_ITERC: {
+			ITERC_();
+			break;
+		}
+		case _T_ITERN: {
+			ITERN_();
+			break;
+		}
+		case _T_ITERL: {
+			ITERL_();
+			break;
+		}
+		case _T_ISNEXT: {
+			ISNEXT_();
+			break;
+		}
+		default: SynErr(81,__FUNCTION__); break;
 		}
 		d_stack.pop(); 
 }
@@ -443,7 +483,7 @@ void Parser::const_val() {
 			primitive();
 		} else if (la->kind == _T_Lbrace) {
 			table_literal();
-		} else SynErr(72,__FUNCTION__);
+		} else SynErr(82,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -454,7 +494,7 @@ void Parser::number() {
 			addTerminal(); 
 		} else if (la->kind == _T_posint || la->kind == _T_negint) {
 			integer();
-		} else SynErr(73,__FUNCTION__);
+		} else SynErr(83,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -469,7 +509,7 @@ void Parser::primitive() {
 		} else if (la->kind == _T_false) {
 			Get();
 			addTerminal(); 
-		} else SynErr(74,__FUNCTION__);
+		} else SynErr(84,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -490,7 +530,7 @@ void Parser::table_literal() {
 				number();
 			} else if (la->kind == _T_false || la->kind == _T_nil || la->kind == _T_true) {
 				primitive();
-			} else SynErr(75,__FUNCTION__);
+			} else SynErr(85,__FUNCTION__);
 		}
 		Expect(_T_Rbrace,__FUNCTION__);
 		addTerminal(); 
@@ -558,7 +598,7 @@ void Parser::ISEQ_() {
 			number();
 		} else if (la->kind == _T_false || la->kind == _T_nil || la->kind == _T_true) {
 			primitive();
-		} else SynErr(76,__FUNCTION__);
+		} else SynErr(86,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -576,7 +616,7 @@ void Parser::ISNE_() {
 			number();
 		} else if (la->kind == _T_false || la->kind == _T_nil || la->kind == _T_true) {
 			primitive();
-		} else SynErr(77,__FUNCTION__);
+		} else SynErr(87,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -659,12 +699,12 @@ void Parser::ADD_() {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(78,__FUNCTION__);
+		} else SynErr(88,__FUNCTION__);
 		if (la->kind == _T_ident) {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(79,__FUNCTION__);
+		} else SynErr(89,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -677,12 +717,12 @@ void Parser::SUB_() {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(80,__FUNCTION__);
+		} else SynErr(90,__FUNCTION__);
 		if (la->kind == _T_ident) {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(81,__FUNCTION__);
+		} else SynErr(91,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -695,12 +735,12 @@ void Parser::MUL_() {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(82,__FUNCTION__);
+		} else SynErr(92,__FUNCTION__);
 		if (la->kind == _T_ident) {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(83,__FUNCTION__);
+		} else SynErr(93,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -713,12 +753,12 @@ void Parser::DIV_() {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(84,__FUNCTION__);
+		} else SynErr(94,__FUNCTION__);
 		if (la->kind == _T_ident) {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(85,__FUNCTION__);
+		} else SynErr(95,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -731,12 +771,12 @@ void Parser::MOD_() {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(86,__FUNCTION__);
+		} else SynErr(96,__FUNCTION__);
 		if (la->kind == _T_ident) {
 			desig();
 		} else if (la->kind == _T_real || la->kind == _T_posint || la->kind == _T_negint) {
 			number();
-		} else SynErr(87,__FUNCTION__);
+		} else SynErr(97,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -777,7 +817,7 @@ void Parser::KSET_() {
 			primitive();
 		} else if (la->kind == _T_ident) {
 			cname();
-		} else SynErr(88,__FUNCTION__);
+		} else SynErr(98,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -816,7 +856,7 @@ void Parser::USET_() {
 			primitive();
 		} else if (la->kind == _T_ident) {
 			desig();
-		} else SynErr(89,__FUNCTION__);
+		} else SynErr(99,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -865,7 +905,7 @@ void Parser::TDUP_() {
 			cname();
 		} else if (la->kind == _T_Lbrace) {
 			table_literal();
-		} else SynErr(90,__FUNCTION__);
+		} else SynErr(100,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -879,7 +919,7 @@ void Parser::GGET_() {
 			addTerminal(); 
 		} else if (la->kind == _T_ident) {
 			cname();
-		} else SynErr(91,__FUNCTION__);
+		} else SynErr(101,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -893,7 +933,7 @@ void Parser::GSET_() {
 			addTerminal(); 
 		} else if (la->kind == _T_ident) {
 			cname();
-		} else SynErr(92,__FUNCTION__);
+		} else SynErr(102,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -911,7 +951,7 @@ void Parser::TGET_() {
 		} else if (la->kind == _T_posint) {
 			Get();
 			addTerminal(); 
-		} else SynErr(93,__FUNCTION__);
+		} else SynErr(103,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -929,7 +969,7 @@ void Parser::TSET_() {
 		} else if (la->kind == _T_posint) {
 			Get();
 			addTerminal(); 
-		} else SynErr(94,__FUNCTION__);
+		} else SynErr(104,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -938,9 +978,14 @@ void Parser::CALL_() {
 		Expect(_T_CALL,__FUNCTION__);
 		addTerminal(); 
 		desig();
-		if (la->kind == _T_posint) {
-			Get();
-			addTerminal(); 
+		if (la->kind == _T_3Dot || la->kind == _T_posint) {
+			if (la->kind == _T_posint) {
+				Get();
+				addTerminal(); 
+			} else if (la->kind == _T_3Dot) {
+				Get();
+				addTerminal(); 
+			} else SynErr(105,__FUNCTION__);
 			if (la->kind == _T_posint) {
 				Get();
 				addTerminal(); 
@@ -1008,6 +1053,111 @@ void Parser::JMP_() {
 		d_stack.pop(); 
 }
 
+void Parser::TSETM_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_TSETM_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_TSETM,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		Expect(_T_posint,__FUNCTION__);
+		addTerminal(); 
+		d_stack.pop(); 
+}
+
+void Parser::CALLM_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_CALLM_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_CALLM,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		if (la->kind == _T_3Dot || la->kind == _T_posint) {
+			if (la->kind == _T_posint) {
+				Get();
+				addTerminal(); 
+			} else if (la->kind == _T_3Dot) {
+				Get();
+				addTerminal(); 
+			} else SynErr(106,__FUNCTION__);
+			if (la->kind == _T_posint) {
+				Get();
+				addTerminal(); 
+			}
+		}
+		d_stack.pop(); 
+}
+
+void Parser::CALLMT_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_CALLMT_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_CALLMT,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		if (la->kind == _T_posint) {
+			Get();
+			addTerminal(); 
+		}
+		d_stack.pop(); 
+}
+
+void Parser::RETM_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_RETM_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_RETM,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		if (la->kind == _T_posint) {
+			Get();
+			addTerminal(); 
+		}
+		d_stack.pop(); 
+}
+
+void Parser::VARG_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_VARG_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_VARG,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		if (la->kind == _T_posint) {
+			Get();
+			addTerminal(); 
+		}
+		d_stack.pop(); 
+}
+
+void Parser::ITERC_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_ITERC_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_ITERC,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		Expect(_T_posint,__FUNCTION__);
+		addTerminal(); 
+		d_stack.pop(); 
+}
+
+void Parser::ITERN_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_ITERN_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_ITERN,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		Expect(_T_posint,__FUNCTION__);
+		addTerminal(); 
+		d_stack.pop(); 
+}
+
+void Parser::ITERL_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_ITERL_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_ITERL,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		label();
+		d_stack.pop(); 
+}
+
+void Parser::ISNEXT_() {
+		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_ISNEXT_, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
+		Expect(_T_ISNEXT,__FUNCTION__);
+		addTerminal(); 
+		desig();
+		label();
+		d_stack.pop(); 
+}
+
 void Parser::integer() {
 		Ljas::SynTree* n = new Ljas::SynTree( Ljas::SynTree::R_integer, d_next ); d_stack.top()->d_children.append(n); d_stack.push(n); 
 		if (la->kind == _T_negint) {
@@ -1016,7 +1166,7 @@ void Parser::integer() {
 		} else if (la->kind == _T_posint) {
 			Get();
 			addTerminal(); 
-		} else SynErr(95,__FUNCTION__);
+		} else SynErr(107,__FUNCTION__);
 		d_stack.pop(); 
 }
 
@@ -1120,7 +1270,7 @@ void Parser::Parse() {
 }
 
 Parser::Parser(PARSER_NS::Lexer *scanner, PARSER_NS::Errors* err) {
-	maxT = 70;
+	maxT = 80;
 
 	ParserInitCaller<Parser>::CallInit(this);
 	la = &d_dummy;
@@ -1134,10 +1284,10 @@ bool Parser::StartOf(int s) {
 	const bool T = true;
 	const bool x = false;
 
-	static bool set[3][72] = {
-		{T,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x},
-		{x,x,x,x, x,x,x,x, x,x,x,x, x,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,x,x,x, x,x,x,x, x,x,T,x, x,x,x,x, x,x,x,x},
-		{x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, T,x,T,T, x,x,T,T, T,T,T,x, x,x,x,x}
+	static bool set[3][82] = {
+		{T,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x},
+		{x,x,x,x, x,x,x,x, x,x,x,x, x,x,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,T, T,T,T,x, x,x,x,x, x,x,x,x, T,x,x,x, x,x,x,x, x,x},
+		{x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,x,x, x,x,T,x, T,T,x,x, T,T,T,T, T,x,x,x, x,x}
 	};
 
 
@@ -1169,95 +1319,107 @@ void Parser::SynErr(const QString& sourcePath, int line, int col, int n, PARSER_
 			case 4: s = coco_string_create(L"T_2Minus expected"); break;
 			case 5: s = coco_string_create(L"T_2MinusLbrack expected"); break;
 			case 6: s = coco_string_create(L"T_Dot expected"); break;
-			case 7: s = coco_string_create(L"T_Colon expected"); break;
-			case 8: s = coco_string_create(L"T_Eq expected"); break;
-			case 9: s = coco_string_create(L"T_Rbrack2Minus expected"); break;
-			case 10: s = coco_string_create(L"T_Lbrace expected"); break;
-			case 11: s = coco_string_create(L"T_Rbrace expected"); break;
-			case 12: s = coco_string_create(L"T_Keywords_ expected"); break;
-			case 13: s = coco_string_create(L"T_ADD expected"); break;
-			case 14: s = coco_string_create(L"T_CALL expected"); break;
-			case 15: s = coco_string_create(L"T_CALLT expected"); break;
-			case 16: s = coco_string_create(L"T_CAT expected"); break;
-			case 17: s = coco_string_create(L"T_DIV expected"); break;
-			case 18: s = coco_string_create(L"T_FNEW expected"); break;
-			case 19: s = coco_string_create(L"T_FORI expected"); break;
-			case 20: s = coco_string_create(L"T_FORL expected"); break;
-			case 21: s = coco_string_create(L"T_GGET expected"); break;
-			case 22: s = coco_string_create(L"T_GSET expected"); break;
-			case 23: s = coco_string_create(L"T_ISEQ expected"); break;
-			case 24: s = coco_string_create(L"T_ISF expected"); break;
-			case 25: s = coco_string_create(L"T_ISFC expected"); break;
-			case 26: s = coco_string_create(L"T_ISGE expected"); break;
-			case 27: s = coco_string_create(L"T_ISGT expected"); break;
-			case 28: s = coco_string_create(L"T_ISLE expected"); break;
-			case 29: s = coco_string_create(L"T_ISLT expected"); break;
-			case 30: s = coco_string_create(L"T_ISNE expected"); break;
-			case 31: s = coco_string_create(L"T_IST expected"); break;
-			case 32: s = coco_string_create(L"T_ISTC expected"); break;
-			case 33: s = coco_string_create(L"T_JMP expected"); break;
-			case 34: s = coco_string_create(L"T_KNIL expected"); break;
-			case 35: s = coco_string_create(L"T_KSET expected"); break;
-			case 36: s = coco_string_create(L"T_LEN expected"); break;
-			case 37: s = coco_string_create(L"T_LOOP expected"); break;
-			case 38: s = coco_string_create(L"T_MOD expected"); break;
-			case 39: s = coco_string_create(L"T_MOV expected"); break;
-			case 40: s = coco_string_create(L"T_MUL expected"); break;
-			case 41: s = coco_string_create(L"T_NOT expected"); break;
-			case 42: s = coco_string_create(L"T_POW expected"); break;
-			case 43: s = coco_string_create(L"T_RET expected"); break;
-			case 44: s = coco_string_create(L"T_SUB expected"); break;
-			case 45: s = coco_string_create(L"T_TDUP expected"); break;
-			case 46: s = coco_string_create(L"T_TGET expected"); break;
-			case 47: s = coco_string_create(L"T_TNEW expected"); break;
-			case 48: s = coco_string_create(L"T_TSET expected"); break;
-			case 49: s = coco_string_create(L"T_UCLO expected"); break;
-			case 50: s = coco_string_create(L"T_UGET expected"); break;
-			case 51: s = coco_string_create(L"T_UNM expected"); break;
-			case 52: s = coco_string_create(L"T_USET expected"); break;
-			case 53: s = coco_string_create(L"T_begin expected"); break;
-			case 54: s = coco_string_create(L"T_const expected"); break;
-			case 55: s = coco_string_create(L"T_end expected"); break;
-			case 56: s = coco_string_create(L"T_false expected"); break;
-			case 57: s = coco_string_create(L"T_function expected"); break;
-			case 58: s = coco_string_create(L"T_nil expected"); break;
-			case 59: s = coco_string_create(L"T_true expected"); break;
-			case 60: s = coco_string_create(L"T_var expected"); break;
-			case 61: s = coco_string_create(L"T_Specials_ expected"); break;
-			case 62: s = coco_string_create(L"T_ident expected"); break;
-			case 63: s = coco_string_create(L"T_string expected"); break;
-			case 64: s = coco_string_create(L"T_real expected"); break;
-			case 65: s = coco_string_create(L"T_posint expected"); break;
-			case 66: s = coco_string_create(L"T_negint expected"); break;
-			case 67: s = coco_string_create(L"T_Comment expected"); break;
-			case 68: s = coco_string_create(L"T_Eof expected"); break;
-			case 69: s = coco_string_create(L"T_MaxToken_ expected"); break;
-			case 70: s = coco_string_create(L"??? expected"); break;
-			case 71: s = coco_string_create(L"invalid statement"); break;
-			case 72: s = coco_string_create(L"invalid const_val"); break;
-			case 73: s = coco_string_create(L"invalid number"); break;
-			case 74: s = coco_string_create(L"invalid primitive"); break;
-			case 75: s = coco_string_create(L"invalid table_literal"); break;
-			case 76: s = coco_string_create(L"invalid ISEQ_"); break;
-			case 77: s = coco_string_create(L"invalid ISNE_"); break;
-			case 78: s = coco_string_create(L"invalid ADD_"); break;
-			case 79: s = coco_string_create(L"invalid ADD_"); break;
-			case 80: s = coco_string_create(L"invalid SUB_"); break;
-			case 81: s = coco_string_create(L"invalid SUB_"); break;
-			case 82: s = coco_string_create(L"invalid MUL_"); break;
-			case 83: s = coco_string_create(L"invalid MUL_"); break;
-			case 84: s = coco_string_create(L"invalid DIV_"); break;
-			case 85: s = coco_string_create(L"invalid DIV_"); break;
-			case 86: s = coco_string_create(L"invalid MOD_"); break;
-			case 87: s = coco_string_create(L"invalid MOD_"); break;
-			case 88: s = coco_string_create(L"invalid KSET_"); break;
-			case 89: s = coco_string_create(L"invalid USET_"); break;
-			case 90: s = coco_string_create(L"invalid TDUP_"); break;
-			case 91: s = coco_string_create(L"invalid GGET_"); break;
-			case 92: s = coco_string_create(L"invalid GSET_"); break;
-			case 93: s = coco_string_create(L"invalid TGET_"); break;
-			case 94: s = coco_string_create(L"invalid TSET_"); break;
-			case 95: s = coco_string_create(L"invalid integer"); break;
+			case 7: s = coco_string_create(L"T_3Dot expected"); break;
+			case 8: s = coco_string_create(L"T_Colon expected"); break;
+			case 9: s = coco_string_create(L"T_Eq expected"); break;
+			case 10: s = coco_string_create(L"T_Rbrack2Minus expected"); break;
+			case 11: s = coco_string_create(L"T_Lbrace expected"); break;
+			case 12: s = coco_string_create(L"T_Rbrace expected"); break;
+			case 13: s = coco_string_create(L"T_Keywords_ expected"); break;
+			case 14: s = coco_string_create(L"T_ADD expected"); break;
+			case 15: s = coco_string_create(L"T_CALL expected"); break;
+			case 16: s = coco_string_create(L"T_CALLM expected"); break;
+			case 17: s = coco_string_create(L"T_CALLMT expected"); break;
+			case 18: s = coco_string_create(L"T_CALLT expected"); break;
+			case 19: s = coco_string_create(L"T_CAT expected"); break;
+			case 20: s = coco_string_create(L"T_DIV expected"); break;
+			case 21: s = coco_string_create(L"T_FNEW expected"); break;
+			case 22: s = coco_string_create(L"T_FORI expected"); break;
+			case 23: s = coco_string_create(L"T_FORL expected"); break;
+			case 24: s = coco_string_create(L"T_GGET expected"); break;
+			case 25: s = coco_string_create(L"T_GSET expected"); break;
+			case 26: s = coco_string_create(L"T_ISEQ expected"); break;
+			case 27: s = coco_string_create(L"T_ISF expected"); break;
+			case 28: s = coco_string_create(L"T_ISFC expected"); break;
+			case 29: s = coco_string_create(L"T_ISGE expected"); break;
+			case 30: s = coco_string_create(L"T_ISGT expected"); break;
+			case 31: s = coco_string_create(L"T_ISLE expected"); break;
+			case 32: s = coco_string_create(L"T_ISLT expected"); break;
+			case 33: s = coco_string_create(L"T_ISNE expected"); break;
+			case 34: s = coco_string_create(L"T_ISNEXT expected"); break;
+			case 35: s = coco_string_create(L"T_IST expected"); break;
+			case 36: s = coco_string_create(L"T_ISTC expected"); break;
+			case 37: s = coco_string_create(L"T_ITERC expected"); break;
+			case 38: s = coco_string_create(L"T_ITERL expected"); break;
+			case 39: s = coco_string_create(L"T_ITERN expected"); break;
+			case 40: s = coco_string_create(L"T_JMP expected"); break;
+			case 41: s = coco_string_create(L"T_KNIL expected"); break;
+			case 42: s = coco_string_create(L"T_KSET expected"); break;
+			case 43: s = coco_string_create(L"T_LEN expected"); break;
+			case 44: s = coco_string_create(L"T_LOOP expected"); break;
+			case 45: s = coco_string_create(L"T_MOD expected"); break;
+			case 46: s = coco_string_create(L"T_MOV expected"); break;
+			case 47: s = coco_string_create(L"T_MUL expected"); break;
+			case 48: s = coco_string_create(L"T_NOT expected"); break;
+			case 49: s = coco_string_create(L"T_POW expected"); break;
+			case 50: s = coco_string_create(L"T_RET expected"); break;
+			case 51: s = coco_string_create(L"T_RETM expected"); break;
+			case 52: s = coco_string_create(L"T_SUB expected"); break;
+			case 53: s = coco_string_create(L"T_TDUP expected"); break;
+			case 54: s = coco_string_create(L"T_TGET expected"); break;
+			case 55: s = coco_string_create(L"T_TNEW expected"); break;
+			case 56: s = coco_string_create(L"T_TSET expected"); break;
+			case 57: s = coco_string_create(L"T_TSETM expected"); break;
+			case 58: s = coco_string_create(L"T_UCLO expected"); break;
+			case 59: s = coco_string_create(L"T_UGET expected"); break;
+			case 60: s = coco_string_create(L"T_UNM expected"); break;
+			case 61: s = coco_string_create(L"T_USET expected"); break;
+			case 62: s = coco_string_create(L"T_VARG expected"); break;
+			case 63: s = coco_string_create(L"T_begin expected"); break;
+			case 64: s = coco_string_create(L"T_const expected"); break;
+			case 65: s = coco_string_create(L"T_end expected"); break;
+			case 66: s = coco_string_create(L"T_false expected"); break;
+			case 67: s = coco_string_create(L"T_function expected"); break;
+			case 68: s = coco_string_create(L"T_nil expected"); break;
+			case 69: s = coco_string_create(L"T_true expected"); break;
+			case 70: s = coco_string_create(L"T_var expected"); break;
+			case 71: s = coco_string_create(L"T_Specials_ expected"); break;
+			case 72: s = coco_string_create(L"T_ident expected"); break;
+			case 73: s = coco_string_create(L"T_string expected"); break;
+			case 74: s = coco_string_create(L"T_real expected"); break;
+			case 75: s = coco_string_create(L"T_posint expected"); break;
+			case 76: s = coco_string_create(L"T_negint expected"); break;
+			case 77: s = coco_string_create(L"T_Comment expected"); break;
+			case 78: s = coco_string_create(L"T_Eof expected"); break;
+			case 79: s = coco_string_create(L"T_MaxToken_ expected"); break;
+			case 80: s = coco_string_create(L"??? expected"); break;
+			case 81: s = coco_string_create(L"invalid statement"); break;
+			case 82: s = coco_string_create(L"invalid const_val"); break;
+			case 83: s = coco_string_create(L"invalid number"); break;
+			case 84: s = coco_string_create(L"invalid primitive"); break;
+			case 85: s = coco_string_create(L"invalid table_literal"); break;
+			case 86: s = coco_string_create(L"invalid ISEQ_"); break;
+			case 87: s = coco_string_create(L"invalid ISNE_"); break;
+			case 88: s = coco_string_create(L"invalid ADD_"); break;
+			case 89: s = coco_string_create(L"invalid ADD_"); break;
+			case 90: s = coco_string_create(L"invalid SUB_"); break;
+			case 91: s = coco_string_create(L"invalid SUB_"); break;
+			case 92: s = coco_string_create(L"invalid MUL_"); break;
+			case 93: s = coco_string_create(L"invalid MUL_"); break;
+			case 94: s = coco_string_create(L"invalid DIV_"); break;
+			case 95: s = coco_string_create(L"invalid DIV_"); break;
+			case 96: s = coco_string_create(L"invalid MOD_"); break;
+			case 97: s = coco_string_create(L"invalid MOD_"); break;
+			case 98: s = coco_string_create(L"invalid KSET_"); break;
+			case 99: s = coco_string_create(L"invalid USET_"); break;
+			case 100: s = coco_string_create(L"invalid TDUP_"); break;
+			case 101: s = coco_string_create(L"invalid GGET_"); break;
+			case 102: s = coco_string_create(L"invalid GSET_"); break;
+			case 103: s = coco_string_create(L"invalid TGET_"); break;
+			case 104: s = coco_string_create(L"invalid TSET_"); break;
+			case 105: s = coco_string_create(L"invalid CALL_"); break;
+			case 106: s = coco_string_create(L"invalid CALLM_"); break;
+			case 107: s = coco_string_create(L"invalid integer"); break;
 
 		default:
 		{
@@ -25,69 +25,79 @@ private:
 		_T_2Minus=4,
 		_T_2MinusLbrack=5,
 		_T_Dot=6,
-		_T_Colon=7,
-		_T_Eq=8,
-		_T_Rbrack2Minus=9,
-		_T_Lbrace=10,
-		_T_Rbrace=11,
-		_T_Keywords_=12,
-		_T_ADD=13,
-		_T_CALL=14,
-		_T_CALLT=15,
-		_T_CAT=16,
-		_T_DIV=17,
-		_T_FNEW=18,
-		_T_FORI=19,
-		_T_FORL=20,
-		_T_GGET=21,
-		_T_GSET=22,
-		_T_ISEQ=23,
-		_T_ISF=24,
-		_T_ISFC=25,
-		_T_ISGE=26,
-		_T_ISGT=27,
-		_T_ISLE=28,
-		_T_ISLT=29,
-		_T_ISNE=30,
-		_T_IST=31,
-		_T_ISTC=32,
-		_T_JMP=33,
-		_T_KNIL=34,
-		_T_KSET=35,
-		_T_LEN=36,
-		_T_LOOP=37,
-		_T_MOD=38,
-		_T_MOV=39,
-		_T_MUL=40,
-		_T_NOT=41,
-		_T_POW=42,
-		_T_RET=43,
-		_T_SUB=44,
-		_T_TDUP=45,
-		_T_TGET=46,
-		_T_TNEW=47,
-		_T_TSET=48,
-		_T_UCLO=49,
-		_T_UGET=50,
-		_T_UNM=51,
-		_T_USET=52,
-		_T_begin=53,
-		_T_const=54,
-		_T_end=55,
-		_T_false=56,
-		_T_function=57,
-		_T_nil=58,
-		_T_true=59,
-		_T_var=60,
-		_T_Specials_=61,
-		_T_ident=62,
-		_T_string=63,
-		_T_real=64,
-		_T_posint=65,
-		_T_negint=66,
-		_T_Comment=67,
-		_T_Eof=68,
-		_T_MaxToken_=69
+		_T_3Dot=7,
+		_T_Colon=8,
+		_T_Eq=9,
+		_T_Rbrack2Minus=10,
+		_T_Lbrace=11,
+		_T_Rbrace=12,
+		_T_Keywords_=13,
+		_T_ADD=14,
+		_T_CALL=15,
+		_T_CALLM=16,
+		_T_CALLMT=17,
+		_T_CALLT=18,
+		_T_CAT=19,
+		_T_DIV=20,
+		_T_FNEW=21,
+		_T_FORI=22,
+		_T_FORL=23,
+		_T_GGET=24,
+		_T_GSET=25,
+		_T_ISEQ=26,
+		_T_ISF=27,
+		_T_ISFC=28,
+		_T_ISGE=29,
+		_T_ISGT=30,
+		_T_ISLE=31,
+		_T_ISLT=32,
+		_T_ISNE=33,
+		_T_ISNEXT=34,
+		_T_IST=35,
+		_T_ISTC=36,
+		_T_ITERC=37,
+		_T_ITERL=38,
+		_T_ITERN=39,
+		_T_JMP=40,
+		_T_KNIL=41,
+		_T_KSET=42,
+		_T_LEN=43,
+		_T_LOOP=44,
+		_T_MOD=45,
+		_T_MOV=46,
+		_T_MUL=47,
+		_T_NOT=48,
+		_T_POW=49,
+		_T_RET=50,
+		_T_RETM=51,
+		_T_SUB=52,
+		_T_TDUP=53,
+		_T_TGET=54,
+		_T_TNEW=55,
+		_T_TSET=56,
+		_T_TSETM=57,
+		_T_UCLO=58,
+		_T_UGET=59,
+		_T_UNM=60,
+		_T_USET=61,
+		_T_VARG=62,
+		_T_begin=63,
+		_T_const=64,
+		_T_end=65,
+		_T_false=66,
+		_T_function=67,
+		_T_nil=68,
+		_T_true=69,
+		_T_var=70,
+		_T_Specials_=71,
+		_T_ident=72,
+		_T_string=73,
+		_T_real=74,
+		_T_posint=75,
+		_T_negint=76,
+		_T_Comment=77,
+		_T_Eof=78,
+		_T_MaxToken_=79
 	};
 	int maxT;
 
@@ -198,6 +208,15 @@ Ljas::SynTree d_root;
 	void FORL_();
 	void LOOP_();
 	void JMP_();
+	void TSETM_();
+	void CALLM_();
+	void CALLMT_();
+	void RETM_();
+	void VARG_();
+	void ITERC_();
+	void ITERN_();
+	void ITERL_();
+	void ISNEXT_();
 	void integer();
 
 	void Parse();
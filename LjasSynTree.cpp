@@ -11,6 +11,8 @@ SynTree::SynTree(quint16 r, const Token& t ):d_tok(r){
 const char* SynTree::rToStr( quint16 r ) {
 	switch(r) {
 		case R_ADD_: return "ADD_";
+		case R_CALLMT_: return "CALLMT_";
+		case R_CALLM_: return "CALLM_";
 		case R_CALLT_: return "CALLT_";
 		case R_CALL_: return "CALL_";
 		case R_CAT_: return "CAT_";
@@ -27,9 +29,13 @@ const char* SynTree::rToStr( quint16 r ) {
 		case R_ISGT_: return "ISGT_";
 		case R_ISLE_: return "ISLE_";
 		case R_ISLT_: return "ISLT_";
+		case R_ISNEXT_: return "ISNEXT_";
 		case R_ISNE_: return "ISNE_";
 		case R_ISTC_: return "ISTC_";
 		case R_IST_: return "IST_";
+		case R_ITERC_: return "ITERC_";
+		case R_ITERL_: return "ITERL_";
+		case R_ITERN_: return "ITERN_";
 		case R_JMP_: return "JMP_";
 		case R_KNIL_: return "KNIL_";
 		case R_KSET_: return "KSET_";
@@ -41,16 +47,19 @@ const char* SynTree::rToStr( quint16 r ) {
 		case R_MUL_: return "MUL_";
 		case R_NOT_: return "NOT_";
 		case R_POW_: return "POW_";
+		case R_RETM_: return "RETM_";
 		case R_RET_: return "RET_";
 		case R_SUB_: return "SUB_";
 		case R_TDUP_: return "TDUP_";
 		case R_TGET_: return "TGET_";
 		case R_TNEW_: return "TNEW_";
+		case R_TSETM_: return "TSETM_";
 		case R_TSET_: return "TSET_";
 		case R_UCLO_: return "UCLO_";
 		case R_UGET_: return "UGET_";
 		case R_UNM_: return "UNM_";
 		case R_USET_: return "USET_";
+		case R_VARG_: return "VARG_";
 		case R_cname: return "cname";
 		case R_comment_: return "comment";
 		case R_const_decls: return "const_decls";
@@ -12,6 +12,8 @@ namespace Ljas {
 		enum ParserRule {
 			R_First = TT_Max + 1,
 			R_ADD_,
+			R_CALLMT_,
+			R_CALLM_,
 			R_CALLT_,
 			R_CALL_,
 			R_CAT_,
@@ -28,9 +30,13 @@ namespace Ljas {
 			R_ISGT_,
 			R_ISLE_,
 			R_ISLT_,
+			R_ISNEXT_,
 			R_ISNE_,
 			R_ISTC_,
 			R_IST_,
+			R_ITERC_,
+			R_ITERL_,
+			R_ITERN_,
 			R_JMP_,
 			R_KNIL_,
 			R_KSET_,
@@ -42,16 +48,19 @@ namespace Ljas {
 			R_MUL_,
 			R_NOT_,
 			R_POW_,
+			R_RETM_,
 			R_RET_,
 			R_SUB_,
 			R_TDUP_,
 			R_TGET_,
 			R_TNEW_,
+			R_TSETM_,
 			R_TSET_,
 			R_UCLO_,
 			R_UGET_,
 			R_UNM_,
 			R_USET_,
+			R_VARG_,
 			R_cname,
 			R_comment_,
 			R_const_decls,
@@ -10,6 +10,7 @@ namespace Ljas {
 			case Tok_2Minus: return "--";
 			case Tok_2MinusLbrack: return "--[";
 			case Tok_Dot: return ".";
+			case Tok_3Dot: return "...";
 			case Tok_Colon: return ":";
 			case Tok_Eq: return "=";
 			case Tok_Rbrack2Minus: return "]--";
@@ -17,6 +18,8 @@ namespace Ljas {
 			case Tok_Rbrace: return "}";
 			case Tok_ADD: return "ADD";
 			case Tok_CALL: return "CALL";
+			case Tok_CALLM: return "CALLM";
+			case Tok_CALLMT: return "CALLMT";
 			case Tok_CALLT: return "CALLT";
 			case Tok_CAT: return "CAT";
 			case Tok_DIV: return "DIV";
@@ -33,8 +36,12 @@ namespace Ljas {
 			case Tok_ISLE: return "ISLE";
 			case Tok_ISLT: return "ISLT";
 			case Tok_ISNE: return "ISNE";
+			case Tok_ISNEXT: return "ISNEXT";
 			case Tok_IST: return "IST";
 			case Tok_ISTC: return "ISTC";
+			case Tok_ITERC: return "ITERC";
+			case Tok_ITERL: return "ITERL";
+			case Tok_ITERN: return "ITERN";
 			case Tok_JMP: return "JMP";
 			case Tok_KNIL: return "KNIL";
 			case Tok_KSET: return "KSET";
@@ -46,15 +53,18 @@ namespace Ljas {
 			case Tok_NOT: return "NOT";
 			case Tok_POW: return "POW";
 			case Tok_RET: return "RET";
+			case Tok_RETM: return "RETM";
 			case Tok_SUB: return "SUB";
 			case Tok_TDUP: return "TDUP";
 			case Tok_TGET: return "TGET";
 			case Tok_TNEW: return "TNEW";
 			case Tok_TSET: return "TSET";
+			case Tok_TSETM: return "TSETM";
 			case Tok_UCLO: return "UCLO";
 			case Tok_UGET: return "UGET";
 			case Tok_UNM: return "UNM";
 			case Tok_USET: return "USET";
+			case Tok_VARG: return "VARG";
 			case Tok_begin: return "begin";
 			case Tok_const: return "const";
 			case Tok_end: return "end";
@@ -81,6 +91,7 @@ namespace Ljas {
 			case Tok_2Minus: return "Tok_2Minus";
 			case Tok_2MinusLbrack: return "Tok_2MinusLbrack";
 			case Tok_Dot: return "Tok_Dot";
+			case Tok_3Dot: return "Tok_3Dot";
 			case Tok_Colon: return "Tok_Colon";
 			case Tok_Eq: return "Tok_Eq";
 			case Tok_Rbrack2Minus: return "Tok_Rbrack2Minus";
@@ -88,6 +99,8 @@ namespace Ljas {
 			case Tok_Rbrace: return "Tok_Rbrace";
 			case Tok_ADD: return "Tok_ADD";
 			case Tok_CALL: return "Tok_CALL";
+			case Tok_CALLM: return "Tok_CALLM";
+			case Tok_CALLMT: return "Tok_CALLMT";
 			case Tok_CALLT: return "Tok_CALLT";
 			case Tok_CAT: return "Tok_CAT";
 			case Tok_DIV: return "Tok_DIV";
@@ -104,8 +117,12 @@ namespace Ljas {
 			case Tok_ISLE: return "Tok_ISLE";
 			case Tok_ISLT: return "Tok_ISLT";
 			case Tok_ISNE: return "Tok_ISNE";
+			case Tok_ISNEXT: return "Tok_ISNEXT";
 			case Tok_IST: return "Tok_IST";
 			case Tok_ISTC: return "Tok_ISTC";
+			case Tok_ITERC: return "Tok_ITERC";
+			case Tok_ITERL: return "Tok_ITERL";
+			case Tok_ITERN: return "Tok_ITERN";
 			case Tok_JMP: return "Tok_JMP";
 			case Tok_KNIL: return "Tok_KNIL";
 			case Tok_KSET: return "Tok_KSET";
@@ -117,15 +134,18 @@ namespace Ljas {
 			case Tok_NOT: return "Tok_NOT";
 			case Tok_POW: return "Tok_POW";
 			case Tok_RET: return "Tok_RET";
+			case Tok_RETM: return "Tok_RETM";
 			case Tok_SUB: return "Tok_SUB";
 			case Tok_TDUP: return "Tok_TDUP";
 			case Tok_TGET: return "Tok_TGET";
 			case Tok_TNEW: return "Tok_TNEW";
 			case Tok_TSET: return "Tok_TSET";
+			case Tok_TSETM: return "Tok_TSETM";
 			case Tok_UCLO: return "Tok_UCLO";
 			case Tok_UGET: return "Tok_UGET";
 			case Tok_UNM: return "Tok_UNM";
 			case Tok_USET: return "Tok_USET";
+			case Tok_VARG: return "Tok_VARG";
 			case Tok_begin: return "Tok_begin";
 			case Tok_const: return "Tok_const";
 			case Tok_end: return "Tok_end";
@@ -176,7 +196,13 @@ namespace Ljas {
 			}
 			break;
 		case '.':
-			res = Tok_Dot; i += 1;
+			if( at(str,i+1) == '.' ){
+				if( at(str,i+2) == '.' ){
+					res = Tok_3Dot; i += 3;
+				}
+			} else {
+				res = Tok_Dot; i += 1;
+			}
 			break;
 		case ':':
 			res = Tok_Colon; i += 1;
@@ -196,10 +222,20 @@ namespace Ljas {
 				switch( at(str,i+2) ){
 				case 'L':
 					if( at(str,i+3) == 'L' ){
-						if( at(str,i+4) == 'T' ){
+						switch( at(str,i+4) ){
+						case 'M':
+							if( at(str,i+5) == 'T' ){
+								res = Tok_CALLMT; i += 6;
+							} else {
+								res = Tok_CALLM; i += 5;
+							}
+							break;
+						case 'T':
 							res = Tok_CALLT; i += 5;
-						} else {
+							break;
+						default:
 							res = Tok_CALL; i += 4;
+							break;
 						}
 					}
 					break;
@@ -258,7 +294,8 @@ namespace Ljas {
 			}
 			break;
 		case 'I':
-			if( at(str,i+1) == 'S' ){
+			switch( at(str,i+1) ){
+			case 'S':
 				switch( at(str,i+2) ){
 				case 'E':
 					if( at(str,i+3) == 'Q' ){
@@ -294,7 +331,13 @@ namespace Ljas {
 					break;
 				case 'N':
 					if( at(str,i+3) == 'E' ){
-						res = Tok_ISNE; i += 4;
+						if( at(str,i+4) == 'X' ){
+							if( at(str,i+5) == 'T' ){
+								res = Tok_ISNEXT; i += 6;
+							}
+						} else {
+							res = Tok_ISNE; i += 4;
+						}
 					}
 					break;
 				case 'T':
@@ -305,6 +348,24 @@ namespace Ljas {
 					}
 					break;
 				}
+				break;
+			case 'T':
+				if( at(str,i+2) == 'E' ){
+					if( at(str,i+3) == 'R' ){
+						switch( at(str,i+4) ){
+						case 'C':
+							res = Tok_ITERC; i += 5;
+							break;
+						case 'L':
+							res = Tok_ITERL; i += 5;
+							break;
+						case 'N':
+							res = Tok_ITERN; i += 5;
+							break;
+						}
+					}
+				}
+				break;
 			}
 			break;
 		case 'J':
@@ -384,7 +445,11 @@ namespace Ljas {
 		case 'R':
 			if( at(str,i+1) == 'E' ){
 				if( at(str,i+2) == 'T' ){
-					res = Tok_RET; i += 3;
+					if( at(str,i+3) == 'M' ){
+						res = Tok_RETM; i += 4;
+					} else {
+						res = Tok_RET; i += 3;
+					}
 				}
 			}
 			break;
@@ -421,7 +486,11 @@ namespace Ljas {
 			case 'S':
 				if( at(str,i+2) == 'E' ){
 					if( at(str,i+3) == 'T' ){
-						res = Tok_TSET; i += 4;
+						if( at(str,i+4) == 'M' ){
+							res = Tok_TSETM; i += 5;
+						} else {
+							res = Tok_TSET; i += 4;
+						}
 					}
 				}
 				break;
@@ -457,6 +526,15 @@ namespace Ljas {
 				break;
 			}
 			break;
+		case 'V':
+			if( at(str,i+1) == 'A' ){
+				if( at(str,i+2) == 'R' ){
+					if( at(str,i+3) == 'G' ){
+						res = Tok_VARG; i += 4;
+					}
+				}
+			}
+			break;
 		case ']':
 			if( at(str,i+1) == '-' ){
 				if( at(str,i+2) == '-' ){
@@ -15,6 +15,7 @@ namespace Ljas {
 		Tok_2Minus,
 		Tok_2MinusLbrack,
 		Tok_Dot,
+		Tok_3Dot,
 		Tok_Colon,
 		Tok_Eq,
 		Tok_Rbrack2Minus,
@@ -24,6 +25,8 @@ namespace Ljas {
 		TT_Keywords,
 		Tok_ADD,
 		Tok_CALL,
+		Tok_CALLM,
+		Tok_CALLMT,
 		Tok_CALLT,
 		Tok_CAT,
 		Tok_DIV,
@@ -40,8 +43,12 @@ namespace Ljas {
 		Tok_ISLE,
 		Tok_ISLT,
 		Tok_ISNE,
+		Tok_ISNEXT,
 		Tok_IST,
 		Tok_ISTC,
+		Tok_ITERC,
+		Tok_ITERL,
+		Tok_ITERN,
 		Tok_JMP,
 		Tok_KNIL,
 		Tok_KSET,
@@ -53,15 +60,18 @@ namespace Ljas {
 		Tok_NOT,
 		Tok_POW,
 		Tok_RET,
+		Tok_RETM,
 		Tok_SUB,
 		Tok_TDUP,
 		Tok_TGET,
 		Tok_TNEW,
 		Tok_TSET,
+		Tok_TSETM,
 		Tok_UCLO,
 		Tok_UGET,
 		Tok_UNM,
 		Tok_USET,
+		Tok_VARG,
 		Tok_begin,
 		Tok_const,
 		Tok_end,
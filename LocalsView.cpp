@@ -0,0 +1,246 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LocalsView.h"
+#include "Engine2Thread.h"
+#include "LuaJitBytecode.h"
+#include <QHeaderView>
+using namespace Lua;
+
+static const int s_moreRole = Qt::UserRole + 1; // column 1: offset of the next page in the "..." item
+
+LocalsView::LocalsView(Engine2* lua, QWidget* parent):QTreeWidget(parent),d_lua(lua),d_runner(0)
+{
+    Q_ASSERT( lua != 0 );
+    setHeaderHidden(true);
+    setAlternatingRowColors(true);
+    setColumnCount(2); // Name, Value
+    header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
+    header()->setSectionResizeMode(1, QHeaderView::Stretch);
+    connect( this, SIGNAL(itemExpanded(QTreeWidgetItem*)), this, SLOT(onExpanded(QTreeWidgetItem*)) );
+    connect( this, SIGNAL(itemDoubleClicked(QTreeWidgetItem*,int)), this, SLOT(onDblClicked(QTreeWidgetItem*,int)) );
+}
+
+void LocalsView::setLocals(const Engine2::LazyVars& vs)
+{
+    updateItems( invisibleRootItem(), vs, false );
+}
+
+void LocalsView::onExpanded(QTreeWidgetItem* item)
+{
+    if( item->childCount() == 0 && canInspect() )
+        fetchPage( item, 0 );
+}
+
+void LocalsView::onDblClicked(QTreeWidgetItem* item, int)
+{
+    const int from = item->data(1,s_moreRole).toInt();
+    if( from > 0 && item->parent() && canInspect() )
+        fetchPage( item->parent(), from );
+}
+
+bool LocalsView::canInspect() const
+{
+    if( d_runner )
+        return d_runner->isWaiting();
+    else
+        return d_lua->isWaiting();
+}
+
+void LocalsView::updateItems(QTreeWidgetItem* parent, const Engine2::LazyVars& vs, bool more)
+{
+    if( parent->childCount() && parent->child(parent->childCount()-1)->data(1,s_moreRole).toInt() != 0 )
+        delete parent->takeChild(parent->childCount()-1);
+
+    for( int i = 0; i < vs.size(); i++ )
+    {
+        const Engine2::LazyVar& v = vs[i];
+        QString name = v.d_name;
+        if( v.d_isUv )
+            name += "'";
+        QTreeWidgetItem* item = 0;
+        if( i < parent->childCount() && parent->child(i)->text(0) == name )
+            item = parent->child(i);
+        else
+        {
+            for( int j = i + 1; j < parent->childCount(); j++ )
+            {
+                if( parent->child(j)->text(0) == name )
+                {
+                    item = parent->takeChild(j);
+                    parent->insertChild(i,item);
+                    break;
+                }
+            }
+        }
+        if( item )
+            setValue( item, v, false );
+        else
+        {
+            item = new QTreeWidgetItem();
+            item->setText(0,name);
+            parent->insertChild(i,item);
+            setValue( item, v, true );
+        }
+    }
+    while( parent->childCount() > vs.size() )
+        delete parent->takeChild(vs.size());
+    if( more )
+        setMore( parent, vs.size() );
+}
+
+static inline void setTypeText( QTreeWidgetItem* item, quint8 type )
+{
+    switch( type )
+    {
+    case Engine2::LocalVar::NIL:
+        item->setText(1, "nil");
+        break;
+    case Engine2::LocalVar::FUNC:
+        item->setText(1, "func");
+        break;
+    case Engine2::LocalVar::TABLE:
+        item->setText(1, "table");
+        break;
+    case Engine2::LocalVar::STRUCT:
+        item->setText(1, "struct");
+        break;
+    case Engine2::LocalVar::CDATA:
+        item->setText(1, "cdata");
+        break;
+    case Engine2::LocalVar::UNKNOWN:
+        item->setText(1, "<unknown>");
+        break;
+    default:
+        item->setText(1, QString());
+        break;
+    }
+}
+
+void LocalsView::setValue(QTreeWidgetItem* item, const Engine2::LazyVar& v, bool isNew)
+{
+    const QString old = item->text(1);
+    item->setToolTip(1, QString());
+    if( v.d_value.canConvert<Lua::Engine2::VarAddress>() )
+    {
+        Lua::Engine2::VarAddress addr = v.d_value.value<Lua::Engine2::VarAddress>();
+        if( addr.d_addr )
+        {
+            QString str = QString("address 0x%1").arg(quintptr(addr.d_addr),8,16,QChar('0'));
+            if( addr.d_meta )
+                str += QString(" metatable 0x%1").arg(quintptr(addr.d_meta),8,16,QChar('0'));
+            item->setToolTip(1, str);
+        }
+        setTypeText( item, addr.d_type );
+        if( addr.d_type == Engine2::LocalVar::TABLE )
+            item->setText(1, QString("table [%1]").arg(v.d_len) );
+    }else if( JitBytecode::isString(v.d_value) )
+    {
+        if( v.d_type == Engine2::LocalVar::STRING )
+            item->setText(1, "\"" + v.d_value.toString().simplified() + "\"");
+        else
+            item->setText(1, v.d_value.toString().simplified());
+        item->setToolTip(1, v.d_value.toString() );
+    }else if( !v.d_value.isNull() )
+    {
+        item->setText(1, v.d_value.toString() );
+        if( v.d_value.type() == QVariant::Double )
+        {
+            const double d = v.d_value.toDouble();
+            const int i = d;
+            if( d - double(i) == 0.0 )
+                item->setToolTip(1, QString("%1 0x%2").arg(i).arg(i,0,16));
+            else
+                item->setToolTip(1,QString::number(d, 'f', 8 ));
+        }
+    }else
+        setTypeText( item, v.d_type );
+
+    if( !isNew && old != item->text(1) )
+        item->setForeground(1, Qt::red );
+    else
+        item->setForeground(1, QBrush() );
+
+    const quint32 oldHandle = item->data(0,Qt::UserRole).toUInt();
+    item->setData(0,Qt::UserRole, v.d_handle );
+    if( v.d_handle == 0 )
+    {
+        qDeleteAll( item->takeChildren() );
+        item->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
+        return;
+    }
+    item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+    if( oldHandle == v.d_handle && item->isExpanded() && canInspect() )
+    {
+        // refresh the entries the user already paged in
+        int count = item->childCount();
+        if( count && item->child(count-1)->data(1,s_moreRole).toInt() != 0 )
+            count--;
+        if( count < PageSize )
+            count = PageSize;
+        bool more;
+        const Engine2::LazyVars vs = d_lua->getChildren( v.d_handle, 0, count, &more );
+        updateItems( item, vs, more );
+    }else
+    {
+        // different table or not visible; fetched again on expansion
+        qDeleteAll( item->takeChildren() );
+        item->setExpanded(false);
+    }
+}
+
+void LocalsView::fetchPage(QTreeWidgetItem* parent, int from)
+{
+    bool more;
+    const Engine2::LazyVars vs = d_lua->getChildren( parent->data(0,Qt::UserRole).toUInt(), from, PageSize, &more );
+    QTreeWidgetItem* last = parent->childCount() ? parent->child(parent->childCount()-1) : 0;
+    if( last && last->data(1,s_moreRole).toInt() > 0 )
+        parent->removeChild(last);
+    else
+        last = 0;
+    foreach( const Engine2::LazyVar& v, vs )
+    {
+        QTreeWidgetItem* item = new QTreeWidgetItem(parent);
+        item->setText(0,v.d_name);
+        setValue( item, v, true );
+    }
+    if( more )
+    {
+        // reuse the "..." item if there is one, it might be the one which was double clicked
+        if( last )
+        {
+            parent->addChild(last);
+            last->setData(1,s_moreRole, from + vs.size() );
+        }else
+            setMore( parent, from + vs.size() );
+    }else if( last )
+    {
+        parent->addChild(last);
+        last->setHidden(true);
+        last->setData(1,s_moreRole, -1 ); // exhausted; removed with the next update
+    }
+}
+
+void LocalsView::setMore(QTreeWidgetItem* parent, int from)
+{
+    QTreeWidgetItem* item = new QTreeWidgetItem(parent);
+    item->setText(0,"...");
+    item->setToolTip(0, tr("double click to show more entries") );
+    item->setData(1,s_moreRole, from );
+}
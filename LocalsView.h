@@ -0,0 +1,56 @@
+#ifndef LUA_LOCALSVIEW_H
+#define LUA_LOCALSVIEW_H
+
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QTreeWidget>
+#include <LjTools/Engine2.h>
+
+namespace Lua
+{
+    class Engine2Thread;
+
+    // Shows the Engine2::LazyVars of the active level. Tables are expanded on demand in pages of
+    // PageSize entries (double click "..." for the next page). setLocals updates the existing
+    // items instead of rebuilding them, so expanded tables stay open and changed values are marked.
+    class LocalsView : public QTreeWidget
+    {
+        Q_OBJECT
+    public:
+        enum { PageSize = 100 };
+        explicit LocalsView(Engine2*, QWidget* parent = 0);
+        void setRunner( Engine2Thread* r ) { d_runner = r; } // expansion only while the runner waits
+        void setLocals( const Engine2::LazyVars& );
+    protected slots:
+        void onExpanded(QTreeWidgetItem*);
+        void onDblClicked(QTreeWidgetItem*,int);
+    protected:
+        bool canInspect() const;
+        void updateItems(QTreeWidgetItem* parent, const Engine2::LazyVars&, bool more);
+        void setValue(QTreeWidgetItem*, const Engine2::LazyVar&, bool isNew );
+        void fetchPage(QTreeWidgetItem* parent, int from );
+        static void setMore(QTreeWidgetItem* parent, int from );
+    private:
+        Engine2* d_lua;
+        Engine2Thread* d_runner;
+    };
+}
+
+#endif // LUA_LOCALSVIEW_H
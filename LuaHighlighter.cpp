@@ -19,368 +19,241 @@
  */
 
 #include "LuaHighlighter.h"
-//#include <Lua.h>
-#include <QtDebug>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QSet>
 using namespace Lua;
 
-// TODO: this implementation doesn't properly cover all test cases by puc-lua yet; especially
-// it has troubles with nested long comments and strings; use LuaLexer
+static const char* s_keywords[] = {
+    "and", "break", "do", "else", "elseif", "end", "false", "for", "function", "goto", "if", "in",
+    "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while", 0
+};
+
+static bool isKeyword( const QString& text, int start, int len )
+{
+    const QStringRef word = text.midRef(start,len);
+    for( int i = 0; s_keywords[i]; i++ )
+    {
+        if( word == QLatin1String(s_keywords[i]) )
+            return true;
+    }
+    return false;
+}
+
+static int longBracket( const QString& text, int i, QChar open )
+{
+    // the level of [==[ resp. ]==] starting at i, or -1
+    if( i >= text.size() || text[i] != open )
+        return -1;
+    int j = i + 1;
+    while( j < text.size() && text[j] == QChar('=') )
+        j++;
+    if( j < text.size() && text[j] == open )
+        return j - i - 1;
+    return -1;
+}
+
+static int findLongEnd( const QString& text, int from, int level )
+{
+    // the position after the closing bracket of the given level, or -1
+    for( int i = from; i < text.size(); i++ )
+    {
+        if( text[i] == QChar(']') && longBracket( text, i, QChar(']') ) == level )
+            return i + level + 2;
+    }
+    return -1;
+}
+
+static inline bool isIdentChar( QChar c )
+{
+    return c.isLetterOrNumber() || c == QChar('_');
+}
 
 Highlighter::Highlighter(QTextDocument *parent) :
     QSyntaxHighlighter(parent)
 {
-    HighlightingRule rule;
-
-    // Die Regeln werden in der hier gegebenen Reihenfolge abgearbeitet
     d_commentFormat.setProperty( TokenProp, Comment );
     d_commentFormat.setForeground(Qt::darkGreen);
-	// Das wird neu unten gemacht mit den Multiline-Formaten
-//    rule.pattern = QRegExp("--+[^\n]*");
-//    rule.format = d_commentFormat;
-//    rule.name = "Single Line Comment";
-//    d_rules.append(rule);
 
     d_literalFormat.setProperty( TokenProp, LiteralString );
     d_literalFormat.setForeground(Qt::darkRed);
-    // Quelle: http://stackoverflow.com/questions/481282/how-can-i-match-double-quoted-strings-with-escaped-double-quote-characters
-	rule.pattern = QRegExp( "\"(?:[^\\\\\"]|\\\\.)*\"" ); // TODO: verhindern, dass '"'abc'"' als String "'abc'" interpretiert wird!
-    rule.pattern.setMinimal(true);
-    rule.name = "Double Quote String";
-    rule.format = d_literalFormat;
-    d_rules.append(rule);
-	rule.pattern = QRegExp( "'(?:[^\\\\']|\\\\.)*'" );
-    rule.pattern.setMinimal(true);
-    rule.name = "Single Quote String";
-    d_rules.append(rule);
 
-    QTextCharFormat keywordFormat;
-    keywordFormat.setProperty( TokenProp, Keyword );
-    keywordFormat.setForeground(QColor(0x00,0x00,0x7f));
-    keywordFormat.setFontWeight(QFont::Bold);
-    QStringList keywordPatterns;
-    keywordPatterns << "\\band\\b" << "\\bbreak\\b" << "\\bdo\\b"
-                    << "\\belse\\b" << "\\belseif\\b" << "\\bend\\b"
-                    << "\\bfalse\\b" << "\\bfor\\b" << "\\bfunction\\b"
-                    << "\\bif\\b" << "\\bin\\b" << "\\blocal\\b"
-                    << "\\bnil\\b" << "\\bnot\\b" << "\\bor\\b"
-                    << "\\brepeat\\b" << "\\breturn\\b" << "\\bthen\\b"
-                    << "\\btrue\\b" << "\\buntil\\b" << "\\bwhile\\b";
-    foreach (const QString &pattern, keywordPatterns)
-    {
-        rule.pattern = QRegExp(pattern);
-        rule.format = keywordFormat;
-        rule.name = "Keyword " + pattern.toUtf8();
-        d_rules.append(rule);
-    }
+    d_keywordFormat.setProperty( TokenProp, Keyword );
+    d_keywordFormat.setForeground(QColor(0x00,0x00,0x7f));
+    d_keywordFormat.setFontWeight(QFont::Bold);
 
-    QTextCharFormat numbers;
-    numbers.setProperty( TokenProp, Number );
-    numbers.setForeground(Qt::red);
-    // 0xff   0x56
-    rule.pattern = QRegExp("(^[a-zA-Z_]|\\b)0x[0-9a-fA-F]+" );
-    // (^[a-zA-Z_]|\\b) heisst, dass 0x nicht Teil eines Idents sein darf
-    rule.format = numbers;
-    rule.name = "Number";
-    d_rules.append(rule);
+    d_otherFormat = d_keywordFormat;
+    d_otherFormat.setProperty( TokenProp, Other );
 
-    QTextCharFormat idents; // Ist nötig, damit Idents der Form "abc123" nicht als Zahl interpretiert werden
-    idents.setProperty( TokenProp, Ident );
-    idents.setForeground(Qt::black);
-	rule.pattern = QRegExp("(\\b)[a-zA-Z_][a-zA-Z0-9_]*");
-	// ([^0-9]|\\b) heisst, entweder ist der Ident am Anfang der Zeile oder nicht unmittelbar nach Zahl.
-    // Damit verhindern wir, dass 314.16e-2 das "e" als Ident verwendet wird.
-	// Issue: "[^0-9]|\\b" or "[^0-9]" also detect on idents like ".b"
-    rule.format = idents;
-    rule.name = "Ident";
-    d_rules.append(rule);
+    d_numberFormat.setProperty( TokenProp, Number );
+    d_numberFormat.setForeground(Qt::red);
 
-    // 3   3.0    3.1416   314.16e-2   0.31416E1   12E2   .123 .16e-2 .31416E1
-    rule.pattern = QRegExp("[0-9]*[\\.]?[0-9]+([eE][-+]?[0-9]+)?" );
-    rule.format = numbers;
-    rule.name = "Number";
-    d_rules.append(rule);
+    d_identFormat.setProperty( TokenProp, Ident );
+    d_identFormat.setForeground(Qt::black);
 
-    keywordFormat.setProperty( TokenProp, Other );
-    QStringList otherTokens; // Zuerst die langen, dann die kurzen
-    otherTokens <<  "\\.\\.\\." << "\\.\\." << "==" << "~=" << "<=" << ">=" <<
-                    "\\*" << "/" << "%" << "\\^" << "#" << "<" << ">" << "=" <<
-					"\\(" << "\\)" << "\\{" << "\\}" << "\\[" << "\\]" <<  ";" << ":" << "," <<
-                    "\\+" << "-" << "\\.";
-    foreach (const QString &pattern, otherTokens)
-    {
-        rule.pattern = QRegExp(pattern);
-        rule.format = keywordFormat;
-        rule.name = "Token " + pattern.toUtf8();
-        d_rules.append(rule);
-    }
-}
-
-static inline void empty( QString& str, int start, int len )
-{
-    // Kostet fast nichts, da kein dynamischer Speicher angelegt oder freigegeben wird
-    for( int i = start; i < ( start + len ); i++ )
-        str[i] = QChar(' ');
+    for( int i = 0; i <= Module::BuiltInSpan; i++ )
+        d_semFormat[i] = d_identFormat;
+    d_semFormat[Module::LocalSpan].setForeground(QColor(0x00,0x70,0x70));
+    d_semFormat[Module::UpvalSpan].setForeground(QColor(0x80,0x00,0x80));
+    d_semFormat[Module::UpvalSpan].setFontItalic(true);
+    d_semFormat[Module::GlobalSpan].setForeground(QColor(0x80,0x40,0x00));
+    d_semFormat[Module::ImplicitGlobalSpan].setForeground(QColor(0xd0,0x60,0x00));
+    d_semFormat[Module::BuiltInSpan].setForeground(QColor(0x00,0x60,0xc0));
 }
 
-struct Mark
+void Highlighter::setSpans(const Module::Spans& spans)
 {
-	enum Kind {
-		LineCmt,      // --
-		StartMlCmt,   // --[[ or --[=[ mit d_num Anz. =
-		StartMlStr,   // [[ or [=[ mit d_num Anz. =
-		EndMlStrOrCmt,// ]] or ]=] mit d_num Anz. =
-		Done
-	};
-	int d_pos;     // Position in text
-	quint8 d_num; // Anzahl Gleichheitszeichen
-	quint8 d_kind; // Kind
-	int len() const
-	{
-		switch( d_kind )
-		{
-		case LineCmt:
-			return 2;
-		case StartMlCmt:
-			return 2 + d_num + 2;
-		case StartMlStr:
-		case EndMlStrOrCmt:
-			return d_num + 2;
-		}
-		return 0;
-	}
-	Mark():d_pos(-1),d_num(0),d_kind(Done){}
-};
-typedef QList<Mark> Marks;
-
-static Mark _nextMark2( const QString& text, int from = 0 )
-{
-	// Suche nach "--", "--[[", "--[=[", "[[", "[=[", "]]", "]=]"
-    Mark res;
-    for( int i = from; i < text.size(); i++ )
+    QHash<int,Sems> sems;
+    foreach( const Module::Span& s, spans )
     {
-        const QChar c = text[i];
-		if( c == QChar('-') && i + 1 < text.size() && text[i+1] == QChar('-') )
-        {
-			// "--" found
-			res.d_kind = Mark::LineCmt;
-			res.d_pos = i;
-			if( i + 3 < text.size() && text[i+2] == QChar('[') )
-			{
-				// "--[" found
-				if( text[i+3] == QChar('=') )
-				{
-					int j = i+4;
-					while( j < text.size() && text[j] == QChar('=') )
-						j++;
-					if( j < text.size() && text[j] == QChar('[') )
-					{
-						// "--[=[" found
-						res.d_kind = Mark::StartMlCmt;
-						res.d_num = j - ( i + 2 ) - 1;
-						return res;
-					}
-				}else if( text[i+3] == QChar('[') )
-				{
-					// "--[[" found
-					res.d_kind = Mark::StartMlCmt;
-					return res;
-				}
-			}
-			return res; // es ist in jedem Fall ein Single Line Comment, wenn man hier ankommt
-		}else if( c == QChar(']') && i + 1 < text.size() )
-        {
-			if( text[i+1] == QChar('=') )
-            {
-                int j = i+2;
-                while( j < text.size() && text[j] == QChar('=') )
-                    j++;
-                if( j < text.size() && text[j] == QChar(']') )
-                {
-					// "]=]" found
-					res.d_kind = Mark::EndMlStrOrCmt;
-                    res.d_pos = i;
-					res.d_num = j - i - 1;
-                    return res;
-                }
-			}else if( text[i+1] == QChar(']') )
-            {
-				// "]]" found
-				res.d_kind = Mark::EndMlStrOrCmt;
-				res.d_pos = i;
-                return res;
-            }
-		}else if( c == QChar('[') && i + 1 < text.size() )
-        {
-			if( text[i+1] == QChar('=') ) // "[=" found
-            {
-                int j = i+2;
-                while( j < text.size() && text[j] == QChar('=') )
-                    j++;
-                if( j < text.size() && text[j] == QChar('[') )
-                {
-					// "[=[" found
-					res.d_kind = Mark::StartMlStr;
-					res.d_pos = i;
-					res.d_num = j - i - 1;
-                    return res;
-                }
-			}else if( text[i+1] == QChar('[') ) // "[[" found
-            {
-				res.d_kind = Mark::StartMlStr;
-				res.d_pos = i;
-                return res;
-			}
-        }
+        if( s.d_line == 0 || s.d_col == 0 )
+            continue;
+        sems[s.d_line - 1].append( Sem( s.d_col - 1, s.d_len, s.d_kind ) );
     }
-    return res;
-}
 
-static Marks _findMarks( const QString& text )
-{
-    Marks marks; // alle Marks der Zeile
-    Mark pos = _nextMark2( text );
-	while( pos.d_kind != Mark::Done )
+    // only the blocks whose spans changed are highlighted again
+    QSet<int> changed;
+    QHash<int,Sems>::const_iterator i;
+    for( i = sems.begin(); i != sems.end(); ++i )
     {
-        marks.append(pos);
-        pos = _nextMark2( text, pos.d_pos + pos.len() );
+        if( d_sems.value(i.key()) != i.value() )
+            changed.insert(i.key());
+    }
+    for( i = d_sems.begin(); i != d_sems.end(); ++i )
+    {
+        if( !sems.contains(i.key()) )
+            changed.insert(i.key());
+    }
+    d_sems = sems;
+    foreach( int n, changed )
+    {
+        const QTextBlock b = document()->findBlockByNumber(n);
+        if( b.isValid() )
+            rehighlightBlock(b);
     }
-    return marks;
 }
 
-union BlockState
+void Highlighter::highlightBlock(const QString & text)
 {
-    int d_int; // Initialwert ist -1, was 0xffffffff entspricht
-    struct Data
+    const int size = text.size();
+    int i = 0;
+    const int prev = previousBlockState();
+    if( prev > 0 )
     {
-        unsigned int startOfComment:1; // Auf der Zeile beginnt ein Kommentar, der dort nicht endet
-		unsigned int endOfStrOrCmnt:1; // Auf der Zeile endet ein Kommentar oder String, der dort nicht beginnt
-        unsigned int allLineComment:1; // Die ganze Zeile gehört zu einem Kommentar, der darüber beginnt und darunter endet
-        unsigned int startOfString:1;
-        unsigned int allLineString:1;
-		unsigned int level:8;    // Anz. "="
-		unsigned int dummy:18;
-        unsigned int unitialized:1;
-    } d_state;
-};
-
-void Highlighter::highlightBlock(const QString & block)
-{
-    QString text = block; // wir machen Kopie, damit wir die geparsten Stellen rauslöschen können
+        // continue the long comment or string of the previous block
+        const QTextCharFormat& f = ( prev >> 8 ) == InComment ? d_commentFormat : d_literalFormat;
+        const int end = findLongEnd( text, 0, prev & 0xff );
+        if( end < 0 )
+        {
+            setFormat( 0, size, f );
+            setCurrentBlockState( prev );
+            return;
+        }
+        setFormat( 0, end, f );
+        i = end;
+    }
+    setCurrentBlockState( Idle );
 
-    BlockState prev;
-    prev.d_int = previousBlockState();
-    if( prev.d_state.unitialized )
-        prev.d_int = 0;
-    BlockState newCur;
-    newCur.d_int = 0;
+    // the spans are positions of the last analysis; they are only applied to identifiers of the same extent
+    const Sems sems = d_sems.value( currentBlock().blockNumber() );
+    int sem = 0;
 
-    Marks marks = _findMarks( text );
-    int marksDone = 0;
-    if( prev.d_state.startOfComment || prev.d_state.allLineComment )
-    {   // wir sind in einem Kommentar drin
-        // prüfe, ob er hier endet; suche das erste End; alle davor liegenden Starts und anderen Marks werden ignoriert
-        for( int i = 0; i < marks.size(); i++ )
+    while( i < size )
+    {
+        const QChar c = text[i];
+        if( c.isSpace() )
         {
-			if( marks[i].d_kind == Mark::EndMlStrOrCmt && marks[i].d_num == prev.d_state.level )
-            {   // wir sind auf ein End gestossen
-                marksDone = i + 1;
-				newCur.d_state.endOfStrOrCmnt = true;
-				newCur.d_state.level = prev.d_state.level;
-				stamp( text, 0, marks[i].d_pos + marks[i].len(), d_commentFormat );
-                break;
-            }
-        }
-        if( marksDone == 0 )
-        {   // keine wirksamen Comment Marks gefunden; die ganze Zeile ist auch ein Kommentar
-            newCur.d_state.allLineComment = true;
-			newCur.d_state.level = prev.d_state.level;
-			stamp( text, 0, text.size(), d_commentFormat );
-            marksDone = marks.size();
+            i++;
+            continue;
         }
-    }else if( prev.d_state.startOfString || prev.d_state.allLineString )
-    {
-        // wir sind in einem String drin
-        // prüfe, ob er hier endet; suche das erste End; alle davor liegenden Starts und anderen Marks werden ignoriert
-        for( int i = 0; i < marks.size(); i++ )
+        if( c == QChar('-') && i + 1 < size && text[i+1] == QChar('-') )
         {
-			if( marks[i].d_kind == Mark::EndMlStrOrCmt && marks[i].d_num == prev.d_state.level )
-            {   // wir sind auf ein End gestossen
-                marksDone = i + 1;
-				newCur.d_state.endOfStrOrCmnt = true;
-				newCur.d_state.level = prev.d_state.level;
-                stamp( text, 0, marks[i].d_pos + marks[i].len(), d_literalFormat );
-                break;
+            const int level = longBracket( text, i + 2, QChar('[') );
+            if( level < 0 )
+            {
+                setFormat( i, size - i, d_commentFormat );
+                return;
             }
+            const int end = findLongEnd( text, i + level + 4, level );
+            if( end < 0 )
+            {
+                setFormat( i, size - i, d_commentFormat );
+                setCurrentBlockState( ( InComment << 8 ) | level );
+                return;
+            }
+            setFormat( i, end - i, d_commentFormat );
+            i = end;
+            continue;
         }
-        if( marksDone == 0 )
-        {   // keine wirksamen String Marks gefunden; die ganze Zeile ist auch ein String
-            newCur.d_state.allLineString = true;
-			newCur.d_state.level = prev.d_state.level;
-            stamp( text, 0, text.size(), d_literalFormat );
-            marksDone = marks.size();
-        }
-    }
-	// Suche ganze LineCmt oder Ml-Paare
-    for( int i = marksDone; i < marks.size(); i++ )
-    {
-		if( marks[i].d_kind == Mark::LineCmt )
-		{
-			stamp( text, marks[i].d_pos, text.size() - marks[i].d_pos, d_commentFormat );
-			marksDone = marks.size();
-			break;
-		}else if( marks[i].d_kind == Mark::StartMlCmt || marks[i].d_kind == Mark::StartMlStr )
+        if( c == QChar('[') )
         {
-			for( int j = i + 1; j < marks.size(); j++ )
+            const int level = longBracket( text, i, QChar('[') );
+            if( level >= 0 )
             {
-				if( marks[j].d_num == marks[i].d_num )
+                const int end = findLongEnd( text, i + level + 2, level );
+                if( end < 0 )
                 {
-                    stamp( text, marks[i].d_pos, marks[j].d_pos - marks[i].d_pos + marks[j].len(),
-						   (marks[i].d_kind == Mark::StartMlCmt)?d_commentFormat:d_literalFormat );
-					marks[i].d_kind = Mark::Done;
-					marks[j].d_kind = Mark::Done; // als gesehen markieren
+                    setFormat( i, size - i, d_literalFormat );
+                    setCurrentBlockState( ( InLiteral << 8 ) | level );
+                    return;
                 }
+                setFormat( i, end - i, d_literalFormat );
+                i = end;
+                continue;
             }
         }
-    }
-    // Suche offene Enden
-    for( int i = marksDone; i < marks.size(); i++ )
-    {
-		if( marks[i].d_kind == Mark::StartMlCmt || marks[i].d_kind == Mark::StartMlStr )
+        if( c == QChar('"') || c == QChar('\'') )
         {
-			if( marks[i].d_kind == Mark::StartMlCmt )
-                newCur.d_state.startOfComment = true;
-            else
-                newCur.d_state.startOfString = true;
-			newCur.d_state.level = marks[i].d_num;
-			stamp( text, marks[i].d_pos, text.size() - marks[i].d_pos,
-				   (marks[i].d_kind == Mark::StartMlCmt)?d_commentFormat:d_literalFormat );
+            int j = i + 1;
+            while( j < size && text[j] != c )
+            {
+                if( text[j] == QChar('\\') )
+                    j++;
+                j++;
+            }
+            j = qMin( j + 1, size );
+            setFormat( i, j - i, d_literalFormat );
+            i = j;
+            continue;
         }
-    }
-    setCurrentBlockState( newCur.d_int );
-
-	//qDebug() << "**********";
-    foreach( const HighlightingRule &rule, d_rules )
-    {
-        QRegExp expression(rule.pattern);
-        int index = expression.indexIn(text);
-        while( index >= 0 )
+        if( c.isDigit() || ( c == QChar('.') && i + 1 < size && text[i+1].isDigit() ) )
         {
-            const int length = expression.matchedLength();
-			//qDebug() << "hit" << rule.name << ":" << text.mid( index, length );
-            stamp( text, index, length, rule.format );
-            index = expression.indexIn(text, index + length);
+            // same extent as lj_lex: identifier chars, dots and a sign after the exponent mark
+            const QChar xp = ( c == QChar('0') && i + 1 < size && text[i+1].toLower() == QChar('x') ) ?
+                        QChar('p') : QChar('e');
+            int j = i + 1;
+            while( j < size && ( isIdentChar(text[j]) || text[j] == QChar('.') ||
+                   ( ( text[j] == QChar('-') || text[j] == QChar('+') ) && text[j-1].toLower() == xp ) ) )
+                j++;
+            setFormat( i, j - i, d_numberFormat );
+            i = j;
+            continue;
+        }
+        if( c.isLetter() || c == QChar('_') )
+        {
+            int j = i + 1;
+            while( j < size && isIdentChar(text[j]) )
+                j++;
+            const int len = j - i;
+            if( isKeyword( text, i, len ) )
+                setFormat( i, len, d_keywordFormat );
+            else
+            {
+                while( sem < sems.size() && sems[sem].d_col < i )
+                    sem++;
+                if( sem < sems.size() && sems[sem].d_col == i && sems[sem].d_len == len )
+                    setFormat( i, len, d_semFormat[sems[sem].d_kind] );
+                else
+                    setFormat( i, len, d_identFormat );
+            }
+            i = j;
+            continue;
         }
+        setFormat( i, 1, d_otherFormat );
+        i++;
     }
 }
 
-void Highlighter::stamp(QString &text, int start, int len, const QTextCharFormat &f)
-{
-    setFormat(start, len, f );
-    // Vermeide, dass mehrere Regeln auf denselben Text angewendet werden
-    empty( text, start, len );
-	// qDebug() << "empty:" << text;
-}
-
 QString Highlighter::format(int tokenType)
 {
     switch( tokenType )
@@ -22,9 +22,14 @@
 #define LUASYNTAXHIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
+#include <QHash>
+#include <LjTools/LuaModule.h>
 
 namespace Lua
 {
+    // Lexes each block in one pass; the lexer state carried to the next block is only the kind and level
+    // of an open long comment or string, so an edit usually touches just the changed block. Identifiers
+    // are further classified by the spans of the last Module analysis (see setSpans).
     class Highlighter : public QSyntaxHighlighter
     {
         Q_OBJECT
@@ -33,21 +38,30 @@ namespace Lua
         enum TokenType { UnknownToken = 0, Ident, Keyword, Number, LiteralString, Comment, Other };
         static QString format( int tokenType );
         explicit Highlighter(QTextDocument *parent = 0);
+        void setSpans( const Module::Spans& );
     protected:
         void highlightBlock(const QString &text);
-        void stamp( QString& text, int start, int len, const QTextCharFormat& f );
     private:
         enum { Idle, InComment, InLiteral };
-        struct HighlightingRule
+        struct Sem
         {
-            QRegExp pattern;
-            QTextCharFormat format;
-            QByteArray name;
+            quint16 d_col; // zero-based
+            quint16 d_len;
+            quint8 d_kind; // Module::SpanKind
+            Sem(quint16 col = 0, quint16 len = 0, quint8 kind = 0):d_col(col),d_len(len),d_kind(kind){}
+            bool operator==( const Sem& rhs ) const
+                { return d_col == rhs.d_col && d_len == rhs.d_len && d_kind == rhs.d_kind; }
         };
-        QVector<HighlightingRule> d_rules;
+        typedef QVector<Sem> Sems;
+        QHash<int,Sems> d_sems; // block number -> spans ordered by column
 
         QTextCharFormat d_commentFormat;
         QTextCharFormat d_literalFormat;
+        QTextCharFormat d_keywordFormat;
+        QTextCharFormat d_numberFormat;
+        QTextCharFormat d_identFormat;
+        QTextCharFormat d_otherFormat;
+        QTextCharFormat d_semFormat[Module::BuiltInSpan+1];
    };
 }
 
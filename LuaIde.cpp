@@ -23,9 +23,12 @@
 #include "LjasFileCache.h"
 #include "LjasErrors.h"
 #include <LjTools/Engine2.h>
+#include <LjTools/LuaJitComposer.h>
 #include <LjTools/Terminal2.h>
 #include <LjTools/BcViewer2.h>
+#include <LjTools/BcSearchView.h>
 #include <LjTools/BcViewer.h>
+#include <LjTools/LocalsView.h>
 #include <LjTools/LuaJitEngine.h>
 #include <lua.hpp>
 #include <QtDebug>
@@ -39,12 +42,14 @@
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QFile>
 #include <QBuffer>
 #include <QHeaderView>
 #include <QLabel>
 #include <QVBoxLayout>
 #include <QDesktopWidget>
 #include <QInputDialog>
+#include <limits.h>
 #include <GuiTools/AutoMenu.h>
 #include <GuiTools/CodeEditor.h>
 #include <GuiTools/AutoShortcut.h>
@@ -168,6 +173,102 @@ public:
         updateExtraSelections();
     }
 
+    ESL d_heat;
+
+    void markHeat( const Engine2* e )
+    {
+        d_heat.clear();
+        if( e == 0 )
+        {
+            updateExtraSelections();
+            return;
+        }
+        const QByteArray source = "@" + getPath().toUtf8();
+        const QList<Engine2::TraceProto>& protos = e->getTraceProtos();
+        QSet<quint32> mine;
+        for( int i = 0; i < protos.size(); i++ )
+        {
+            if( protos[i].d_source == source )
+                mine.insert(i);
+        }
+
+        QMap<quint32,quint32> counts; // row -> samples
+        quint32 max = 0;
+        foreach( const Engine2::ExecSite& s, e->getExecProfile() )
+        {
+            if( !mine.contains(s.d_proto) || s.d_line == 0 )
+                continue;
+            quint32& n = counts[ JitComposer::isRowCol() ? JitComposer::unpackRow(s.d_line) : s.d_line ];
+            n += s.d_count;
+            max = qMax( max, n );
+        }
+        QMap<quint32,quint32>::const_iterator i;
+        for( i = counts.begin(); i != counts.end(); ++i )
+        {
+            QTextEdit::ExtraSelection sel;
+            sel.format.setBackground( BcViewer2::heatColor( i.value(), max ) );
+            sel.format.setProperty( QTextFormat::FullWidthSelection, true );
+            sel.format.setToolTip( tr("%1 samples").arg(i.value()) );
+            sel.cursor = QTextCursor( document()->findBlockByNumber( i.key() - 1 ) );
+            d_heat << sel;
+        }
+
+        // loops which failed to compile and where the trace was aborted
+        QMap<quint32,QStringList> notes;
+        QSet<quint32> black;
+        foreach( const Engine2::TraceSite& s, e->getTraceStarts() )
+        {
+            if( mine.contains(s.d_proto) && ( s.d_reasons.size() > 1 || !s.d_reasons.contains("completed") ) )
+                notes[s.d_line] << traceNote( tr("trace start"), s );
+        }
+        foreach( const Engine2::TraceSite& s, e->getTraceAborts() )
+        {
+            if( mine.contains(s.d_proto) )
+                notes[s.d_line] << traceNote( tr("trace abort"), s );
+        }
+        foreach( const Engine2::TraceSite& s, e->getBlacklisted() )
+        {
+            if( mine.contains(s.d_proto) )
+            {
+                notes[s.d_line] << traceNote( tr("blacklisted"), s );
+                black.insert(s.d_line);
+            }
+        }
+        QMap<quint32,QStringList>::const_iterator j;
+        for( j = notes.begin(); j != notes.end(); ++j )
+        {
+            if( j.key() == 0 )
+                continue;
+            QTextCursor c;
+            if( JitComposer::isRowCol() )
+            {
+                c = QTextCursor( document()->findBlockByNumber( JitComposer::unpackRow(j.key()) - 1 ) );
+                c.setPosition( c.position() + qMax( int(JitComposer::unpackCol(j.key())) - 1, 0 ) );
+                c.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
+            }else
+            {
+                c = QTextCursor( document()->findBlockByNumber( j.key() - 1 ) );
+                c.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+            }
+            QTextEdit::ExtraSelection sel;
+            sel.format.setUnderlineStyle(QTextCharFormat::WaveUnderline);
+            sel.format.setUnderlineColor( black.contains(j.key()) ? Qt::red : QColor(255,140,0) );
+            sel.format.setToolTip( j.value().join("\n") );
+            sel.cursor = c;
+            d_heat << sel;
+        }
+        updateExtraSelections();
+    }
+
+    static QString traceNote( const QString& what, const Engine2::TraceSite& s )
+    {
+        QStringList reasons;
+        QMap<QByteArray,quint32>::const_iterator i;
+        for( i = s.d_reasons.begin(); i != s.d_reasons.end(); ++i )
+            reasons << QString("%1 (%2)").arg(QString::fromUtf8(i.key())).arg(i.value());
+        return QString("%1 %2x: %3").arg(what).arg(s.d_count).arg(reasons.join(", "));
+    }
+
     void updateExtraSelections()
     {
         ESL sum;
@@ -179,6 +280,8 @@ public:
         line.cursor.clearSelection();
         sum << line;
 
+        sum << d_heat;
+
         sum << d_nonTerms;
 
         if( !d_pro->getErrs()->getErrors().isEmpty() )
@@ -313,8 +416,11 @@ public:
     void handleBreak( Engine2* lua, const QByteArray& source, quint32 line )
     {
         d_ide->enableDbgMenu();
-        d_ide->fillStack();
-        d_ide->fillLocals();
+        const int level = d_ide->fillStack( lua->getStackTrace() );
+        if( level >= 0 )
+            lua->setActiveLevel(level);
+        d_ide->d_locals->setLocals( lua->getLazyLocals() );
+        d_ide->d_watches->setLocals( lua->evalWatches( d_ide->d_watchExprs ) );
 
         QByteArray msg = lua->getValueString(1).simplified();
         msg = msg.mid(1,msg.size()-2); // remove ""
@@ -332,7 +438,7 @@ public:
         d_ide->removePosMarkers();
         d_ide->enableDbgMenu();
         d_ide->d_stack->clear();
-        d_ide->d_locals->clear();
+        // d_locals is kept so the next stop can be diffed against it
     }
     void handleAliveSignal(Engine2* e)
     {
@@ -370,7 +476,8 @@ static void messageHander(QtMsgType type, const QMessageLogContext& ctx, const Q
 }
 
 LuaIde::LuaIde(Engine2* lua, QWidget *parent)
-    : QMainWindow(parent),d_lock(false),d_filesDirty(false),d_pushBackLock(false)
+    : QMainWindow(parent),d_lock(false),d_filesDirty(false),d_pushBackLock(false),d_runner(0),
+      d_threaded(false),d_threadErrors(false),d_showHeat(false)
 {
     s_this = this;
 
@@ -468,6 +575,7 @@ LuaIde::LuaIde(Engine2* lua, QWidget *parent)
     createXref();
     createStack();
     createLocals();
+    createWatches();
     createMenu();
 
     setCentralWidget(d_tab);
@@ -498,6 +606,8 @@ LuaIde::~LuaIde()
 {
     d_lua->setDbgShell(0);
     delete d_dbg;
+    if( d_runner )
+        delete d_runner;
 }
 
 void LuaIde::loadFile(const QString& path)
@@ -529,7 +639,7 @@ void LuaIde::setSpecialInterpreter(bool on)
 
 void LuaIde::closeEvent(QCloseEvent* event)
 {
-    if( d_lua->isExecuting() )
+    if( isExecuting() )
     {
         QMessageBox::warning(this,tr("Closing Main Window"), tr("Cannot quit IDE when Lua is running") );
         event->setAccepted(false);
@@ -574,6 +684,13 @@ void LuaIde::createDumpView()
     //pop->addCommand( "Export binary...", this, SLOT(onExportBc()) );
     //pop->addCommand( "Export LjAsm...", this, SLOT(onExportAsm()) );
     addTopCommands(pop);
+
+    dock = new QDockWidget( tr("Bytecode Search"), this );
+    dock->setObjectName("BytecodeSearch");
+    dock->setAllowedAreas( Qt::AllDockWidgetAreas );
+    dock->setFeatures( QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable );
+    dock->setWidget( new BcSearchView(d_bcv, dock) );
+    addDockWidget( Qt::RightDockWidgetArea, dock );
 }
 
 void LuaIde::createMods()
@@ -664,16 +781,25 @@ void LuaIde::createLocals()
     dock->setObjectName("Locals");
     dock->setAllowedAreas( Qt::AllDockWidgetAreas );
     dock->setFeatures( QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable );
-    d_locals = new QTreeWidget(dock);
-    d_locals->setHeaderHidden(true);
-    d_locals->setAlternatingRowColors(true);
-    d_locals->setColumnCount(2); // Name, Value
-    d_locals->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
-    d_locals->header()->setSectionResizeMode(1, QHeaderView::Stretch);
+    d_locals = new LocalsView(d_lua,dock);
     dock->setWidget(d_locals);
     addDockWidget( Qt::LeftDockWidgetArea, dock );
 }
 
+void LuaIde::createWatches()
+{
+    QDockWidget* dock = new QDockWidget( tr("Watches"), this );
+    dock->setObjectName("Watches");
+    dock->setAllowedAreas( Qt::AllDockWidgetAreas );
+    dock->setFeatures( QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable );
+    d_watches = new LocalsView(d_lua,dock);
+    dock->setWidget(d_watches);
+    addDockWidget( Qt::LeftDockWidgetArea, dock );
+    Gui::AutoMenu* pop = new Gui::AutoMenu( d_watches, true );
+    pop->addCommand( "Add Watch...", this, SLOT(onAddWatch()) );
+    pop->addCommand( "Remove Watch", this, SLOT(onRemoveWatch()) );
+}
+
 void LuaIde::createMenu()
 {
     Gui::AutoMenu* pop = new Gui::AutoMenu( d_mods, true );
@@ -763,7 +889,18 @@ void LuaIde::createMenuBar()
 
     pop = new Gui::AutoMenu( tr("Debug"), this );
     pop->addCommand( "Enable Debugging", this, SLOT(onEnableDebug()),tr(OBN_ENDBG_SC), false );
+    pop->addCommand( "Run on Worker Thread", this, SLOT(onThreaded()) );
     pop->addCommand( "Toggle Breakpoint", this, SLOT(onToggleBreakPt()), tr(OBN_TOGBP_SC), false);
+    pop->addCommand( "Breakpoint Condition...", this, SLOT(onBreakCondition()) );
+    pop->addCommand( "Add Watch...", this, SLOT(onAddWatch()) );
+    pop->addSeparator();
+    pop->addCommand( "Collect JIT Traces", this, SLOT(onCollectTraces()) );
+    pop->addCommand( "Show JIT Trace Report", this, SLOT(onTraceReport()) );
+    pop->addCommand( "Export JIT Traces...", this, SLOT(onExportTraces()) );
+    pop->addCommand( "Profile Execution", this, SLOT(onExecProfile()) );
+    pop->addCommand( "Show Heatmap", this, SLOT(onShowHeat()) );
+    pop->addCommand( "Reset Profile and Traces", this, SLOT(onResetHeat()) );
+    pop->addSeparator();
     pop->addAction( d_dbgStepIn );
     pop->addAction( d_dbgStepOver );
     pop->addAction( d_dbgStepOut );
@@ -800,13 +937,34 @@ void LuaIde::onCompile()
 
 void LuaIde::onRun()
 {
-    ENABLED_IF( !d_pro->getFiles().isEmpty() && !d_lua->isExecuting() && !d_filesDirty );
+    ENABLED_IF( !d_pro->getFiles().isEmpty() && !isExecuting() && !d_filesDirty );
 
     if( !compile(true) )
         return;
 
     QDir::setCurrent(d_pro->getWorkingDir(true));
 
+    if( d_threaded )
+    {
+        // same sequence as below, but only queued; the results arrive in onThreadJobDone/onThreadIdle
+        d_threadErrors = false;
+        foreach( const QString& path, d_pro->getFileOrder() )
+        {
+            if( path.startsWith(":/") )
+                continue;
+            const QString module = QFileInfo(path).baseName();
+            d_runner->executeCmd( QString("package.loaded[\"%1\"]=nil").arg(module).toUtf8(), "terminal" );
+            d_runner->executeFile(path.toUtf8());
+            if( d_pro->useRequire() )
+                d_runner->executeCmd( QString("%1 = require '%2'").arg(module).arg(module).toUtf8(), "terminal", true );
+        }
+        const QString main = d_pro->formatMain();
+        if( !main.isEmpty() )
+            d_runner->executeCmd( QString("%1()").arg(main).toUtf8(), "terminal", true );
+        enableDbgMenu();
+        return;
+    }
+
 
     bool hasErrors = false;
     foreach( const QString& path, d_pro->getFileOrder() )
@@ -860,13 +1018,17 @@ void LuaIde::onRun()
     if( !src.isEmpty() )
         d_lua->executeCmd(src,"terminal");
     removePosMarkers();
-
+    if( d_showHeat )
+        updateHeat();
 }
 
 void LuaIde::onAbort()
 {
     // ENABLED_IF( d_lua->isWaiting() );
-    d_lua->terminate();
+    if( d_threaded )
+        d_runner->terminate();
+    else
+        d_lua->terminate();
 }
 
 void LuaIde::onGenerate()
@@ -1024,8 +1186,14 @@ void LuaIde::onStackDblClicked(QTreeWidgetItem* item, int)
             showEditor( source, line, 1 );
         }
         const int level = item->data(0,Qt::UserRole).toInt();
-        d_lua->setActiveLevel(level);
-        fillLocals();
+        if( d_threaded )
+            d_runner->setActiveLevel(level); // locals arrive with onThreadLevel
+        else
+        {
+            d_lua->setActiveLevel(level);
+            d_locals->setLocals( d_lua->getLazyLocals() );
+            d_watches->setLocals( d_lua->evalWatches( d_watchExprs ) );
+        }
     }
 }
 
@@ -1036,7 +1204,7 @@ void LuaIde::onTabChanged()
     onEditorChanged();
 
     d_bcv->clear();
-    if( !path.isEmpty() )
+    if( !path.isEmpty() && !( d_threaded && d_runner->isBusy() ) ) // the state belongs to the worker then
     {
         const QString to = QDir::temp().absoluteFilePath("temp.bc");
         QFile in(path);
@@ -1050,6 +1218,8 @@ void LuaIde::onTabChanged()
             }
         }
     }
+    if( d_showHeat && !isExecuting() )
+        updateHeat();
 }
 
 void LuaIde::onTabClosing(int i)
@@ -1158,14 +1328,89 @@ void LuaIde::onRemoveFile()
 
 void LuaIde::onEnableDebug()
 {
-    CHECKED_IF( true, d_lua->isDebug() );
+    CHECKED_IF( true, isDebug() );
 
-    d_lua->setDebug( !d_lua->isDebug() );
+    if( d_threaded )
+        d_runner->setDebug( !d_runner->isDebug() );
+    else
+        d_lua->setDebug( !d_lua->isDebug() );
     enableDbgMenu();
 }
 
+void LuaIde::onCollectTraces()
+{
+    CHECKED_IF( !isExecuting(), d_lua->isTraceCollecting() );
+
+    d_lua->setTraceCollecting( !d_lua->isTraceCollecting() );
+}
+
+void LuaIde::onTraceReport()
+{
+    ENABLED_IF( !isExecuting() && !d_lua->getTraceProtos().isEmpty() );
+
+    foreach( const QByteArray& line, d_lua->getTraceReport().split('\n') )
+        logMessage( QString::fromUtf8(line) );
+}
+
+void LuaIde::onExportTraces()
+{
+    ENABLED_IF( !isExecuting() && !d_lua->getTraceProtos().isEmpty() );
+
+    const QString path = QFileDialog::getSaveFileName( this, tr("Export JIT Traces"), QString(),
+                                                       tr("CSV Files (*.csv)") );
+    if( path.isEmpty() )
+        return;
+    QFile out(path);
+    if( !out.open(QIODevice::WriteOnly) || !d_lua->exportTraceEvents(&out) )
+        QMessageBox::critical( this, tr("Export JIT Traces"), tr("Cannot write to file %1").arg(path) );
+}
+
+void LuaIde::onExecProfile()
+{
+    CHECKED_IF( !isExecuting(), d_lua->isExecProfiling() );
+
+    d_lua->setExecProfiling( !d_lua->isExecProfiling() );
+}
+
+void LuaIde::onShowHeat()
+{
+    CHECKED_IF( !isExecuting(), d_showHeat );
+
+    d_showHeat = !d_showHeat;
+    updateHeat();
+}
+
+void LuaIde::onResetHeat()
+{
+    ENABLED_IF( !isExecuting() );
+
+    d_lua->resetExecProfile();
+    d_lua->resetTraces();
+    updateHeat();
+}
+
+void LuaIde::updateHeat()
+{
+    for( int i = 0; i < d_tab->count(); i++ )
+    {
+        Editor* e = static_cast<Editor*>( d_tab->widget(i) );
+        Q_ASSERT( e );
+        e->markHeat( d_showHeat ? d_lua : 0 );
+    }
+    const QString path = d_tab->getCurrentDoc().toString();
+    if( d_showHeat && !path.isEmpty() )
+        d_bcv->setHeat( d_lua, "@" + path.toUtf8() );
+    else
+        d_bcv->clearHeat();
+}
+
 void LuaIde::onBreak()
 {
+    if( d_threaded )
+    {
+        d_runner->runToNextLine(); // switches on debugging if necessary
+        return;
+    }
     if( !d_lua->isDebug() )
         d_lua->setDebug(true);
     // normal call because called during processEvent which doesn't seem to enable
@@ -1226,6 +1471,13 @@ bool LuaIde::compile(bool generate )
             d_pro->getFc()->removeFile( e->getPath() );
     }
     d_pro->recompile();
+    for( int i = 0; i < d_tab->count(); i++ )
+    {
+        Editor* e = static_cast<Editor*>( d_tab->widget(i) );
+        Module* m = d_pro->getFiles().value(e->getPath());
+        if( m && m->getTopChunk() )
+            e->d_hl->setSpans( m->getSpans() );
+    }
     onErrors();
     fillMods();
     onTabChanged();
@@ -1331,8 +1583,12 @@ void LuaIde::showEditor(const QString& path, int row, int col, bool setMarker ,
         connect(edit,SIGNAL(sigUpdateLocation(int,int)),this,SLOT(onUpdateLocation(int,int)));
 
         edit->loadFromFile(path);
+        Module* m = d_pro->getFiles().value(path);
+        if( m && m->getTopChunk() )
+            edit->d_hl->setSpans( m->getSpans() );
 
-        const Engine2::Breaks& br = d_lua->getBreaks( path.toUtf8() );
+        const Engine2::Breaks br = d_threaded ? d_runner->getBreaks( path.toUtf8() ) :
+                                                d_lua->getBreaks( path.toUtf8() );
         Engine2::Breaks::const_iterator j;
         for( j = br.begin(); j != br.end(); ++j )
             edit->addBreakPoint((*j) - 1);
@@ -1391,7 +1647,10 @@ void LuaIde::addDebugMenu(Gui::AutoMenu* pop)
     Gui::AutoMenu* sub = new Gui::AutoMenu(tr("Debugger"), this, false );
     pop->addMenu(sub);
     sub->addCommand( "Enable Debugging", this, SLOT(onEnableDebug()),tr(OBN_ENDBG_SC), false );
+    sub->addCommand( "Run on Worker Thread", this, SLOT(onThreaded()) );
     sub->addCommand( "Toggle Breakpoint", this, SLOT(onToggleBreakPt()), tr(OBN_TOGBP_SC), false);
+    sub->addCommand( "Breakpoint Condition...", this, SLOT(onBreakCondition()) );
+    sub->addCommand( "Add Watch...", this, SLOT(onAddWatch()) );
     sub->addAction( d_dbgStepIn );
     sub->addAction( d_dbgStepOver );
     sub->addAction( d_dbgStepOut );
@@ -1472,17 +1731,18 @@ void LuaIde::fillXref()
             refSym = static_cast<Module::SymbolUse*>(refSym)->d_sym;
         Editor::ExList l1, l2;
         l1.append(refSym);
-        l2.append(refSym);
-        foreach( const Module::Ref<Module::SymbolUse>& e, refSym->d_uses )
+        if( Module* m = d_pro->getFiles().value(edit->getPath()) )
         {
-            l2 << e.data();
-            if( e->d_tok.d_sourcePath == edit->getPath() )
-                l1 << e.data();
+            foreach( Module::SymbolUse* e, m->getUses(refSym) )
+                l1 << e;
         }
 
         edit->markNonTerms(l1);
 
-        std::sort( l2.begin(), l2.end(), sortExList );
+        // the uses come ordered from the module indices, only the declaration has to be placed
+        foreach( Module::SymbolUse* e, d_pro->getUses(refSym) )
+            l2 << e;
+        l2.insert( std::lower_bound( l2.begin(), l2.end(), ThingRef(refSym), sortExList ), refSym );
 
         QFont f = d_xref->font();
         f.setBold(true);
@@ -1541,12 +1801,11 @@ void LuaIde::fillXref()
     }
 }
 
-void LuaIde::fillStack()
+int LuaIde::fillStack(const Engine2::StackLevels& ls)
 {
     d_stack->clear();
-    Engine2::StackLevels ls = d_lua->getStackTrace();
 
-    bool opened = false;
+    int opened = -1;
     for( int level = 0; level < ls.size(); level++ )
     {
         const Engine2::StackLevel& l = ls[level];
@@ -1566,184 +1825,59 @@ void LuaIde::fillStack()
             item->setText(3, QFileInfo(path).baseName() );
             item->setData(3, Qt::UserRole, path );
             item->setToolTip(3, path );
-            if( !opened )
+            if( opened < 0 )
             {
                 showEditor(path, l.d_line, 1, true );
-                d_lua->setActiveLevel(level);
-                opened = true;
+                opened = level;
             }
         }
     }
 
     d_stack->parentWidget()->show();
+    return opened;
 }
 
-static void typeAddr( QTreeWidgetItem* item, const QVariant& val )
-{
-    if( val.canConvert<Lua::Engine2::VarAddress>() )
-    {
-        Lua::Engine2::VarAddress addr = val.value<Lua::Engine2::VarAddress>();
-        if( addr.d_addr )
-        {
-            QString str = QString("address 0x%1").arg(quintptr(addr.d_addr),8,16,QChar('0'));
-            if( addr.d_meta )
-                str += QString(" metatable 0x%1").arg(quintptr(addr.d_meta),8,16,QChar('0'));
-            item->setToolTip(1, str);
-        }
-        switch( addr.d_type )
-        {
-        case Engine2::LocalVar::NIL:
-            item->setText(1, "nil");
-            break;
-        case Engine2::LocalVar::FUNC:
-            item->setText(1, "func");
-            break;
-        case Engine2::LocalVar::TABLE:
-            item->setText(1, "table");
-            break;
-        case Engine2::LocalVar::STRUCT:
-            item->setText(1, "struct");
-            break;
-        case Engine2::LocalVar::CDATA:
-            item->setText(1, "cdata");
-            break;
-        case Engine2::LocalVar::UNKNOWN:
-            item->setText(1, "<unknown>");
-            break;
-        }
-    }else if( val.type() == QMetaType::QVariantMap)
-    {
-        QVariantMap map = val.toMap();
-        typeAddr( item, map.value(QString()) );
-    }
-}
-
-static void setLocalText( QTreeWidgetItem* local, const QVariant& val )
+void LuaIde::removePosMarkers()
 {
-    local->setText(1, val.toString() );
-    switch( val.type() )
+    for( int i = 0; i < d_tab->count(); i++ )
     {
-    case QVariant::Double:
-        {
-            const double d = val.toDouble();
-            const int i = d;
-            if( d - double(i) == 0.0 )
-                local->setToolTip(1, QString("%1 0x%2").arg(i).arg(i,0,16));
-            else
-                local->setToolTip(1,QString::number(d, 'f', 8 ));
-        }
-        break;
-    case QVariant::Int:
-    case QVariant::UInt:
-    case QVariant::LongLong:
-    case QVariant::ULongLong:
-        local->setToolTip(1, QString("%1 0x%2").arg(val.toString()).arg(val.toLongLong(),0,16));
-        break;
+        Editor* e = static_cast<Editor*>( d_tab->widget(i) );
+        e->setPositionMarker(-1);
     }
 }
 
-static void fillLocalSubs( QTreeWidgetItem* super, const QVariantMap& vals )
+void LuaIde::enableDbgMenu()
 {
-    QVariantMap::const_iterator i;
-    for( i = vals.begin(); i != vals.end(); i++ )
-    {
-        if( i.key().isEmpty() )
-            continue;
-        QTreeWidgetItem* item = new QTreeWidgetItem(super);
-        item->setText(0, i.key() );
-
-        if( i.value().canConvert<Lua::Engine2::VarAddress>() )
-        {
-            typeAddr(item,i.value());
-        }else if( i.value().type() == QMetaType::QVariantMap)
-        {
-            typeAddr(item,i.value());
-            fillLocalSubs(item,i.value().toMap() );
-        }else if( i.value().type() == QMetaType::QByteArray )
-        {
-            item->setText(1, "\"" + i.value().toString().simplified() + "\"");
-            item->setToolTip(1, i.value().toString());
-        }else
-            setLocalText(item,i.value());
-    }
+    d_dbgBreak->setEnabled(isExecuting());
+    d_dbgAbort->setEnabled(isExecuting());
+    d_dbgContinue->setEnabled(isWaiting());
+    d_dbgStepIn->setEnabled(isWaiting() && isDebug() );
+    d_dbgStepOver->setEnabled(isWaiting() && isDebug() );
+    d_dbgStepOut->setEnabled(isWaiting() && isDebug() );
 }
 
-void LuaIde::fillLocals()
+bool LuaIde::isExecuting() const
 {
-    d_locals->clear();
-    Engine2::LocalVars vs = d_lua->getLocalVars(true,4,50); // TODO: adjustable
-    foreach( const Engine2::LocalVar& v, vs )
-    {
-        QTreeWidgetItem* item = new QTreeWidgetItem(d_locals);
-        QString name = v.d_name;
-        if( v.d_isUv )
-            name = name + "'";
-        item->setText(0,name);
-        if( v.d_value.canConvert<Lua::Engine2::VarAddress>() )
-        {
-            typeAddr(item,v.d_value);
-        }else if( v.d_value.type() == QMetaType::QVariantMap )
-        {
-            typeAddr(item,v.d_value);
-            fillLocalSubs(item,v.d_value.toMap() );
-        }else if( JitBytecode::isString(v.d_value) )
-        {
-            if( v.d_type == Engine2::LocalVar::CDATA || v.d_type == Engine2::LocalVar::UNKNOWN )
-                item->setText(1, v.d_value.toString().simplified());
-            else
-                item->setText(1, "\"" + v.d_value.toString().simplified() + "\"");
-            item->setToolTip(1, v.d_value.toString() );
-        }else if( !v.d_value.isNull() )
-            setLocalText(item,v.d_value);
-        else
-        {
-            switch( v.d_type )
-            {
-            case Engine2::LocalVar::NIL:
-                item->setText(1, "nil");
-                break;
-            case Engine2::LocalVar::FUNC:
-                item->setText(1, "func");
-                break;
-            case Engine2::LocalVar::TABLE:
-                item->setText(1, "table");
-                break;
-            case Engine2::LocalVar::STRUCT:
-                item->setText(1, "struct");
-                break;
-            case Engine2::LocalVar::CDATA:
-                item->setText(1, "cdata");
-                break;
-            case Engine2::LocalVar::UNKNOWN:
-                item->setText(1, "<unknown>");
-                break;
-            case Engine2::LocalVar::STRING:
-                item->setText(1, "\"" + v.d_value.toString().simplified() + "\"");
-                break;
-            default:
-                break;
-           }
-        }
-    }
+    if( d_threaded )
+        return d_runner->isBusy();
+    else
+        return d_lua->isExecuting();
 }
 
-void LuaIde::removePosMarkers()
+bool LuaIde::isWaiting() const
 {
-    for( int i = 0; i < d_tab->count(); i++ )
-    {
-        Editor* e = static_cast<Editor*>( d_tab->widget(i) );
-        e->setPositionMarker(-1);
-    }
+    if( d_threaded )
+        return d_runner->isWaiting();
+    else
+        return d_lua->isWaiting();
 }
 
-void LuaIde::enableDbgMenu()
+bool LuaIde::isDebug() const
 {
-    d_dbgBreak->setEnabled(d_lua->isExecuting());
-    d_dbgAbort->setEnabled(d_lua->isExecuting());
-    d_dbgContinue->setEnabled(d_lua->isWaiting());
-    d_dbgStepIn->setEnabled(d_lua->isWaiting() && d_lua->isDebug() );
-    d_dbgStepOver->setEnabled(d_lua->isWaiting() && d_lua->isDebug() );
-    d_dbgStepOut->setEnabled(d_lua->isWaiting() && d_lua->isDebug() );
+    if( d_threaded )
+        return d_runner->isDebug();
+    else
+        return d_lua->isDebug();
 }
 
 void LuaIde::handleGoBack()
@@ -1791,39 +1925,213 @@ void LuaIde::onToggleBreakPt()
 
     quint32 line;
     const bool on = edit->toggleBreakPoint(&line);
-    if( on )
+    if( d_threaded )
+    {
+        if( on )
+            d_runner->addBreak( edit->getPath().toUtf8(), line + 1 );
+        else
+            d_runner->removeBreak( edit->getPath().toUtf8(), line + 1 );
+    }else if( on )
         d_lua->addBreak( edit->getPath().toUtf8(), line + 1 );
     else
         d_lua->removeBreak( edit->getPath().toUtf8(), line + 1 );
 }
 
+void LuaIde::onBreakCondition()
+{
+    Editor* edit = static_cast<Editor*>( d_tab->getCurrentTab() );
+    ENABLED_IF( edit );
+
+    int line, col;
+    edit->getCursorPosition( &line, &col );
+    const QByteArray path = edit->getPath().toUtf8();
+    const Engine2::BreakCond cond = d_threaded ? d_runner->getBreakCondition( path, line + 1 ) :
+                                                 d_lua->getBreakCondition( path, line + 1 );
+
+    bool ok;
+    const QString expr = QInputDialog::getText( this, tr("Breakpoint Condition"),
+                                                tr("Stop if this expression is true (empty: always):"),
+                                                QLineEdit::Normal, QString::fromUtf8(cond.d_expr), &ok );
+    if( !ok )
+        return;
+    const int hitCount = QInputDialog::getInt( this, tr("Breakpoint Condition"),
+                                               tr("Stop from this hit on (0: each hit):"),
+                                               cond.d_hitCount, 0, INT_MAX, 1, &ok );
+    if( !ok )
+        return;
+
+    const bool hasBreak = d_threaded ? d_runner->getBreaks( path ).contains( line + 1 ) :
+                                       d_lua->getBreaks( path ).contains( line + 1 );
+    if( !hasBreak )
+    {
+        edit->setCursorPosition( line, col );
+        onToggleBreakPt();
+    }
+    if( d_threaded )
+        d_runner->setBreakCondition( path, line + 1, expr.toUtf8(), hitCount );
+    else
+        d_lua->setBreakCondition( path, line + 1, expr.toUtf8(), hitCount );
+}
+
+void LuaIde::onAddWatch()
+{
+    ENABLED_IF( true );
+
+    const QString expr = QInputDialog::getText( this, tr("Add Watch"), tr("Lua expression:") ).trimmed();
+    if( expr.isEmpty() || d_watchExprs.contains( expr.toUtf8() ) )
+        return;
+    d_watchExprs.append( expr.toUtf8() );
+    fillWatches();
+}
+
+void LuaIde::onRemoveWatch()
+{
+    QTreeWidgetItem* item = d_watches->currentItem();
+    while( item && item->parent() )
+        item = item->parent();
+    ENABLED_IF( item );
+
+    d_watchExprs.removeAll( item->text(0).toUtf8() );
+    fillWatches();
+}
+
+void LuaIde::fillWatches()
+{
+    if( d_runner )
+        d_runner->setWatches( d_watchExprs );
+    if( isWaiting() )
+        d_watches->setLocals( d_lua->evalWatches( d_watchExprs ) );
+    else
+    {
+        Engine2::LazyVars vs;
+        foreach( const QByteArray& expr, d_watchExprs )
+        {
+            Engine2::LazyVar v;
+            v.d_name = expr;
+            v.d_type = Engine2::LocalVar::UNKNOWN;
+            v.d_value = QByteArray();
+            vs << v;
+        }
+        d_watches->setLocals( vs );
+    }
+}
+
 void LuaIde::onStepInto()
 {
     // ENABLED_IF( d_lua->isWaiting() );
 
-    d_lua->runToNextLine();
+    if( d_threaded )
+        d_runner->runToNextLine();
+    else
+        d_lua->runToNextLine();
 }
 
 void LuaIde::onStepOver()
 {
-    d_lua->runToNextLine(Engine2::StepOver);
+    if( d_threaded )
+        d_runner->runToNextLine(Engine2::StepOver);
+    else
+        d_lua->runToNextLine(Engine2::StepOver);
 }
 
 void LuaIde::onStepOut()
 {
-    d_lua->runToNextLine(Engine2::StepOut);
+    if( d_threaded )
+        d_runner->runToNextLine(Engine2::StepOut);
+    else
+        d_lua->runToNextLine(Engine2::StepOut);
 }
 
 void LuaIde::onContinue()
 {
     // ENABLED_IF( d_lua->isWaiting() );
 
-    d_lua->runToBreakPoint();
+    if( d_threaded )
+        d_runner->runToBreakPoint();
+    else
+        d_lua->runToBreakPoint();
+}
+
+void LuaIde::onThreaded()
+{
+    CHECKED_IF( !isExecuting(), d_threaded );
+
+    d_threaded = !d_threaded;
+    if( d_threaded )
+    {
+        if( d_runner == 0 )
+        {
+            d_runner = new Engine2Thread(d_lua);
+            connect( d_runner, SIGNAL(sigBreak(Lua::Engine2Thread::Snapshot)),
+                     this, SLOT(onThreadBreak(Lua::Engine2Thread::Snapshot)) );
+            connect( d_runner, SIGNAL(sigLevel(Lua::Engine2Thread::Snapshot)),
+                     this, SLOT(onThreadLevel(Lua::Engine2Thread::Snapshot)) );
+            connect( d_runner, SIGNAL(sigContinued()), this, SLOT(onThreadContinued()) );
+            connect( d_runner, SIGNAL(sigJobDone(bool,QByteArray)), this, SLOT(onThreadJobDone(bool,QByteArray)) );
+            connect( d_runner, SIGNAL(sigIdle()), this, SLOT(onThreadIdle()) );
+        }else
+            d_runner->syncState(); // the engine was used directly meanwhile
+        d_lua->setDbgShell(d_runner);
+        d_runner->setWatches(d_watchExprs);
+        d_locals->setRunner(d_runner);
+        d_watches->setRunner(d_runner);
+        d_term->setRunner(d_runner);
+    }else
+    {
+        d_lua->setDbgShell(d_dbg);
+        d_locals->setRunner(0);
+        d_watches->setRunner(0);
+        d_term->setRunner(0);
+    }
+    enableDbgMenu();
+}
+
+void LuaIde::onThreadBreak(const Engine2Thread::Snapshot& s)
+{
+    enableDbgMenu();
+    fillStack( s.d_stack );
+    d_locals->setLocals( s.d_locals );
+    d_watches->setLocals( s.d_watches );
+    if( !s.d_breakHit )
+    {
+        if( luaRuntimeMessage(s.d_value,s.d_source) )
+            onErrors();
+    }
+}
+
+void LuaIde::onThreadLevel(const Engine2Thread::Snapshot& s)
+{
+    d_locals->setLocals( s.d_locals );
+    d_watches->setLocals( s.d_watches );
+}
+
+void LuaIde::onThreadContinued()
+{
+    removePosMarkers();
+    enableDbgMenu();
+    d_stack->clear();
+}
+
+void LuaIde::onThreadJobDone(bool ok, const QByteArray& error)
+{
+    if( !ok )
+        d_threadErrors = true;
+}
+
+void LuaIde::onThreadIdle()
+{
+    removePosMarkers();
+    enableDbgMenu();
+    if( d_threadErrors )
+        onErrors();
+    d_threadErrors = false;
+    if( d_showHeat )
+        updateHeat();
 }
 
 void LuaIde::onShowLlBc()
 {
-    ENABLED_IF( d_bcv->topLevelItemCount() );
+    ENABLED_IF( !d_bcv->isEmpty() );
 
     BcViewer* bc = new BcViewer();
     QBuffer buf; // TODO
@@ -1854,9 +2162,13 @@ void LuaIde::onLuaNotify(int messageType, QByteArray val1, int val2)
     case Engine2::LineHit:
     case Engine2::BreakHit:
     case Engine2::ErrorHit:
+        enableDbgMenu();
+        break;
     case Engine2::Finished:
     case Engine2::Aborted:
         enableDbgMenu();
+        d_locals->clear();
+        fillWatches();
         break;
     }
 }
@@ -1922,7 +2234,7 @@ void LuaIde::onSetMain()
 
 void LuaIde::onQuit()
 {
-    ENABLED_IF(!d_lua->isExecuting());
+    ENABLED_IF(!isExecuting());
 
     qApp->quit();
 }
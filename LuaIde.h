@@ -22,6 +22,7 @@
 
 #include <QMainWindow>
 #include <LjTools/LuaModule.h>
+#include <LjTools/Engine2Thread.h>
 
 class QTreeWidget;
 class QTreeWidgetItem;
@@ -40,6 +41,7 @@ namespace Lua
     class JitEngine;
     class Highlighter;
     class Project;
+    class LocalsView;
     /*
     namespace Ast
     {
@@ -72,6 +74,7 @@ namespace Lua
         void createXref();
         void createStack();
         void createLocals();
+        void createWatches();
         void createMenu();
         void createMenuBar();
         void closeEvent(QCloseEvent* event);
@@ -85,10 +88,14 @@ namespace Lua
         void addDebugMenu(Gui::AutoMenu * pop);
         bool luaRuntimeMessage(const QByteArray&, const QString& file);
         void fillXref();
-        void fillStack();
-        void fillLocals();
+        int fillStack(const Engine2::StackLevels&);
+        void fillWatches();
+        bool isExecuting() const;
+        bool isWaiting() const;
+        bool isDebug() const;
         void removePosMarkers();
         void enableDbgMenu();
+        void updateHeat();
         struct Location
         {
             // Qt-Koordinaten
@@ -134,6 +141,9 @@ namespace Lua
         void onUpdateLocation(int line, int col );
         void onXrefDblClicked();
         void onToggleBreakPt();
+        void onBreakCondition();
+        void onAddWatch();
+        void onRemoveWatch();
         void onStepInto();
         void onStepOver();
         void onStepOut();
@@ -145,6 +155,18 @@ namespace Lua
         void onQt();
         void onSetMain();
         void onQuit();
+        void onThreaded();
+        void onThreadBreak(const Lua::Engine2Thread::Snapshot&);
+        void onThreadLevel(const Lua::Engine2Thread::Snapshot&);
+        void onThreadContinued();
+        void onThreadJobDone(bool ok, const QByteArray& error);
+        void onThreadIdle();
+        void onCollectTraces();
+        void onTraceReport();
+        void onExportTraces();
+        void onExecProfile();
+        void onShowHeat();
+        void onResetHeat();
     private:
         class DocTab;
         class Debugger;
@@ -152,11 +174,14 @@ namespace Lua
         DocTab* d_tab;
         Debugger* d_dbg;
         Lua::Engine2* d_lua;
+        Lua::Engine2Thread* d_runner;
         Lua::BcViewer2* d_bcv;
         Lua::Terminal2* d_term;
         QTreeWidget* d_mods;
         QTreeWidget* d_stack;
-        QTreeWidget* d_locals;
+        LocalsView* d_locals;
+        LocalsView* d_watches;
+        QByteArrayList d_watchExprs;
         QLabel* d_xrefTitle;
         QTreeWidget* d_xref;
         QTreeWidget* d_errs;
@@ -172,6 +197,9 @@ namespace Lua
         bool d_lock;
         bool d_filesDirty;
         bool d_pushBackLock;
+        bool d_threaded;
+        bool d_threadErrors;
+        bool d_showHeat;
     };
 }
 
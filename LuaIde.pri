@@ -24,13 +24,20 @@ SOURCES += \
     ../GuiTools/CodeEditor.cpp \
     ../LjTools/LuaJitBytecode.cpp \
     ../LjTools/Engine2.cpp \
+    ../LjTools/Engine2Thread.cpp \
+    ../LjTools/LocalsView.cpp \
     ../LjTools/Terminal2.cpp \
     ../LjTools/ExpressionParser.cpp \
     ../LjTools/LuaJitEngine.cpp \
     ../LjTools/LuaJitComposer.cpp \
+    ../LjTools/LuaJitFlowGraph.cpp \
+    ../LjTools/LuaJitVerifier.cpp \
     ../LjTools/LuaHighlighter.cpp \
     ../LjTools/LjDisasm.cpp \
     ../LjTools/BcViewer2.cpp \
+    ../LjTools/BcSearchView.cpp \
+    ../LjTools/LuaJitIndex.cpp \
+    ../LjTools/LuaJitDiff.cpp \
     ../GuiTools/DocSelector.cpp \
     ../GuiTools/DocTabWidget.cpp \
     ../LjTools/BcViewer.cpp \ 
@@ -41,13 +48,20 @@ HEADERS  += \
     ../GuiTools/CodeEditor.h \
     ../LjTools/LuaJitBytecode.h \
     ../LjTools/Engine2.h \
+    ../LjTools/Engine2Thread.h \
+    ../LjTools/LocalsView.h \
     ../LjTools/Terminal2.h \
     ../LjTools/ExpressionParser.h \
     ../LjTools/LuaJitEngine.h \
     ../LjTools/LuaJitComposer.h \
+    ../LjTools/LuaJitFlowGraph.h \
+    ../LjTools/LuaJitVerifier.h \
     ../LjTools/LuaHighlighter.h \
     ../LjTools/LjDisasm.h \
     ../LjTools/BcViewer2.h \
+    ../LjTools/BcSearchView.h \
+    ../LjTools/LuaJitIndex.h \
+    ../LjTools/LuaJitDiff.h \
     ../GuiTools/DocSelector.h \
     ../GuiTools/DocTabWidget.h \
     ../LjTools/BcViewer.h \
@@ -662,6 +662,7 @@ bool JitBytecode::parseFunction(QIODevice* in )
     const quint32 sizebc = bcread_uleb128(in);
 
     const quint32 sizedbg = (d_flags & BCDUMP_F_STRIP) ? 0: bcread_uleb128(in);
+    f.d_sizedbg = sizedbg;
     f.d_firstline = sizedbg ? bcread_uleb128(in) : 0;
     f.d_numline = sizedbg ? bcread_uleb128(in) : 0;
 
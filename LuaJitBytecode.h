@@ -59,6 +59,7 @@ namespace Lua
             bool d_isRoot;
             quint32 d_firstline; // may be packed or unpacked
             quint32 d_numline; // always the diff of last - first + 1, even if packed!
+            quint32 d_sizedbg; // bytes of debug info in the dump, 0 if stripped
             CodeList d_byteCodes;
             UpvalList d_upvals;
             VariantList d_constObjs;
@@ -75,7 +76,7 @@ namespace Lua
             mutable QByteArrayList d_varNames; // fill by calcVarNames
             Function* d_outer;
 
-            Function():d_isRoot(false),d_outer(0){}
+            Function():d_isRoot(false),d_sizedbg(0),d_outer(0){}
 
             const Var* findVar( int pc, int slot, int* idx = 0 ) const;
             QByteArray getVarName( int pc, int slot, int* idx = 0 ) const;
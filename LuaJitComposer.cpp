@@ -21,12 +21,16 @@
 #include <QtDebug>
 #include <QFile>
 #include <QBitArray>
+#include <QtNumeric>
+#include <math.h>
+#include <queue>
 using namespace Lua;
 
 quint32 JitComposer::colBitLen = 12;
 quint32 JitComposer::rowColBitLen = 31;
 
-JitComposer::JitComposer(QObject *parent) : QObject(parent),d_hasDebugInfo(false),d_stripped(false),d_useRowColFormat(true)
+JitComposer::JitComposer(QObject *parent) : QObject(parent),d_hasDebugInfo(false),d_stripped(false),d_useRowColFormat(true),
+    d_optimize(false),d_verify(true)
 {
 
 }
@@ -34,10 +38,12 @@ JitComposer::JitComposer(QObject *parent) : QObject(parent),d_hasDebugInfo(false
 void JitComposer::clear()
 {
     d_bc.clear();
+    d_issues.clear();
     d_hasDebugInfo = false;
 }
 
-int JitComposer::openFunction(quint8 parCount, const QByteArray& sourceRef, quint32 firstLine, quint32 lastLine)
+int JitComposer::openFunction(quint8 parCount, const QByteArray& sourceRef, quint32 firstLine, quint32 lastLine,
+                              bool varargs)
 {
     if( d_bc.d_funcs.isEmpty() )
         d_bc.d_name = sourceRef;
@@ -81,6 +87,7 @@ int JitComposer::openFunction(quint8 parCount, const QByteArray& sourceRef, quin
         f->d_numline = 1;
     }
     f->d_numparams = parCount;
+    f->d_flags = varargs ? JitBytecode::Function::FuVarargs : 0;
     const int slot = getConstSlot(QVariant::fromValue(f));
     d_bc.d_fstack.push_back( f );
     d_bc.d_funcs.append(f);
@@ -93,7 +100,8 @@ static inline bool isRET( quint8 op )
             op == JitBytecode::OP_RET ||
             op == JitBytecode::OP_RET0 ||
             op == JitBytecode::OP_RET1 ||
-            op == JitBytecode::OP_CALLT;
+            op == JitBytecode::OP_CALLT ||
+            op == JitBytecode::OP_CALLMT;
 }
 
 bool JitComposer::closeFunction(quint8 frameSize)
@@ -102,6 +110,9 @@ bool JitComposer::closeFunction(quint8 frameSize)
     Func* f = static_cast<Func*>(d_bc.d_fstack.back().data());
     f->d_framesize = frameSize;
 
+    if( d_optimize )
+        optimize(f); // before the constants are frozen, folding might add some
+
     QHash<QVariant,int>::const_iterator n;
     f->d_constNums.resize(f->d_numConst.size());
     for( n = f->d_numConst.begin(); n != f->d_numConst.end(); ++n )
@@ -119,6 +130,401 @@ bool JitComposer::closeFunction(quint8 frameSize)
     return hasReturn;
 }
 
+int JitComposer::addFunction(const JitComposer& other, const QList<UpvalList>& upvals)
+{
+    if( !other.d_bc.d_fstack.isEmpty() )
+        return -1;
+    return addFunction( other.d_bc.d_funcs, upvals );
+}
+
+int JitComposer::addFunction(const QList<JitBytecode::FuncRef>& funcs, const QList<UpvalList>& upvals)
+{
+    if( d_bc.d_fstack.isEmpty() || funcs.isEmpty() )
+        return -1;
+    for( int i = 0; i < upvals.size() && i < funcs.size(); i++ )
+        addUpvals( funcs[i].data(), upvals[i] );
+    d_bc.d_funcs.append( funcs );
+    return getConstSlot(QVariant::fromValue(funcs.first()));
+}
+
+QList<JitBytecode::FuncRef> JitComposer::copyFunctions(const QList<JitBytecode::FuncRef>& funcs, int lineDelta)
+{
+    QList<JitBytecode::FuncRef> res;
+    QHash<const JitBytecode::Function*,JitBytecode::FuncRef> map;
+    foreach( const JitBytecode::FuncRef& f, funcs )
+    {
+        JitBytecode::FuncRef c( new JitBytecode::Function( *f.constData() ) );
+        if( c->d_firstline != 0 )
+            c->d_firstline += lineDelta;
+        for( int i = 0; i < c->d_lines.size(); i++ )
+        {
+            if( c->d_lines[i] != 0 )
+                c->d_lines[i] += lineDelta;
+        }
+        map[f.constData()] = c;
+        res << c;
+    }
+    foreach( const JitBytecode::FuncRef& c, res )
+    {
+        // children refer to the copies as well; the children may follow their parent in the list
+        for( int i = 0; i < c->d_constObjs.size(); i++ )
+        {
+            if( c->d_constObjs[i].canConvert<JitBytecode::FuncRef>() )
+            {
+                const JitBytecode::Function* child = c->d_constObjs[i].value<JitBytecode::FuncRef>().constData();
+                if( map.contains(child) )
+                    c->d_constObjs[i] = QVariant::fromValue(map.value(child));
+            }
+        }
+    }
+    return res;
+}
+
+static inline quint8 bcOp( quint32 bc ) { return bc & 0xff; }
+static inline quint8 bcA( quint32 bc ) { return ( bc >> 8 ) & 0xff; }
+static inline quint8 bcB( quint32 bc ) { return bc >> 24; }
+static inline quint8 bcC( quint32 bc ) { return ( bc >> 16 ) & 0xff; }
+static inline quint16 bcD( quint32 bc ) { return bc >> 16; }
+static inline quint32 makeAd( quint8 op, quint8 a, quint16 d ) { return op | ( a << 8 ) | ( d << 16 ); }
+
+static inline bool isJump( quint8 op )
+{
+    return JitBytecode::typeCdFromOp(op) == JitBytecode::Instruction::_jump;
+}
+
+static inline bool isTest( quint8 op )
+{
+    // the next instruction is a JMP which is only executed if the test succeeds
+    return op <= JitBytecode::OP_ISF;
+}
+
+static inline int jumpTarget( const JitBytecode::CodeList& code, int pc )
+{
+    return pc + 1 + int(bcD(code[pc])) - JitBytecode::Instruction::JumpBias;
+}
+
+static inline bool isPureWrite( quint8 op )
+{
+    // writes slot A, no side effects, can't call metamethods; FNEW is missing because it captures slots
+    switch( op )
+    {
+    case JitBytecode::OP_MOV:
+    case JitBytecode::OP_NOT:
+    case JitBytecode::OP_KSTR:
+    case JitBytecode::OP_KCDATA:
+    case JitBytecode::OP_KSHORT:
+    case JitBytecode::OP_KNUM:
+    case JitBytecode::OP_KPRI:
+    case JitBytecode::OP_UGET:
+    case JitBytecode::OP_TNEW:
+    case JitBytecode::OP_TDUP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline bool readsSlot( quint32 bc, quint8 slot )
+{
+    // only valid for isPureWrite and KNIL
+    switch( bcOp(bc) )
+    {
+    case JitBytecode::OP_MOV:
+    case JitBytecode::OP_NOT:
+        return bcD(bc) == slot;
+    default:
+        return false;
+    }
+}
+
+static inline bool writesSlot( quint32 bc, quint8 slot )
+{
+    // only valid for isPureWrite and KNIL
+    if( bcOp(bc) == JitBytecode::OP_KNIL )
+        return slot >= bcA(bc) && slot <= bcD(bc);
+    return bcA(bc) == slot;
+}
+
+static QBitArray findLeaders( const JitBytecode::CodeList& code )
+{
+    QBitArray res( code.size() + 1 );
+    res.setBit(0);
+    for( int pc = 0; pc < code.size(); pc++ )
+    {
+        const quint8 op = bcOp(code[pc]);
+        if( isJump(op) )
+        {
+            const int t = jumpTarget(code,pc);
+            if( t >= 0 && t <= code.size() )
+                res.setBit(t);
+            res.setBit(pc+1);
+        }else if( isRET(op) )
+            res.setBit(pc+1);
+    }
+    return res;
+}
+
+void JitComposer::optimize(Func* f)
+{
+    JitBytecode::CodeList& code = f->d_byteCodes;
+    const bool hasLines = f->d_lines.size() == code.size();
+    bool changed = true;
+    int round = 0;
+    while( changed && round++ < 8 )
+    {
+        changed = false;
+        const QBitArray leaders = findLeaders(code);
+        QBitArray removed( code.size() );
+
+        // jump threading: a JMP to a JMP goes directly to the final target
+        for( int pc = 0; pc < code.size(); pc++ )
+        {
+            if( bcOp(code[pc]) != JitBytecode::OP_JMP )
+                continue;
+            int t = jumpTarget(code,pc);
+            int steps = 0;
+            while( t >= 0 && t < code.size() && t != pc && bcOp(code[t]) == JitBytecode::OP_JMP &&
+                   steps++ < code.size() )
+                t = jumpTarget(code,t);
+            if( t != jumpTarget(code,pc) && t >= 0 && t <= code.size() && t != pc )
+            {
+                code[pc] = makeAd( JitBytecode::OP_JMP, bcA(code[pc]),
+                                   quint16( t - pc - 1 + JitBytecode::Instruction::JumpBias ) );
+                changed = true;
+            }
+        }
+
+        if( foldConstants(f, leaders) )
+            changed = true;
+
+        for( int pc = 0; pc < code.size(); pc++ )
+        {
+            const quint32 bc = code[pc];
+            const quint8 op = bcOp(bc);
+            if( op == JitBytecode::OP_JMP )
+            {
+                // unconditional jump to the next instruction
+                if( jumpTarget(code,pc) == pc + 1 && ( pc == 0 || !isTest(bcOp(code[pc-1])) ) )
+                    removed.setBit(pc);
+                continue;
+            }
+            if( op == JitBytecode::OP_MOV )
+            {
+                if( bcA(bc) == bcD(bc) )
+                {
+                    removed.setBit(pc);
+                    continue;
+                }
+                // MOV t x; MOV y t -> MOV t x; MOV y x, and MOV a b; MOV b a -> MOV a b
+                const int next = pc + 1;
+                if( next < code.size() && !leaders.testBit(next) && bcOp(code[next]) == JitBytecode::OP_MOV &&
+                        bcD(code[next]) == bcA(bc) )
+                {
+                    if( bcA(code[next]) == bcD(bc) )
+                        removed.setBit(next);
+                    else
+                        code[next] = makeAd( JitBytecode::OP_MOV, bcA(code[next]), bcD(bc) );
+                    changed = true;
+                }
+            }
+            if( !isPureWrite(op) || removed.testBit(pc) )
+                continue;
+            // dead store: the slot is overwritten in the same block before it is read
+            const quint8 slot = bcA(bc);
+            for( int i = pc + 1; i < code.size() && !leaders.testBit(i); i++ )
+            {
+                if( removed.testBit(i) )
+                    continue;
+                const quint32 bc2 = code[i];
+                if( !isPureWrite(bcOp(bc2)) && bcOp(bc2) != JitBytecode::OP_KNIL )
+                    break;
+                if( readsSlot(bc2,slot) )
+                    break;
+                if( writesSlot(bc2,slot) )
+                {
+                    removed.setBit(pc);
+                    break;
+                }
+            }
+        }
+        if( removed.count(true) == 0 )
+            continue;
+        changed = true;
+
+        // compact the code and adjust jumps, lines and variable ranges
+        const int oldLen = code.size();
+        QVector<int> newPc( oldLen + 1 );
+        int n = 0;
+        for( int pc = 0; pc < oldLen; pc++ )
+        {
+            newPc[pc] = n;
+            if( !removed.testBit(pc) )
+                n++;
+        }
+        newPc[oldLen] = n;
+        JitBytecode::CodeList res;
+        QVector<quint32> lines;
+        res.reserve(n);
+        for( int pc = 0; pc < oldLen; pc++ )
+        {
+            if( removed.testBit(pc) )
+                continue;
+            quint32 bc = code[pc];
+            if( isJump(bcOp(bc)) )
+            {
+                int t = jumpTarget(code,pc);
+                t = ( t >= 0 && t <= oldLen ) ? newPc[t] : t;
+                bc = ( bc & 0x0000ffff ) | ( quint16( t - newPc[pc] - 1 + JitBytecode::Instruction::JumpBias ) << 16 );
+            }
+            res.append(bc);
+            if( hasLines )
+                lines.append(f->d_lines[pc]);
+        }
+        code = res;
+        if( hasLines )
+            f->d_lines = lines;
+        for( int i = 0; i < f->d_vars.size(); i++ )
+        {
+            JitBytecode::Function::Var& v = f->d_vars[i];
+            v.d_startpc = v.d_startpc <= quint32(oldLen) ? newPc[v.d_startpc] : v.d_startpc - ( oldLen - n );
+            v.d_endpc = v.d_endpc <= quint32(oldLen) ? newPc[v.d_endpc] : v.d_endpc - ( oldLen - n );
+        }
+    }
+}
+
+static bool foldArith( quint8 op, double lhs, double rhs, double& res )
+{
+    switch( op )
+    {
+    case JitBytecode::OP_ADDVN:
+    case JitBytecode::OP_ADDNV:
+    case JitBytecode::OP_ADDVV:
+        res = lhs + rhs;
+        break;
+    case JitBytecode::OP_SUBVN:
+    case JitBytecode::OP_SUBNV:
+    case JitBytecode::OP_SUBVV:
+        res = lhs - rhs;
+        break;
+    case JitBytecode::OP_MULVN:
+    case JitBytecode::OP_MULNV:
+    case JitBytecode::OP_MULVV:
+        res = lhs * rhs;
+        break;
+    case JitBytecode::OP_DIVVN:
+    case JitBytecode::OP_DIVNV:
+    case JitBytecode::OP_DIVVV:
+        if( rhs == 0.0 )
+            return false;
+        res = lhs / rhs;
+        break;
+    case JitBytecode::OP_MODVN:
+    case JitBytecode::OP_MODNV:
+    case JitBytecode::OP_MODVV:
+        if( rhs == 0.0 )
+            return false;
+        res = lhs - ::floor( lhs / rhs ) * rhs; // as in Lua
+        break;
+    default:
+        return false;
+    }
+    return qIsFinite(res);
+}
+
+bool JitComposer::foldConstants(Func* f, const QBitArray& leaders)
+{
+    // Slots with a known number are tracked from a leader on as long as only pure instructions
+    // follow; everything else might run a metamethod which changes captured slots.
+    JitBytecode::CodeList& code = f->d_byteCodes;
+    QVector<double> nums( f->d_numConst.size() );
+    QHash<QVariant,int>::const_iterator n;
+    for( n = f->d_numConst.begin(); n != f->d_numConst.end(); ++n )
+        nums[n.value()] = n.key().toDouble();
+
+    bool changed = false;
+    QHash<quint8,double> known;
+    for( int pc = 0; pc < code.size(); pc++ )
+    {
+        if( leaders.testBit(pc) )
+            known.clear();
+        const quint32 bc = code[pc];
+        const quint8 op = bcOp(bc);
+        const quint8 a = bcA(bc);
+        switch( op )
+        {
+        case JitBytecode::OP_KSHORT:
+            known[a] = qint16(bcD(bc));
+            continue;
+        case JitBytecode::OP_KNUM:
+            known[a] = nums.value(bcD(bc));
+            continue;
+        case JitBytecode::OP_MOV:
+            if( known.contains(bcD(bc)) )
+                known[a] = known.value(bcD(bc));
+            else
+                known.remove(a);
+            continue;
+        case JitBytecode::OP_KNIL:
+            for( int i = a; i <= bcD(bc); i++ )
+                known.remove(i);
+            continue;
+        default:
+            break;
+        }
+        if( isPureWrite(op) )
+        {
+            known.remove(a);
+            continue;
+        }
+        bool ok = false;
+        double lhs = 0, rhs = 0;
+        if( op >= JitBytecode::OP_ADDVN && op <= JitBytecode::OP_MODVN )
+        {
+            ok = known.contains(bcB(bc)) && bcC(bc) < nums.size();
+            lhs = known.value(bcB(bc));
+            rhs = nums.value(bcC(bc));
+        }else if( op >= JitBytecode::OP_ADDNV && op <= JitBytecode::OP_MODNV )
+        {
+            ok = known.contains(bcB(bc)) && bcC(bc) < nums.size();
+            lhs = nums.value(bcC(bc));
+            rhs = known.value(bcB(bc));
+        }else if( op >= JitBytecode::OP_ADDVV && op <= JitBytecode::OP_MODVV )
+        {
+            ok = known.contains(bcB(bc)) && known.contains(bcC(bc));
+            lhs = known.value(bcB(bc));
+            rhs = known.value(bcC(bc));
+        }else
+        {
+            known.clear();
+            continue;
+        }
+        double res;
+        if( !ok || !foldArith(op, lhs, rhs, res) )
+        {
+            known.clear();
+            continue;
+        }
+        if( res == ::floor(res) && res >= SHRT_MIN && res <= SHRT_MAX && !( res == 0.0 && 1.0 / res < 0.0 ) ) // keep -0
+            code[pc] = makeAd( JitBytecode::OP_KSHORT, a, quint16(qint16(res)) );
+        else
+        {
+            Q_ASSERT( d_bc.d_fstack.back().data() == f );
+            const int slot = getConstSlot(res);
+            if( slot > 0xffff )
+            {
+                known.clear();
+                continue;
+            }
+            if( slot >= nums.size() )
+                nums.append(res);
+            code[pc] = makeAd( JitBytecode::OP_KNUM, a, slot );
+        }
+        known[a] = res;
+        changed = true;
+    }
+    return changed;
+}
+
 bool JitComposer::addOpImp(JitBytecode::Op op, quint8 a, quint8 b, quint16 cd, quint32 line)
 {
     if( d_bc.d_fstack.isEmpty() )
@@ -330,6 +736,27 @@ bool JitComposer::FORL(SlotNr base, Jump offset, quint32 line)
     return addAd(JitBytecode::OP_FORL, base, quint16( offset + JitBytecode::Instruction::JumpBias ), line );
 }
 
+bool JitComposer::ITERC(SlotNr base, quint8 numOfVars, quint32 line)
+{
+    // A points to the loop variables; C is always 3 (generator called with state and control)
+    return addAbc(JitBytecode::OP_ITERC, base + 3, numOfVars + 1, 3, line );
+}
+
+bool JitComposer::ITERN(SlotNr base, quint8 numOfVars, quint32 line)
+{
+    return addAbc(JitBytecode::OP_ITERN, base + 3, numOfVars + 1, 3, line );
+}
+
+bool JitComposer::ITERL(SlotNr base, Jump offset, quint32 line)
+{
+    return addAd(JitBytecode::OP_ITERL, base + 3, quint16( offset + JitBytecode::Instruction::JumpBias ), line );
+}
+
+bool JitComposer::ISNEXT(SlotNr base, Jump offset, quint32 line)
+{
+    return addAd(JitBytecode::OP_ISNEXT, base + 3, quint16( offset + JitBytecode::Instruction::JumpBias ), line );
+}
+
 bool JitComposer::MOD(SlotNr dst, const QVariant& lhs, SlotNr rhs, quint32 line)
 {
     if( JitBytecode::isNumber(lhs) )
@@ -363,6 +790,17 @@ bool JitComposer::CALLT(SlotNr slot, quint8 numOfArgs, quint32 line)
     return addAd(JitBytecode::OP_CALLT, slot, numOfArgs + 1, line );
 }
 
+bool JitComposer::CALLM(SlotNr slot, quint8 numOfReturns, quint8 numOfFixedArgs, quint32 line)
+{
+    // Operand C is the number of fixed arguments, not one plus as with CALL.
+    return addAbc(JitBytecode::OP_CALLM, slot, numOfReturns + 1, numOfFixedArgs, line );
+}
+
+bool JitComposer::CALLMT(SlotNr slot, quint8 numOfFixedArgs, quint32 line)
+{
+    return addAd(JitBytecode::OP_CALLMT, slot, numOfFixedArgs, line );
+}
+
 bool JitComposer::CAT(SlotNr dst, SlotNr from, SlotNr to, quint32 line)
 {
     return addAbc(JitBytecode::OP_CAT, dst, from, to, line );
@@ -432,6 +870,11 @@ bool JitComposer::RET(quint32 line)
     return addAd(JitBytecode::OP_RET0, 0, 1, line );
 }
 
+bool JitComposer::RETM(SlotNr slot, quint8 numOfFixed, quint32 line)
+{
+    return addAd(JitBytecode::OP_RETM, slot, numOfFixed, line );
+}
+
 bool JitComposer::TNEW(SlotNr slot, quint16 arrSize, quint8 hashSize, quint32 line)
 {
     return addAd(JitBytecode::OP_TNEW, slot, arrSize + ( hashSize << 11 ), line );
@@ -453,6 +896,11 @@ bool JitComposer::TSET(JitComposer::SlotNr value, JitComposer::SlotNr table, con
     return addAbc(JitBytecode::OP_TSETS, value, table, slot, line );
 }
 
+bool JitComposer::TSETM(JitComposer::SlotNr table, quint32 index, quint32 line)
+{
+    return addAd(JitBytecode::OP_TSETM, table + 1, getConstSlot(toTsetmConst(index)), line );
+}
+
 bool JitComposer::UCLO(SlotNr slot, Jump offset, quint32 line)
 {
     return addAd(JitBytecode::OP_UCLO, slot, quint16(offset+JitBytecode::Instruction::JumpBias), line );
@@ -485,6 +933,17 @@ bool JitComposer::UNM(SlotNr lhs, SlotNr rhs, quint32 line)
     return addAd(JitBytecode::OP_UNM, lhs, rhs, line );
 }
 
+bool JitComposer::VARG(SlotNr slot, quint8 numOfParams, int len, quint32 line)
+{
+    // Operand B is one plus the number of values or zero for MULTRES; C is the number of fixed params
+    if( d_bc.d_fstack.isEmpty() || ( d_bc.d_fstack.back()->d_flags & JitBytecode::Function::FuVarargs ) == 0 )
+    {
+        qWarning() << "JitComposer::VARG: function is not vararg";
+        return false;
+    }
+    return addAbc(JitBytecode::OP_VARG, slot, len < 0 ? 0 : len + 1, numOfParams, line );
+}
+
 bool JitComposer::GGET(SlotNr to, const QByteArray& name, quint32 line)
 {
     return addAd(JitBytecode::OP_GGET, to, getConstSlot(name), line );
@@ -587,7 +1046,11 @@ void JitComposer::setUpvals(const JitComposer::UpvalList& l)
 {
     if( d_bc.d_fstack.isEmpty() )
         return;
-    Func* f = static_cast<Func*>( d_bc.d_fstack.back().data() );
+    addUpvals( static_cast<Func*>( d_bc.d_fstack.back().data() ), l );
+}
+
+void JitComposer::addUpvals(JitBytecode::Function* f, const JitComposer::UpvalList& l)
+{
     foreach( const Upval& uv, l )
     {
         quint16 tmp = uv.d_uv;
@@ -663,6 +1126,8 @@ bool JitComposer::write(QIODevice* out, const QString& path)
     if( d_bc.d_fstack.isEmpty() )
         d_bc.d_fstack.push_back( d_bc.d_funcs.first() );
     d_bc.setStripped( d_stripped || !d_hasDebugInfo );
+    if( !verify() )
+        return false;
     return d_bc.write(out,path);
 }
 
@@ -673,9 +1138,28 @@ bool JitComposer::write(const QString& file)
     if( d_bc.d_fstack.isEmpty() )
         d_bc.d_fstack.push_back( d_bc.d_funcs.first() );
     d_bc.setStripped( d_stripped || !d_hasDebugInfo );
+    if( !verify() )
+        return false;
     return d_bc.write(file);
 }
 
+bool JitComposer::verify()
+{
+    d_issues.clear();
+#ifndef LJTOOLS_NO_VERIFIER
+    if( !d_verify )
+        return true;
+    JitVerifier v;
+    const bool ok = v.verify(d_bc);
+    d_issues = v.getIssues();
+    foreach( const JitVerifier::Issue& i, d_issues )
+        qCritical() << "JitComposer::write:" << d_bc.d_name << i.toString();
+    return ok;
+#else
+    return true;
+#endif
+}
+
 void JitComposer::setStripped(bool on)
 {
     d_stripped = on;
@@ -816,30 +1300,27 @@ bool JitComposer::allocateWithLinearScan(SlotPool& pool, JitComposer::Intervals&
 {
     // according to Poletto & Sarkar (1999): Linear scan register allocation, ACM TOPLAS, Volume 21 Issue 5
 
-    std::sort( vars.begin(), vars.end(), sortIntervals );
+    std::stable_sort( vars.begin(), vars.end(), sortIntervals );
 
-    typedef QMultiMap<quint32,quint32> Active; // to -> Interval
-    Active active;
+    typedef std::pair<quint32,int> End; // to -> Interval
+    std::vector<End> heap;
+    heap.reserve( qMin( vars.size(), int(MAX_SLOTS) ) );
+    std::priority_queue<End, std::vector<End>, std::greater<End> > active( std::greater<End>(), heap );
 
     for( int i = 0; i < vars.size(); i++ )
     {
-        Active::iterator j = active.begin();
-        while( j != active.end() )
+        // ExpireOldIntervals(i)
+        while( !active.empty() && vars[active.top().second].d_to < vars[i].d_from )
         {
-            // ExpireOldIntervals(i)
-            if( vars[j.value()].d_to >= vars[i].d_from )
-            {
-                break;
-            }
-            pool.d_slots.set(vars[j.value()].d_slot,false); // why not releaseSlot?
-            fill(pool,false, vars[j.value()].d_slot, vars[j.value()].d_slot + len );
-            j = active.erase(j);
+            const quint8 slot = vars[active.top().second].d_slot;
+            fill(pool,false, slot, slot + len );
+            active.pop();
         }
         const int slot = nextFreeSlot(pool,len);
         if( active.size() >= MAX_SLOTS || slot < 0 )
             return false;
         vars[i].d_slot = slot;
-        active.insert(vars[i].d_to, i);
+        active.push( End(vars[i].d_to, i) );
     }
     return true;
 }
@@ -22,6 +22,7 @@
 
 #include <QObject>
 #include <LjTools/LuaJitBytecode.h>
+#include <LjTools/LuaJitVerifier.h>
 #include <bitset>
 
 namespace Lua
@@ -55,9 +56,9 @@ namespace Lua
             quint32 d_to;
             void* d_payload;
             quint8 d_slot;
-            Interval(quint32 from, quint32 to, void* pl):d_from(from),d_to(to),d_payload(pl),d_slot(0){}
+            Interval(quint32 from = 0, quint32 to = 0, void* pl = 0):d_from(from),d_to(to),d_payload(pl),d_slot(0){}
         };
-        typedef QList<Interval> Intervals;
+        typedef QVector<Interval> Intervals; // formerly a QList of heap allocated nodes; now stored in one block
         struct SlotPool
         {
             std::bitset<MAX_SLOTS> d_slots;
@@ -73,8 +74,16 @@ namespace Lua
 
         void clear();
 
-        int openFunction(quint8 parCount, const QByteArray& sourceRef, quint32 firstLine = 0, quint32 lastLine = 0 );
+        int openFunction(quint8 parCount, const QByteArray& sourceRef, quint32 firstLine = 0, quint32 lastLine = 0,
+                         bool varargs = false );
         bool closeFunction(quint8 frameSize);
+        // Adds the functions composed by another JitComposer as a child of the open function; upvals are
+        // applied to the functions of other in the order they were opened. Returns the slot as openFunction.
+        int addFunction(const JitComposer& other, const QList<UpvalList>& upvals = QList<UpvalList>() );
+        int addFunction(const QList<JitBytecode::FuncRef>& funcs, const QList<UpvalList>& upvals = QList<UpvalList>() );
+        const QList<JitBytecode::FuncRef>& getFuncs() const { return d_bc.getFuncs(); }
+        // deep copy of a list of functions as returned by getFuncs; lineDelta is added to all line numbers
+        static QList<JitBytecode::FuncRef> copyFunctions(const QList<JitBytecode::FuncRef>&, int lineDelta = 0 );
 
         bool addAbc( JitBytecode::Op, quint8 a, quint8 b, int c, quint32 line = 0 );
         bool addAd(JitBytecode::Op, quint8 a, int d, quint32 line = 0 );
@@ -88,6 +97,9 @@ namespace Lua
         bool ADD(SlotNr dst, SlotNr lhs, SlotNr rhs, quint32 line = 0 );
         bool CALL(SlotNr slot, quint8 numOfReturns = 0, quint8 numOfArgs = 0, quint32 line = 0 );
         bool CALLT(SlotNr slot, quint8 numOfArgs = 0, quint32 line = 0 );
+        // the M variants take MULTRES values after the fixed args/values, set by a preceding VARG
+        bool CALLM(SlotNr slot, quint8 numOfReturns = 0, quint8 numOfFixedArgs = 0, quint32 line = 0 );
+        bool CALLMT(SlotNr slot, quint8 numOfFixedArgs = 0, quint32 line = 0 );
         bool CAT(SlotNr dst, SlotNr from, SlotNr to, quint32 line = 0 );
         bool DIV(SlotNr dst, const QVariant& lhs, SlotNr rhs, quint32 line = 0 );
         bool DIV(SlotNr dst, SlotNr lhs, const QVariant& rhs, quint32 line = 0 );
@@ -95,6 +107,11 @@ namespace Lua
         bool FNEW(SlotNr dst, quint16 func, quint32 line = 0 );
         bool FORI(SlotNr base, Jump offset, quint32 line = 0 );
         bool FORL(SlotNr base, Jump offset, quint32 line = 0 );
+        // base is the first of the three slots generator, state and control; the loop variables follow
+        bool ITERC(SlotNr base, quint8 numOfVars, quint32 line = 0 );
+        bool ITERN(SlotNr base, quint8 numOfVars, quint32 line = 0 );
+        bool ITERL(SlotNr base, Jump offset, quint32 line = 0 );
+        bool ISNEXT(SlotNr base, Jump offset, quint32 line = 0 );
         bool GGET(SlotNr to, const QByteArray& name, quint32 line = 0 );
         bool GSET(SlotNr value, const QByteArray& name, quint32 line = 0 );
         bool ISGE(SlotNr lhs, SlotNr rhs, quint32 line = 0 ); // lhs >= rhs
@@ -125,6 +142,7 @@ namespace Lua
         bool POW(SlotNr dst, SlotNr lhs, SlotNr rhs, quint32 line = 0 );
         bool RET(SlotNr slot, quint8 len, quint32 line = 0 );
         bool RET(quint32 line = 0 );
+        bool RETM(SlotNr slot, quint8 numOfFixed = 0, quint32 line = 0 );
         bool SUB(SlotNr dst, const QVariant& lhs, SlotNr rhs, quint32 line = 0 );
         bool SUB(SlotNr dst, SlotNr lhs, const QVariant& rhs, quint32 line = 0 );
         bool SUB(SlotNr dst, SlotNr lhs, SlotNr rhs, quint32 line = 0 );
@@ -136,11 +154,13 @@ namespace Lua
         bool TSET(SlotNr value, SlotNr table, quint8 index, quint32 line = 0 ); // index is a slot
         bool TSETi(SlotNr value, SlotNr table, quint8 index, quint32 line = 0 ); // index is a number
         bool TSET(SlotNr value, SlotNr table, const QByteArray&  index, quint32 line = 0 );
+        bool TSETM(SlotNr table, quint32 index, quint32 line = 0 ); // table[index], ... = MULTRES from table + 1
         bool UCLO(SlotNr slot, Jump offset, quint32 line = 0 ); // see note**
         bool UGET(SlotNr toSlot, UvNr fromUv, quint32 line = 0 );
         bool USET(UvNr toUv, SlotNr rhs, quint32 line = 0 );
         bool USET(UvNr toUv, const QVariant& rhs, quint32 line = 0 );
         bool UNM(SlotNr lhs, SlotNr rhs, quint32 line = 0 );
+        bool VARG(SlotNr slot, quint8 numOfParams, int len = -1, quint32 line = 0 ); // len -1 is MULTRES
 
         // **NOTE: UCLO must be emitted whenever a body is left the locals of which are accessed as
         // upvalues; slot was always 0 so far where observed from the LJ compiler; bodies which access
@@ -152,11 +172,20 @@ namespace Lua
         int getLocalSlot( const QByteArray& name );
         int getConstSlot( const QVariant& );
 
+        // write runs the JitVerifier on all functions first and refuses to write invalid bytecode, unless switched
+        // off here or compiled with LJTOOLS_NO_VERIFIER, in which case LuaJitVerifier.cpp is not needed
         bool write(QIODevice* out, const QString& path = QString() );
         bool write( const QString& file );
+        void setVerify(bool on) { d_verify = on; } // default on
+        const JitVerifier::Issues& getIssues() const { return d_issues; }
         void setStripped(bool);
         void setUseRowColFormat(bool);
+        // Peephole optimization of each function at closeFunction: jump threading, redundant MOV and
+        // dead store elimination and folding of arithmetic on known constants, all within basic blocks.
+        // Lines and variable ranges are adjusted; labels returned by getCurPc must be patched before.
+        void setOptimize(bool on) { d_optimize = on; }
 
+        // O(n log n): vars are sorted by start, the active set is a min heap on the interval ends
         static bool allocateWithLinearScan(SlotPool& pool, Intervals& vars, int len = 1 );
         static int nextFreeSlot(SlotPool& pool, int len = 1 , bool callArgs = false);
         static bool releaseSlot( SlotPool& pool, quint8 slot, int len = 1 );
@@ -170,11 +199,18 @@ namespace Lua
         static quint32 colBitLen; // defaults to 12
         static quint32 rowColBitLen; // defaults to 31; with 31 we can use unmodified LuaJIT
         static bool isRowCol() { return colBitLen != 0; }
+
+        // TSETM D refers to a number constant the lower 32 bits of which are the first table index
+        static QVariant toTsetmConst( quint32 index ) { return double(1LL << 52) + double(index); }
+        static quint32 fromTsetmConst( const QVariant& v ) { return v.toDouble() - double(1LL << 52); }
     protected:
         JitBytecode d_bc;
         bool d_hasDebugInfo;
         bool d_stripped;
         bool d_useRowColFormat;
+        bool d_optimize;
+        bool d_verify;
+        JitVerifier::Issues d_issues;
 
         struct Func : public JitBytecode::Function
         {
@@ -184,6 +220,10 @@ namespace Lua
         };
 
         bool addOpImp( JitBytecode::Op, quint8 a, quint8 b, quint16 cd, quint32 line = 0 );
+        void addUpvals( JitBytecode::Function*, const UpvalList& );
+        void optimize( Func* );
+        bool foldConstants( Func*, const QBitArray& leaders );
+        bool verify();
     };
 }
 
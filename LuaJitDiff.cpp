@@ -0,0 +1,428 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LuaJitDiff.h"
+#include <QHash>
+#include <algorithm>
+using namespace Lua;
+
+static inline quint32 mix( quint32 h, quint32 v )
+{
+    return h * 31 + v;
+}
+
+static quint32 tableKey( const JitBytecode::ConstTable& t )
+{
+    quint32 h = t.d_array.size();
+    foreach( const QVariant& v, t.d_array )
+        h = mix( h, qHash(v) );
+    quint32 sum = 0; // independent of the order of the hash part
+    QHash<QVariant,QVariant>::const_iterator i;
+    for( i = t.d_hash.begin(); i != t.d_hash.end(); ++i )
+        sum += mix( qHash(i.key()), qHash(i.value()) );
+    return mix( h, sum );
+}
+
+static inline bool sameTable( const QVariant& a, const QVariant& b )
+{
+    const JitBytecode::ConstTable ta = a.value<JitBytecode::ConstTable>();
+    const JitBytecode::ConstTable tb = b.value<JitBytecode::ConstTable>();
+    return ta.d_array == tb.d_array && ta.d_hash == tb.d_hash;
+}
+
+static quint32 operandKey( const JitBytecode::Function* f, int type, int v )
+{
+    switch( type )
+    {
+    case JitBytecode::Instruction::_str:
+        if( v >= 0 && v < f->d_constObjs.size() )
+            return qHash( f->d_constObjs[ f->d_constObjs.size() - v - 1 ] );
+        return v;
+    case JitBytecode::Instruction::_num:
+        if( v >= 0 && v < f->d_constNums.size() )
+            return qHash( f->d_constNums[v].toDouble() );
+        return v;
+    case JitBytecode::Instruction::_tab:
+        if( v >= 0 && v < f->d_constObjs.size() &&
+                f->d_constObjs[ f->d_constObjs.size() - v - 1 ].canConvert<JitBytecode::ConstTable>() )
+            return mix( type, tableKey( f->d_constObjs[ f->d_constObjs.size() - v - 1 ].value<JitBytecode::ConstTable>() ) );
+        return type;
+    case JitBytecode::Instruction::_func:
+    case JitBytecode::Instruction::_cdata:
+        return type; // the referenced objects are compared separately
+    default:
+        return v;
+    }
+}
+
+quint32 JitDiff::instrKey(const JitBytecode::Function* f, int pc)
+{
+    const quint32 bc = f->d_byteCodes[pc];
+    const quint8 op = bc & 0xff;
+    if( op > JitBytecode::OP_JMP )
+        return bc;
+    quint32 h = op;
+    h = mix( h, operandKey( f, JitBytecode::typeAFromOp(op), ( bc >> 8 ) & 0xff ) );
+    if( JitBytecode::formatFromOp(op) == JitBytecode::AD )
+        h = mix( h, operandKey( f, JitBytecode::typeCdFromOp(op), bc >> 16 ) );
+    else
+    {
+        h = mix( h, operandKey( f, JitBytecode::typeBFromOp(op), bc >> 24 ) );
+        h = mix( h, operandKey( f, JitBytecode::typeCdFromOp(op), ( bc >> 16 ) & 0xff ) );
+    }
+    return h;
+}
+
+bool JitDiff::FuncDiff::isChanged() const
+{
+    return d_a < 0 || d_b < 0 || d_instrDelta != 0 || d_frameDelta != 0 || d_deleted != 0 || d_inserted != 0 ||
+            !d_constAdded.isEmpty() || !d_constRemoved.isEmpty();
+}
+
+JitDiff::JitDiff()
+{
+}
+
+void JitDiff::diff(const JitBytecode& a, const JitBytecode& b)
+{
+    clear();
+    match( a, b );
+    const QList<JitBytecode::FuncRef>& fa = a.getFuncs();
+    const QList<JitBytecode::FuncRef>& fb = b.getFuncs();
+    d_funcs.reserve( fa.size() + fb.size() );
+    for( int i = 0; i < fa.size(); i++ )
+    {
+        FuncDiff d;
+        d.d_a = i;
+        d.d_b = d_aToB[i];
+        if( d.d_b >= 0 )
+            compare( fa[i].constData(), fb[d.d_b].constData(), d );
+        else
+        {
+            d.d_instrDelta = -fa[i]->d_byteCodes.size();
+            d.d_frameDelta = -fa[i]->d_framesize;
+            d.d_deleted = fa[i]->d_byteCodes.size();
+        }
+        d_funcs.append(d);
+    }
+    for( int i = 0; i < fb.size(); i++ )
+    {
+        if( d_bToA[i] >= 0 )
+            continue;
+        FuncDiff d;
+        d.d_b = i;
+        d.d_instrDelta = fb[i]->d_byteCodes.size();
+        d.d_frameDelta = fb[i]->d_framesize;
+        d.d_inserted = fb[i]->d_byteCodes.size();
+        d_funcs.append(d);
+    }
+}
+
+int JitDiff::getChangedCount() const
+{
+    int res = 0;
+    foreach( const FuncDiff& d, d_funcs )
+    {
+        if( d.isChanged() )
+            res++;
+    }
+    return res;
+}
+
+void JitDiff::clear()
+{
+    d_funcs.clear();
+    d_aToB.clear();
+    d_bToA.clear();
+}
+
+static inline quint64 posKey( const JitBytecode::Function* f )
+{
+    return ( quint64(f->d_firstline) << 32 ) | f->d_numline;
+}
+
+static quint32 shapeKey( const JitBytecode::Function* f )
+{
+    int children = 0;
+    foreach( const QVariant& o, f->d_constObjs )
+    {
+        if( o.canConvert<JitBytecode::FuncRef>() )
+            children++;
+    }
+    quint32 h = f->d_numparams;
+    h = mix( h, f->d_flags & JitBytecode::Function::FuVarargs );
+    h = mix( h, f->d_upvals.size() );
+    h = mix( h, children );
+    return h;
+}
+
+void JitDiff::match(const JitBytecode& a, const JitBytecode& b)
+{
+    const QList<JitBytecode::FuncRef>& fa = a.getFuncs();
+    const QList<JitBytecode::FuncRef>& fb = b.getFuncs();
+    d_aToB.fill( -1, fa.size() );
+    d_bToA.fill( -1, fb.size() );
+
+    // first by source position; candidates of equal position are taken in dump order
+    if( !a.isStripped() && !b.isStripped() )
+    {
+        QHash<quint64,QList<int> > pos;
+        for( int i = fb.size() - 1; i >= 0; i-- )
+            pos[posKey(fb[i].constData())].append(i);
+        for( int i = 0; i < fa.size(); i++ )
+        {
+            QHash<quint64,QList<int> >::iterator j = pos.find( posKey(fa[i].constData()) );
+            if( j == pos.end() || j.value().isEmpty() )
+                continue;
+            const int k = j.value().takeLast();
+            d_aToB[i] = k;
+            d_bToA[k] = i;
+        }
+    }
+
+    // then the remaining ones by shape, also in dump order
+    QHash<quint32,QList<int> > shape;
+    for( int i = fb.size() - 1; i >= 0; i-- )
+    {
+        if( d_bToA[i] < 0 )
+            shape[shapeKey(fb[i].constData())].append(i);
+    }
+    for( int i = 0; i < fa.size(); i++ )
+    {
+        if( d_aToB[i] >= 0 )
+            continue;
+        QHash<quint32,QList<int> >::iterator j = shape.find( shapeKey(fa[i].constData()) );
+        if( j == shape.end() || j.value().isEmpty() )
+            continue;
+        const int k = j.value().takeLast();
+        d_aToB[i] = k;
+        d_bToA[k] = i;
+    }
+}
+
+static QString keyToString( const QVariant& v )
+{
+    if( v.isNull() )
+        return "nil";
+    if( v.type() == QVariant::Bool )
+        return v.toBool() ? "true" : "false";
+    if( JitBytecode::isString(v) )
+        return "\"" + QString::fromUtf8( v.toByteArray() ) + "\"";
+    return QString::number( v.toDouble() );
+}
+
+static QString constToString( const QVariant& v )
+{
+    if( JitBytecode::isString(v) )
+        return "\"" + QString::fromUtf8( v.toByteArray() ) + "\"";
+    if( JitBytecode::isNumber(v) )
+        return QString::number( v.toDouble() );
+    if( v.canConvert<JitBytecode::ConstTable>() )
+    {
+        const JitBytecode::ConstTable t = v.value<JitBytecode::ConstTable>();
+        QStringList items;
+        foreach( const QVariant& e, t.d_array )
+            items << keyToString(e);
+        QStringList fields;
+        QHash<QVariant,QVariant>::const_iterator i;
+        for( i = t.d_hash.begin(); i != t.d_hash.end(); ++i )
+            fields << keyToString(i.key()) + " = " + keyToString(i.value());
+        fields.sort(); // the hash order is arbitrary
+        items += fields;
+        return "{ " + items.join(" ") + " }";
+    }
+    return QString();
+}
+
+static bool sameConsts( const JitBytecode::Function* a, const JitBytecode::Function* b )
+{
+    if( a->d_constNums != b->d_constNums || a->d_constObjs.size() != b->d_constObjs.size() )
+        return false;
+    for( int i = 0; i < a->d_constObjs.size(); i++ )
+    {
+        const QVariant& x = a->d_constObjs[i];
+        const QVariant& y = b->d_constObjs[i];
+        if( x.canConvert<JitBytecode::FuncRef>() || y.canConvert<JitBytecode::FuncRef>() )
+        {
+            // child prototypes are compared on their own
+            if( !x.canConvert<JitBytecode::FuncRef>() || !y.canConvert<JitBytecode::FuncRef>() )
+                return false;
+        }else if( x.canConvert<JitBytecode::ConstTable>() || y.canConvert<JitBytecode::ConstTable>() )
+        {
+            if( !x.canConvert<JitBytecode::ConstTable>() || !y.canConvert<JitBytecode::ConstTable>() ||
+                    !sameTable( x, y ) )
+                return false;
+        }else if( x.type() != y.type() || x != y )
+            return false;
+    }
+    return true;
+}
+
+static void diffConsts( const JitBytecode::Function* a, const JitBytecode::Function* b, QStringList& removed,
+                        QStringList& added )
+{
+    // multiset difference of the string, number and table constants; functions are not compared
+    QHash<QString,int> count;
+    foreach( const QVariant& v, a->d_constObjs )
+    {
+        const QString s = constToString(v);
+        if( !s.isEmpty() )
+            count[s]++;
+    }
+    foreach( const QVariant& v, a->d_constNums )
+        count[constToString(v)]++;
+    foreach( const QVariant& v, b->d_constObjs )
+    {
+        const QString s = constToString(v);
+        if( !s.isEmpty() )
+            count[s]--;
+    }
+    foreach( const QVariant& v, b->d_constNums )
+        count[constToString(v)]--;
+    QHash<QString,int>::const_iterator i;
+    for( i = count.begin(); i != count.end(); ++i )
+    {
+        for( int n = 0; n < i.value(); n++ )
+            removed << i.key();
+        for( int n = 0; n > i.value(); n-- )
+            added << i.key();
+    }
+    removed.sort();
+    added.sort();
+}
+
+void JitDiff::compare(const JitBytecode::Function* a, const JitBytecode::Function* b, JitDiff::FuncDiff& d)
+{
+    d.d_instrDelta = b->d_byteCodes.size() - a->d_byteCodes.size();
+    d.d_frameDelta = int(b->d_framesize) - int(a->d_framesize);
+    if( a->d_byteCodes == b->d_byteCodes && sameConsts( a, b ) )
+        return; // the usual case; no need to compare constants or to compute keys
+
+    diffConsts( a, b, d.d_constRemoved, d.d_constAdded );
+
+    QVector<quint32> ka( a->d_byteCodes.size() ), kb( b->d_byteCodes.size() );
+    for( int pc = 0; pc < ka.size(); pc++ )
+        ka[pc] = instrKey( a, pc );
+    for( int pc = 0; pc < kb.size(); pc++ )
+        kb[pc] = instrKey( b, pc );
+    if( ka == kb )
+        return;
+    align( ka, kb, d.d_edits );
+    foreach( const Edit& e, d.d_edits )
+    {
+        if( e.d_kind == Deleted )
+            d.d_deleted++;
+        else if( e.d_kind == Inserted )
+            d.d_inserted++;
+    }
+}
+
+void JitDiff::align(const QVector<quint32>& a, const QVector<quint32>& b, Edits& edits)
+{
+    // the common prefix and suffix are cut off first, the middle is aligned by Myers' greedy algorithm;
+    // the trace keeps only the diagonals -d..d of each step, i.e. O(D^2) memory
+    const int n = a.size();
+    const int m = b.size();
+    int pre = 0;
+    while( pre < n && pre < m && a[pre] == b[pre] )
+        pre++;
+    int suf = 0;
+    while( suf < n - pre && suf < m - pre && a[n-1-suf] == b[m-1-suf] )
+        suf++;
+    const int na = n - pre - suf;
+    const int nb = m - pre - suf;
+
+    edits.reserve( qMax(n,m) + qMin(na,nb) );
+    for( int i = 0; i < pre; i++ )
+        edits.append( Edit( Same, i, i ) );
+
+    Edits mid;
+    const int maxD = qMin( na + nb, int(MaxEdits) );
+    QVector<int> v( 2 * maxD + 3, 0 );
+    const int off = maxD + 1;
+    QList< QVector<int> > trace;
+    int found = -1;
+    for( int d = 0; d <= maxD && found < 0; d++ )
+    {
+        for( int k = -d; k <= d; k += 2 )
+        {
+            int x;
+            if( k == -d || ( k != d && v[off+k-1] < v[off+k+1] ) )
+                x = v[off+k+1]; // down, i.e. insertion
+            else
+                x = v[off+k-1] + 1; // right, i.e. deletion
+            int y = x - k;
+            while( x < na && y < nb && a[pre+x] == b[pre+y] )
+            {
+                x++;
+                y++;
+            }
+            v[off+k] = x;
+            if( x >= na && y >= nb )
+                found = d;
+        }
+        trace.append( v.mid( off - d, 2 * d + 1 ) );
+    }
+
+    if( found < 0 )
+    {
+        // too many differences; report as replaced
+        for( int i = 0; i < na; i++ )
+            mid.append( Edit( Deleted, pre + i, -1 ) );
+        for( int i = 0; i < nb; i++ )
+            mid.append( Edit( Inserted, -1, pre + i ) );
+    }else
+    {
+        int x = na, y = nb;
+        for( int d = found; d > 0; d-- )
+        {
+            const QVector<int>& prev = trace[d-1]; // index k + d - 1
+            const int k = x - y;
+            int prevK;
+            if( k == -d || ( k != d && prev[k-1+d-1] < prev[k+1+d-1] ) )
+                prevK = k + 1;
+            else
+                prevK = k - 1;
+            const int prevX = prev[prevK+d-1];
+            const int prevY = prevX - prevK;
+            while( x > prevX && y > prevY )
+            {
+                x--;
+                y--;
+                mid.append( Edit( Same, pre + x, pre + y ) );
+            }
+            if( x == prevX )
+                mid.append( Edit( Inserted, -1, pre + y - 1 ) );
+            else
+                mid.append( Edit( Deleted, pre + x - 1, -1 ) );
+            x = prevX;
+            y = prevY;
+        }
+        while( x > 0 && y > 0 )
+        {
+            x--;
+            y--;
+            mid.append( Edit( Same, pre + x, pre + y ) );
+        }
+        std::reverse( mid.begin(), mid.end() );
+    }
+    edits += mid;
+    for( int i = 0; i < suf; i++ )
+        edits.append( Edit( Same, n - suf + i, m - suf + i ) );
+}
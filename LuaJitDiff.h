@@ -0,0 +1,76 @@
+#ifndef LUAJITDIFF_H
+#define LUAJITDIFF_H
+
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <LjTools/LuaJitBytecode.h>
+#include <QStringList>
+
+namespace Lua
+{
+    // Compares two dumps structurally. The prototypes are matched by source position (first line and line count),
+    // the remaining ones by shape (parameters, varargs, upvalues, child functions) in dump order. The instructions
+    // of matched prototypes are aligned by Myers' O(ND) algorithm over keys which compare constants by value
+    // instead of by index, so a shifted constant pool doesn't show up as a change of every instruction; template
+    // tables are compared by content, child prototypes are compared as prototypes of their own.
+    class JitDiff
+    {
+    public:
+        enum { MaxEdits = 2000 }; // beyond that a function is reported as replaced as a whole
+        enum EditKind { Same, Deleted, Inserted };
+        struct Edit
+        {
+            quint8 d_kind;
+            qint32 d_pcA, d_pcB; // zero-based, -1 if not on that side
+            Edit(quint8 k = Same, qint32 a = -1, qint32 b = -1):d_kind(k),d_pcA(a),d_pcB(b){}
+        };
+        typedef QVector<Edit> Edits;
+        struct FuncDiff
+        {
+            qint32 d_a, d_b; // index in getFuncs() of the side, -1 if the prototype only exists on the other side
+            qint32 d_instrDelta, d_frameDelta;
+            quint32 d_deleted, d_inserted; // instructions
+            QStringList d_constRemoved, d_constAdded;
+            Edits d_edits; // empty if the instructions are equal
+            FuncDiff():d_a(-1),d_b(-1),d_instrDelta(0),d_frameDelta(0),d_deleted(0),d_inserted(0){}
+            bool isChanged() const;
+        };
+        typedef QList<FuncDiff> FuncDiffs;
+
+        JitDiff();
+        void diff( const JitBytecode& a, const JitBytecode& b );
+        const FuncDiffs& getFuncs() const { return d_funcs; } // in the order of a, followed by the ones only in b
+        int matchOfA( int a ) const { return a >= 0 && a < d_aToB.size() ? d_aToB[a] : -1; }
+        int matchOfB( int b ) const { return b >= 0 && b < d_bToA.size() ? d_bToA[b] : -1; }
+        int getChangedCount() const;
+        void clear();
+
+        static quint32 instrKey( const JitBytecode::Function*, int pc );
+    protected:
+        void match( const JitBytecode& a, const JitBytecode& b );
+        void compare( const JitBytecode::Function* a, const JitBytecode::Function* b, FuncDiff& );
+        static void align( const QVector<quint32>& a, const QVector<quint32>& b, Edits& );
+    private:
+        FuncDiffs d_funcs;
+        QVector<int> d_aToB, d_bToA;
+    };
+}
+
+#endif // LUAJITDIFF_H
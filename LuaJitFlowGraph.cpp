@@ -0,0 +1,739 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LuaJitFlowGraph.h"
+#include <QHash>
+using namespace Lua;
+
+static inline quint8 bcOp( quint32 bc ) { return bc & 0xff; }
+static inline quint8 bcA( quint32 bc ) { return ( bc >> 8 ) & 0xff; }
+static inline quint8 bcB( quint32 bc ) { return bc >> 24; }
+static inline quint8 bcC( quint32 bc ) { return ( bc >> 16 ) & 0xff; }
+static inline quint16 bcD( quint32 bc ) { return bc >> 16; }
+
+static inline void setRange( JitFlowGraph::Slots& s, int from, int to )
+{
+    // inclusive, clipped to the frame
+    if( from < 0 )
+        from = 0;
+    if( to >= JitComposer::MAX_SLOTS )
+        to = JitComposer::MAX_SLOTS - 1;
+    for( int i = from; i <= to; i++ )
+        s.set(i);
+}
+
+static inline void set( JitFlowGraph::Slots& s, int slot )
+{
+    if( slot >= 0 && slot < JitComposer::MAX_SLOTS )
+        s.set(slot);
+}
+
+JitFlowGraph::JitFlowGraph():d_func(0)
+{
+}
+
+void JitFlowGraph::clear()
+{
+    d_func = 0;
+    d_blocks.clear();
+    d_loops.clear();
+    d_defs.clear();
+    d_defsOfSlot.clear();
+    d_blockOf.clear();
+    d_rpo.clear();
+    d_error.clear();
+}
+
+bool JitFlowGraph::analyze(const JitBytecode::Function* f, int what)
+{
+    clear();
+    d_func = f;
+    if( f == 0 || f->d_byteCodes.isEmpty() )
+    {
+        d_error = "function has no code";
+        return false;
+    }
+    if( !buildBlocks() )
+        return false;
+    if( what & Dominators )
+        calcDominators();
+    if( ( what & Loops ) == Loops )
+        calcLoops();
+    if( what & Liveness )
+        calcLiveness();
+    if( what & ReachingDefs )
+        calcReachingDefs();
+    return true;
+}
+
+bool JitFlowGraph::isBranch(quint8 op)
+{
+    return JitBytecode::typeCdFromOp(op) == JitBytecode::Instruction::_jump;
+}
+
+bool JitFlowGraph::isTest(quint8 op)
+{
+    return op <= JitBytecode::OP_ISF;
+}
+
+bool JitFlowGraph::endsFlow(quint8 op)
+{
+    switch( op )
+    {
+    case JitBytecode::OP_JMP:
+    case JitBytecode::OP_UCLO:
+    case JitBytecode::OP_ISNEXT:
+    case JitBytecode::OP_RETM:
+    case JitBytecode::OP_RET:
+    case JitBytecode::OP_RET0:
+    case JitBytecode::OP_RET1:
+    case JitBytecode::OP_CALLT:
+    case JitBytecode::OP_CALLMT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int JitFlowGraph::jumpTarget(quint32 pc) const
+{
+    return pc + 1 + int(bcD(d_func->d_byteCodes[pc])) - JitBytecode::Instruction::JumpBias;
+}
+
+bool JitFlowGraph::buildBlocks()
+{
+    const JitBytecode::CodeList& code = d_func->d_byteCodes;
+    const int len = code.size();
+    QBitArray leaders( len + 1 );
+    leaders.setBit(0);
+    for( int pc = 0; pc < len; pc++ )
+    {
+        const quint8 op = bcOp(code[pc]);
+        if( isBranch(op) )
+        {
+            const int t = jumpTarget(pc);
+            if( t < 0 || t >= len )
+            {
+                d_error = QString("jump target out of range at pc %1").arg(pc);
+                return false;
+            }
+            leaders.setBit(t);
+            leaders.setBit(pc+1);
+        }else if( isTest(op) || endsFlow(op) )
+            leaders.setBit(pc+1);
+    }
+
+    d_blockOf.resize(len);
+    for( int pc = 0; pc < len; pc++ )
+    {
+        if( leaders.testBit(pc) )
+        {
+            Block b;
+            b.d_first = pc;
+            d_blocks.append(b);
+        }
+        d_blocks.last().d_last = pc;
+        d_blockOf[pc] = d_blocks.size() - 1;
+    }
+
+    for( int i = 0; i < d_blocks.size(); i++ )
+    {
+        Block& b = d_blocks[i];
+        const quint8 op = bcOp(code[b.d_last]);
+        const int next = b.d_last + 1;
+        if( isTest(op) )
+        {
+            if( next + 1 >= len )
+            {
+                d_error = QString("test without jump at pc %1").arg(b.d_last);
+                return false;
+            }
+            b.d_succ << d_blockOf[next] << d_blockOf[next+1];
+        }else if( op == JitBytecode::OP_LOOP || op == JitBytecode::OP_ILOOP )
+        {
+            // the target of LOOP is the loop exit, only used by the JIT
+            if( next < len )
+                b.d_succ << d_blockOf[next];
+        }else if( isBranch(op) )
+        {
+            if( !endsFlow(op) && next < len )
+                b.d_succ << d_blockOf[next];
+            const int t = d_blockOf[jumpTarget(b.d_last)];
+            if( !b.d_succ.contains(t) )
+                b.d_succ << t;
+        }else if( !endsFlow(op) && next < len )
+            b.d_succ << d_blockOf[next];
+    }
+    for( int i = 0; i < d_blocks.size(); i++ )
+    {
+        foreach( int s, d_blocks[i].d_succ )
+            d_blocks[s].d_pred << i;
+    }
+
+    // reverse post order of the reachable blocks by iterative DFS
+    QVector<int> post;
+    post.reserve(d_blocks.size());
+    QVector<QPair<int,int> > stack; // block, next successor index
+    stack.append( qMakePair(0,0) );
+    d_blocks[0].d_reachable = true;
+    while( !stack.isEmpty() )
+    {
+        QPair<int,int>& top = stack.last();
+        const Block& b = d_blocks[top.first];
+        if( top.second < b.d_succ.size() )
+        {
+            const int s = b.d_succ[top.second++];
+            if( !d_blocks[s].d_reachable )
+            {
+                d_blocks[s].d_reachable = true;
+                stack.append( qMakePair(s,0) );
+            }
+        }else
+        {
+            post.append(top.first);
+            stack.pop_back();
+        }
+    }
+    d_rpo.resize(post.size());
+    for( int i = 0; i < post.size(); i++ )
+        d_rpo[i] = post[post.size() - i - 1];
+    return true;
+}
+
+void JitFlowGraph::calcDominators()
+{
+    // Cooper, Harvey, Kennedy: A Simple, Fast Dominance Algorithm
+    QVector<int> order( d_blocks.size(), -1 );
+    for( int i = 0; i < d_rpo.size(); i++ )
+        order[d_rpo[i]] = i;
+    QVector<int> idom( d_blocks.size(), -1 );
+    idom[0] = 0;
+    bool changed = true;
+    while( changed )
+    {
+        changed = false;
+        for( int i = 1; i < d_rpo.size(); i++ )
+        {
+            const int b = d_rpo[i];
+            int newIdom = -1;
+            foreach( int p, d_blocks[b].d_pred )
+            {
+                if( idom[p] == -1 )
+                    continue;
+                if( newIdom == -1 )
+                    newIdom = p;
+                else
+                {
+                    int f1 = p, f2 = newIdom;
+                    while( f1 != f2 )
+                    {
+                        while( order[f1] > order[f2] )
+                            f1 = idom[f1];
+                        while( order[f2] > order[f1] )
+                            f2 = idom[f2];
+                    }
+                    newIdom = f1;
+                }
+            }
+            if( idom[b] != newIdom )
+            {
+                idom[b] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    idom[0] = -1;
+    for( int i = 0; i < d_blocks.size(); i++ )
+        d_blocks[i].d_idom = idom[i];
+}
+
+bool JitFlowGraph::dominates(int a, int b) const
+{
+    if( a < 0 || b < 0 || a >= d_blocks.size() || b >= d_blocks.size() )
+        return false;
+    if( !d_blocks[b].d_reachable )
+        return false;
+    while( b != -1 )
+    {
+        if( a == b )
+            return true;
+        b = d_blocks[b].d_idom;
+    }
+    return false;
+}
+
+bool JitFlowGraph::isLoopHeader(int block) const
+{
+    for( int i = 0; i < d_loops.size(); i++ )
+    {
+        if( d_loops[i].d_header == block )
+            return true;
+    }
+    return false;
+}
+
+void JitFlowGraph::calcLoops()
+{
+    // natural loops of the back edges; back edges to the same header make one loop
+    QHash<int,int> byHeader;
+    QVector<QBitArray> members;
+    for( int i = 0; i < d_rpo.size(); i++ )
+    {
+        const int u = d_rpo[i];
+        foreach( int h, d_blocks[u].d_succ )
+        {
+            if( !dominates(h,u) )
+                continue;
+            int l = byHeader.value(h,-1);
+            if( l == -1 )
+            {
+                l = d_loops.size();
+                byHeader[h] = l;
+                Loop loop;
+                loop.d_header = h;
+                d_loops.append(loop);
+                members.append( QBitArray(d_blocks.size()) );
+                members[l].setBit(h);
+            }
+            d_loops[l].d_latches << u;
+            QVector<int> work;
+            if( !members[l].testBit(u) )
+            {
+                members[l].setBit(u);
+                work << u;
+            }
+            while( !work.isEmpty() )
+            {
+                const int b = work.takeLast();
+                foreach( int p, d_blocks[b].d_pred )
+                {
+                    if( d_blocks[p].d_reachable && !members[l].testBit(p) )
+                    {
+                        members[l].setBit(p);
+                        work << p;
+                    }
+                }
+            }
+        }
+    }
+    for( int l = 0; l < d_loops.size(); l++ )
+    {
+        for( int b = 0; b < d_blocks.size(); b++ )
+        {
+            if( members[l].testBit(b) )
+                d_loops[l].d_blocks << b;
+        }
+    }
+    // the parent is the smallest other loop containing the header
+    for( int l = 0; l < d_loops.size(); l++ )
+    {
+        int parent = -1;
+        for( int k = 0; k < d_loops.size(); k++ )
+        {
+            if( k == l || !members[k].testBit(d_loops[l].d_header) ||
+                    d_loops[k].d_blocks.size() <= d_loops[l].d_blocks.size() )
+                continue;
+            if( parent == -1 || d_loops[k].d_blocks.size() < d_loops[parent].d_blocks.size() )
+                parent = k;
+        }
+        d_loops[l].d_parent = parent;
+    }
+    for( int l = 0; l < d_loops.size(); l++ )
+    {
+        quint8 depth = 1;
+        for( int p = d_loops[l].d_parent; p != -1; p = d_loops[p].d_parent )
+            depth++;
+        d_loops[l].d_depth = depth;
+    }
+    for( int b = 0; b < d_blocks.size(); b++ )
+    {
+        int inner = -1;
+        for( int l = 0; l < d_loops.size(); l++ )
+        {
+            if( members[l].testBit(b) && ( inner == -1 || d_loops[l].d_depth > d_loops[inner].d_depth ) )
+                inner = l;
+        }
+        d_blocks[b].d_loop = inner;
+        d_blocks[b].d_depth = inner == -1 ? 0 : d_loops[inner].d_depth;
+    }
+}
+
+void JitFlowGraph::useDef(const JitBytecode::Function* f, quint32 pc, Slots& use, Slots& def, Slots& mayDef)
+{
+    use.reset();
+    def.reset();
+    mayDef.reset();
+    const quint32 bc = f->d_byteCodes[pc];
+    const int a = bcA(bc);
+    const int b = bcB(bc);
+    const int c = bcC(bc);
+    const int d = bcD(bc);
+    const int top = qMin( int(f->d_framesize), int(JitComposer::MAX_SLOTS) ) - 1;
+    switch( bcOp(bc) )
+    {
+    case JitBytecode::OP_ISLT:
+    case JitBytecode::OP_ISGE:
+    case JitBytecode::OP_ISLE:
+    case JitBytecode::OP_ISGT:
+    case JitBytecode::OP_ISEQV:
+    case JitBytecode::OP_ISNEV:
+        set(use,a);
+        set(use,d);
+        break;
+    case JitBytecode::OP_ISEQS:
+    case JitBytecode::OP_ISNES:
+    case JitBytecode::OP_ISEQN:
+    case JitBytecode::OP_ISNEN:
+    case JitBytecode::OP_ISEQP:
+    case JitBytecode::OP_ISNEP:
+        set(use,a);
+        break;
+    case JitBytecode::OP_ISTC:
+    case JitBytecode::OP_ISFC:
+        set(use,d);
+        set(mayDef,a);
+        break;
+    case JitBytecode::OP_IST:
+    case JitBytecode::OP_ISF:
+    case JitBytecode::OP_USETV:
+        set(use,d);
+        break;
+    case JitBytecode::OP_MOV:
+    case JitBytecode::OP_NOT:
+    case JitBytecode::OP_UNM:
+    case JitBytecode::OP_LEN:
+        set(use,d);
+        set(def,a);
+        break;
+    case JitBytecode::OP_ADDVN:
+    case JitBytecode::OP_SUBVN:
+    case JitBytecode::OP_MULVN:
+    case JitBytecode::OP_DIVVN:
+    case JitBytecode::OP_MODVN:
+    case JitBytecode::OP_ADDNV:
+    case JitBytecode::OP_SUBNV:
+    case JitBytecode::OP_MULNV:
+    case JitBytecode::OP_DIVNV:
+    case JitBytecode::OP_MODNV:
+    case JitBytecode::OP_TGETS:
+    case JitBytecode::OP_TGETB:
+        set(use,b);
+        set(def,a);
+        break;
+    case JitBytecode::OP_ADDVV:
+    case JitBytecode::OP_SUBVV:
+    case JitBytecode::OP_MULVV:
+    case JitBytecode::OP_DIVVV:
+    case JitBytecode::OP_MODVV:
+    case JitBytecode::OP_POW:
+    case JitBytecode::OP_TGETV:
+        set(use,b);
+        set(use,c);
+        set(def,a);
+        break;
+    case JitBytecode::OP_CAT:
+        setRange(use,b,c);
+        set(def,a);
+        break;
+    case JitBytecode::OP_KSTR:
+    case JitBytecode::OP_KCDATA:
+    case JitBytecode::OP_KSHORT:
+    case JitBytecode::OP_KNUM:
+    case JitBytecode::OP_KPRI:
+    case JitBytecode::OP_UGET:
+    case JitBytecode::OP_TNEW:
+    case JitBytecode::OP_TDUP:
+    case JitBytecode::OP_GGET:
+        set(def,a);
+        break;
+    case JitBytecode::OP_KNIL:
+        setRange(def,a,d);
+        break;
+    case JitBytecode::OP_FNEW:
+        {
+            // the closure captures the local slots it has as upvalues
+            const int i = f->d_constObjs.size() - d - 1;
+            if( i >= 0 && i < f->d_constObjs.size() && f->d_constObjs[i].canConvert<JitBytecode::FuncRef>() )
+            {
+                JitBytecode::FuncRef fr = f->d_constObjs[i].value<JitBytecode::FuncRef>();
+                for( int j = 0; j < fr->d_upvals.size(); j++ )
+                {
+                    if( fr->isLocalUpval(j) )
+                        set(use,fr->getUpval(j));
+                }
+            }
+            set(def,a);
+        }
+        break;
+    case JitBytecode::OP_GSET:
+    case JitBytecode::OP_RET1:
+        set(use,a);
+        break;
+    case JitBytecode::OP_TSETV:
+        set(use,a);
+        set(use,b);
+        set(use,c);
+        break;
+    case JitBytecode::OP_TSETS:
+    case JitBytecode::OP_TSETB:
+        set(use,a);
+        set(use,b);
+        break;
+    case JitBytecode::OP_TSETM:
+        setRange(use,a-1,top);
+        break;
+    case JitBytecode::OP_CALLM:
+        setRange(use,a,top);
+        if( b == 0 )
+            setRange(def,a,top);
+        else
+            setRange(def,a,a+b-2);
+        break;
+    case JitBytecode::OP_CALL:
+        setRange(use,a,a+c-1);
+        if( b == 0 )
+            setRange(def,a,top);
+        else
+            setRange(def,a,a+b-2);
+        break;
+    case JitBytecode::OP_CALLMT:
+    case JitBytecode::OP_RETM:
+        setRange(use,a,top);
+        break;
+    case JitBytecode::OP_CALLT:
+        setRange(use,a,a+d-1);
+        break;
+    case JitBytecode::OP_RET:
+        setRange(use,a,a+d-2);
+        break;
+    case JitBytecode::OP_ITERC:
+    case JitBytecode::OP_ITERN:
+        setRange(use,a-3,a-1);
+        setRange(def,a,qMax(a+2,a+b-2));
+        break;
+    case JitBytecode::OP_VARG:
+        if( b == 0 )
+            setRange(def,a,top);
+        else
+            setRange(def,a,a+b-2);
+        break;
+    case JitBytecode::OP_ISNEXT:
+        setRange(use,a-3,a-1);
+        break;
+    case JitBytecode::OP_FORI:
+    case JitBytecode::OP_JFORI:
+        setRange(use,a,a+2);
+        set(mayDef,a);
+        set(mayDef,a+3);
+        break;
+    case JitBytecode::OP_FORL:
+    case JitBytecode::OP_IFORL:
+    case JitBytecode::OP_JFORL:
+        setRange(use,a,a+2);
+        set(def,a);
+        set(mayDef,a+3);
+        break;
+    case JitBytecode::OP_ITERL:
+    case JitBytecode::OP_IITERL:
+    case JitBytecode::OP_JITERL:
+        set(use,a);
+        set(mayDef,a-1);
+        break;
+    default:
+        // USETS, USETN, USETP, UCLO, RET0, LOOP, JMP and the like don't touch slots
+        break;
+    }
+}
+
+void JitFlowGraph::calcLiveness()
+{
+    Slots use, def, mayDef;
+    for( int i = 0; i < d_blocks.size(); i++ )
+    {
+        Block& b = d_blocks[i];
+        b.d_use.reset();
+        b.d_def.reset();
+        for( quint32 pc = b.d_first; pc <= b.d_last; pc++ )
+        {
+            useDef(d_func,pc,use,def,mayDef);
+            b.d_use |= use & ~b.d_def;
+            b.d_def |= def;
+        }
+        b.d_liveIn = b.d_use;
+        b.d_liveOut.reset();
+    }
+    bool changed = true;
+    while( changed )
+    {
+        changed = false;
+        for( int i = d_blocks.size() - 1; i >= 0; i-- )
+        {
+            Block& b = d_blocks[i];
+            Slots out;
+            foreach( int s, b.d_succ )
+                out |= d_blocks[s].d_liveIn;
+            const Slots in = b.d_use | ( out & ~b.d_def );
+            if( out != b.d_liveOut || in != b.d_liveIn )
+            {
+                b.d_liveOut = out;
+                b.d_liveIn = in;
+                changed = true;
+            }
+        }
+    }
+}
+
+JitFlowGraph::Slots JitFlowGraph::liveBefore(quint32 pc) const
+{
+    const int bi = blockOf(pc);
+    if( bi < 0 || d_blocks.isEmpty() )
+        return Slots();
+    const Block& b = d_blocks[bi];
+    Slots live = b.d_liveOut;
+    Slots use, def, mayDef;
+    for( int i = b.d_last; i >= int(pc); i-- )
+    {
+        useDef(d_func,i,use,def,mayDef);
+        live = ( live & ~def ) | use;
+    }
+    return live;
+}
+
+JitFlowGraph::Slots JitFlowGraph::liveAfter(quint32 pc) const
+{
+    const int bi = blockOf(pc);
+    if( bi < 0 )
+        return Slots();
+    if( pc == d_blocks[bi].d_last )
+        return d_blocks[bi].d_liveOut;
+    return liveBefore(pc+1);
+}
+
+void JitFlowGraph::calcReachingDefs()
+{
+    const int len = d_func->d_byteCodes.size();
+    d_defsOfSlot.fill(QVector<int>(),JitComposer::MAX_SLOTS);
+    QVector<int> firstDef(len+1); // index of the first def of a pc into d_defs
+    Slots use, def, mayDef;
+    for( int pc = 0; pc < len; pc++ )
+    {
+        firstDef[pc] = d_defs.size();
+        useDef(d_func,pc,use,def,mayDef);
+        const Slots all = def | mayDef;
+        if( all.none() )
+            continue;
+        for( int s = 0; s < JitComposer::MAX_SLOTS; s++ )
+        {
+            if( all.test(s) )
+            {
+                d_defsOfSlot[s].append(d_defs.size());
+                d_defs.append( Def(pc,s) );
+            }
+        }
+    }
+    firstDef[len] = d_defs.size();
+
+    const int n = d_defs.size();
+    // one mask per slot with all its defs, so a def kills them in one pass over the words
+    QVector<QBitArray> defsMask(JitComposer::MAX_SLOTS);
+    for( int s = 0; s < JitComposer::MAX_SLOTS; s++ )
+    {
+        if( d_defsOfSlot[s].isEmpty() )
+            continue;
+        defsMask[s] = QBitArray(n);
+        foreach( int j, d_defsOfSlot[s] )
+            defsMask[s].setBit(j);
+    }
+    QVector<QBitArray> gen(d_blocks.size()), kill(d_blocks.size());
+    for( int i = 0; i < d_blocks.size(); i++ )
+    {
+        Block& b = d_blocks[i];
+        gen[i] = QBitArray(n);
+        kill[i] = QBitArray(n);
+        for( quint32 pc = b.d_first; pc <= b.d_last; pc++ )
+        {
+            useDef(d_func,pc,use,def,mayDef);
+            for( int k = firstDef[pc]; k < firstDef[pc+1]; k++ )
+            {
+                const int s = d_defs[k].d_slot;
+                if( def.test(s) )
+                {
+                    kill[i] |= defsMask[s];
+                    gen[i] &= ~defsMask[s];
+                    kill[i].clearBit(k);
+                }
+                gen[i].setBit(k);
+            }
+        }
+        b.d_reachIn = QBitArray(n);
+        b.d_reachOut = gen[i];
+    }
+    bool changed = true;
+    while( changed )
+    {
+        changed = false;
+        foreach( int i, d_rpo )
+        {
+            Block& b = d_blocks[i];
+            QBitArray in(n);
+            foreach( int p, b.d_pred )
+                in |= d_blocks[p].d_reachOut;
+            const QBitArray out = gen[i] | ( in & ~kill[i] );
+            b.d_reachIn = in;
+            if( out != b.d_reachOut )
+            {
+                b.d_reachOut = out;
+                changed = true;
+            }
+        }
+    }
+}
+
+QVector<quint32> JitFlowGraph::reachingDefs(quint32 pc, quint8 slot) const
+{
+    QVector<quint32> res;
+    const int bi = blockOf(pc);
+    if( bi < 0 || d_defs.isEmpty() )
+        return res;
+    const Block& b = d_blocks[bi];
+    if( b.d_reachIn.size() != d_defs.size() || slot >= d_defsOfSlot.size() )
+        return res; // not calculated
+    const QVector<int>& defs = d_defsOfSlot[slot];
+    QBitArray reach = b.d_reachIn;
+    Slots use, def, mayDef;
+    for( quint32 i = b.d_first; i < pc; i++ )
+    {
+        useDef(d_func,i,use,def,mayDef);
+        if( !def.test(slot) && !mayDef.test(slot) )
+            continue;
+        foreach( int k, defs )
+        {
+            if( d_defs[k].d_pc == i )
+                reach.setBit(k);
+            else if( def.test(slot) )
+                reach.clearBit(k);
+        }
+    }
+    foreach( int k, defs )
+    {
+        if( reach.testBit(k) )
+            res.append(d_defs[k].d_pc);
+    }
+    return res;
+}
@@ -0,0 +1,115 @@
+#ifndef LUAJITFLOWGRAPH_H
+#define LUAJITFLOWGRAPH_H
+
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <LjTools/LuaJitComposer.h>
+#include <QBitArray>
+#include <QVector>
+
+namespace Lua
+{
+    // Control flow graph of a JitBytecode::Function with dominators, natural loops, slot liveness and
+    // reaching definitions. Blocks are numbered in code order, block 0 is the entry. ISxx tests end a
+    // block; the following JMP is a block of its own, so each test has two successors.
+    class JitFlowGraph
+    {
+    public:
+        typedef std::bitset<JitComposer::MAX_SLOTS> Slots;
+        enum What { Blocks = 0, Dominators = 1, Loops = 2 | Dominators, Liveness = 4, ReachingDefs = 8,
+                    All = Loops | Liveness | ReachingDefs };
+
+        struct Block
+        {
+            quint32 d_first, d_last; // pc of first and last instruction
+            QVector<int> d_succ, d_pred; // block indices
+            int d_idom; // immediate dominator; -1 for the entry and unreachable blocks
+            int d_loop; // innermost loop containing the block, index into getLoops(); -1 if none
+            quint8 d_depth; // loop nesting depth; 0 outside of loops
+            bool d_reachable;
+            Slots d_use; // read before written in the block
+            Slots d_def; // written in the block
+            Slots d_liveIn, d_liveOut;
+            QBitArray d_reachIn, d_reachOut; // index into getDefs()
+            Block():d_first(0),d_last(0),d_idom(-1),d_loop(-1),d_depth(0),d_reachable(false){}
+        };
+        typedef QVector<Block> BlockList;
+
+        struct Loop
+        {
+            int d_header; // block
+            int d_parent; // enclosing loop, -1 if none
+            quint8 d_depth; // 1 for outermost
+            QVector<int> d_blocks; // including the header
+            QVector<int> d_latches; // blocks with a back edge to the header
+            Loop():d_header(-1),d_parent(-1),d_depth(0){}
+        };
+        typedef QVector<Loop> LoopList;
+
+        struct Def
+        {
+            quint32 d_pc;
+            quint8 d_slot;
+            Def(quint32 pc = 0, quint8 slot = 0):d_pc(pc),d_slot(slot){}
+        };
+        typedef QVector<Def> DefList;
+
+        JitFlowGraph();
+        bool analyze( const JitBytecode::Function*, int what = All );
+        void clear();
+
+        const JitBytecode::Function* getFunction() const { return d_func; }
+        const BlockList& getBlocks() const { return d_blocks; }
+        const LoopList& getLoops() const { return d_loops; }
+        const DefList& getDefs() const { return d_defs; }
+        int blockOf( quint32 pc ) const { return pc < quint32(d_blockOf.size()) ? d_blockOf[pc] : -1; }
+        bool dominates( int a, int b ) const; // block a dominates block b
+        bool isLoopHeader( int block ) const;
+        Slots liveBefore( quint32 pc ) const; // slots whose current value is read later
+        Slots liveAfter( quint32 pc ) const;
+        QVector<quint32> reachingDefs( quint32 pc, quint8 slot ) const; // defs of slot reaching the instruction at pc
+        const QString& getError() const { return d_error; }
+
+        // use: slots read by the instruction; def: slots certainly written; mayDef: slots conditionally written.
+        // Ranges depending on MULTRES reach up to the frame size.
+        static void useDef( const JitBytecode::Function*, quint32 pc, Slots& use, Slots& def, Slots& mayDef );
+        static bool isBranch( quint8 op ); // has a jump target in D
+        static bool isTest( quint8 op ); // the next instruction is a JMP executed if the test holds
+        static bool endsFlow( quint8 op ); // no fall through
+    protected:
+        bool buildBlocks();
+        void calcDominators();
+        void calcLoops();
+        void calcLiveness();
+        void calcReachingDefs();
+        int jumpTarget( quint32 pc ) const;
+    private:
+        const JitBytecode::Function* d_func;
+        BlockList d_blocks;
+        LoopList d_loops;
+        DefList d_defs;
+        QVector<QVector<int> > d_defsOfSlot; // slot -> indices into d_defs in code order
+        QVector<int> d_blockOf; // pc -> block
+        QVector<int> d_rpo; // reachable blocks in reverse post order
+        QString d_error;
+    };
+}
+
+#endif // LUAJITFLOWGRAPH_H
@@ -0,0 +1,217 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LuaJitIndex.h"
+#include <QStringList>
+#include <algorithm>
+#include <iterator>
+using namespace Lua;
+
+const char* JitIndex::s_kindName[] = { "op", "str", "num", "upval", "global", "args" };
+
+JitIndex::JitIndex():d_count(0)
+{
+}
+
+void JitIndex::clear()
+{
+    for( int i = 0; i < MaxKind; i++ )
+        d_index[i].clear();
+    d_count = 0;
+}
+
+QByteArray JitIndex::numberKey(double d)
+{
+    // the same key for 3, 3.0 and the KSHORT literal 3
+    return QByteArray::number( d, 'g', 17 );
+}
+
+void JitIndex::add(JitIndex::Kind k, const QByteArray& key, quint32 func, quint32 pc)
+{
+    Postings& p = d_index[k][key];
+    // the instructions are visited in ascending order, so only the last posting can be a duplicate
+    if( !p.isEmpty() && p.last().d_func == func && p.last().d_pc == pc )
+        return;
+    const Posting post = { func, pc };
+    p.append( post );
+}
+
+static QByteArray constString( const JitBytecode::Function* f, int cd )
+{
+    if( cd >= f->d_constObjs.size() )
+        return QByteArray();
+    const QVariant& v = f->d_constObjs[f->d_constObjs.size() - cd - 1]; // negated index
+    if( !JitBytecode::isString(v) )
+        return QByteArray();
+    return v.toByteArray();
+}
+
+void JitIndex::build(const JitBytecode& bc)
+{
+    clear();
+    const QList<JitBytecode::FuncRef>& funcs = bc.getFuncs();
+    for( int fi = 0; fi < funcs.size(); fi++ )
+    {
+        const JitBytecode::Function* f = funcs[fi].constData();
+        for( int pc = 0; pc < f->d_byteCodes.size(); pc++ )
+        {
+            const quint32 ins = f->d_byteCodes[pc];
+            const quint8 op = ins & 0xff;
+            if( op > JitBytecode::OP_JMP )
+                continue;
+            d_count++;
+            add( Op, JitBytecode::nameOfOp(op), fi, pc );
+
+            const bool isAd = JitBytecode::formatFromOp(op) == JitBytecode::AD;
+            const int a = ( ins >> 8 ) & 0xff;
+            const int cd = isAd ? ins >> 16 : ( ins >> 16 ) & 0xff;
+
+            if( JitBytecode::typeAFromOp(op) == JitBytecode::Instruction::_uv
+                    && a < f->d_upNames.size() && !f->d_upNames[a].isEmpty() )
+                add( Upval, f->d_upNames[a], fi, pc );
+
+            switch( JitBytecode::typeCdFromOp(op) )
+            {
+            case JitBytecode::Instruction::_str:
+                {
+                    const QByteArray s = constString( f, cd );
+                    if( op == JitBytecode::OP_GGET || op == JitBytecode::OP_GSET )
+                        add( Global, s, fi, pc );
+                    else
+                        add( String, s, fi, pc );
+                }
+                break;
+            case JitBytecode::Instruction::_num:
+                if( cd < f->d_constNums.size() )
+                    add( Number, numberKey( f->d_constNums[cd].toDouble() ), fi, pc );
+                break;
+            case JitBytecode::Instruction::_lits:
+                add( Number, numberKey( qint16(cd) ), fi, pc );
+                break;
+            case JitBytecode::Instruction::_uv:
+                if( cd < f->d_upNames.size() && !f->d_upNames[cd].isEmpty() )
+                    add( Upval, f->d_upNames[cd], fi, pc );
+                break;
+            default:
+                break;
+            }
+
+            switch( op )
+            {
+            case JitBytecode::OP_CALL:
+                add( Args, QByteArray::number( cd - 1 ), fi, pc ); // C = nargs + 1
+                break;
+            case JitBytecode::OP_CALLT:
+                add( Args, QByteArray::number( cd - 1 ), fi, pc ); // D = nargs + 1
+                break;
+            case JitBytecode::OP_CALLM:
+            case JitBytecode::OP_CALLMT:
+                add( Args, QByteArray::number( cd ) + "+", fi, pc ); // fixed args plus MULTRES
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+const JitIndex::Postings& JitIndex::find(JitIndex::Kind k, const QByteArray& key) const
+{
+    static const Postings empty;
+    QHash<QByteArray,Postings>::const_iterator i = d_index[k].find(key);
+    if( i == d_index[k].end() )
+        return empty;
+    return i.value();
+}
+
+QList<QByteArray> JitIndex::keys(JitIndex::Kind k) const
+{
+    QList<QByteArray> res = d_index[k].keys();
+    std::sort( res.begin(), res.end() );
+    return res;
+}
+
+static JitIndex::Postings unite( const JitIndex::Postings& lhs, const JitIndex::Postings& rhs )
+{
+    JitIndex::Postings res;
+    res.reserve( lhs.size() + rhs.size() );
+    std::set_union( lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(res) );
+    return res;
+}
+
+static JitIndex::Postings intersect( const JitIndex::Postings& lhs, const JitIndex::Postings& rhs )
+{
+    JitIndex::Postings res;
+    std::set_intersection( lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(res) );
+    return res;
+}
+
+JitIndex::Postings JitIndex::query(const QString& str, QString* error) const
+{
+    Postings res;
+    bool first = true;
+    foreach( const QString& term, str.split( QChar(' '), QString::SkipEmptyParts ) )
+    {
+        Postings hits;
+        const int colon = term.indexOf(':');
+        if( colon > 0 )
+        {
+            const QString kind = term.left(colon).toLower();
+            const QByteArray key = term.mid(colon+1).toUtf8();
+            int k = 0;
+            while( k < MaxKind && kind != s_kindName[k] )
+                k++;
+            if( k == MaxKind )
+            {
+                if( error )
+                    *error = QString("unknown kind '%1'").arg(kind);
+                return Postings();
+            }
+            if( k == Number )
+            {
+                bool ok;
+                const double d = key.toDouble(&ok);
+                if( !ok )
+                {
+                    if( error )
+                        *error = QString("'%1' is not a number").arg(key.constData());
+                    return Postings();
+                }
+                hits = find( Number, numberKey(d) );
+            }else if( k == Op )
+                hits = find( Op, key.toUpper() );
+            else
+                hits = find( Kind(k), key );
+        }else
+        {
+            const QByteArray key = term.toUtf8();
+            hits = unite( find( Op, key.toUpper() ), find( Global, key ) );
+            hits = unite( hits, find( Upval, key ) );
+            hits = unite( hits, find( String, key ) );
+        }
+        if( first )
+            res = hits;
+        else
+            res = intersect( res, hits );
+        first = false;
+        if( res.isEmpty() )
+            break;
+    }
+    return res;
+}
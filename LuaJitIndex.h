@@ -0,0 +1,65 @@
+#ifndef LUAJITINDEX_H
+#define LUAJITINDEX_H
+
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <LjTools/LuaJitBytecode.h>
+
+namespace Lua
+{
+    // Inverted index of a JitBytecode, built in one pass over all instructions; maps op names, string
+    // and number constants, upvalue names, global names and the argument count of calls to the
+    // instructions using them.
+    class JitIndex
+    {
+    public:
+        enum Kind { Op, String, Number, Upval, Global, Args, MaxKind };
+        struct Posting
+        {
+            quint32 d_func; // index in JitBytecode::getFuncs
+            quint32 d_pc; // zero-based
+            bool operator<( const Posting& rhs ) const
+                { return d_func < rhs.d_func || ( d_func == rhs.d_func && d_pc < rhs.d_pc ); }
+            bool operator==( const Posting& rhs ) const { return d_func == rhs.d_func && d_pc == rhs.d_pc; }
+        };
+        typedef QVector<Posting> Postings; // ascending
+
+        JitIndex();
+        void build( const JitBytecode& );
+        void clear();
+        bool isEmpty() const { return d_count == 0; }
+        const Postings& find( Kind, const QByteArray& key ) const;
+        QList<QByteArray> keys( Kind ) const;
+
+        // Terms separated by blanks are and-combined; a term is kind:key with kind one of op, str,
+        // num, upval, global, args, e.g. "op:GGET global:print" or "args:2"; a term without kind
+        // matches op, global, upval or string of that name.
+        Postings query( const QString&, QString* error = 0 ) const;
+        static QByteArray numberKey( double );
+        static const char* s_kindName[];
+    protected:
+        void add( Kind, const QByteArray& key, quint32 func, quint32 pc );
+    private:
+        QHash<QByteArray,Postings> d_index[MaxKind];
+        quint32 d_count;
+    };
+}
+
+#endif // LUAJITINDEX_H
@@ -0,0 +1,361 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LuaJitLinker.h"
+#include "LuaJitComposer.h"
+#include <QMultiHash>
+using namespace Lua;
+
+typedef JitBytecode::Function Func;
+typedef JitBytecode::FuncRef FuncRef;
+
+static inline quint8 bcOp( quint32 bc ) { return bc & 0xff; }
+static inline quint8 bcC( quint32 bc ) { return ( bc >> 16 ) & 0xff; }
+static inline quint16 bcD( quint32 bc ) { return bc >> 16; }
+
+static inline bool isFunc( const QVariant& v )
+{
+    return v.canConvert<FuncRef>();
+}
+
+static uint hashFunc( const Func* f )
+{
+    uint h = f->d_numparams ^ ( f->d_framesize << 8 ) ^ ( f->d_upvals.size() << 16 );
+    foreach( quint32 bc, f->d_byteCodes )
+        h = h * 31 + bc;
+    return h ^ f->d_constObjs.size() ^ ( f->d_constNums.size() << 20 );
+}
+
+static bool sameNum( const QVariant& a, const QVariant& b )
+{
+    if( a.type() != b.type() )
+        return false;
+    if( a.type() == QVariant::Double )
+    {
+        // bitwise, so that 0.0 and -0.0 stay apart
+        const double x = a.toDouble();
+        const double y = b.toDouble();
+        return ::memcmp( &x, &y, sizeof(double) ) == 0;
+    }
+    return a == b;
+}
+
+static bool sameFunc( const Func* a, const Func* b, bool withDbg );
+
+static bool sameConst( const QVariant& a, const QVariant& b, bool withDbg )
+{
+    if( isFunc(a) || isFunc(b) )
+        return isFunc(a) && isFunc(b) &&
+                sameFunc( a.value<FuncRef>().constData(), b.value<FuncRef>().constData(), withDbg );
+    if( a.canConvert<JitBytecode::ConstTable>() || b.canConvert<JitBytecode::ConstTable>() )
+    {
+        if( !a.canConvert<JitBytecode::ConstTable>() || !b.canConvert<JitBytecode::ConstTable>() )
+            return false;
+        const JitBytecode::ConstTable ta = a.value<JitBytecode::ConstTable>();
+        const JitBytecode::ConstTable tb = b.value<JitBytecode::ConstTable>();
+        return ta.d_array == tb.d_array && ta.d_hash == tb.d_hash;
+    }
+    return a.type() == b.type() && a == b;
+}
+
+static bool sameFunc( const Func* a, const Func* b, bool withDbg )
+{
+    if( a == b )
+        return true;
+    if( a->d_flags != b->d_flags || a->d_numparams != b->d_numparams || a->d_framesize != b->d_framesize ||
+            a->d_byteCodes != b->d_byteCodes || a->d_upvals != b->d_upvals ||
+            a->d_constObjs.size() != b->d_constObjs.size() || a->d_constNums.size() != b->d_constNums.size() )
+        return false;
+    if( withDbg )
+    {
+        if( a->d_firstline != b->d_firstline || a->d_numline != b->d_numline || a->d_lines != b->d_lines ||
+                a->d_upNames != b->d_upNames || a->d_vars.size() != b->d_vars.size() )
+            return false;
+        for( int i = 0; i < a->d_vars.size(); i++ )
+        {
+            if( a->d_vars[i].d_name != b->d_vars[i].d_name || a->d_vars[i].d_startpc != b->d_vars[i].d_startpc ||
+                    a->d_vars[i].d_endpc != b->d_vars[i].d_endpc )
+                return false;
+        }
+    }
+    for( int i = 0; i < a->d_constNums.size(); i++ )
+    {
+        if( !sameNum( a->d_constNums[i], b->d_constNums[i] ) )
+            return false;
+    }
+    for( int i = 0; i < a->d_constObjs.size(); i++ )
+    {
+        if( !sameConst( a->d_constObjs[i], b->d_constObjs[i], withDbg ) )
+            return false;
+    }
+    return true;
+}
+
+static void collect( const FuncRef& f, QList<FuncRef>& res )
+{
+    res.append(f);
+    foreach( const QVariant& v, f->d_constObjs )
+    {
+        if( isFunc(v) )
+            collect( v.value<FuncRef>(), res );
+    }
+}
+
+JitLinker::JitLinker():d_stripped(false)
+{
+}
+
+bool JitLinker::addModule(const QByteArray& name, const JitBytecode& bc)
+{
+    if( name.isEmpty() )
+        return error("module name must not be empty");
+    foreach( const Module& m, d_mods )
+    {
+        if( m.d_name == name )
+            return error(QString("module %1 added twice").arg(name.constData()));
+    }
+    const Func* root = bc.getRoot();
+    if( root == 0 )
+        return error(QString("module %1 has no main function").arg(name.constData()));
+    if( !root->d_upvals.isEmpty() )
+        return error(QString("main function of module %1 has upvalues").arg(name.constData()));
+    Module m;
+    m.d_name = name;
+    m.d_stripped = bc.isStripped();
+    m.d_funcs = bc.getFuncs();
+    for( int i = 0; i < m.d_funcs.size(); i++ )
+    {
+        if( m.d_funcs[i].constData() == root )
+        {
+            m.d_funcs.move(i,0);
+            break;
+        }
+    }
+    d_mods.append(m);
+    return true;
+}
+
+bool JitLinker::addModule(const QByteArray& name, const QString& path)
+{
+    JitBytecode bc;
+    if( !bc.parse(path) )
+        return error(QString("cannot parse %1").arg(path));
+    return addModule(name,bc);
+}
+
+bool JitLinker::write(QIODevice* out, const QString& path)
+{
+    JitComposer c;
+    if( !compose(c,path) )
+        return false;
+    const bool ok = c.write(out,path);
+    d_issues = c.getIssues();
+    if( !ok && d_issues.isEmpty() )
+        return error("cannot write the linked bytecode");
+    return ok;
+}
+
+bool JitLinker::write(const QString& file)
+{
+    JitComposer c;
+    if( !compose(c,file) )
+        return false;
+    const bool ok = c.write(file);
+    d_issues = c.getIssues();
+    if( !ok && d_issues.isEmpty() )
+        return error(QString("cannot write %1").arg(file));
+    return ok;
+}
+
+void JitLinker::clear()
+{
+    d_mods.clear();
+    d_errors.clear();
+    d_issues.clear();
+    d_stats = Stats();
+}
+
+bool JitLinker::compose(JitComposer& c, const QString& path)
+{
+    d_issues.clear();
+    d_stats = Stats();
+    if( d_mods.isEmpty() )
+        return error("no modules to link");
+
+    // a dump is either stripped as a whole or not at all
+    bool withDbg = !d_stripped;
+    foreach( const Module& m, d_mods )
+    {
+        if( m.d_stripped )
+            withDbg = false;
+    }
+    quint32 line = 0;
+    if( withDbg )
+        line = JitComposer::isRowCol() ? JitComposer::packRowCol(1,1) : 1;
+
+    c.setStripped(!withDbg);
+    c.openFunction( 0, path.isEmpty() ? QByteArray("=linked") : path.toUtf8(), line, line, true );
+    const FuncRef main = c.getFuncs().first();
+    c.GGET( 0, "package", line );
+    c.TGET( 0, 0, "preload", line );
+
+    QMultiHash<uint,int> done; // hash of the main function -> module
+    QVector<int> slotOf(d_mods.size());
+    QList<FuncRef> mains;
+    for( int i = 0; i < d_mods.size(); i++ )
+    {
+        const Module& m = d_mods[i];
+
+        // work on copies, so the modules can be linked again with other options
+        const QList<FuncRef> copies = JitComposer::copyFunctions(m.d_funcs);
+        foreach( const FuncRef& f, copies )
+        {
+            f->d_isRoot = false;
+            if( !withDbg )
+            {
+                f->d_lines.clear();
+                f->d_upNames.clear();
+                f->d_vars.clear();
+                f->d_varNames.clear();
+            }
+            for( int j = 0; j < f->d_constObjs.size(); j++ )
+            {
+                if( isFunc(f->d_constObjs[j]) )
+                    f->d_constObjs[j].value<FuncRef>()->d_outer = f.data();
+            }
+        }
+        const FuncRef root = copies.first();
+        root->d_outer = main.data();
+        compact( root.data(), withDbg );
+        mains.append(root);
+
+        const uint h = hashFunc(root.data());
+        int slot = -1;
+        QMultiHash<uint,int>::const_iterator j = done.constFind(h);
+        while( slot < 0 && j != done.constEnd() && j.key() == h )
+        {
+            if( sameFunc( mains[j.value()].constData(), root.constData(), withDbg ) )
+                slot = slotOf[j.value()];
+            ++j;
+        }
+        if( slot < 0 )
+        {
+            QList<FuncRef> funcs;
+            collect( root, funcs );
+            slot = c.addFunction(funcs);
+            done.insert(h,i);
+        }else
+            d_stats.d_sharedModules++;
+        slotOf[i] = slot;
+
+        c.FNEW( 1, slot, line );
+        if( c.getConstSlot(m.d_name) <= 255 )
+            c.TSET( 1, 0, m.d_name, line );
+        else
+        {
+            // TSETS only reaches the first 256 constants
+            c.KSET( 2, m.d_name, line );
+            c.TSET( 1, 0, quint8(2), line );
+        }
+    }
+    c.RET(line);
+    c.closeFunction(3);
+
+    for( int i = 0; i < c.getFuncs().size(); i++ )
+        c.getFuncs()[i]->d_id = i;
+    d_stats.d_modules = d_mods.size();
+    d_stats.d_funcs = c.getFuncs().size();
+    return true;
+}
+
+void JitLinker::compact(Func* f, bool withDbg)
+{
+    // Children first, so that equal children have equal grandchildren as well. The operands index the
+    // object constants from the end; the constants are visited from the end too and a duplicate is merged
+    // into the one nearer to the end, so no index grows and C operands of TGETS/TSETS etc. still fit.
+    const int n = f->d_constObjs.size();
+    QVector<int> map(n); // position -> operand index after merging
+    JitBytecode::VariantList objs; // in operand order, i.e. reversed
+    QMultiHash<uint,int> funcs;
+    for( int i = n - 1; i >= 0; i-- )
+    {
+        const QVariant& v = f->d_constObjs[i];
+        int to = -1;
+        if( isFunc(v) )
+        {
+            Func* child = v.value<FuncRef>().data();
+            compact( child, withDbg );
+            const uint h = hashFunc(child);
+            QMultiHash<uint,int>::const_iterator j = funcs.constFind(h);
+            while( to < 0 && j != funcs.constEnd() && j.key() == h )
+            {
+                if( sameFunc( objs[j.value()].value<FuncRef>().constData(), child, withDbg ) )
+                    to = j.value();
+                ++j;
+            }
+            if( to >= 0 )
+                d_stats.d_mergedFuncs++;
+            else
+                funcs.insert(h,objs.size());
+        }
+        if( to < 0 )
+        {
+            to = objs.size();
+            objs.append(v);
+        }
+        map[i] = to;
+    }
+    if( objs.size() == n )
+        return;
+
+    for( int pc = 0; pc < f->d_byteCodes.size(); pc++ )
+    {
+        quint32& bc = f->d_byteCodes[pc];
+        const quint8 op = bcOp(bc);
+        switch( JitBytecode::typeCdFromOp(op) )
+        {
+        case JitBytecode::Instruction::_str:
+        case JitBytecode::Instruction::_func:
+        case JitBytecode::Instruction::_tab:
+        case JitBytecode::Instruction::_cdata:
+            break;
+        default:
+            continue;
+        }
+        const bool isAd = JitBytecode::formatFromOp(op) == JitBytecode::AD;
+        const int k = isAd ? bcD(bc) : bcC(bc);
+        if( k >= n )
+            continue; // left to the verifier
+        const quint32 nk = map[n - 1 - k];
+        Q_ASSERT( nk <= quint32(k) );
+        if( isAd )
+            bc = ( bc & 0xffff ) | ( nk << 16 );
+        else
+            bc = ( bc & 0xff00ffff ) | ( nk << 16 );
+    }
+    f->d_constObjs.resize(objs.size());
+    for( int i = 0; i < objs.size(); i++ )
+        f->d_constObjs[objs.size() - i - 1] = objs[i];
+}
+
+bool JitLinker::error(const QString& msg)
+{
+    d_errors << msg;
+    return false;
+}
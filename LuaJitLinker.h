@@ -0,0 +1,80 @@
+#ifndef LUAJITLINKER_H
+#define LUAJITLINKER_H
+
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <LjTools/LuaJitVerifier.h>
+#include <QStringList>
+
+namespace Lua
+{
+    class JitComposer;
+
+    // Links the dumps of several modules into a single chunk which assigns the main function of each module
+    // to package.preload[name] and returns; require then finds the modules without loading further files.
+    // The format has no constant pool shared between prototypes, and LuaJIT interns strings when loading anyway;
+    // within a prototype the LuaJIT parser and JitComposer already keep each constant once, so strings are left
+    // as they are. Structurally identical child prototypes of the same parent are merged and the FNEW operands
+    // renumbered; modules with identical code are emitted once and registered under each name. Since a dump has only one chunk name,
+    // tracebacks of linked code show the name of the linked file with the line numbers of the module.
+    class JitLinker
+    {
+    public:
+        struct Stats
+        {
+            quint32 d_modules;
+            quint32 d_sharedModules; // modules which reuse the code of an identical one
+            quint32 d_funcs;         // prototypes written, including the linker main function
+            quint32 d_mergedFuncs;
+            Stats():d_modules(0),d_sharedModules(0),d_funcs(0),d_mergedFuncs(0){}
+        };
+
+        JitLinker();
+        bool addModule( const QByteArray& name, const JitBytecode& );
+        bool addModule( const QByteArray& name, const QString& path );
+        // debug info is also stripped if any of the modules comes without
+        void setStripped(bool on) { d_stripped = on; }
+        bool write(QIODevice* out, const QString& path = QString() );
+        bool write( const QString& file );
+        const QStringList& getErrors() const { return d_errors; }
+        const JitVerifier::Issues& getIssues() const { return d_issues; }
+        const Stats& getStats() const { return d_stats; }
+        void clear();
+    protected:
+        typedef QList<JitBytecode::FuncRef> FuncList;
+        struct Module
+        {
+            QByteArray d_name;
+            FuncList d_funcs; // as parsed, main function first
+            bool d_stripped;
+        };
+        bool compose( JitComposer&, const QString& path );
+        void compact( JitBytecode::Function*, bool withDbg );
+        bool error( const QString& );
+    private:
+        QList<Module> d_mods;
+        QStringList d_errors;
+        JitVerifier::Issues d_issues;
+        Stats d_stats;
+        bool d_stripped;
+    };
+}
+
+#endif // LUAJITLINKER_H
@@ -0,0 +1,327 @@
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "LuaJitVerifier.h"
+using namespace Lua;
+
+static inline quint8 bcOp( quint32 bc ) { return bc & 0xff; }
+static inline quint8 bcA( quint32 bc ) { return ( bc >> 8 ) & 0xff; }
+static inline quint8 bcB( quint32 bc ) { return bc >> 24; }
+static inline quint8 bcC( quint32 bc ) { return ( bc >> 16 ) & 0xff; }
+static inline quint16 bcD( quint32 bc ) { return bc >> 16; }
+
+QString JitVerifier::Issue::toString() const
+{
+    QString res;
+    if( d_func )
+        res = QString("function %1").arg(d_func->d_id);
+    if( d_pc >= 0 )
+        res += QString(" pc %1").arg(d_pc + 1); // same numbering as the viewer
+    if( d_line )
+        res += QString(" line %1").arg(d_line);
+    return res + ": " + d_msg;
+}
+
+JitVerifier::JitVerifier()
+{
+}
+
+bool JitVerifier::verify(const JitBytecode& bc)
+{
+    const int count = d_issues.size();
+    foreach( const JitBytecode::FuncRef& f, bc.getFuncs() )
+        verify(f.constData());
+    return d_issues.size() == count;
+}
+
+void JitVerifier::error(const JitBytecode::Function* f, int pc, const QString& msg)
+{
+    quint32 line = 0;
+    if( pc >= 0 && pc < f->d_lines.size() )
+        line = f->d_lines[pc];
+    else if( !f->isStripped() )
+        line = f->d_firstline;
+    d_issues.append( Issue(f,pc,line,msg) );
+}
+
+void JitVerifier::checkSlot(const JitBytecode::Function* f, int pc, int slot)
+{
+    if( slot < 0 || slot >= f->d_framesize )
+        error(f,pc,QString("%1 slot %2 out of frame of size %3")
+              .arg(JitBytecode::nameOfOp(bcOp(f->d_byteCodes[pc]))).arg(slot).arg(f->d_framesize));
+}
+
+void JitVerifier::checkBase(const JitBytecode::Function* f, int pc, int slot)
+{
+    // a read-only base may point just past the frame, e.g. JMP, LOOP and UCLO carry the first free slot
+    if( slot < 0 || slot > f->d_framesize )
+        error(f,pc,QString("%1 base %2 out of frame of size %3")
+              .arg(JitBytecode::nameOfOp(bcOp(f->d_byteCodes[pc]))).arg(slot).arg(f->d_framesize));
+}
+
+void JitVerifier::checkChild(const JitBytecode::Function* f, int pc, const QVariant& v)
+{
+    const JitBytecode::FuncRef child = v.value<JitBytecode::FuncRef>();
+    if( child.constData() == 0 )
+    {
+        error(f,pc,"FNEW references a null function");
+        return;
+    }
+    if( child->d_outer != 0 && child->d_outer != f )
+        error(f,pc,QString("FNEW references function %1 of another outer function").arg(child->d_id));
+    for( int i = 0; i < child->d_upvals.size(); i++ )
+    {
+        const int uv = child->getUpval(i);
+        if( child->isLocalUpval(i) )
+        {
+            if( uv >= f->d_framesize )
+                error(f,pc,QString("upvalue %1 of function %2 refers to slot %3 out of frame")
+                      .arg(i).arg(child->d_id).arg(uv));
+        }else if( uv >= f->d_upvals.size() )
+            error(f,pc,QString("upvalue %1 of function %2 refers to missing upvalue %3")
+                  .arg(i).arg(child->d_id).arg(uv));
+    }
+}
+
+bool JitVerifier::verify(const JitBytecode::Function* f)
+{
+    Q_ASSERT( f != 0 );
+    const int count = d_issues.size();
+    const JitBytecode::CodeList& code = f->d_byteCodes;
+    const int len = code.size();
+    const int fs = f->d_framesize;
+
+    if( fs > MaxSlots )
+        error(f,-1,QString("frame size %1 exceeds %2 slots").arg(fs).arg(int(MaxSlots)));
+    if( f->d_numparams > fs )
+        error(f,-1,QString("%1 parameters don't fit in frame of size %2").arg(f->d_numparams).arg(fs));
+    if( !f->d_lines.isEmpty() && f->d_lines.size() != len )
+        error(f,-1,QString("%1 line entries for %2 instructions").arg(f->d_lines.size()).arg(len));
+    if( len == 0 )
+    {
+        error(f,-1,"function has no code");
+        return false;
+    }
+
+    for( int pc = 0; pc < len; pc++ )
+    {
+        const quint32 bc = code[pc];
+        const quint8 op = bcOp(bc);
+        if( op > JitBytecode::OP_JMP )
+        {
+            error(f,pc,QString("invalid opcode %1").arg(op));
+            continue;
+        }
+        const int a = bcA(bc);
+        const int b = bcB(bc);
+        const int c = bcC(bc);
+        const int d = bcD(bc);
+        const JitBytecode::Instruction::FieldType ta = JitBytecode::typeAFromOp(op);
+        const JitBytecode::Instruction::FieldType tb = JitBytecode::typeBFromOp(op);
+        const JitBytecode::Instruction::FieldType tcd = JitBytecode::typeCdFromOp(op);
+        const bool isAd = JitBytecode::formatFromOp(op) == JitBytecode::AD;
+
+        switch( ta )
+        {
+        case JitBytecode::Instruction::_var:
+        case JitBytecode::Instruction::_dst:
+        case JitBytecode::Instruction::_base:
+            checkSlot(f,pc,a);
+            break;
+        case JitBytecode::Instruction::_rbase:
+            checkBase(f,pc,a);
+            break;
+        case JitBytecode::Instruction::_uv:
+            if( a >= f->d_upvals.size() )
+                error(f,pc,QString("upvalue %1 out of range").arg(a));
+            break;
+        default:
+            break;
+        }
+        if( !isAd && tb == JitBytecode::Instruction::_var )
+            checkSlot(f,pc,b);
+        else if( !isAd && tb == JitBytecode::Instruction::_rbase )
+            checkBase(f,pc,b);
+
+        const int cd = isAd ? d : c;
+        switch( tcd )
+        {
+        case JitBytecode::Instruction::_var:
+        case JitBytecode::Instruction::_dst:
+        case JitBytecode::Instruction::_base:
+            checkSlot(f,pc,cd);
+            break;
+        case JitBytecode::Instruction::_rbase:
+            checkBase(f,pc,cd);
+            break;
+        case JitBytecode::Instruction::_num:
+            if( cd >= f->d_constNums.size() )
+                error(f,pc,QString("number constant %1 out of range").arg(cd));
+            break;
+        case JitBytecode::Instruction::_str:
+        case JitBytecode::Instruction::_tab:
+        case JitBytecode::Instruction::_func:
+        case JitBytecode::Instruction::_cdata:
+            if( cd >= f->d_constObjs.size() )
+                error(f,pc,QString("object constant %1 out of range").arg(cd));
+            else
+            {
+                // negated index
+                const QVariant& v = f->d_constObjs[f->d_constObjs.size() - cd - 1];
+                if( tcd == JitBytecode::Instruction::_str && !JitBytecode::isString(v) )
+                    error(f,pc,QString("object constant %1 is not a string").arg(cd));
+                else if( tcd == JitBytecode::Instruction::_tab && !v.canConvert<JitBytecode::ConstTable>() )
+                    error(f,pc,QString("object constant %1 is not a table").arg(cd));
+                else if( tcd == JitBytecode::Instruction::_func )
+                {
+                    if( !v.canConvert<JitBytecode::FuncRef>() )
+                        error(f,pc,QString("object constant %1 is not a function").arg(cd));
+                    else
+                        checkChild(f,pc,v);
+                }
+            }
+            break;
+        case JitBytecode::Instruction::_pri:
+            if( cd > 2 )
+                error(f,pc,QString("invalid primitive %1").arg(cd));
+            break;
+        case JitBytecode::Instruction::_uv:
+            if( cd >= f->d_upvals.size() )
+                error(f,pc,QString("upvalue %1 out of range").arg(cd));
+            break;
+        case JitBytecode::Instruction::_jump:
+            {
+                const int target = pc + 1 + cd - JitBytecode::Instruction::JumpBias;
+                if( target < 0 || target >= len )
+                    error(f,pc,QString("jump target %1 out of range").arg(target + 1));
+            }
+            break;
+        default:
+            break;
+        }
+
+        // the ranges implied by the operands
+        switch( op )
+        {
+        case JitBytecode::OP_ISLT:
+        case JitBytecode::OP_ISGE:
+        case JitBytecode::OP_ISLE:
+        case JitBytecode::OP_ISGT:
+        case JitBytecode::OP_ISEQV:
+        case JitBytecode::OP_ISNEV:
+        case JitBytecode::OP_ISEQS:
+        case JitBytecode::OP_ISNES:
+        case JitBytecode::OP_ISEQN:
+        case JitBytecode::OP_ISNEN:
+        case JitBytecode::OP_ISEQP:
+        case JitBytecode::OP_ISNEP:
+        case JitBytecode::OP_ISTC:
+        case JitBytecode::OP_ISFC:
+        case JitBytecode::OP_IST:
+        case JitBytecode::OP_ISF:
+            if( pc + 1 >= len || bcOp(code[pc+1]) != JitBytecode::OP_JMP )
+                error(f,pc,"test not followed by JMP");
+            break;
+        case JitBytecode::OP_KNIL:
+            if( d < a )
+                error(f,pc,"KNIL range is empty");
+            break;
+        case JitBytecode::OP_CAT:
+            if( c < b )
+                error(f,pc,"CAT range is empty");
+            break;
+        case JitBytecode::OP_CALL:
+            if( c == 0 )
+                error(f,pc,"CALL without function slot");
+            checkSlot(f,pc,a+c-1);
+            if( b > 1 )
+                checkSlot(f,pc,a+b-2);
+            break;
+        case JitBytecode::OP_CALLM:
+            checkSlot(f,pc,a+c);
+            if( b > 1 )
+                checkSlot(f,pc,a+b-2);
+            break;
+        case JitBytecode::OP_CALLT:
+            if( d == 0 )
+                error(f,pc,"CALLT without function slot");
+            checkSlot(f,pc,a+d-1);
+            break;
+        case JitBytecode::OP_CALLMT:
+            checkSlot(f,pc,a+d);
+            break;
+        case JitBytecode::OP_VARG:
+            if( b > 1 )
+                checkSlot(f,pc,a+b-2);
+            break;
+        case JitBytecode::OP_RET:
+            if( d > 1 )
+                checkSlot(f,pc,a+d-2);
+            break;
+        case JitBytecode::OP_RETM:
+            if( d > 0 )
+                checkSlot(f,pc,a+d-1);
+            break;
+        case JitBytecode::OP_ITERC:
+        case JitBytecode::OP_ITERN:
+            if( a < 3 )
+                error(f,pc,"iterator base below slot 3");
+            checkSlot(f,pc,a+2);
+            if( b > 1 )
+                checkSlot(f,pc,a+b-2);
+            break;
+        case JitBytecode::OP_ISNEXT:
+            if( a < 3 )
+                error(f,pc,"iterator base below slot 3");
+            break;
+        case JitBytecode::OP_ITERL:
+        case JitBytecode::OP_IITERL:
+        case JitBytecode::OP_JITERL:
+        case JitBytecode::OP_TSETM:
+            if( a < 1 )
+                error(f,pc,"base must be above slot 0");
+            break;
+        case JitBytecode::OP_FORI:
+        case JitBytecode::OP_JFORI:
+        case JitBytecode::OP_FORL:
+        case JitBytecode::OP_IFORL:
+        case JitBytecode::OP_JFORL:
+            checkSlot(f,pc,a+3);
+            break;
+        default:
+            break;
+        }
+    }
+
+    switch( bcOp(code.last()) )
+    {
+    case JitBytecode::OP_RETM:
+    case JitBytecode::OP_RET:
+    case JitBytecode::OP_RET0:
+    case JitBytecode::OP_RET1:
+    case JitBytecode::OP_CALLT:
+    case JitBytecode::OP_CALLMT:
+    case JitBytecode::OP_JMP:
+        break;
+    default:
+        error(f,len-1,"function doesn't end with a return");
+        break;
+    }
+    return d_issues.size() == count;
+}
@@ -0,0 +1,61 @@
+#ifndef LUAJITVERIFIER_H
+#define LUAJITVERIFIER_H
+
+/*
+* Copyright 2020 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the JuaJIT BC Viewer application.
+*
+* The following is the license that applies to this copy of the
+* application. For a license to use the application under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <LjTools/LuaJitBytecode.h>
+
+namespace Lua
+{
+    // Checks the prototypes of a JitBytecode in one linear pass over each function, i.e. the things
+    // LuaJIT takes for granted when loading or running the code: slot operands within the frame,
+    // jump targets, constant, upvalue and child function references and the return at the end.
+    class JitVerifier
+    {
+    public:
+        enum { MaxSlots = 250 }; // LJ_MAX_SLOTS
+        struct Issue
+        {
+            const JitBytecode::Function* d_func;
+            int d_pc; // -1 if the issue concerns the whole function
+            quint32 d_line; // as in Function::d_lines, or d_firstline; 0 if stripped
+            QString d_msg;
+            Issue(const JitBytecode::Function* f = 0, int pc = -1, quint32 line = 0, const QString& msg = QString()):
+                d_func(f),d_pc(pc),d_line(line),d_msg(msg){}
+            QString toString() const;
+        };
+        typedef QList<Issue> Issues;
+
+        JitVerifier();
+        bool verify( const JitBytecode& ); // all functions
+        bool verify( const JitBytecode::Function* );
+        const Issues& getIssues() const { return d_issues; }
+        void clear() { d_issues.clear(); }
+    protected:
+        void error( const JitBytecode::Function*, int pc, const QString& );
+        void checkSlot( const JitBytecode::Function*, int pc, int slot );
+        void checkBase( const JitBytecode::Function*, int pc, int slot );
+        void checkChild( const JitBytecode::Function*, int pc, const QVariant& );
+    private:
+        Issues d_issues;
+    };
+}
+
+#endif // LUAJITVERIFIER_H
@@ -21,6 +21,8 @@
 #include "LuaLexer.h"
 #include "LuaParser.h"
 #include "LjasErrors.h"
+#include <QDataStream>
+#include <QSet>
 #include <QtDebug>
 using namespace Lua;
 
@@ -101,7 +103,7 @@ static void dumpTree( Lua::Module::Thing* node, int level = 0)
     }
 }
 
-Module::Module(QObject *parent) : QObject(parent),d_fcache(0),d_err(0)
+Module::Module(QObject *parent) : QObject(parent),d_fcache(0),d_err(0),d_msgStart(0),d_msgCount(0)
 {
 
 }
@@ -118,8 +120,10 @@ bool Module::parse(const QString& path, bool clearGlobal)
         initBuiltIns(d_global.data());
     }
     d_nonLocals.clear();
+    d_globalRefs.clear();
     d_path = path;
     const quint32 before = d_err ? d_err->getErrCount() : 0;
+    d_msgStart = d_err ? d_err->getAll().size() : 0;
     Lexer lex;
     lex.setErrors(d_err);
     lex.setCache(d_fcache);
@@ -128,6 +132,7 @@ bool Module::parse(const QString& path, bool clearGlobal)
     lex.setStream( path );
     Parser p(&lex,d_err);
     p.RunParser();
+    d_msgCount = d_err ? d_err->getAll().size() - d_msgStart : 0;
     bool hasError = ( d_err->getErrCount() - before ) != 0;
     if( !hasError )
     {
@@ -139,12 +144,127 @@ bool Module::parse(const QString& path, bool clearGlobal)
             dumpTree(d_nonLocals[i].data());
 #endif
     }
+    buildIndex();
     if( d_err )
         return !hasError;
     else
         return true;
 }
 
+static inline quint64 toPos( const Module::Thing* t )
+{
+    return ( quint64(t->d_tok.d_lineNr) << 16 ) | t->d_tok.d_colNr;
+}
+
+struct PosLess
+{
+    bool operator()( quint64 pos, const Module::Thing* t ) const { return pos < toPos(t); }
+    bool operator()( const Module::Thing* lhs, const Module::Thing* rhs ) const { return toPos(lhs) < toPos(rhs); }
+};
+
+struct SpanLess
+{
+    bool operator()( const Module::Span& lhs, const Module::Span& rhs ) const
+    {
+        return lhs.d_line < rhs.d_line || ( lhs.d_line == rhs.d_line && lhs.d_col < rhs.d_col );
+    }
+};
+
+void Module::buildIndex()
+{
+    // same things in the same order as the former recursive search, so ties are resolved the same way
+    d_index.clear();
+    d_useIndex.clear();
+    d_spans.clear();
+    if( !d_topChunk.isNull() )
+        index( d_topChunk.data() );
+    for( int i = 0; i < d_nonLocals.size(); i++ )
+        index( d_nonLocals[i].data() );
+    std::stable_sort( d_index.begin(), d_index.end(), PosLess() );
+    std::stable_sort( d_spans.begin(), d_spans.end(), SpanLess() );
+    for( int i = 0; i < d_index.size(); i++ )
+    {
+        if( d_index[i]->getTag() == Thing::T_SymbolUse )
+        {
+            SymbolUse* use = static_cast<SymbolUse*>( d_index[i] );
+            d_useIndex[use->d_sym].append(use);
+        }
+    }
+}
+
+static bool isUpvalue( const Module::Scope* scope, const Module::Thing* decl )
+{
+    // decl is a local of an enclosing function if a function boundary lies between the scope of the use
+    // and the scope declaring it
+    bool crossed = false;
+    while( scope )
+    {
+        if( scope->d_names.value( decl->d_tok.d_val.constData() ).data() == decl )
+            return crossed;
+        if( scope->getTag() == Module::Thing::T_Function )
+            crossed = true;
+        scope = scope->d_outer;
+    }
+    return false;
+}
+
+void Module::addSpan(const Module::Thing* t, quint8 kind)
+{
+    if( t->d_tok.d_type != Tok_Name || t->d_tok.d_lineNr == 0 )
+        return;
+    Span s;
+    s.d_line = t->d_tok.d_lineNr;
+    s.d_col = t->d_tok.d_colNr;
+    s.d_len = t->d_tok.d_len;
+    s.d_kind = kind;
+    d_spans.append(s);
+}
+
+void Module::index(Module::Thing* node)
+{
+    d_index.append(node);
+    if( !node->isScope() )
+        return;
+    Scope* scope = static_cast<Scope*>(node);
+    foreach( const Ref<Thing>& n, scope->d_locals )
+    {
+        addSpan( n.data(), LocalSpan );
+        index( n.data() );
+    }
+    foreach( const Ref<Block>& n, scope->d_stats )
+        index( n.data() );
+    foreach( const Ref<SymbolUse>& n, scope->d_refs )
+    {
+        const Thing* sym = n->d_sym;
+        if( sym == 0 )
+            ;
+        else if( sym->getTag() == Thing::T_GlobalSym )
+            addSpan( n.data(), static_cast<const GlobalSym*>(sym)->d_builtIn ? BuiltInSpan : ImplicitGlobalSpan );
+        else if( sym->getTag() == Thing::T_Function && static_cast<const Function*>(sym)->d_kind == Function::Global )
+            addSpan( n.data(), GlobalSpan );
+        else
+            addSpan( n.data(), isUpvalue( scope, sym ) ? UpvalSpan : LocalSpan );
+        index( n.data() );
+    }
+    if( node->getTag() == Thing::T_Function && static_cast<Function*>(node)->d_kind == Function::Global )
+        addSpan( node, GlobalSpan );
+}
+
+Module::Thing*Module::findSymbolBySourcePos(quint32 line, quint16 col) const
+{
+    const quint64 pos = ( quint64(line) << 16 ) | col;
+    QVector<Thing*>::const_iterator i = std::upper_bound( d_index.begin(), d_index.end(), pos, PosLess() );
+    if( i == d_index.begin() )
+        return 0;
+    --i;
+    while( i != d_index.begin() && toPos(*(i-1)) == toPos(*i) )
+        --i;
+    Thing* res = *i;
+    if( res->d_tok.d_lineNr == line && res->d_tok.d_colNr <= col && col <= ( res->d_tok.d_colNr + res->d_tok.d_len ) )
+        return res;
+    return 0;
+}
+
 void Module::initBuiltIns(Global* g)
 {
     addBuiltInSym(g,"_G");
@@ -186,6 +306,333 @@ void Module::addBuiltInSym(Global* g, const QByteArray& name)
     g->d_names.insert(sym->d_tok.d_val.constData(),sym);
 }
 
+enum { AnalysisVersion = 2 };
+enum Rel { R_Top, R_NonLocal, R_Local, R_Stat, R_Ref };
+
+struct ThingRec
+{
+    const Module::Thing* d_thing;
+    quint8 d_rel;
+    qint32 d_parent;
+    ThingRec(const Module::Thing* t = 0, quint8 rel = R_Top, qint32 parent = -1 ):d_thing(t),d_rel(rel),d_parent(parent){}
+};
+
+static void collect( const Module::Thing* t, quint8 rel, qint32 parent, QList<ThingRec>& recs,
+                     QHash<const Module::Thing*,qint32>& ids )
+{
+    const qint32 id = recs.size();
+    ids.insert(t,id);
+    recs.append(ThingRec(t,rel,parent));
+    if( !t->isScope() )
+        return;
+    const Module::Scope* scope = static_cast<const Module::Scope*>(t);
+    foreach( const Module::Ref<Module::Thing>& n, scope->d_locals )
+        collect( n.data(), R_Local, id, recs, ids );
+    foreach( const Module::Ref<Module::Block>& n, scope->d_stats )
+        collect( n.data(), R_Stat, id, recs, ids );
+    foreach( const Module::Ref<Module::SymbolUse>& n, scope->d_refs )
+        collect( n.data(), R_Ref, id, recs, ids );
+}
+
+QByteArray Module::saveAnalysis() const
+{
+    if( d_topChunk.isNull() )
+        return QByteArray();
+    const Ljas::Errors::EntryList msgs = d_err ? d_err->getAll().mid(d_msgStart,d_msgCount) : Ljas::Errors::EntryList();
+    foreach( const Ljas::Errors::Entry& e, msgs )
+    {
+        if( e.d_isErr )
+            return QByteArray(); // the tree is from an earlier parse
+    }
+
+    QList<ThingRec> recs;
+    QHash<const Thing*,qint32> ids;
+    collect( d_topChunk.data(), R_Top, -1, recs, ids );
+    for( int i = 0; i < d_nonLocals.size(); i++ )
+        collect( d_nonLocals[i].data(), R_NonLocal, -1, recs, ids );
+
+    QSet<const Thing*> globalUses;
+    foreach( const GlobalRef& r, d_globalRefs )
+        globalUses.insert(r.d_thing.data());
+
+    QByteArray res;
+    QDataStream out(&res,QIODevice::WriteOnly);
+    out << quint16(AnalysisVersion);
+
+    out << quint32(msgs.size());
+    foreach( const Ljas::Errors::Entry& e, msgs )
+        out << e.d_source << e.d_line << e.d_col << e.d_msg << e.d_file;
+
+    out << quint32(recs.size());
+    foreach( const ThingRec& r, recs )
+    {
+        const Thing* t = r.d_thing;
+        qint32 parent = r.d_parent;
+        if( r.d_rel == R_NonLocal )
+            parent = ids.value( static_cast<const Function*>(t)->d_outer, -1 );
+        out << quint8(t->getTag()) << r.d_rel << parent;
+        out << quint16(t->d_tok.d_type) << t->d_tok.d_lineNr << t->d_tok.d_colNr << t->d_tok.d_len << t->d_tok.d_val
+            << quint8(!t->d_tok.d_sourcePath.isEmpty());
+        switch( t->getTag() )
+        {
+        case Thing::T_Function:
+            out << static_cast<const Function*>(t)->d_parCount << static_cast<const Function*>(t)->d_kind;
+            break;
+        case Thing::T_SymbolUse:
+            {
+                const SymbolUse* use = static_cast<const SymbolUse*>(t);
+                // -1: resolved via the global scope, see d_globalRefs
+                out << quint8(use->d_lhs) << ( globalUses.contains(use) ? -1 : ids.value(use->d_sym,-1) );
+            }
+            break;
+        }
+    }
+
+    // the uses of global functions are restored when replaying d_globalRefs
+    foreach( const ThingRec& r, recs )
+    {
+        const Thing* t = r.d_thing;
+        QList<qint32> uses;
+        if( t->getTag() != Thing::T_Function || static_cast<const Function*>(t)->d_kind != Function::Global )
+        {
+            foreach( const Ref<SymbolUse>& use, t->d_uses )
+            {
+                const qint32 id = ids.value(use.data(),-1);
+                if( id >= 0 )
+                    uses.append(id);
+            }
+        }
+        out << quint32(uses.size());
+        foreach( qint32 id, uses )
+            out << id;
+    }
+
+    // implicit declarations are not part of the tree, so they are written out with the id of their scope
+    out << quint32(d_globalRefs.size());
+    foreach( const GlobalRef& r, d_globalRefs )
+    {
+        const Thing* t = r.d_thing.data();
+        if( t->isImplicitDecl() )
+            out << qint32(-1) << ids.value(r.d_scope,-1) << quint8(t->isLhsUse()) << t->d_tok.d_lineNr
+                << t->d_tok.d_colNr << t->d_tok.d_len << t->d_tok.d_val;
+        else
+            out << ids.value(t,-1);
+    }
+    return res;
+}
+
+bool Module::loadAnalysis(const QString& path, const QByteArray& data)
+{
+    // first read and check everything, then modify the global state
+    QDataStream in(data);
+    quint16 version;
+    in >> version;
+    if( version != AnalysisVersion )
+        return false;
+
+    quint32 count;
+    in >> count;
+    Ljas::Errors::EntryList msgs;
+    for( quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++ )
+    {
+        Ljas::Errors::Entry e;
+        in >> e.d_source >> e.d_line >> e.d_col >> e.d_msg >> e.d_file;
+        e.d_isErr = false;
+        msgs.append(e);
+    }
+
+    const QByteArray sourcePath = Lexer::getSymbol(path.toUtf8());
+    in >> count;
+    if( in.status() != QDataStream::Ok || count == 0 || int(count) > data.size() )
+        return false;
+    QVector< Ref<Thing> > things(count);
+    QVector<qint32> outers(count,-1), syms(count,-1), owners(count,-1);
+    Ref<Block> top;
+    QList< Ref<Function> > nonLocals;
+    for( quint32 i = 0; i < count; i++ )
+    {
+        quint8 tag, rel, hasPath;
+        qint32 parent;
+        quint16 type;
+        Token tok;
+        in >> tag >> rel >> parent >> type >> tok.d_lineNr >> tok.d_colNr >> tok.d_len >> tok.d_val >> hasPath;
+        if( in.status() != QDataStream::Ok )
+            return false;
+        tok.d_type = type;
+        if( tok.d_type == Tok_Name )
+            tok.d_val = Lexer::getSymbol(tok.d_val);
+        if( hasPath )
+            tok.d_sourcePath = sourcePath;
+
+        Thing* t = 0;
+        switch( tag )
+        {
+        case Thing::T_Variable:
+            t = new Variable();
+            break;
+        case Thing::T_Block:
+            t = new Block();
+            break;
+        case Thing::T_Function:
+            {
+                Function* f = new Function();
+                in >> f->d_parCount >> f->d_kind;
+                t = f;
+            }
+            break;
+        case Thing::T_SymbolUse:
+            {
+                SymbolUse* use = new SymbolUse();
+                quint8 lhs;
+                in >> lhs >> syms[i];
+                use->d_lhs = lhs;
+                t = use;
+            }
+            break;
+        default:
+            return false;
+        }
+        t->d_tok = tok;
+        things[i] = t;
+
+        Scope* outer = 0;
+        if( rel != R_Top && rel != R_NonLocal )
+        {
+            if( parent < 0 || parent >= qint32(i) || !things[parent]->isScope() )
+                return false;
+            outer = static_cast<Scope*>(things[parent].data());
+        }
+        switch( rel )
+        {
+        case R_Top:
+            if( tag != Thing::T_Block || !top.isNull() )
+                return false;
+            top = static_cast<Block*>(t);
+            break;
+        case R_NonLocal:
+            if( tag != Thing::T_Function )
+                return false;
+            outers[i] = parent;
+            nonLocals.append( static_cast<Function*>(t) );
+            break;
+        case R_Local:
+            if( tag != Thing::T_Variable && tag != Thing::T_Function )
+                return false;
+            if( tag == Thing::T_Function )
+                static_cast<Function*>(t)->d_outer = outer;
+            outer->d_locals.append(t);
+            outer->d_names.insert(t->d_tok.d_val.constData(),t);
+            break;
+        case R_Stat:
+            if( tag != Thing::T_Block )
+                return false;
+            static_cast<Block*>(t)->d_outer = outer;
+            outer->d_stats.append( static_cast<Block*>(t) );
+            break;
+        case R_Ref:
+            if( tag != Thing::T_SymbolUse )
+                return false;
+            // uses resolved via the global scope are added again when replayed
+            if( syms[i] == -1 )
+                owners[i] = parent;
+            else
+                outer->d_refs.append( static_cast<SymbolUse*>(t) );
+            break;
+        default:
+            return false;
+        }
+    }
+    if( top.isNull() )
+        return false;
+    for( quint32 i = 0; i < count; i++ )
+    {
+        if( outers[i] >= 0 )
+        {
+            if( outers[i] >= qint32(count) || !things[outers[i]]->isScope() )
+                return false;
+            static_cast<Function*>(things[i].data())->d_outer = static_cast<Scope*>(things[outers[i]].data());
+        }
+        if( syms[i] >= qint32(count) )
+            return false;
+        if( syms[i] >= 0 )
+            static_cast<SymbolUse*>(things[i].data())->d_sym = things[syms[i]].data();
+    }
+    for( quint32 i = 0; i < count; i++ )
+    {
+        quint32 n;
+        in >> n;
+        for( quint32 j = 0; j < n && in.status() == QDataStream::Ok; j++ )
+        {
+            qint32 id;
+            in >> id;
+            if( id < 0 || id >= qint32(count) || things[id]->getTag() != Thing::T_SymbolUse )
+                return false;
+            things[i]->d_uses.append( static_cast<SymbolUse*>(things[id].data()) );
+        }
+    }
+    in >> count;
+    QList<GlobalRef> globalRefs;
+    for( quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++ )
+    {
+        qint32 id;
+        in >> id;
+        if( id == -1 )
+        {
+            qint32 scope;
+            quint8 lhs;
+            Token tok;
+            in >> scope >> lhs >> tok.d_lineNr >> tok.d_colNr >> tok.d_len >> tok.d_val;
+            if( scope < 0 || scope >= things.size() || !things[scope]->isScope() )
+                return false;
+            SymbolUse* use = new SymbolUse();
+            use->d_tok = tok;
+            use->d_tok.d_type = Tok_Name;
+            use->d_tok.d_val = Lexer::getSymbol(tok.d_val);
+            use->d_tok.d_sourcePath = sourcePath;
+            use->d_lhs = lhs;
+            globalRefs.append( GlobalRef( use, static_cast<Scope*>(things[scope].data()) ) );
+            continue;
+        }
+        if( id < 0 || id >= things.size() )
+            return false;
+        Thing* t = things[id].data();
+        if( t->getTag() == Thing::T_SymbolUse ? ( syms[id] != -1 || owners[id] < 0 ) : t->getTag() != Thing::T_Function )
+            return false;
+        if( t->getTag() == Thing::T_SymbolUse )
+            globalRefs.append( GlobalRef( t, static_cast<Scope*>(things[owners[id]].data()) ) );
+        else
+            globalRefs.append( GlobalRef(t) );
+    }
+    if( in.status() != QDataStream::Ok )
+        return false;
+
+    if( d_global.isNull() )
+    {
+        d_global = new Global();
+        initBuiltIns(d_global.data());
+    }
+    d_path = path;
+    d_topChunk = top;
+    d_nonLocals = nonLocals;
+    d_globalRefs.clear();
+    d_msgStart = d_err ? d_err->getAll().size() : 0;
+    d_msgCount = msgs.size();
+    if( d_err )
+    {
+        foreach( const Ljas::Errors::Entry& e, msgs )
+            d_err->warning( Ljas::Errors::Source(e.d_source), e.d_file, e.d_line, e.d_col, e.d_msg );
+    }
+    foreach( const GlobalRef& r, globalRefs )
+    {
+        if( r.d_thing->getTag() == Thing::T_Function )
+            declareGlobal( static_cast<Function*>(r.d_thing.data()) );
+        else
+            useGlobal( static_cast<SymbolUse*>(r.d_thing.data()), r.d_scope );
+    }
+    buildIndex();
+    return true;
+}
+
 void Module::analyze(SynTree* st)
 {
     switch( st->d_tok.d_type )
@@ -438,10 +885,7 @@ void Module::gfuncdecl(SynTree* st,Scope* scope)
         fun->d_tok = names->d_children.first()->d_tok;
         fun->d_kind = Function::Global;
         // true global function
-        if( d_global->d_names.contains(fun->d_tok.d_val.constData()) )
-            d_err->warning(Ljas::Errors::Semantics,fun->d_tok.d_sourcePath,fun->d_tok.d_lineNr,fun->d_tok.d_colNr,
-                           tr("overwriting existing global variable '%1'").arg(fun->d_tok.d_val.constData()) );
-        d_global->d_names.insert( fun->d_tok.d_val.constData(), fun );
+        declareGlobal(fun);
         d_nonLocals.append(fun);
     }else
     {
@@ -495,30 +939,47 @@ void Module::use(SynTree* st, Module::Scope* scope, bool lhs)
 {
     Q_ASSERT( st->d_tok.d_type == Tok_Name );
     Thing* decl = scope->find(st->d_tok.d_val.constData() );
-    bool implicitDecl = false;
-    if( decl == 0 )
-    {
-        decl = d_global->find(st->d_tok.d_val.constData());
-        if( decl == 0 )
-        {
-            GlobalSym* sym = new GlobalSym();
-            sym->d_tok = st->d_tok;
-            d_global->d_names.insert(st->d_tok.d_val.constData(),sym);
-            implicitDecl = true;
-            d_err->warning(Ljas::Errors::Semantics,st->d_tok.d_sourcePath,st->d_tok.d_lineNr,st->d_tok.d_colNr,
-                           tr("implicit global declaration '%1'").arg(st->d_tok.d_val.constData()) );
-        }
-    }
+    SymbolUse* s = new SymbolUse();
+    s->d_tok = st->d_tok;
+    s->d_lhs = lhs;
     if( decl )
     {
-        SymbolUse* s = new SymbolUse();
-        s->d_tok = st->d_tok;
-        s->d_lhs = lhs;
-        s->d_implicitDecl = implicitDecl;
         s->d_sym = decl;
         decl->d_uses.append(s);
         scope->d_refs.append(s);
+    }else
+        useGlobal(s,scope);
+}
+
+void Module::declareGlobal(Module::Function* fun)
+{
+    if( d_global->d_names.contains(fun->d_tok.d_val.constData()) )
+        d_err->warning(Ljas::Errors::Semantics,fun->d_tok.d_sourcePath,fun->d_tok.d_lineNr,fun->d_tok.d_colNr,
+                       tr("overwriting existing global variable '%1'").arg(fun->d_tok.d_val.constData()) );
+    d_global->d_names.insert( fun->d_tok.d_val.constData(), fun );
+    d_globalRefs.append( GlobalRef(fun) );
+}
+
+void Module::useGlobal(Module::SymbolUse* s, Module::Scope* scope)
+{
+    Thing* decl = d_global->find(s->d_tok.d_val.constData());
+    if( decl == 0 )
+    {
+        // the use which implicitly declares the global is not recorded, only kept for saveAnalysis
+        GlobalSym* sym = new GlobalSym();
+        sym->d_tok = s->d_tok;
+        d_global->d_names.insert(s->d_tok.d_val.constData(),sym);
+        s->d_implicitDecl = true;
+        d_err->warning(Ljas::Errors::Semantics,s->d_tok.d_sourcePath,s->d_tok.d_lineNr,s->d_tok.d_colNr,
+                       tr("implicit global declaration '%1'").arg(s->d_tok.d_val.constData()) );
+        d_globalRefs.append( GlobalRef(s,scope) );
+        return;
     }
+    s->d_implicitDecl = false;
+    s->d_sym = decl;
+    decl->d_uses.append(s);
+    scope->d_refs.append(s);
+    d_globalRefs.append( GlobalRef(s) );
 }
 
 void Module::lambdecl(SynTree* st, Module::Scope* scope)
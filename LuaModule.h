@@ -22,6 +22,7 @@
 
 #include <QObject>
 #include <QSharedData>
+#include <QVector>
 #include <LjTools/LuaSynTree.h>
 
 namespace Ljas
@@ -130,6 +131,31 @@ namespace Lua
         const QList< Ref<Function> >& getNonLocals() const { return d_nonLocals; }
         const QString& getPath() const { return d_path; }
 
+        // binary search in the things of this module ordered by position; the index is built by parse
+        Thing* findSymbolBySourcePos( quint32 line, quint16 col ) const;
+        typedef QList<SymbolUse*> UseList;
+        // the uses of sym in this module ordered by position
+        UseList getUses( const Thing* sym ) const { return d_useIndex.value(sym); }
+
+        // the identifiers of this module ordered by position, classified for semantic highlighting;
+        // built together with the position index, so it costs no extra parse
+        enum SpanKind { LocalSpan, UpvalSpan, GlobalSpan, ImplicitGlobalSpan, BuiltInSpan };
+        struct Span
+        {
+            quint32 d_line; // one-based as in Token
+            quint16 d_col; // one-based
+            quint16 d_len;
+            quint8 d_kind;
+        };
+        typedef QVector<Span> Spans;
+        const Spans& getSpans() const { return d_spans; }
+
+        // the result of the last error free parse in binary form including the lexer and parser messages;
+        // loadAnalysis replays the global declarations and uses in the original order against getGlobal(),
+        // so the result is the same as parse() provided the modules are loaded in the same order.
+        QByteArray saveAnalysis() const;
+        bool loadAnalysis( const QString& path, const QByteArray& );
+
         Global* getGlobal() const { return d_global.data(); }
         void setGlobal(Global* g) { d_global = g; }
         static void initBuiltIns(Global*);
@@ -151,6 +177,11 @@ namespace Lua
         void assignment(SynTree*,Scope*);
         void use(SynTree*,Scope*,bool lhs);
         void lambdecl(SynTree*,Scope*);
+        void buildIndex();
+        void index( Thing* );
+        void addSpan( const Thing*, quint8 kind );
+        void declareGlobal( Function* );
+        void useGlobal( SymbolUse*, Scope* );
     private:
         QString d_path;
         Ljas::Errors* d_err;
@@ -158,6 +189,17 @@ namespace Lua
         Ref<Global> d_global;
         Ref<Block> d_topChunk;
         QList< Ref<Function> > d_nonLocals;
+        QVector<Thing*> d_index;
+        QHash<const Thing*,UseList> d_useIndex;
+        Spans d_spans;
+        struct GlobalRef
+        {
+            Ref<Thing> d_thing; // a global function, a use resolved via d_global or an implicit declaration
+            Scope* d_scope;     // where the implicit declaration happened
+            GlobalRef(Thing* t = 0, Scope* s = 0):d_thing(t),d_scope(s){}
+        };
+        QList<GlobalRef> d_globalRefs; // in analysis order
+        quint32 d_msgStart, d_msgCount; // the lexer and parser messages in d_err
     };
 }
 
@@ -22,13 +22,16 @@
 #include "LjasFileCache.h"
 #include "LuaModule.h"
 #include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QDir>
+#include <QSaveFile>
 #include <QtDebug>
 #include <QSettings>
 #include <QCoreApplication>
 using namespace Lua;
 
-Project::Project(QObject *parent) : QObject(parent),d_dirty(false),d_useRequire(false)
+Project::Project(QObject *parent) : QObject(parent),d_dirty(false),d_useRequire(false),d_cacheDirty(false)
 {
     d_err = new Ljas::Errors(this);
     d_err->setRecord(true);
@@ -48,6 +51,8 @@ void Project::clear()
         delete i.value();
     d_files.clear();
     d_fileOrder.clear();
+    d_cache.clear();
+    d_cacheDirty = false;
 }
 
 void Project::createNew()
@@ -145,27 +150,23 @@ bool Project::removeFile(const QString& path)
     return true;
 }
 
-static inline bool isHit( Module::Thing* res, quint32 line, quint16 col )
-{
-    return res->d_tok.d_lineNr == line && res->d_tok.d_colNr <= col &&
-                col <= ( res->d_tok.d_colNr + res->d_tok.d_len );
-}
-
 Module::Thing* Project::findSymbolBySourcePos(const QString& file, quint32 line, quint16 col) const
 {
     Module* m = d_files.value(file);
     if( m == 0 )
         return 0;
-    Module::Thing* res = findSymbolBySourcePosImp( m->getTopChunk(), line, col );
-    if( res )
-        return res;
-    for( int i = 0; i < m->getNonLocals().size(); i++ )
-    {
-        Module::Thing* res = findSymbolBySourcePosImp( m->getNonLocals()[i].data(), line, col );
-        if( res )
-            return res;
-    }
-    return 0;
+    return m->findSymbolBySourcePos(line,col);
+}
+
+Module::UseList Project::getUses(const Module::Thing* sym) const
+{
+    // ordered by file and position; the modules have the uses ordered by position
+    QStringList files = d_files.keys();
+    std::sort( files.begin(), files.end() );
+    Module::UseList res;
+    foreach( const QString& f, files )
+        res += d_files.value(f)->getUses(sym);
+    return res;
 }
 
 QString Project::getWorkingDir(bool resolved) const
@@ -211,40 +212,17 @@ QStringList Project::findFiles(const QDir& dir, bool recursive)
     return res;
 }
 
-Module::Thing*Project::findSymbolBySourcePosImp(Module::Thing* node, quint32 line, quint16 col) const
+static QByteArray readFile( Ljas::FileCache* fc, const QString& path )
 {
-    if( node == 0 )
-        return 0;
-    if( node->d_tok.d_lineNr > line )
-        return 0;
-    if( isHit( node, line, col ) )
-        return node;
-    if( !node->isScope() )
-        return 0;
-    // else
-    Module::Scope* scope = static_cast<Module::Scope*>(node);
-    foreach( const Module::Ref<Module::Thing>& n, scope->d_locals )
-    {
-        // TODO: binary search falls nötig
-        Module::Thing* res = findSymbolBySourcePosImp( n.data(), line, col );
-        if( res )
-            return res;
-    }
-    foreach( const Module::Ref<Module::Block>& n, scope->d_stats )
-    {
-        // TODO: binary search falls nötig
-        Module::Thing* res = findSymbolBySourcePosImp( n.data(), line, col );
-        if( res )
-            return res;
-    }
-    foreach( const Module::Ref<Module::SymbolUse>& n, scope->d_refs )
-    {
-        // TODO: binary search falls nötig
-        Module::Thing* res = findSymbolBySourcePosImp( n.data(), line, col );
-        if( res )
-            return res;
-    }
-    return 0;
+    // the same content the lexer reads
+    bool found;
+    const QByteArray content = fc->getFile(path,&found);
+    if( found )
+        return content;
+    QFile f(path);
+    if( !f.open(QIODevice::ReadOnly) )
+        return QByteArray();
+    return f.readAll();
 }
 
 void Project::touch()
@@ -263,16 +241,94 @@ bool Project::recompile()
     Module::initBuiltIns(d_global.data());
     foreach( const QByteArray& name, d_addBuiltIns )
         Module::addBuiltInSym( d_global.data(), name );
+    // modules with unchanged content are restored from the cache; this must happen in the same order as
+    // parsing so the global names resolve the same way
     FileHash::const_iterator i;
     for( i = d_files.begin(); i != d_files.end(); ++i )
     {
-        i.value()->setGlobal(d_global.data());
-        i.value()->parse( i.key(), false );
+        Module* m = i.value();
+        m->setGlobal(d_global.data());
+        const QByteArray hash = QCryptographicHash::hash( readFile(d_fcache,i.key()), QCryptographicHash::Sha1 );
+        Cache::iterator j = d_cache.find(i.key());
+        if( j != d_cache.end() && j.value().d_hash == hash && m->loadAnalysis( i.key(), j.value().d_data ) )
+            continue;
+        m->parse( i.key(), false );
+        const QByteArray data = m->saveAnalysis();
+        if( !data.isEmpty() )
+        {
+            CacheEntry& e = d_cache[i.key()];
+            e.d_hash = hash;
+            e.d_data = data;
+            d_cacheDirty = true;
+        }
+    }
+    Cache::iterator j = d_cache.begin();
+    while( j != d_cache.end() )
+    {
+        if( !d_files.contains(j.key()) )
+        {
+            j = d_cache.erase(j);
+            d_cacheDirty = true;
+        }else
+            ++j;
     }
+    saveCache();
     emit sigRecompiled();
     return true;
 }
 
+QString Project::getCachePath() const
+{
+    if( d_filePath.isEmpty() )
+        return QString();
+    QFileInfo info(d_filePath);
+    return info.absoluteDir().absoluteFilePath( info.completeBaseName() + ".luacache" );
+}
+
+static const char* s_cacheMagic = "LuaProjectCache";
+enum { CacheVersion = 1 };
+
+void Project::loadCache()
+{
+    d_cache.clear();
+    d_cacheDirty = false;
+    QFile f(getCachePath());
+    if( !f.open(QIODevice::ReadOnly) )
+        return;
+    QDataStream in(&f);
+    QByteArray magic;
+    quint16 version;
+    quint32 count;
+    in >> magic >> version >> count;
+    if( magic != s_cacheMagic || version != CacheVersion )
+        return;
+    for( quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++ )
+    {
+        QString path;
+        CacheEntry e;
+        in >> path >> e.d_hash >> e.d_data;
+        if( in.status() == QDataStream::Ok && d_files.contains(path) )
+            d_cache.insert(path,e);
+    }
+}
+
+void Project::saveCache()
+{
+    const QString path = getCachePath();
+    if( !d_cacheDirty || path.isEmpty() )
+        return;
+    QSaveFile f(path);
+    if( !f.open(QIODevice::WriteOnly) )
+        return;
+    QDataStream out(&f);
+    out << QByteArray(s_cacheMagic) << quint16(CacheVersion) << quint32(d_cache.size());
+    Cache::const_iterator i;
+    for( i = d_cache.begin(); i != d_cache.end(); ++i )
+        out << i.key() << i.value().d_hash << i.value().d_data;
+    if( f.commit() )
+        d_cacheDirty = false;
+}
+
 bool Project::save()
 {
     if( d_filePath.isEmpty() )
@@ -351,6 +407,8 @@ bool Project::loadFrom(const QString& filePath)
 
     in.endArray();
 
+    loadCache();
+
     d_dirty = false;
     emit sigModified(d_dirty);
     emit sigRenamed();
@@ -360,6 +418,7 @@ bool Project::loadFrom(const QString& filePath)
 bool Project::saveTo(const QString& filePath)
 {
     d_filePath = filePath;
+    d_cacheDirty = !d_cache.isEmpty();
     const bool res = save();
     emit sigRenamed();
     return res;
@@ -64,10 +64,12 @@ namespace Lua
         const QStringList& getFileOrder() const { return d_fileOrder; }
         bool isDirty() const { return d_dirty; }
         Module::Thing* findSymbolBySourcePos(const QString& file, quint32 line, quint16 col ) const;
+        Module::UseList getUses( const Module::Thing* sym ) const; // all files
         QString getWorkingDir(bool resolved = false) const;
         void setWorkingDir( const QString& );
         void addBuiltIn( const QByteArray& name ) { d_addBuiltIns.append(name); }
         bool useRequire() const { return d_useRequire; }
+        QString getCachePath() const; // the analysis cache next to the project file
 
         Ljas::Errors* getErrs() const { return d_err; }
         Ljas::FileCache* getFc() const { return d_fcache; }
@@ -77,9 +79,17 @@ namespace Lua
         void sigRecompiled();
     protected:
         QStringList findFiles(const QDir& , bool recursive = false);
-        Module::Thing* findSymbolBySourcePosImp(Module::Thing*, quint32 line, quint16 col ) const;
         void touch();
+        void loadCache();
+        void saveCache();
     private:
+        struct CacheEntry
+        {
+            QByteArray d_hash; // of the file content
+            QByteArray d_data; // Module::saveAnalysis
+        };
+        typedef QHash<QString,CacheEntry> Cache;
+        Cache d_cache;
         Ljas::Errors* d_err;
         Ljas::FileCache* d_fcache;
         FileHash d_files;
@@ -92,6 +102,7 @@ namespace Lua
         QByteArrayList d_addBuiltIns;
         bool d_dirty;
         bool d_useRequire;
+        bool d_cacheDirty;
     };
 }
 
@@ -19,6 +19,7 @@
 
 #include "Terminal2.h"
 #include "ExpressionParser.h"
+#include "Engine2Thread.h"
 #include <QStatusBar>
 #include <QKeyEvent>
 #include <QApplication>
@@ -36,6 +37,7 @@
 #include <GuiTools/AutoMenu.h>
 #include <QProcess>
 #include <QDate>
+#include <QThread>
 #include <lua.hpp>
 using namespace Lua;
 
@@ -44,9 +46,12 @@ static QTextCharFormat s_luaf;
 static QTextCharFormat s_errf;
 static QTextCharFormat s_outf;
 static const char* s_prompt = "Lua> ";
+enum { FlushInterval = 40, // ms
+       LogChunk = 64 * 1024,
+       DefaultMaxBlocks = 10000 };
 
 Terminal2::Terminal2(QWidget* parent, Lua::Engine2* l):
-    QTextEdit( parent ), d_lua( l ), d_specialInterpreter(true)
+    QTextEdit( parent ), d_lua( l ), d_runner(0), d_specialInterpreter(true),d_batchErr(false)
 {
 	if( d_lua == 0 )
 		d_lua = Lua::Engine2::getInst();
@@ -61,6 +66,11 @@ Terminal2::Terminal2(QWidget* parent, Lua::Engine2* l):
 #endif
 	QSettings set;
 	updateFont(set.value( "Terminal/Font", QVariant::fromValue( font ) ).value<QFont>());
+    setMaxBlockCount( set.value( "Terminal/MaxBlocks", int(DefaultMaxBlocks) ).toInt() );
+
+    d_flushTimer.setSingleShot(true);
+    d_flushTimer.setInterval(FlushInterval);
+    connect( &d_flushTimer, SIGNAL(timeout()), this, SLOT(flushOutput()) );
 
 	QTextCursor cur = textCursor();
     cur.insertText( prompt(), s_pf );
@@ -79,12 +89,15 @@ Terminal2::Terminal2(QWidget* parent, Lua::Engine2* l):
 	pop->addSeparator();
     pop->addCommand( "Export PDF...", this, SLOT(handleExportPdf()) );
     pop->addCommand( "Save Log...", this, SLOT(handleSaveAs()) );
+    pop->addCommand( "Log to File...", this, SLOT(handleLogToFile()) );
 	pop->addSeparator();
 	pop->addCommand( "Set Font...", this, SLOT(handleSetFont()) );
 
 	new QShortcut( tr("F12"), this, SLOT(handlePrintStack()) );
 
-    connect( d_lua, SIGNAL(onNotify(int,QByteArray,int)), this, SLOT(onNotify(int,QByteArray,int)) );
+    // direct, so output from the engine thread is only queued and never waits for the GUI
+    connect( d_lua, SIGNAL(onNotify(int,QByteArray,int)), this, SLOT(onNotify(int,QByteArray,int)),
+             Qt::DirectConnection );
 	printText( QString("%1 %2").arg(LUA_RELEASE).arg(LUA_COPYRIGHT) );
     printText( QString("%1 -- %2. %3").arg(LUAJIT_VERSION).arg(LUAJIT_COPYRIGHT).arg(LUAJIT_URL) );
     printJitInfo();
@@ -94,13 +107,149 @@ Terminal2::Terminal2(QWidget* parent, Lua::Engine2* l):
 
 void Terminal2::printText(const QString & str, bool err )
 {
+    flushOutput();
+    writeLog( str.toUtf8() + '\n' );
     d_out.insertText( str, err ? s_errf : s_outf );
 	d_out.insertText( QString( QChar::ParagraphSeparator ), s_pf );
 	moveCursor( QTextCursor::End );
 }
 
+void Terminal2::setMaxBlockCount(int n)
+{
+    // QTextDocument drops the first blocks when the limit is reached
+    document()->setMaximumBlockCount( qMax( 0, n ) );
+}
+
+bool Terminal2::setLogFile(const QString& path)
+{
+    if( d_log.isOpen() )
+    {
+        writeLog( QByteArray(), true );
+        d_log.close();
+    }
+    if( path.isEmpty() )
+        return true;
+    d_log.setFileName(path);
+    return d_log.open( QIODevice::WriteOnly | QIODevice::Append );
+}
+
 Terminal2::~Terminal2()
 {
+    setLogFile( QString() );
+}
+
+Terminal2::OutputQueue::~OutputQueue()
+{
+    Item* i = d_head.fetchAndStoreAcquire(0);
+    while( i )
+    {
+        Item* next = i->d_next;
+        delete i;
+        i = next;
+    }
+}
+
+void Terminal2::OutputQueue::push(const QByteArray& text, quint8 type)
+{
+    Item* i = new Item(text,type);
+    Item* head;
+    do
+    {
+        head = d_head.loadAcquire();
+        i->d_next = head;
+    }while( !d_head.testAndSetRelease(head,i) );
+}
+
+Terminal2::OutputQueue::Item*Terminal2::OutputQueue::takeAll()
+{
+    Item* i = d_head.fetchAndStoreAcquire(0);
+    Item* res = 0;
+    while( i )
+    {
+        Item* next = i->d_next;
+        i->d_next = res;
+        res = i;
+        i = next;
+    }
+    return res;
+}
+
+void Terminal2::onFlushRequested()
+{
+    if( !d_flushTimer.isActive() )
+        d_flushTimer.start();
+}
+
+void Terminal2::flushOutput()
+{
+    d_flushTimer.stop();
+    d_flushPending.storeRelease(0);
+    d_lastFlush.start();
+    OutputQueue::Item* i = d_queue.takeAll();
+    if( i == 0 )
+        return;
+    d_out.beginEditBlock();
+    while( i )
+    {
+        switch( i->d_type )
+        {
+        case Engine2::Print:
+            addOutput( QString::fromUtf8(i->d_text) + QChar::ParagraphSeparator, false );
+            break;
+        case Engine2::Error:
+            addOutput( QString::fromUtf8(i->d_text) + QChar::ParagraphSeparator, true );
+            break;
+        case Engine2::Cout:
+        case Engine2::Cerr:
+            handleStdoutErr( i->d_text, i->d_type == Engine2::Cerr );
+            break;
+        }
+        OutputQueue::Item* next = i->d_next;
+        delete i;
+        i = next;
+    }
+    writeOutput( d_batch, d_batchErr );
+    d_batch.clear();
+    d_out.endEditBlock();
+    moveCursor( QTextCursor::End );
+    ensureCursorVisible();
+}
+
+void Terminal2::addOutput(const QString& str, bool err)
+{
+    if( err != d_batchErr )
+    {
+        writeOutput( d_batch, d_batchErr );
+        d_batch.clear();
+        d_batchErr = err;
+    }
+    d_batch += str;
+}
+
+void Terminal2::writeOutput(const QString& str, bool err)
+{
+    if( str.isEmpty() )
+        return;
+    d_out.insertText( str, err ? s_errf : s_outf );
+    if( d_log.isOpen() )
+    {
+        QString line = str;
+        line.replace( QChar::ParagraphSeparator, QChar('\n') );
+        writeLog( line.toUtf8() );
+    }
+}
+
+void Terminal2::writeLog(const QByteArray& str, bool force)
+{
+    if( !d_log.isOpen() )
+        return;
+    d_logBuf += str;
+    if( force || d_logBuf.size() >= LogChunk )
+    {
+        d_log.write(d_logBuf);
+        d_log.flush();
+        d_logBuf.clear();
+    }
 }
 
 void Terminal2::keyPressEvent(QKeyEvent *e)
@@ -120,12 +269,14 @@ void Terminal2::keyPressEvent(QKeyEvent *e)
 			if( !d_line.isEmpty() )
 				d_histo.append( d_line );
 			d_next.clear();
-            if( d_specialInterpreter && d_lua->isWaiting() )
+            if( d_specialInterpreter && isWaiting() )
             {
                 ExpressionParser p;
                 if( p.parseAndPrint( d_line.toLatin1(), d_lua, false ) )
                     p.executeAndPrint( d_lua );
-            }else
+            }else if( d_runner )
+                d_runner->executeCmd( d_line.toLatin1(), "Terminal" );
+            else
                 d_lua->executeCmd( d_line.toLatin1(), "Terminal" );
 			d_line.clear();
 		}
@@ -207,12 +358,20 @@ void Terminal2::inputMethodEvent(QInputMethodEvent * e)
 
 QString Terminal2::prompt() const
 {
-    if( d_specialInterpreter && d_lua->isWaiting() )
+    if( d_specialInterpreter && isWaiting() )
         return "Exp>";
     else
 		return s_prompt;
 }
 
+bool Terminal2::isWaiting() const
+{
+    if( d_runner )
+        return d_runner->isWaiting();
+    else
+        return d_lua->isWaiting();
+}
+
 void Terminal2::updateFont(const QFont & f)
 {
 	s_pf.setFontFamily( f.family() );
@@ -270,7 +429,7 @@ void Terminal2::handleStdoutErr(const QByteArray& str, bool err)
                 break;
             case 0x0a: // LF
             case 0x04: // EOT
-                printText( QString::fromLatin1(out), err );
+                addOutput( QString::fromLatin1(out) + QChar::ParagraphSeparator, err );
                 out.clear();
                 break;
             }
@@ -283,20 +442,48 @@ void Terminal2::handleStdoutErr(const QByteArray& str, bool err)
 
 void Terminal2::onNotify(int messageType, QByteArray val1, int val2)
 {
+    // called on the thread running the engine
+    const bool guiThread = QThread::currentThread() == thread();
     switch( messageType )
     {
 	case Engine2::Print:
-		printText( val1 );
-		break;
 	case Engine2::Error:
-        d_out.insertText( val1, s_errf );
-        d_out.insertText( QString( QChar::ParagraphSeparator ), s_pf );
-		moveCursor( QTextCursor::End );
-        break;
     case Engine2::Cout:
     case Engine2::Cerr:
-        handleStdoutErr( val1, messageType == Engine2::Cerr );
+        d_queue.push( val1, messageType );
+        if( guiThread && ( !d_lastFlush.isValid() || d_lastFlush.elapsed() >= FlushInterval ) )
+        {
+            // the script runs on the GUI thread, so nothing would be shown until it terminates
+            flushOutput();
+            QApplication::processEvents();
+        }else if( d_flushPending.testAndSetOrdered(0,1) )
+        {
+            if( guiThread )
+                d_flushTimer.start();
+            else
+                QMetaObject::invokeMethod( this, "onFlushRequested", Qt::QueuedConnection );
+        }
+        return;
+    case Engine2::Finished:
+        // the returns are only valid on the thread running the engine
+        foreach( const QByteArray& res, d_lua->getReturns() )
+            d_queue.push( res, Engine2::Print );
         break;
+    default:
+        break;
+    }
+    if( guiThread )
+        handleNotify( messageType, val1, val2 );
+    else
+        QMetaObject::invokeMethod( this, "handleNotify", Qt::QueuedConnection, Q_ARG(int, messageType),
+                                   Q_ARG(QByteArray, val1), Q_ARG(int, val2) );
+}
+
+void Terminal2::handleNotify(int messageType, QByteArray val1, int val2)
+{
+    flushOutput();
+    switch( messageType )
+    {
 	case Engine2::LineHit:
 	case Engine2::BreakHit:
 	case Engine2::Continued:
@@ -311,13 +498,10 @@ void Terminal2::onNotify(int messageType, QByteArray val1, int val2)
 			d_line.clear();
         }
         break;
-    case Engine2::Finished:
-        foreach(const QByteArray& res, d_lua->getReturns() )
-            printText(res);
-        break;
     default:
         break;
     }
+    writeLog( QByteArray(), true );
     //msg.consume();
 	ensureCursorVisible();
     QApplication::processEvents();
@@ -397,9 +581,27 @@ void Terminal2::handleSaveAs()
 	out.write( toPlainText().toLatin1() );
 }
 
+void Terminal2::handleLogToFile()
+{
+    CHECKED_IF( true, d_log.isOpen() );
+
+    if( d_log.isOpen() )
+    {
+        setLogFile( QString() );
+        return;
+    }
+    const QString path = QFileDialog::getSaveFileName( this, tr("Log to File" ), QString(), "*.txt" );
+    if( path.isEmpty() )
+        return;
+    if( !setLogFile(path) )
+        QMessageBox::critical( this, tr("Log to File"), tr("Cannot open file for writing") );
+}
+
 void Terminal2::handlePrintStack()
 {
 	// ENABLED_IF( true );
+    if( d_runner && d_runner->isBusy() && !d_runner->isWaiting() )
+        return; // the stack belongs to the worker thread
 	QByteArray str;
 	QTextStream out( &str, QIODevice::WriteOnly );
 	const int top = lua_gettop( d_lua->getCtx() );
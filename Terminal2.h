@@ -24,10 +24,16 @@
 
 #include <QTextEdit>
 #include <QTextCursor>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QAtomicPointer>
+#include <QFile>
 #include <LjTools/Engine2.h>
 
 namespace Lua
 {
+    class Engine2Thread;
+
     class Terminal2 : public QTextEdit
 	{
         Q_OBJECT
@@ -35,13 +41,44 @@ namespace Lua
 		void paste();
 		void clear();
         void setSpecialInterpreter(bool on) { d_specialInterpreter = on; }
+        void setMaxBlockCount( int ); // scrollback in lines, 0 is unlimited
+        bool setLogFile( const QString& ); // all output is also appended to the file; empty closes it
+        void setRunner( Engine2Thread* r ) { d_runner = r; } // commands are then queued on the runner
 		Terminal2(QWidget*, Engine2 * = 0);
         virtual ~Terminal2();
     public slots:
         void printText(const QString& , bool err = false);
         void onClear();
     private:
+        // Output of print, stdout and stderr is pushed here by the engine (possibly on the Engine2Thread)
+        // without locking and written to the document in batches by flushOutput.
+        class OutputQueue
+        {
+        public:
+            struct Item
+            {
+                QByteArray d_text;
+                quint8 d_type; // Engine2::MessageType
+                Item* d_next;
+                Item(const QByteArray& t, quint8 type):d_text(t),d_type(type),d_next(0){}
+            };
+            OutputQueue():d_head(0){}
+            ~OutputQueue();
+            void push( const QByteArray&, quint8 type ); // any thread
+            Item* takeAll(); // in push order; the caller deletes the items
+        private:
+            QAtomicPointer<Item> d_head; // last pushed first
+        };
+        OutputQueue d_queue;
+        QAtomicInt d_flushPending;
+        QTimer d_flushTimer;
+        QElapsedTimer d_lastFlush;
+        QString d_batch; // consecutive output of the same format, see addOutput
+        bool d_batchErr;
+        QFile d_log;
+        QByteArray d_logBuf;
         Lua::Engine2* d_lua;
+        Engine2Thread* d_runner;
 		QTextCursor d_out;
 		QString d_line;
 		QStringList d_histo;
@@ -52,16 +89,24 @@ namespace Lua
 		void keyPressEvent ( QKeyEvent * e );
         void inputMethodEvent(QInputMethodEvent *);
         QString prompt() const;
+        bool isWaiting() const;
 		void updateFont( const QFont& );
         void printJitInfo();
         void handleStdoutErr( const QByteArray&, bool err );
+        void addOutput( const QString&, bool err );
+        void writeOutput( const QString&, bool err );
+        void writeLog( const QByteArray&, bool force = false );
     protected slots:
         void onNotify( int messageType, QByteArray val1 = "", int val2 = 0 );
+        void handleNotify( int messageType, QByteArray val1, int val2 );
+        void onFlushRequested();
+        void flushOutput();
         void handlePaste();
         void handleCopy();
         void handleSelectAll();
         void handleExportPdf();
         void handleSaveAs();
+        void handleLogToFile();
 		void handlePrintStack();
 		void handleSetFont();
 	};